@@ -0,0 +1,136 @@
+#pragma once
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --------------------------------------------------------
+// What the registry knows about one loaded asset
+// --------------------------------------------------------
+struct AssetInfo
+{
+	std::wstring Path;				// The first path it was loaded from
+	unsigned long long ContentHash;
+	long References;				// Not counting the registry's own
+	size_t MemorySize;				// GPU memory, in bytes
+};
+
+// --------------------------------------------------------
+// One kind of asset, keyed by the hash of its file's
+// contents, for AssetRegistry
+//
+// - Safe to call from several threads at once: the first
+//   request for a hash loads it, and any others for the
+//   same hash wait for that load instead of starting their
+//   own
+// - Knows nothing about Direct3D, so the load-once logic
+//   can be tested on its own
+// --------------------------------------------------------
+template<typename T>
+class AssetCache
+{
+public:
+	// Load(path, hash, memorySize) is only called by the first
+	// request for the hash, and everyone gets what it returns
+	template<typename Load>
+	T GetOrLoad(const std::wstring& path, unsigned long long hash, Load load)
+	{
+		// Whoever asks first claims the load, and everyone
+		// else gets the future it'll be delivered through
+		std::promise<T> promise;
+		std::shared_future<T> existing;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = assets.find(hash);
+			if (found != assets.end())
+				existing = found->second.Asset;
+			else
+				assets[hash] = { path, promise.get_future().share(), 0 };
+		}
+
+		// Waits here if another thread is still loading it
+		if (existing.valid())
+			return existing.get();
+
+		size_t memorySize = 0;
+		T asset;
+		try
+		{
+			asset = load(path, hash, memorySize);
+		}
+		catch (...)
+		{
+			// Anyone waiting gets the same exception, and the entry
+			// goes (before the future's ready, so GetInfo never sees
+			// it) so the next request tries loading again
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				assets.erase(hash);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			assets[hash].MemorySize = memorySize;
+		}
+		promise.set_value(asset);
+		return asset;
+	}
+
+	// References(asset) counts the cache's own reference too
+	template<typename References>
+	void GetInfo(std::vector<AssetInfo>& info, References references)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& asset : assets)
+		{
+			if (!IsReady(asset.second.Asset))
+				continue;
+			long count = (long)references(asset.second.Asset.get()) - 1;
+			info.push_back({ asset.second.Path, asset.first, count, asset.second.MemorySize });
+		}
+	}
+
+	size_t GetMemorySize()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t size = 0;
+		for (auto& asset : assets)
+			size += asset.second.MemorySize;
+		return size;
+	}
+
+	// Drops assets with only the cache's own reference left
+	// (and that aren't mid-load)
+	template<typename References>
+	void ReleaseUnused(References references)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = assets.begin(); it != assets.end();)
+		{
+			if (IsReady(it->second.Asset) && references(it->second.Asset.get()) <= 1)
+				it = assets.erase(it);
+			else
+				++it;
+		}
+	}
+
+private:
+	struct Entry
+	{
+		std::wstring Path;
+		std::shared_future<T> Asset;	// Ready once loading finishes
+		size_t MemorySize;
+	};
+
+	static bool IsReady(const std::shared_future<T>& asset)
+	{
+		return asset.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	std::mutex mutex;	// Guards assets
+	std::unordered_map<unsigned long long, Entry> assets;
+};
@@ -0,0 +1,157 @@
+#include "AssetRegistry.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "WICTextureLoader.h"
+#include <cwctype>
+
+using namespace DirectX;
+
+std::wstring NormalizeAssetPath(const std::wstring& path)
+{
+	// Resolves any "." and ".." along the way
+	wchar_t fullPath[MAX_PATH] = {};
+	DWORD length = GetFullPathNameW(path.c_str(), MAX_PATH, fullPath, 0);
+	std::wstring normalized = length > 0 && length < MAX_PATH ? fullPath : path;
+
+	// Windows paths don't care about either of these
+	for (wchar_t& c : normalized)
+		c = c == L'/' ? L'\\' : (wchar_t)towlower(c);
+	return normalized;
+}
+
+// --------------------------------------------------------
+// Bytes used by a texture and all of its mips
+// --------------------------------------------------------
+static size_t GetTextureMemorySize(ID3D11ShaderResourceView* srv)
+{
+	if (!srv)
+		return 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+
+	// WIC loads everything as one of these
+	size_t bytesPerPixel = 4;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT: bytesPerPixel = 16; break;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM: bytesPerPixel = 8; break;
+	case DXGI_FORMAT_R8_UNORM: bytesPerPixel = 1; break;
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_FLOAT: bytesPerPixel = 2; break;
+	default: break;
+	}
+
+	size_t size = 0;
+	for (UINT mip = 0; mip < desc.MipLevels; mip++)
+	{
+		size_t width = desc.Width >> mip ? desc.Width >> mip : 1;
+		size_t height = desc.Height >> mip ? desc.Height >> mip : 1;
+		size += width * height * bytesPerPixel;
+	}
+	return size * desc.ArraySize;
+}
+
+// COM objects only expose their count through AddRef/Release
+static long GetReferenceCount(IUnknown* object)
+{
+	if (!object)
+		return 0;
+
+	object->AddRef();
+	return (long)object->Release();
+}
+
+AssetRegistry::AssetRegistry(Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	device(device),
+	context(context)
+{
+	geometryArena = std::make_shared<GeometryArena>(device);
+}
+
+unsigned long long AssetRegistry::GetContentHash(const std::wstring& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(pathMutex);
+		auto known = pathHashes.find(path);
+		if (known != pathHashes.end())
+			return known->second;
+	}
+
+	// Hashed outside the lock, so other loads aren't held up - two
+	// threads might both hash a new path, but they'll agree
+	unsigned long long hash;
+	MappedFile file(path);
+	if (file.IsValid())
+		hash = HashMeshSource(file.GetData(), file.GetSize());
+	else
+		hash = HashMeshSource((const char*)path.data(), path.size() * sizeof(wchar_t));
+
+	std::lock_guard<std::mutex> lock(pathMutex);
+	pathHashes[path] = hash;
+	return hash;
+}
+
+std::shared_ptr<Mesh> AssetRegistry::GetMesh(const std::wstring& path)
+{
+	std::wstring normalized = NormalizeAssetPath(path);
+	return meshes.GetOrLoad(normalized, GetContentHash(normalized),
+		[&](const std::wstring& file, unsigned long long hash, size_t& memorySize)
+	{
+		// The mesh checks its cache against the same hash, so
+		// the file doesn't get read through twice
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(file, hash, geometryArena);
+		memorySize = mesh->GetMemorySize();
+		return mesh;
+	});
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> AssetRegistry::GetTexture(const std::wstring& path)
+{
+	std::wstring normalized = NormalizeAssetPath(path);
+	return textures.GetOrLoad(normalized, GetContentHash(normalized),
+		[&](const std::wstring& file, unsigned long long, size_t& memorySize)
+	{
+		// Mips are generated on the immediate context
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		{
+			std::lock_guard<std::mutex> lock(contextMutex);
+			CreateWICTextureFromFile(device.Get(), context.Get(),
+				file.c_str(), 0, srv.GetAddressOf());
+		}
+		memorySize = GetTextureMemorySize(srv.Get());
+		return srv;
+	});
+}
+
+std::shared_ptr<GeometryArena> AssetRegistry::GetGeometryArena()
+{
+	return geometryArena;
+}
+
+std::vector<AssetInfo> AssetRegistry::GetAssetInfo()
+{
+	std::vector<AssetInfo> info;
+	meshes.GetInfo(info, [](const std::shared_ptr<Mesh>& mesh) { return mesh.use_count(); });
+	textures.GetInfo(info, [](const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv) { return GetReferenceCount(srv.Get()); });
+	return info;
+}
+
+size_t AssetRegistry::GetMemorySize()
+{
+	return meshes.GetMemorySize() + textures.GetMemorySize();
+}
+
+void AssetRegistry::ReleaseUnused()
+{
+	meshes.ReleaseUnused([](const std::shared_ptr<Mesh>& mesh) { return mesh.use_count(); });
+	textures.ReleaseUnused([](const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv) { return GetReferenceCount(srv.Get()); });
+}
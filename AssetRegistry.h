@@ -0,0 +1,63 @@
+#pragma once
+#include <Windows.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mesh.h"
+#include "GeometryArena.h"
+#include "AssetCache.h"
+
+// --------------------------------------------------------
+// Loads each mesh and texture once and hands out shared
+// references to it
+//
+// - Assets are keyed by the hash of their file's contents,
+//   so different spellings of a path (or copies of a file)
+//   all share one asset
+// - Safe to call from several threads at once: the first
+//   request for an asset loads it, and any others for the
+//   same asset wait for that load instead of starting their
+//   own (see AssetCache.h)
+// --------------------------------------------------------
+class AssetRegistry
+{
+public:
+	AssetRegistry(Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Registries own GPU resources, so they can't be copied
+	AssetRegistry(const AssetRegistry&) = delete;
+	AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+	std::shared_ptr<Mesh> GetMesh(const std::wstring& path);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTexture(const std::wstring& path);
+
+	// Every mesh's vertices and indices live in here
+	std::shared_ptr<GeometryArena> GetGeometryArena();
+
+	std::vector<AssetInfo> GetAssetInfo();
+	size_t GetMemorySize();
+
+	// Drops assets nothing outside the registry is using
+	void ReleaseUnused();
+
+private:
+	unsigned long long GetContentHash(const std::wstring& path);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<GeometryArena> geometryArena;
+
+	std::mutex contextMutex;	// The immediate context isn't thread safe
+	std::mutex pathMutex;		// Guards pathHashes
+	std::unordered_map<std::wstring, unsigned long long> pathHashes;
+	AssetCache<std::shared_ptr<Mesh>> meshes;
+	AssetCache<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textures;
+};
+
+// Makes a path absolute, with one kind of slash and one case
+std::wstring NormalizeAssetPath(const std::wstring& path);
@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include "Input.h"
+#include <cmath>
 
 using namespace DirectX;
 
@@ -73,6 +74,13 @@ float Camera::GetMouseLookSpeed()
     return mouseLookSpeed;
 }
 
+void Camera::GetFrustumPlanes(DirectX::XMFLOAT4 planes[6])
+{
+    XMFLOAT4X4 viewProjection;
+    XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&viewMatrix) * XMLoadFloat4x4(&projMatrix));
+    ExtractFrustumPlanes(viewProjection, planes);
+}
+
 void Camera::SetFieldOfView(float _fov)
 {
     fov = _fov;
@@ -112,8 +120,9 @@ void Camera::UpdateProjectionMatrix(float _aspectRatio)
 
 void Camera::UpdateViewMatrix()
 {
-    XMFLOAT3 position = transform.GetPosition();
-    XMFLOAT3 forward = transform.GetForward();
+    // In world space, in case the camera's attached to something
+    XMFLOAT3 position = transform.GetWorldPosition();
+    XMFLOAT3 forward = transform.GetWorldForward();
 
     // Use the position, forward, and world up to calculate view matrix
     XMMATRIX viewMat = XMMatrixLookToLH(XMLoadFloat3(&position), XMLoadFloat3(&forward), XMVectorSet(0, 1, 0, 0));
@@ -148,15 +157,12 @@ void Camera::Update(float dt)
     {
         float cursorMovementX = input.GetMouseXDelta() * mouseLookSpeed;
         float cursorMovementY = input.GetMouseYDelta() * mouseLookSpeed;
-        transform.Rotate(cursorMovementY, cursorMovementX, 0);
-
-        // Clamp x so that camera doesn't flip upside down
-        XMFLOAT3 rotation = transform.GetPitchYawRoll();
-        if (rotation.x > XM_PIDIV2)
-            rotation.x = XM_PIDIV2-0.005f;
-        if (rotation.x < -XM_PIDIV2)
-            rotation.x = -XM_PIDIV2+0.005f;
-        transform.SetRotation(rotation);
+        // Clamp the pitch so that camera doesn't flip upside down,
+        // reading it from the forward axis
+        float pitch = -asinf(fmaxf(-1.0f, fminf(1.0f, transform.GetForward().y)));
+        float limit = XM_PIDIV2 - 0.005f;
+        float newPitch = fmaxf(-limit, fminf(limit, pitch + cursorMovementY));
+        transform.Rotate(newPitch - pitch, cursorMovementX, 0);
     }
 
     UpdateViewMatrix();
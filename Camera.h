@@ -2,6 +2,7 @@
 #include "DXCore.h"
 #include <DirectXMath.h>
 #include "Transform.h"
+#include "FrustumCull.h"
 
 class Camera
 {
@@ -26,6 +27,9 @@ public:
 	float GetMoveSpeed();
 	float GetMouseLookSpeed();
 
+	// World space planes of the view frustum - see FrustumCull.h
+	void GetFrustumPlanes(DirectX::XMFLOAT4 planes[6]);
+
 
 	void SetFieldOfView(float _fov);
 	void SetNearClipPlane(float distance);
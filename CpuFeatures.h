@@ -0,0 +1,40 @@
+#pragma once
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// --------------------------------------------------------
+// Whether this CPU (and OS) can run AVX2 code
+//
+// The game builds for any x64 CPU, and only the *Avx2.cpp
+// files are built with AVX2 - their loops are only called
+// when this says so (see SimdLanes.h)
+// --------------------------------------------------------
+inline bool HasAvx2()
+{
+	// Only ask once, as the answer can't change
+	static const bool avx2 = []()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// The CPU needs AVX, and the OS has to save the wide
+		// registers between threads (bits 1 and 2 of XCR0)
+		__cpuid(info, 1);
+		bool osSaves = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osSaves || !avx || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		// Checks the OS side too
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+	return avx2;
+}
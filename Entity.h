@@ -1,27 +0,0 @@
-#pragma once
-#include <memory>
-#include "Transform.h"
-#include "Mesh.h"
-#include "Camera.h"
-#include "Material.h"
-
-class Entity
-{
-public:
-	Entity(std::shared_ptr<Mesh> _mesh, std::shared_ptr<Material> _material);
-
-	std::shared_ptr<Mesh> GetMesh();
-	Transform& GetTransform();
-	std::shared_ptr<Material> GetMaterial();
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<Camera> camera, float totalTime);
-
-	void SetMesh(std::shared_ptr<Mesh> _mesh);
-	void SetMaterial(std::shared_ptr<Material> _material);
-
-private:
-	Transform transform;
-	std::shared_ptr<Mesh> mesh;
-	std::shared_ptr<Material> material;
-};
-
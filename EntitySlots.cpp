@@ -0,0 +1,56 @@
+#include "EntitySlots.h"
+
+EntityId EntitySlots::Add()
+{
+	EntityId id;
+	if (!freeSlots.empty())
+	{
+		id.Index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		id.Index = (unsigned int)slotIndices.size();
+		slotIndices.push_back(0);
+		slotGenerations.push_back(1);
+	}
+	id.Generation = slotGenerations[id.Index];
+	slotIndices[id.Index] = (unsigned int)ids.size();
+	ids.push_back(id);
+	return id;
+}
+
+unsigned int EntitySlots::Remove(EntityId id)
+{
+	unsigned int index = slotIndices[id.Index];
+	ids[index] = ids.back();
+	slotIndices[ids[index].Index] = index;
+	ids.pop_back();
+
+	// Anything still holding the old ID now sees it as dead
+	slotGenerations[id.Index] = NextGeneration(slotGenerations[id.Index]);
+	freeSlots.push_back(id.Index);
+	return index;
+}
+
+bool EntitySlots::IsAlive(EntityId id)
+{
+	return id.Index < slotGenerations.size() &&
+		id.Generation != 0 &&
+		slotGenerations[id.Index] == id.Generation;
+}
+
+unsigned int EntitySlots::GetCount()
+{
+	return (unsigned int)ids.size();
+}
+
+unsigned int EntitySlots::GetIndex(EntityId id)
+{
+	return slotIndices[id.Index];
+}
+
+const EntityId* EntitySlots::GetIds()
+{
+	return ids.data();
+}
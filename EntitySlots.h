@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+
+// --------------------------------------------------------
+// Names one entity in an EntityStore
+//
+// Each slot's generation goes up whenever the entity in it
+// is destroyed, so old IDs can tell they're stale instead
+// of naming whatever reuses the slot
+// --------------------------------------------------------
+struct EntityId
+{
+	unsigned int Index;			// Slot in the store
+	unsigned int Generation;	// Zero for no entity
+};
+
+// The generation a slot moves on to when its entity is
+// destroyed - zero is skipped when it wraps around, as no
+// entity has that one
+inline unsigned int NextGeneration(unsigned int generation)
+{
+	return generation + 1 == 0 ? 1 : generation + 1;
+}
+
+// --------------------------------------------------------
+// Hands out an EntityStore's IDs and keeps track of where
+// each one's entity is in the dense arrays
+//
+// - Add() puts a new entity at the end, and Remove() moves
+//   the last one into the removed one's place - the store
+//   does the same with each of its components
+// - Knows nothing about the components, so the ID logic
+//   can be tested on its own
+// --------------------------------------------------------
+class EntitySlots
+{
+public:
+	EntityId Add();
+
+	// Returns the dense index the entity had, where the last
+	// one now is (unless it was the last)
+	unsigned int Remove(EntityId id);
+
+	bool IsAlive(EntityId id);
+	unsigned int GetCount();
+	unsigned int GetIndex(EntityId id);	// Where it is in the dense arrays right now
+	const EntityId* GetIds();			// GetCount() long
+
+private:
+	// Indexed by EntityId::Index
+	std::vector<unsigned int> slotIndices;		// Into the dense arrays
+	std::vector<unsigned int> slotGenerations;
+	std::vector<unsigned int> freeSlots;
+
+	std::vector<EntityId> ids;					// Dense
+};
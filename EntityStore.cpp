@@ -0,0 +1,476 @@
+#include "EntityStore.h"
+#include "Meshlet.h"
+#include "TransformSystem.h"
+#include <cmath>
+
+using namespace DirectX;
+
+// Whether an entity's shadow is part of the static casters' -
+// its own if it's a batch, or its batch's if it's static
+static bool IsStaticShadow(unsigned int flags)
+{
+	return (flags & (ENTITY_FLAG_STATIC | ENTITY_FLAG_BATCH)) != 0;
+}
+
+EntityStore::EntityStore() :
+	boundsFrame(0),
+	staticVersion(0),
+	instanceCapacity(0)
+{
+}
+
+EntityId EntityStore::Create(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material,
+	unsigned int _flags)
+{
+	EntityId id = slots.Add();
+	transforms.emplace_back();
+	meshes.push_back(mesh.get());
+	materials.push_back(material.get());
+	bounds.push_back({});
+	flags.push_back(_flags);
+	lods.push_back(0);
+	drawnTriangles.push_back(0);
+	boundsDirty.push_back(1);
+	meshRefs.push_back(mesh);
+	materialRefs.push_back(material);
+	bvh.Insert(slots.GetIndex(id));
+	if (IsStaticShadow(_flags))
+		staticVersion++;
+	return id;
+}
+
+void EntityStore::Destroy(EntityId id)
+{
+	if (!slots.IsAlive(id))
+		return;
+
+	// Move the last entity into this one's place
+	unsigned int last = slots.GetCount() - 1;
+	unsigned int index = slots.Remove(id);
+	if (IsStaticShadow(flags[index]))
+		staticVersion++;
+	bvh.Remove(index);
+	if (index != last)
+	{
+		bvh.Rename(last, index);
+		transforms[index] = std::move(transforms[last]);
+		meshes[index] = meshes[last];
+		materials[index] = materials[last];
+		bounds[index] = bounds[last];
+		flags[index] = flags[last];
+		lods[index] = lods[last];
+		drawnTriangles[index] = drawnTriangles[last];
+		boundsDirty[index] = boundsDirty[last];
+		meshRefs[index] = std::move(meshRefs[last]);
+		materialRefs[index] = std::move(materialRefs[last]);
+	}
+
+	transforms.pop_back();
+	meshes.pop_back();
+	materials.pop_back();
+	bounds.pop_back();
+	flags.pop_back();
+	lods.pop_back();
+	drawnTriangles.pop_back();
+	boundsDirty.pop_back();
+	meshRefs.pop_back();
+	materialRefs.pop_back();
+}
+
+bool EntityStore::IsAlive(EntityId id)
+{
+	return slots.IsAlive(id);
+}
+
+unsigned int EntityStore::GetCount()
+{
+	return slots.GetCount();
+}
+
+unsigned int EntityStore::GetIndex(EntityId id)
+{
+	return slots.GetIndex(id);
+}
+
+const EntityId* EntityStore::GetIds() { return slots.GetIds(); }
+Transform* EntityStore::GetTransforms() { return transforms.data(); }
+Mesh* const* EntityStore::GetMeshes() { return meshes.data(); }
+Material* const* EntityStore::GetMaterials() { return materials.data(); }
+const CullBounds* EntityStore::GetBounds() { return bounds.data(); }
+const unsigned int* EntityStore::GetFlags() { return flags.data(); }
+int* EntityStore::GetLods() { return lods.data(); }
+
+Transform& EntityStore::GetTransform(EntityId id)
+{
+	return transforms[slots.GetIndex(id)];
+}
+
+std::shared_ptr<Mesh> EntityStore::GetMesh(EntityId id)
+{
+	return meshRefs[slots.GetIndex(id)];
+}
+
+std::shared_ptr<Material> EntityStore::GetMaterial(EntityId id)
+{
+	return materialRefs[slots.GetIndex(id)];
+}
+
+unsigned int EntityStore::GetFlags(EntityId id)
+{
+	return flags[slots.GetIndex(id)];
+}
+
+int EntityStore::GetLod(EntityId id)
+{
+	return lods[slots.GetIndex(id)];
+}
+
+int EntityStore::GetDrawnTriangleCount(EntityId id)
+{
+	return drawnTriangles[slots.GetIndex(id)];
+}
+
+void EntityStore::SetMesh(EntityId id, std::shared_ptr<Mesh> mesh)
+{
+	unsigned int index = slots.GetIndex(id);
+	meshes[index] = mesh.get();
+	meshRefs[index] = mesh;
+	lods[index] = 0;
+	boundsDirty[index] = 1;
+	if (IsStaticShadow(flags[index]))
+		staticVersion++;
+}
+
+void EntityStore::SetMaterial(EntityId id, std::shared_ptr<Material> material)
+{
+	unsigned int index = slots.GetIndex(id);
+	materials[index] = material.get();
+	materialRefs[index] = material;
+}
+
+void EntityStore::SetFlags(EntityId id, unsigned int _flags)
+{
+	unsigned int index = slots.GetIndex(id);
+	if (flags[index] != _flags && (IsStaticShadow(flags[index]) || IsStaticShadow(_flags)))
+		staticVersion++;
+	flags[index] = _flags;
+}
+
+// --------------------------------------------------------
+// Each box becomes the box around the rotated local one:
+// every world axis reaches as far as the absolute values
+// of the world matrix carry the local extents
+//
+// Each sphere grows by the largest scale in the world
+// matrix (the longest row), so it still holds the mesh
+// --------------------------------------------------------
+void EntityStore::UpdateBounds()
+{
+	for (unsigned int i = 0; i < slots.GetCount(); i++)
+	{
+		if (!boundsDirty[i] && !transforms[i].HasChangedSince(boundsFrame))
+			continue;
+		boundsDirty[i] = 0;
+		bvh.MarkMoved(i);
+		if (IsStaticShadow(flags[i]))
+			staticVersion++;
+
+		XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+		XMMATRIX worldMat = XMLoadFloat4x4(&world);
+		XMFLOAT3 localMin = meshes[i]->GetBoundsMin();
+		XMFLOAT3 localMax = meshes[i]->GetBoundsMax();
+		XMVECTOR localCenter = (XMLoadFloat3(&localMin) + XMLoadFloat3(&localMax)) * 0.5f;
+		XMVECTOR localExtents = (XMLoadFloat3(&localMax) - XMLoadFloat3(&localMin)) * 0.5f;
+		XMStoreFloat3(&bounds[i].Center, XMVector3TransformCoord(localCenter, worldMat));
+		XMStoreFloat3(&bounds[i].Extents,
+			XMVectorAbs(worldMat.r[0]) * XMVectorSplatX(localExtents) +
+			XMVectorAbs(worldMat.r[1]) * XMVectorSplatY(localExtents) +
+			XMVectorAbs(worldMat.r[2]) * XMVectorSplatZ(localExtents));
+
+		float maxScale = fmaxf(XMVectorGetX(XMVector3Length(worldMat.r[0])), fmaxf(
+			XMVectorGetX(XMVector3Length(worldMat.r[1])),
+			XMVectorGetX(XMVector3Length(worldMat.r[2]))));
+		bounds[i].Radius = meshes[i]->GetBoundingSphereRadius() * maxScale;
+	}
+	boundsFrame = TransformSystem::GetInstance().GetFrame();
+
+	if (bvh.NeedsRebuild())
+		bvh.Build(bounds.data(), (unsigned int)slots.GetCount());
+	else
+		bvh.Refit(bounds.data());
+}
+
+void EntityStore::Cull(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& visible)
+{
+	visible.clear();
+	bvh.CullFrustum(planes, bounds.data(), visible);
+}
+
+void EntityStore::DrawOccluders(OcclusionBuffer& occlusion, const std::vector<unsigned int>& visible)
+{
+	for (unsigned int i : visible)
+	{
+		if (!(flags[i] & ENTITY_FLAG_OCCLUDER))
+			continue;
+
+		OccluderGeometry& geometry = occluderGeometry[meshes[i]->GetId()];
+		if (geometry.Indices.empty())
+		{
+			std::vector<Vertex> verts;
+			meshes[i]->GetGeometry(verts, geometry.Indices);
+			for (const Vertex& v : verts)
+				geometry.Positions.push_back(v.Position);
+		}
+
+		occlusion.AddOccluder(transforms[i].GetWorldMatrix(),
+			geometry.Positions.data(), (unsigned int)geometry.Positions.size(),
+			geometry.Indices.data(), (unsigned int)geometry.Indices.size());
+	}
+	occlusion.Rasterize();
+}
+
+unsigned int EntityStore::CullOccluded(OcclusionBuffer& occlusion, std::vector<unsigned int>& visible)
+{
+	return occlusion.CullOccluded(bounds.data(), visible);
+}
+
+void EntityStore::QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<unsigned int>& found)
+{
+	found.clear();
+	bvh.QuerySphere(center, radius, bounds.data(), found);
+}
+
+EntityId EntityStore::Pick(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction)
+{
+	int hit = bvh.Raycast(origin, direction, bounds.data(), 0);
+	return hit < 0 ? EntityId{ 0, 0 } : slots.GetIds()[hit];
+}
+
+SceneBvh& EntityStore::GetBvh()
+{
+	return bvh;
+}
+
+unsigned int EntityStore::GetStaticVersion()
+{
+	return staticVersion;
+}
+
+void EntityStore::QueueDraws(RenderQueue& queue, std::shared_ptr<Camera> camera,
+	const std::vector<unsigned int>& visible)
+{
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetWorldPosition();
+	XMFLOAT3 cameraForward = camera->GetTransform()->GetWorldForward();
+	XMVECTOR camPos = XMLoadFloat3(&cameraPos);
+	XMVECTOR camForward = XMLoadFloat3(&cameraForward);
+	float invFar = 1.0f / camera->GetFarClipPlane();
+
+	for (unsigned int i : visible)
+	{
+		if (flags[i] & ENTITY_FLAG_STATIC)
+			continue;
+
+		// Sorted by the nearest point of the bounds, along the view
+		float depth = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&bounds[i].Center) - camPos, camForward));
+		depth = (depth - bounds[i].Radius) * invFar;
+
+		queue.Add(MakeSortKey(RENDER_PASS_OPAQUE, materials[i]->GetShaderId(),
+			materials[i]->GetId(), meshes[i]->GetId(), depth), i);
+	}
+}
+
+RenderStats EntityStore::SubmitDraws(RenderQueue& queue,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<Camera> camera, float totalTime)
+{
+	RenderStats stats = {};
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetWorldPosition();
+
+	const DrawPacket* packets = queue.GetPackets();
+	BuildInstanceGroups(packets, queue.GetCount(), meshes.data(), materials.data(), lods.data(),
+		instanceGroups);
+	bool instancesUploaded = UploadInstances(queue, context);
+
+	Material* lastMaterial = 0;
+	SimpleVertexShader* vs = 0;
+	SimplePixelShader* ps = 0;
+	for (const InstanceGroup& group : instanceGroups)
+	{
+		unsigned int first = packets[group.First].Entity;
+		Mesh* mesh = meshes[first];
+		Material* material = materials[first];
+		SimpleVertexShader* instancedVS = material->GetInstancedVertexShader().get();
+		bool instanced = instancesUploaded && instancedVS && group.Count >= INSTANCE_MIN_COUNT;
+
+		// The shaders' per frame values only need setting when
+		// they're bound, as nothing else changes them mid-frame
+		SimpleVertexShader* groupVS = instanced ? instancedVS : material->GetVertexShader().get();
+		if (groupVS != vs)
+		{
+			vs = groupVS;
+			vs->SetMatrix4x4("view", view);
+			vs->SetMatrix4x4("projection", projection);
+			vs->SetShader();
+			stats.ShaderBinds++;
+		}
+		if (material != lastMaterial)
+		{
+			SimplePixelShader* materialPS = material->GetPixelShader().get();
+			if (materialPS != ps)
+			{
+				ps = materialPS;
+				ps->SetFloat3("cameraPos", cameraPos);
+				ps->SetFloat("totalTime", totalTime);
+				ps->CopyAllBufferData();
+				ps->SetShader();
+				stats.ShaderBinds++;
+			}
+
+			material->PrepareMaterial();
+			lastMaterial = material;
+			stats.MaterialBinds++;
+		}
+
+		vs->SetFloat3("positionOffset", mesh->GetPositionOffset());
+		vs->SetFloat3("positionScale", mesh->GetPositionScale());
+		vs->SetFloat2("uvOffset", mesh->GetUVOffset());
+		vs->SetFloat2("uvScale", mesh->GetUVScale());
+
+		// The whole run at once, with the matrices from the
+		// instance buffer
+		if (instanced)
+		{
+			vs->CopyAllBufferData();
+			int triangles = mesh->DrawInstanced(context, lods[first], group.Count, group.First);
+			for (unsigned int p = group.First; p < group.First + group.Count; p++)
+				drawnTriangles[packets[p].Entity] = triangles;
+			stats.Draws++;
+			stats.Instances += group.Count;
+			continue;
+		}
+
+		for (unsigned int p = group.First; p < group.First + group.Count; p++)
+		{
+			unsigned int index = packets[p].Entity;
+			Transform& transform = transforms[index];
+			vs->SetMatrix4x4("world", transform.GetWorldMatrix());
+			vs->SetMatrix4x4("worldInverseTranspose", transform.GetWorldInverseTransposeMatrix());
+			vs->CopyAllBufferData();
+
+			// Meshlets facing away or off screen are skipped
+			MeshletCullData cull;
+			BuildMeshletCullData(transform.GetWorldMatrix(), transform.GetWorldInverseTransposeMatrix(),
+				view, projection, cameraPos, cull);
+			drawnTriangles[index] = mesh->Draw(context, lods[index], &cull);
+			stats.Draws++;
+		}
+	}
+	return stats;
+}
+
+void EntityStore::QueueShadowDraws(RenderQueue& queue, const std::vector<unsigned int>& casters,
+	unsigned int casterSet)
+{
+	for (unsigned int i : casters)
+	{
+		if (flags[i] & (ENTITY_FLAG_STATIC | ENTITY_FLAG_NO_SHADOW))
+			continue;
+		if (!(casterSet & ((flags[i] & ENTITY_FLAG_BATCH) ? SHADOW_CASTERS_STATIC : SHADOW_CASTERS_DYNAMIC)))
+			continue;
+
+		// With no materials to sort by, their bits hold the LOD
+		queue.Add(MakeSortKey(RENDER_PASS_OPAQUE, 0, (unsigned int)lods[i], meshes[i]->GetId(), 0.0f), i);
+	}
+}
+
+RenderStats EntityStore::SubmitShadowDraws(RenderQueue& queue,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleVertexShader> vs,
+	std::shared_ptr<SimpleVertexShader> instancedVS)
+{
+	RenderStats stats = {};
+	const DrawPacket* packets = queue.GetPackets();
+	BuildInstanceGroups(packets, queue.GetCount(), meshes.data(), 0, lods.data(), instanceGroups);
+	bool instancesUploaded = UploadInstances(queue, context);
+
+	SimpleVertexShader* bound = 0;
+	for (const InstanceGroup& group : instanceGroups)
+	{
+		unsigned int first = packets[group.First].Entity;
+		Mesh* mesh = meshes[first];
+		bool instanced = instancesUploaded && instancedVS && group.Count >= INSTANCE_MIN_COUNT;
+
+		SimpleVertexShader* groupVS = instanced ? instancedVS.get() : vs.get();
+		if (groupVS != bound)
+		{
+			bound = groupVS;
+			bound->SetShader();
+			stats.ShaderBinds++;
+		}
+		bound->SetFloat3("positionOffset", mesh->GetPositionOffset());
+		bound->SetFloat3("positionScale", mesh->GetPositionScale());
+
+		if (instanced)
+		{
+			bound->CopyAllBufferData();
+			mesh->DrawInstanced(context, lods[first], group.Count, group.First);
+			stats.Draws++;
+			stats.Instances += group.Count;
+			continue;
+		}
+
+		for (unsigned int p = group.First; p < group.First + group.Count; p++)
+		{
+			unsigned int index = packets[p].Entity;
+			bound->SetMatrix4x4("world", transforms[index].GetWorldMatrix());
+			bound->CopyAllBufferData();
+			mesh->Draw(context, lods[index]);
+			stats.Draws++;
+		}
+	}
+	return stats;
+}
+
+bool EntityStore::UploadInstances(RenderQueue& queue, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	bool worthIt = false;
+	for (const InstanceGroup& group : instanceGroups)
+		worthIt |= group.Count >= INSTANCE_MIN_COUNT;
+	if (!worthIt)
+		return false;
+
+	// Grown to the next power of two, so it's rarely remade
+	unsigned int count = queue.GetCount();
+	if (count > instanceCapacity)
+	{
+		instanceCapacity = 64;
+		while (instanceCapacity < count)
+			instanceCapacity *= 2;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = instanceCapacity * sizeof(InstanceData);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		Microsoft::WRL::ComPtr<ID3D11Device> device;
+		context->GetDevice(device.GetAddressOf());
+		instanceBuffer.Reset();
+		device->CreateBuffer(&desc, 0, instanceBuffer.GetAddressOf());
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	PackInstances(queue.GetPackets(), count, transforms.data(), (InstanceData*)mapped.pData);
+	context->Unmap(instanceBuffer.Get(), 0);
+
+	// Slot 1, after the arena's vertices (which nothing else
+	// uses, so it can stay bound)
+	UINT stride = sizeof(InstanceData);
+	UINT offset = 0;
+	context->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
+	return true;
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "EntitySlots.h"
+#include "Transform.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Camera.h"
+#include "RenderQueue.h"
+#include "FrustumCull.h"
+#include "SceneBvh.h"
+#include "InstanceBatch.h"
+#include "OcclusionBuffer.h"
+
+// Bits in an entity's flags
+#define ENTITY_FLAG_STATIC		0x1		// Drawn as part of a static batch - see StaticBatch.h
+#define ENTITY_FLAG_NO_SHADOW	0x2		// Left out of the shadow map
+#define ENTITY_FLAG_BATCH		0x4		// A static batch's merged mesh, not a scene object
+#define ENTITY_FLAG_OCCLUDER	0x8		// Drawn into the occlusion buffer - see OcclusionBuffer.h
+
+// Which casters QueueShadowDraws() adds
+#define SHADOW_CASTERS_STATIC	0x1		// Static batches, which only change when rebuilt
+#define SHADOW_CASTERS_DYNAMIC	0x2		// Everything else that casts
+#define SHADOW_CASTERS_ALL		(SHADOW_CASTERS_STATIC | SHADOW_CASTERS_DYNAMIC)
+
+// --------------------------------------------------------
+// Holds every entity's components in dense arrays, one per
+// component, so systems can loop over all of them without
+// chasing pointers or touching reference counts
+//
+// - Entities are always packed into [0, GetCount()) - the
+//   last one moves into the place of any that's destroyed,
+//   so dense indices aren't stable, but IDs are
+// - Meshes and materials are kept alive by references held
+//   on the side, and the arrays that get looped over just
+//   have raw pointers
+// --------------------------------------------------------
+class EntityStore
+{
+public:
+	EntityStore();
+
+	EntityId Create(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material,
+		unsigned int flags = 0);
+	void Destroy(EntityId id);
+	bool IsAlive(EntityId id);
+
+	unsigned int GetCount();
+	unsigned int GetIndex(EntityId id);	// Where it is in the dense arrays right now
+
+	// Dense arrays, GetCount() long, for looping over everything
+	const EntityId* GetIds();
+	Transform* GetTransforms();
+	Mesh* const* GetMeshes();
+	Material* const* GetMaterials();
+	const CullBounds* GetBounds();		// World space, as of UpdateBounds()
+	const unsigned int* GetFlags();
+	int* GetLods();
+
+	// One entity at a time
+	Transform& GetTransform(EntityId id);
+	std::shared_ptr<Mesh> GetMesh(EntityId id);
+	std::shared_ptr<Material> GetMaterial(EntityId id);
+	unsigned int GetFlags(EntityId id);
+	int GetLod(EntityId id);
+	int GetDrawnTriangleCount(EntityId id);
+	void SetMesh(EntityId id, std::shared_ptr<Mesh> mesh);
+	void SetMaterial(EntityId id, std::shared_ptr<Material> material);
+	void SetFlags(EntityId id, unsigned int flags);
+
+	// Moves the bounding box and sphere of each entity that's
+	// new or moved since last time (as of the last
+	// TransformSystem::UpdateMatrices()) to where it is, then
+	// refits or rebuilds the BVH over them - see SceneBvh.h
+	void UpdateBounds();
+
+	// Fills visible with the dense indices of the entities
+	// whose bounds are inside the planes - see FrustumCull.h
+	void Cull(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& visible);
+
+	// Draws the given entities that are occluders into a
+	// begun occlusion buffer, then rasterizes it
+	void DrawOccluders(OcclusionBuffer& occlusion, const std::vector<unsigned int>& visible);
+
+	// Takes the entities whose bounds are hidden behind the
+	// occluders out of visible, and returns how many there were
+	unsigned int CullOccluded(OcclusionBuffer& occlusion, std::vector<unsigned int>& visible);
+
+	// Fills found with the dense indices of the entities whose
+	// bounds touch the sphere
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<unsigned int>& found);
+
+	// The entity whose bounds the ray hits first, if any
+	EntityId Pick(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction);
+
+	SceneBvh& GetBvh();
+
+	// Goes up whenever a static or batch entity is created,
+	// destroyed, moved, given a new mesh or has its flags
+	// changed - anything caching the static casters' shadows
+	// is stale once it's moved on
+	unsigned int GetStaticVersion();
+
+	// Adds a packet for each of the given entities that draws
+	// itself (not static ones, which are drawn by their batch)
+	void QueueDraws(RenderQueue& queue, std::shared_ptr<Camera> camera,
+		const std::vector<unsigned int>& visible);
+
+	// Draws a sorted queue's packets in order, only binding
+	// shaders and materials when they change from the last
+	// packet's - per frame values (lights, shadows) should
+	// already be set on the shaders, instanced ones included
+	//
+	// Runs of packets with the same mesh, material and LOD are
+	// drawn with one instanced draw, if the material has an
+	// instanced vertex shader - see InstanceBatch.h
+	RenderStats SubmitDraws(RenderQueue& queue,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<Camera> camera, float totalTime);
+
+	// Adds a packet for each of the given entities that casts
+	// a shadow and is in the set asked for, sorted by mesh and
+	// LOD (shadows don't use materials) so SubmitShadowDraws()
+	// can instance them
+	void QueueShadowDraws(RenderQueue& queue, const std::vector<unsigned int>& casters,
+		unsigned int casterSet = SHADOW_CASTERS_ALL);
+
+	// Draws a sorted shadow queue with just a vertex shader,
+	// the instanced one for runs of the same mesh and LOD -
+	// both should already have their view and projection
+	RenderStats SubmitShadowDraws(RenderQueue& queue,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleVertexShader> vs,
+		std::shared_ptr<SimpleVertexShader> instancedVS);
+
+private:
+	// Fills the instance buffer from a queue whose groups have
+	// been built, if any group is worth instancing
+	bool UploadInstances(RenderQueue& queue, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	EntitySlots slots;					// IDs, and where they are in the arrays
+
+	// Dense components
+	std::vector<Transform> transforms;
+	std::vector<Mesh*> meshes;
+	std::vector<Material*> materials;
+	std::vector<CullBounds> bounds;
+	std::vector<unsigned int> flags;
+	std::vector<int> lods;				// Which of the mesh's LODs to draw
+	std::vector<int> drawnTriangles;	// Left after meshlet culling, last time it was drawn
+	std::vector<char> boundsDirty;		// New, or given a new mesh, since UpdateBounds()
+
+	SceneBvh bvh;						// Over the bounds, by dense index
+	unsigned int boundsFrame;			// TransformSystem frame the bounds are from
+	unsigned int staticVersion;			// See GetStaticVersion()
+
+	// Occluders' positions and triangles, by mesh ID, unpacked
+	// the first time each mesh is drawn into the occlusion buffer
+	struct OccluderGeometry
+	{
+		std::vector<DirectX::XMFLOAT3> Positions;
+		std::vector<unsigned int> Indices;
+	};
+	std::unordered_map<unsigned int, OccluderGeometry> occluderGeometry;
+
+	// Instancing, rebuilt by each submit
+	std::vector<InstanceGroup> instanceGroups;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;	// One InstanceData per packet
+	unsigned int instanceCapacity;
+
+	// What keeps the meshes and materials alive
+	std::vector<std::shared_ptr<Mesh>> meshRefs;
+	std::vector<std::shared_ptr<Material>> materialRefs;
+};
@@ -0,0 +1,62 @@
+#include "FrustumCull.h"
+#include "FrustumCullSimd.h"
+#include "CpuFeatures.h"
+#include <cmath>
+
+using namespace DirectX;
+
+void ExtractFrustumPlanes(const XMFLOAT4X4& m, XMFLOAT4 planes[6])
+{
+	// Planes straight from the columns of the combined matrix (Gribb &
+	// Hartmann), with D3D's 0 to 1 depth range for the near plane
+	XMVECTOR column1 = XMVectorSet(m._11, m._21, m._31, m._41);
+	XMVECTOR column2 = XMVectorSet(m._12, m._22, m._32, m._42);
+	XMVECTOR column3 = XMVectorSet(m._13, m._23, m._33, m._43);
+	XMVECTOR column4 = XMVectorSet(m._14, m._24, m._34, m._44);
+	XMVECTOR unnormalized[6] =
+	{
+		column4 + column1,	// Left
+		column4 - column1,	// Right
+		column4 + column2,	// Bottom
+		column4 - column2,	// Top
+		column3,			// Near
+		column4 - column3,	// Far
+	};
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planes[p], XMPlaneNormalize(unnormalized[p]));
+}
+
+bool IsBoxInFrustum(const XMFLOAT4 planes[6], const CullBounds& bounds)
+{
+	// Outside if even the corner furthest along the plane's
+	// normal is behind it - the same sums, in the same order,
+	// as the SIMD version so the two always agree
+	for (int p = 0; p < 6; p++)
+	{
+		const XMFLOAT4& plane = planes[p];
+		float distance = plane.x * bounds.Center.x + plane.y * bounds.Center.y;
+		distance = distance + plane.z * bounds.Center.z;
+		distance = distance + plane.w;
+		float reach = fabsf(plane.x) * bounds.Extents.x + fabsf(plane.y) * bounds.Extents.y;
+		reach = reach + fabsf(plane.z) * bounds.Extents.z;
+		if (distance + reach < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+unsigned int CullBoxes(const XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible)
+{
+	if (HasAvx2())
+		return CullBoxesAvx2(planes, bounds, count, visible);
+	return CullBoxesSse(planes, bounds, count, visible);
+}
+
+unsigned int CullBoxesSse(const XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible)
+{
+	return CullBoxBlocks<SseLanes>(planes, bounds, count, visible);
+}
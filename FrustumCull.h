@@ -0,0 +1,44 @@
+#pragma once
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// A world space bounding box (center and half size) with
+// the sphere around it, packed into 32 bytes so the
+// culling can load each one straight into SIMD registers
+// --------------------------------------------------------
+struct CullBounds
+{
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+	DirectX::XMFLOAT3 Extents;
+	float Padding;
+};
+
+// --------------------------------------------------------
+// Pulls the six planes out of a combined view-projection
+// matrix (or world-view-projection, for planes in the
+// mesh's local space), normalized and pointing into the
+// frustum, in the order left, right, bottom, top, near, far
+// --------------------------------------------------------
+void ExtractFrustumPlanes(const DirectX::XMFLOAT4X4& matrix, DirectX::XMFLOAT4 planes[6]);
+
+// --------------------------------------------------------
+// Whether a box is at least partly inside all six planes
+//
+// Conservative - a box near a corner of the frustum can be
+// outside it without being all the way behind any one plane
+// --------------------------------------------------------
+bool IsBoxInFrustum(const DirectX::XMFLOAT4 planes[6], const CullBounds& bounds);
+
+// --------------------------------------------------------
+// Tests every box against the frustum, 8 at a time with
+// AVX2 (on CPUs that have it) or 4 at a time with SSE,
+// giving the same answers as IsBoxInFrustum
+//
+// Writes the indices of those that survive, in order, to
+// visible (which needs room for count of them) and returns
+// how many there were
+// --------------------------------------------------------
+unsigned int CullBoxes(const DirectX::XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible);
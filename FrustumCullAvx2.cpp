@@ -0,0 +1,10 @@
+#include "FrustumCullSimd.h"
+
+// Only this file is built with AVX2 - see SimdLanes.h
+
+unsigned int CullBoxesAvx2(const DirectX::XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible)
+{
+	return CullBoxBlocks<Avx2Lanes>(planes, bounds, count, visible);
+}
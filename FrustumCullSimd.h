@@ -0,0 +1,120 @@
+#pragma once
+#include "FrustumCull.h"
+#include "SimdLanes.h"
+
+// --------------------------------------------------------
+// CullBoxes() for each instruction set - the AVX2 one is in
+// FrustumCullAvx2.cpp, and must only be called if HasAvx2()
+// --------------------------------------------------------
+unsigned int CullBoxesSse(const DirectX::XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible);
+unsigned int CullBoxesAvx2(const DirectX::XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible);
+
+// --------------------------------------------------------
+// Loads a block of boxes as one register per component
+// --------------------------------------------------------
+
+// Each box is two rows of 4 floats, so this is two 4x4 transposes
+static inline void LoadBoxLanes(const CullBounds* bounds, __m128 center[3], __m128 extents[3])
+{
+	const float* f = &bounds[0].Center.x;
+	__m128 c0 = _mm_loadu_ps(f + 0), e0 = _mm_loadu_ps(f + 4);
+	__m128 c1 = _mm_loadu_ps(f + 8), e1 = _mm_loadu_ps(f + 12);
+	__m128 c2 = _mm_loadu_ps(f + 16), e2 = _mm_loadu_ps(f + 20);
+	__m128 c3 = _mm_loadu_ps(f + 24), e3 = _mm_loadu_ps(f + 28);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+	center[0] = c0; center[1] = c1; center[2] = c2;
+	extents[0] = e0; extents[1] = e1; extents[2] = e2;
+}
+
+#if defined(__AVX2__)
+// Each box is one row of 8 floats, so this is an 8x8 transpose
+static inline void LoadBoxLanes(const CullBounds* bounds, __m256 center[3], __m256 extents[3])
+{
+	const float* f = &bounds[0].Center.x;
+	__m256 r0 = _mm256_loadu_ps(f + 0), r1 = _mm256_loadu_ps(f + 8);
+	__m256 r2 = _mm256_loadu_ps(f + 16), r3 = _mm256_loadu_ps(f + 24);
+	__m256 r4 = _mm256_loadu_ps(f + 32), r5 = _mm256_loadu_ps(f + 40);
+	__m256 r6 = _mm256_loadu_ps(f + 48), r7 = _mm256_loadu_ps(f + 56);
+
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+	__m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+	__m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+	__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+
+	// Low halves hold the centers, high halves the extents
+	center[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+	center[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+	center[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+	extents[0] = _mm256_permute2f128_ps(s0, s4, 0x31);
+	extents[1] = _mm256_permute2f128_ps(s1, s5, 0x31);
+	extents[2] = _mm256_permute2f128_ps(s2, s6, 0x31);
+}
+#endif
+
+// --------------------------------------------------------
+// CullBoxes(), L::Count boxes at a time
+// --------------------------------------------------------
+template<typename L>
+unsigned int CullBoxBlocks(const DirectX::XMFLOAT4 planes[6],
+	const CullBounds* bounds, unsigned int count,
+	unsigned int* visible)
+{
+	typedef typename L::Type Lanes;
+	Lanes normal[6][3], absNormal[6][3], offset[6];
+	for (int p = 0; p < 6; p++)
+	{
+		normal[p][0] = L::Set(planes[p].x);
+		normal[p][1] = L::Set(planes[p].y);
+		normal[p][2] = L::Set(planes[p].z);
+		absNormal[p][0] = L::Set(planes[p].x < 0.0f ? -planes[p].x : planes[p].x);
+		absNormal[p][1] = L::Set(planes[p].y < 0.0f ? -planes[p].y : planes[p].y);
+		absNormal[p][2] = L::Set(planes[p].z < 0.0f ? -planes[p].z : planes[p].z);
+		offset[p] = L::Set(planes[p].w);
+	}
+
+	unsigned int visibleCount = 0;
+	unsigned int first = 0;
+	for (; first + L::Count <= count; first += L::Count)
+	{
+		Lanes center[3], extents[3];
+		LoadBoxLanes(&bounds[first], center, extents);
+
+		int outside = 0;
+		for (int p = 0; p < 6; p++)
+		{
+			Lanes distance = L::Add(L::Mul(normal[p][0], center[0]), L::Mul(normal[p][1], center[1]));
+			distance = L::Add(distance, L::Mul(normal[p][2], center[2]));
+			distance = L::Add(distance, offset[p]);
+			Lanes reach = L::Add(L::Mul(absNormal[p][0], extents[0]), L::Mul(absNormal[p][1], extents[1]));
+			reach = L::Add(reach, L::Mul(absNormal[p][2], extents[2]));
+			outside |= L::NegativeMask(L::Add(distance, reach));
+		}
+
+		// Every lane is written, but only survivors move the end on
+		for (int lane = 0; lane < L::Count; lane++)
+		{
+			visible[visibleCount] = first + lane;
+			visibleCount += ((outside >> lane) & 1) ^ 1;
+		}
+	}
+
+	// Whatever doesn't fill a whole block
+	for (; first < count; first++)
+	{
+		if (IsBoxInFrustum(planes, bounds[first]))
+			visible[visibleCount++] = first;
+	}
+	return visibleCount;
+}
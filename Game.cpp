@@ -3,6 +3,8 @@
 #include "Input.h"
 #include "PathHelpers.h"
 #include "Material.h"
+#include "TransformSystem.h"
+#include "ShadowCasterCull.h"
 
 
 #include "ImGui/imgui.h"
@@ -13,6 +15,8 @@
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
 #include <d3dcompiler.h>
+#include <chrono>
+#include <cstring>
 
 // For the DirectX Math library
 using namespace DirectX;
@@ -41,9 +45,7 @@ Game::Game(HINSTANCE hInstance)
 #endif
 
 	shadowMapResolution = 1024;
-	lightProjectionSize = 10.0f;
-	lightProjectionMatrix = XMFLOAT4X4();
-	lightViewMatrix = XMFLOAT4X4();
+	shadowLightDirection = XMFLOAT3(0.0f, -1.0f, 1.0f);
 }
 
 // --------------------------------------------------------
@@ -88,6 +90,11 @@ void Game::Init()
 	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 	device->CreateSamplerState(&ppSampDesc, ppSampler.GetAddressOf());
 
+	// Everything loaded from a file goes through here,
+	// so each file is only loaded once
+	assets = std::make_shared<AssetRegistry>(device, context);
+	entities = std::make_shared<EntityStore>();
+
 	LoadTexturesAndCreateMaterials();
 	CreateLights();
 	CreateGeometry();
@@ -122,6 +129,7 @@ void Game::Init()
 	activeCamera = cameraList[0];
 
 	CreateShadowMap();
+	CreateLightClusterBuffers();
 }
 
 // --------------------------------------------------------
@@ -134,8 +142,56 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
+	// Meshes store compressed vertices (see Vertex.h), which shader
+	// reflection can't work out the formats for, so the layout is
+	// described by hand and shared by every shader that draws meshes
+	D3D11_INPUT_ELEMENT_DESC packedVertexDesc[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, offsetof(PackedVertex, Position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, offsetof(PackedVertex, NormalTangent), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_UNORM, 0, offsetof(PackedVertex, UV), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+
+	Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob;
+	D3DReadFileToBlob(FixPath(L"VertexShader.cso").c_str(), vertexShaderBlob.GetAddressOf());
+	device->CreateInputLayout(
+		packedVertexDesc,
+		ARRAYSIZE(packedVertexDesc),
+		vertexShaderBlob->GetBufferPointer(),
+		vertexShaderBlob->GetBufferSize(),
+		packedInputLayout.GetAddressOf());
+
 	vertexShader = std::make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"VertexShader.cso").c_str());
+		FixPath(L"VertexShader.cso").c_str(), packedInputLayout, false);
+
+	// The instanced shaders add each entity's matrices (see
+	// InstanceBatch.h), a row at a time, from input slot 1
+	D3D11_INPUT_ELEMENT_DESC instancedVertexDesc[] =
+	{
+		packedVertexDesc[0],
+		packedVertexDesc[1],
+		packedVertexDesc[2],
+		{ "WORLD_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, World) + 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, World) + 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, World) + 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, World) + 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_IT_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, WorldInverseTranspose) + 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_IT_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, WorldInverseTranspose) + 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_IT_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, WorldInverseTranspose) + 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_IT_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, WorldInverseTranspose) + 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	Microsoft::WRL::ComPtr<ID3DBlob> instancedShaderBlob;
+	D3DReadFileToBlob(FixPath(L"VertexShaderInstanced.cso").c_str(), instancedShaderBlob.GetAddressOf());
+	device->CreateInputLayout(
+		instancedVertexDesc,
+		ARRAYSIZE(instancedVertexDesc),
+		instancedShaderBlob->GetBufferPointer(),
+		instancedShaderBlob->GetBufferSize(),
+		instancedInputLayout.GetAddressOf());
+
+	instancedVertexShader = std::make_shared<SimpleVertexShader>(device, context,
+		FixPath(L"VertexShaderInstanced.cso").c_str(), instancedInputLayout, true);
 
 	pixelShader = std::make_shared<SimplePixelShader>(device, context,
 		FixPath(L"PixelShader.cso").c_str());
@@ -144,13 +200,16 @@ void Game::LoadShaders()
 		FixPath(L"CustomPS.cso").c_str());
 
 	skyVertexShader = std::make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"SkyVertexShader.cso").c_str());
+		FixPath(L"SkyVertexShader.cso").c_str(), packedInputLayout, false);
 
 	skyPixelShader = std::make_shared<SimplePixelShader>(device, context,
 		FixPath(L"SkyPixelShader.cso").c_str());
 
 	shadowVertexShader = std::make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"ShadowVertexShader.cso").c_str());
+		FixPath(L"ShadowVertexShader.cso").c_str(), packedInputLayout, false);
+
+	instancedShadowVertexShader = std::make_shared<SimpleVertexShader>(device, context,
+		FixPath(L"ShadowVertexShaderInstanced.cso").c_str(), instancedInputLayout, true);
 
 	ppVS = std::make_shared<SimpleVertexShader>(device, context,
 		FixPath(L"FullScreenVertexShader.cso").c_str());
@@ -162,85 +221,53 @@ void Game::LoadShaders()
 void Game::LoadTexturesAndCreateMaterials() 
 {
 #pragma region loadTextures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeAlbedoSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/bronze_albedo.png").c_str(), 0,
-		bronzeAlbedoSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeNormalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/bronze_normals.png").c_str(), 0,
-		bronzeNormalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeRoughnessSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/bronze_roughness.png").c_str(), 0,
-		bronzeRoughnessSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeMetalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/bronze_metal.png").c_str(), 0,
-		bronzeMetalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneAlbedoSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone_albedo.png").c_str(), 0,
-		cobblestoneAlbedoSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneNormalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone_normals.png").c_str(), 0,
-		cobblestoneNormalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneRoughnessSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone_roughness.png").c_str(), 0,
-		cobblestoneRoughnessSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneMetalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone_metal.png").c_str(), 0,
-		cobblestoneMetalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorAlbedoSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/floor_albedo.png").c_str(), 0,
-		floorAlbedoSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorNormalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/floor_normals.png").c_str(), 0,
-		floorNormalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorRoughnessSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/floor_roughness.png").c_str(), 0,
-		floorRoughnessSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorMetalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/floor_metal.png").c_str(), 0,
-		floorMetalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodAlbedoSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/wood_albedo.png").c_str(), 0,
-		woodAlbedoSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodNormalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/wood_normals.png").c_str(), 0,
-		woodNormalSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodRoughnessSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/wood_roughness.png").c_str(), 0,
-		woodRoughnessSRV.GetAddressOf());
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodMetalSRV;
-	CreateWICTextureFromFile(device.Get(), context.Get(),
-		FixPath(L"../../Assets/Textures/wood_metal.png").c_str(), 0,
-		woodMetalSRV.GetAddressOf());
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeAlbedoSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/bronze_albedo.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeNormalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/bronze_normals.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeRoughnessSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/bronze_roughness.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeMetalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/bronze_metal.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneAlbedoSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/cobblestone_albedo.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneNormalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/cobblestone_normals.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneRoughnessSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/cobblestone_roughness.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneMetalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/cobblestone_metal.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorAlbedoSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/floor_albedo.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorNormalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/floor_normals.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorRoughnessSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/floor_roughness.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorMetalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/floor_metal.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodAlbedoSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/wood_albedo.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodNormalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/wood_normals.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodRoughnessSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/wood_roughness.png"));
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodMetalSRV =
+		assets->GetTexture(FixPath(L"../../Assets/Textures/wood_metal.png"));
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
 	D3D11_SAMPLER_DESC samplerDesc = {};
@@ -280,10 +307,15 @@ void Game::LoadTexturesAndCreateMaterials()
 	materials[3]->AddTextureSRV("RoughnessMap", woodRoughnessSRV);
 	materials[3]->AddTextureSRV("MetalnessMap", woodMetalSRV);
 
+	// They all use the standard vertex shader, so runs of the
+	// same mesh and material can be instanced
+	for (std::shared_ptr<Material>& material : materials)
+		material->SetInstancedVertexShader(instancedVertexShader);
+
 #pragma endregion loadTextures
 
 	// Create Sky
-	skyMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device);
+	skyMesh = assets->GetMesh(FixPath(L"../../Assets/Models/cube.obj"));
 	
 	sky = std::make_shared<Sky>(
 		FixPath(L"../../Assets/Textures/Clouds Pink/right.png").c_str(),
@@ -354,7 +386,7 @@ void Game::CreateShadowMap()
 	D3D11_TEXTURE2D_DESC shadowDesc = {};
 	shadowDesc.Width = shadowMapResolution; // Ideally a power of 2 (like 1024)
 	shadowDesc.Height = shadowMapResolution; // Ideally a power of 2 (like 1024)
-	shadowDesc.ArraySize = 1;
+	shadowDesc.ArraySize = MAX_SHADOW_CASCADES;
 	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	shadowDesc.CPUAccessFlags = 0;
 	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
@@ -363,23 +395,35 @@ void Game::CreateShadowMap()
 	shadowDesc.SampleDesc.Count = 1;
 	shadowDesc.SampleDesc.Quality = 0;
 	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
 	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
 
+	// The static casters' cache only needs to be drawn into
+	// and copied from
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	device->CreateTexture2D(&shadowDesc, 0, shadowCacheTexture.GetAddressOf());
+
 
-	// Create the depth/stencil view
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSV.GetAddressOf());
+	// Create a depth/stencil view for each cascade's slice
+	for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		shadowDSDesc.Texture2DArray.MipSlice = 0;
+		shadowDSDesc.Texture2DArray.FirstArraySlice = i;
+		shadowDSDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSVs[i].GetAddressOf());
+		device->CreateDepthStencilView(shadowCacheTexture.Get(), &shadowDSDesc, shadowCacheDSVs[i].GetAddressOf());
+	}
 
-	// Create the SRV for the shadow map
+	// Create the SRV for the whole array
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = MAX_SHADOW_CASCADES;
 	device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRV.GetAddressOf());
 
 	D3D11_SAMPLER_DESC shadowSampDesc = {};
@@ -394,32 +438,58 @@ void Game::CreateShadowMap()
 	D3D11_RASTERIZER_DESC shadowRastDesc = {};
 	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
 	shadowRastDesc.CullMode = D3D11_CULL_BACK;
-	shadowRastDesc.DepthClipEnable = true;
+	shadowRastDesc.DepthClipEnable = false; // Casters nearer than the near plane clamp to it, not vanish
 	shadowRastDesc.DepthBias = 1000; // Min. precision units, not world units!
 	shadowRastDesc.SlopeScaledDepthBias = 1.0f; // Bias more based on slope
 	device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
 
-
-	// View
-	XMMATRIX lightView = XMMatrixLookAtLH(
-		XMVectorSet(0, 20, -20, 0),
-		XMVectorSet(0, 0, 0, 0),
-		XMVectorSet(0, 1, 0, 0));
-	XMStoreFloat4x4(&lightViewMatrix, lightView);
-
-	XMMATRIX lightProjection = XMMatrixOrthographicLH(
-		lightProjectionSize,
-		lightProjectionSize,
-		1.0f,
-		100.0f);
-	XMStoreFloat4x4(&lightProjectionMatrix, lightProjection);
+	// The cascades' views and projections follow the camera,
+	// so they're fitted every frame in RenderShadowMap()
+
+	// The shadow atlas, for every other light, with the same
+	// format and views as the cascades' (but only one slice)
+	D3D11_TEXTURE2D_DESC atlasDesc = shadowDesc;
+	atlasDesc.Width = shadowAtlas.GetSize();
+	atlasDesc.Height = shadowAtlas.GetSize();
+	atlasDesc.ArraySize = 1;
+	atlasDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> atlasTexture;
+	device->CreateTexture2D(&atlasDesc, 0, atlasTexture.GetAddressOf());
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC atlasDSDesc = {};
+	atlasDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	atlasDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	atlasDSDesc.Texture2D.MipSlice = 0;
+	device->CreateDepthStencilView(atlasTexture.Get(), &atlasDSDesc, shadowAtlasDSV.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC atlasSRVDesc = {};
+	atlasSRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	atlasSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	atlasSRVDesc.Texture2D.MipLevels = 1;
+	atlasSRVDesc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(atlasTexture.Get(), &atlasSRVDesc, shadowAtlasSRV.GetAddressOf());
+
+	// Each tile's matrix and place in the atlas, rewritten
+	// every frame for the pixel shader
+	D3D11_BUFFER_DESC tileDesc = {};
+	tileDesc.ByteWidth = SHADOW_ATLAS_MAX_TILES * sizeof(ShadowAtlasEntry);
+	tileDesc.Usage = D3D11_USAGE_DYNAMIC;
+	tileDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tileDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	tileDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	tileDesc.StructureByteStride = sizeof(ShadowAtlasEntry);
+	device->CreateBuffer(&tileDesc, 0, shadowAtlasBuffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC tileSRVDesc = {};
+	tileSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	tileSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	tileSRVDesc.Buffer.FirstElement = 0;
+	tileSRVDesc.Buffer.NumElements = SHADOW_ATLAS_MAX_TILES;
+	device->CreateShaderResourceView(shadowAtlasBuffer.Get(), &tileSRVDesc, shadowAtlasBufferSRV.GetAddressOf());
 }
 
 void Game::RenderShadowMap()
 {
-	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);	
-	ID3D11RenderTargetView* nullRTV{};
-	context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
 	context->RSSetState(shadowRasterizer.Get());
 	context->PSSetShader(0, 0, 0);
 
@@ -429,21 +499,95 @@ void Game::RenderShadowMap()
 	viewport.MaxDepth = 1.0f;
 	context->RSSetViewports(1, &viewport);
 
-
-	shadowVertexShader->SetShader();
-	shadowVertexShader->SetMatrix4x4("view", lightViewMatrix);
-	shadowVertexShader->SetMatrix4x4("projection", lightProjectionMatrix);
-	
-
-	// Loop and draw all entities
-	for (std::shared_ptr<Entity> e : entities)
+	// Split the camera's view into slices, nearest first, each
+	// with its own box from the light - see ShadowCascades.h
+	XMFLOAT4X4 view = activeCamera->GetViewMatrix();
+	float fov = activeCamera->GetFieldOfView();
+	float aspectRatio = activeCamera->GetAspectRatio();
+	float splits[MAX_SHADOW_CASCADES + 1];
+	ComputeCascadeSplits(activeCamera->GetNearClipPlane(), activeCamera->GetFarClipPlane(),
+		shadowCascadeCount, shadowCascadeLambda, splits);
+
+	shadowCasterCount = 0;
+	shadowCastersRejected = 0;
+	shadowStats = {};
+	bool allCached = true;
+
+	// Static casters are the batches' merged entities, so without
+	// any there's nothing to cache
+	bool caching = shadowCaching && !staticBatches.empty();
+	ID3D11RenderTargetView* nullRTV{};
+	for (int i = 0; i < shadowCascadeCount; i++)
 	{
-		shadowVertexShader->SetMatrix4x4("world", e->GetTransform().GetWorldMatrix());
-		shadowVertexShader->CopyAllBufferData();
+		ShadowCascade& cascade = shadowCascades[i];
+		FitCascade(view, fov, aspectRatio, splits[i], splits[i + 1],
+			shadowLightDirection, shadowMapResolution, cascade,
+			caching ? &shadowRegions[i] : 0);
+
+		shadowVertexShader->SetMatrix4x4("view", cascade.View);
+		shadowVertexShader->SetMatrix4x4("projection", cascade.Projection);
+		instancedShadowVertexShader->SetMatrix4x4("view", cascade.View);
+		instancedShadowVertexShader->SetMatrix4x4("projection", cascade.Projection);
+
+		// Only entities inside the cascade's box can land in its
+		// slice - its near plane is left out, so it reaches all the
+		// way back to the light (depth clamps to 0 rather than
+		// clipping them)
+		XMFLOAT4 lightPlanes[6];
+		ExtractFrustumPlanes(cascade.ViewProjection, lightPlanes);
+		lightPlanes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		entities->Cull(lightPlanes, shadowCasters);
+
+		if (caching)
+		{
+			// The cached static casters still hold as long as the
+			// cascade's region (and so the light) and the static
+			// entities are the same - the camera moving around inside
+			// the region doesn't matter. They're only culled to the
+			// box, not the caster volume below, as that also turns
+			// with the camera
+			ShadowCacheKey key = { shadowRegions[i], entities->GetStaticVersion() };
+			if (IsShadowCacheHit(shadowCacheKeys[i], key))
+				shadowCacheHits++;
+			else
+			{
+				context->ClearDepthStencilView(shadowCacheDSVs[i].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+				context->OMSetRenderTargets(1, &nullRTV, shadowCacheDSVs[i].Get());
+				DrawShadowCasters(SHADOW_CASTERS_STATIC);
+
+				shadowCacheKeys[i] = key;
+				shadowCacheMisses++;
+				allCached = false;
+			}
 
-		e->GetMesh()->Draw(context);
+			// Both are depth buffers, so the whole slice is copied
+			context->CopySubresourceRegion(shadowTexture.Get(), i, 0, 0, 0,
+				shadowCacheTexture.Get(), i, 0);
+		}
+		else
+			context->ClearDepthStencilView(shadowDSVs[i].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		context->OMSetRenderTargets(1, &nullRTV, shadowDSVs[i].Get());
+
+		// ...and of those, only ones whose shadows can fall in the
+		// part of the view this cascade covers - see ShadowCasterCull.h
+		XMFLOAT4X4 sliceViewProjection;
+		XMStoreFloat4x4(&sliceViewProjection, XMLoadFloat4x4(&view) *
+			XMMatrixPerspectiveFovLH(fov, aspectRatio, splits[i], splits[i + 1]));
+		XMFLOAT4 casterPlanes[CASTER_VOLUME_MAX_PLANES];
+		int casterPlaneCount = BuildCasterVolume(sliceViewProjection, shadowLightDirection, casterPlanes);
+		shadowCastersRejected += CullShadowCasters(casterPlanes, casterPlaneCount,
+			entities->GetBounds(), shadowCasters);
+		shadowCasterCount += (unsigned int)shadowCasters.size();
+
+		DrawShadowCasters(caching ? SHADOW_CASTERS_DYNAMIC : SHADOW_CASTERS_ALL);
 	}
 
+	shadowFrames++;
+	if (caching && allCached)
+		shadowCachedFrames++;
+
+	RenderShadowAtlas();
+
 	viewport.Width = (float)this->windowWidth;
 	viewport.Height = (float)this->windowHeight;
 	context->RSSetViewports(1, &viewport);
@@ -454,6 +598,229 @@ void Game::RenderShadowMap()
 	context->RSSetState(0);
 }
 
+// --------------------------------------------------------
+// Draws the shadows of every light but the first (which has
+// the cascades) into the tiles of the shadow atlas they're
+// given this frame, and sets each light's ShadowTile
+// --------------------------------------------------------
+void Game::RenderShadowAtlas()
+{
+	XMFLOAT4X4 view = activeCamera->GetViewMatrix();
+	XMFLOAT4X4 projection = activeCamera->GetProjectionMatrix();
+	XMFLOAT4 cameraPlanes[6];
+	activeCamera->GetFrustumPlanes(cameraPlanes);
+
+	// The first light's shadows are the cascades', so it
+	// doesn't ask for tiles
+	auto allocateStart = std::chrono::high_resolution_clock::now();
+	shadowAtlasRequests.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		shadowAtlasRequests[i].Importance = i == 0 ? 0.0f :
+			GetShadowImportance(lights[i], view, projection, cameraPlanes);
+		shadowAtlasRequests[i].TileCount = lights[i].Type == LIGHT_TYPE_POINT ? SHADOW_ATLAS_FACES : 1;
+	}
+	shadowAtlasLights = shadowAtlas.Allocate(shadowAtlasRequests.data(), (int)shadowAtlasRequests.size(),
+		shadowAtlasFirstTiles, shadowAtlasTiles);
+	shadowAtlasTime = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - allocateStart).count();
+
+	context->ClearDepthStencilView(shadowAtlasDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+	ID3D11RenderTargetView* nullRTV{};
+	context->OMSetRenderTargets(1, &nullRTV, shadowAtlasDSV.Get());
+
+	float atlasSize = (float)shadowAtlas.GetSize();
+	shadowAtlasEntries.resize(shadowAtlasTiles.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		Light& light = lights[i];
+		light.ShadowTile = shadowAtlasFirstTiles[i];
+		if (light.ShadowTile < 0)
+			continue;
+
+		// A directional light's box is fitted like a single cascade
+		// over the nearer part of the view, and a point light has a
+		// perspective view down each axis
+		int tileCount = shadowAtlasRequests[i].TileCount;
+		XMFLOAT4X4 views[SHADOW_ATLAS_FACES];
+		XMFLOAT4X4 projections[SHADOW_ATLAS_FACES];
+		float sliceFar = fminf(activeCamera->GetFarClipPlane(), shadowAtlasDistance);
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			ShadowCascade box;
+			FitCascade(view, activeCamera->GetFieldOfView(), activeCamera->GetAspectRatio(),
+				activeCamera->GetNearClipPlane(), sliceFar, light.Direction,
+				shadowAtlasTiles[light.ShadowTile].Size, box);
+			views[0] = box.View;
+			projections[0] = box.Projection;
+		}
+		else
+		{
+			BuildPointShadowFaces(light.Position, light.Range, views, projections[0]);
+			for (int f = 1; f < tileCount; f++)
+				projections[f] = projections[0];
+		}
+
+		for (int t = 0; t < tileCount; t++)
+		{
+			const ShadowAtlasTile& tile = shadowAtlasTiles[light.ShadowTile + t];
+			ShadowAtlasEntry& entry = shadowAtlasEntries[light.ShadowTile + t];
+			XMStoreFloat4x4(&entry.ViewProjection,
+				XMLoadFloat4x4(&views[t]) * XMLoadFloat4x4(&projections[t]));
+			entry.Rect = XMFLOAT4(tile.X / atlasSize, tile.Y / atlasSize,
+				tile.Size / atlasSize, tile.Size / atlasSize);
+
+			D3D11_VIEWPORT viewport = {};
+			viewport.TopLeftX = (float)tile.X;
+			viewport.TopLeftY = (float)tile.Y;
+			viewport.Width = (float)tile.Size;
+			viewport.Height = (float)tile.Size;
+			viewport.MaxDepth = 1.0f;
+			context->RSSetViewports(1, &viewport);
+
+			shadowVertexShader->SetMatrix4x4("view", views[t]);
+			shadowVertexShader->SetMatrix4x4("projection", projections[t]);
+			instancedShadowVertexShader->SetMatrix4x4("view", views[t]);
+			instancedShadowVertexShader->SetMatrix4x4("projection", projections[t]);
+
+			// Culled like a cascade - a directional light's box reaches
+			// back to the light, and only keeps casters whose shadows
+			// fall in the view
+			XMFLOAT4 lightPlanes[6];
+			ExtractFrustumPlanes(entry.ViewProjection, lightPlanes);
+			if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+				lightPlanes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+			entities->Cull(lightPlanes, shadowCasters);
+			if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+			{
+				XMFLOAT4X4 sliceViewProjection;
+				XMStoreFloat4x4(&sliceViewProjection, XMLoadFloat4x4(&view) * XMMatrixPerspectiveFovLH(
+					activeCamera->GetFieldOfView(), activeCamera->GetAspectRatio(),
+					activeCamera->GetNearClipPlane(), sliceFar));
+				XMFLOAT4 casterPlanes[CASTER_VOLUME_MAX_PLANES];
+				int casterPlaneCount = BuildCasterVolume(sliceViewProjection, light.Direction, casterPlanes);
+				shadowCastersRejected += CullShadowCasters(casterPlanes, casterPlaneCount,
+					entities->GetBounds(), shadowCasters);
+			}
+			shadowCasterCount += (unsigned int)shadowCasters.size();
+			DrawShadowCasters(SHADOW_CASTERS_ALL);
+		}
+	}
+
+	if (shadowAtlasEntries.empty())
+		return;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(shadowAtlasBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, shadowAtlasEntries.data(), shadowAtlasEntries.size() * sizeof(ShadowAtlasEntry));
+	context->Unmap(shadowAtlasBuffer.Get(), 0);
+}
+
+// --------------------------------------------------------
+// Queues, sorts and draws the shadow casters of one set
+// (see QueueShadowDraws()) into whatever's bound - sorted by
+// mesh and LOD, so matching casters are drawn with one
+// instanced draw
+// --------------------------------------------------------
+void Game::DrawShadowCasters(unsigned int casterSet)
+{
+	shadowQueue.Clear();
+	entities->QueueShadowDraws(shadowQueue, shadowCasters, casterSet);
+	shadowQueue.Sort();
+	RenderStats stats = entities->SubmitShadowDraws(shadowQueue, context,
+		shadowVertexShader, instancedShadowVertexShader);
+	shadowStats.Draws += stats.Draws;
+	shadowStats.Instances += stats.Instances;
+	shadowStats.ShaderBinds += stats.ShaderBinds;
+	shadowStats.MaterialBinds += stats.MaterialBinds;
+}
+
+// --------------------------------------------------------
+// Creates the buffer of clusters the pixel shader reads its
+// light list from - the index buffer those lists point into
+// changes size, so it's made in UploadLightClusters()
+// --------------------------------------------------------
+void Game::CreateLightClusterBuffers()
+{
+	D3D11_BUFFER_DESC clusterDesc = {};
+	clusterDesc.ByteWidth = CLUSTER_COUNT * sizeof(LightCluster);
+	clusterDesc.Usage = D3D11_USAGE_DYNAMIC;
+	clusterDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	clusterDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	clusterDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	clusterDesc.StructureByteStride = sizeof(LightCluster);
+	device->CreateBuffer(&clusterDesc, 0, lightClusterBuffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC clusterSRVDesc = {};
+	clusterSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	clusterSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	clusterSRVDesc.Buffer.FirstElement = 0;
+	clusterSRVDesc.Buffer.NumElements = CLUSTER_COUNT;
+	device->CreateShaderResourceView(lightClusterBuffer.Get(), &clusterSRVDesc, lightClusterSRV.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Bins the lights into the active camera's clusters (or
+// puts them all in every cluster, with clustering off) and
+// copies the clusters and their lists to the GPU
+// --------------------------------------------------------
+void Game::UploadLightClusters()
+{
+	auto binStart = std::chrono::high_resolution_clock::now();
+	if (clusteredLighting)
+	{
+		lightClusters.Build(lights.data(), (int)lights.size(),
+			activeCamera->GetViewMatrix(), activeCamera->GetProjectionMatrix(),
+			activeCamera->GetNearClipPlane(), activeCamera->GetFarClipPlane());
+	}
+	else
+	{
+		lightClusters.BuildUnclustered((int)lights.size());
+	}
+	lightClusterTime = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - binStart).count();
+
+	// Grown to the next power of two, so it's rarely recreated
+	unsigned int indexCount = lightClusters.GetIndexCount();
+	if (indexCount > lightIndexCapacity || !lightIndexBuffer)
+	{
+		lightIndexCapacity = 64;
+		while (lightIndexCapacity < indexCount)
+			lightIndexCapacity *= 2;
+
+		D3D11_BUFFER_DESC indexDesc = {};
+		indexDesc.ByteWidth = lightIndexCapacity * sizeof(unsigned int);
+		indexDesc.Usage = D3D11_USAGE_DYNAMIC;
+		indexDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		indexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		indexDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		indexDesc.StructureByteStride = sizeof(unsigned int);
+		lightIndexBuffer.Reset();
+		lightIndexSRV.Reset();
+		device->CreateBuffer(&indexDesc, 0, lightIndexBuffer.GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC indexSRVDesc = {};
+		indexSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+		indexSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		indexSRVDesc.Buffer.FirstElement = 0;
+		indexSRVDesc.Buffer.NumElements = lightIndexCapacity;
+		device->CreateShaderResourceView(lightIndexBuffer.Get(), &indexSRVDesc, lightIndexSRV.GetAddressOf());
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(lightClusterBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, lightClusters.GetClusters(), CLUSTER_COUNT * sizeof(LightCluster));
+	context->Unmap(lightClusterBuffer.Get(), 0);
+
+	if (indexCount == 0)
+		return;
+	if (FAILED(context->Map(lightIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, lightClusters.GetIndices(), indexCount * sizeof(unsigned int));
+	context->Unmap(lightIndexBuffer.Get(), 0);
+}
+
 void Game::SetUpRenderTarget()
 {
 	ppRTV.Reset();
@@ -498,16 +865,20 @@ void Game::SetUpRenderTarget()
 void Game::CreateGeometry()
 {
 	// Create and reposition entities
-	entities.push_back(std::make_shared<Entity>(Entity(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str(), device), materials[0])));
-	entities[0]->GetTransform().SetPosition(XMFLOAT3(-3.0f, 2.0f, -2.0f));
-	entities.push_back(std::make_shared<Entity>(Entity(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str(), device), materials[1])));
-	entities.push_back(std::make_shared<Entity>(Entity(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cylinder.obj").c_str(), device), materials[2])));
-	entities[2]->GetTransform().SetPosition(XMFLOAT3(3.0f, 0.0f, 0.0f));
+	movingEntities.push_back(entities->Create(assets->GetMesh(FixPath(L"../../Assets/Models/sphere.obj")), materials[0]));
+	entities->GetTransform(movingEntities[0]).SetPosition(XMFLOAT3(-3.0f, 2.0f, -2.0f));
+	movingEntities.push_back(entities->Create(assets->GetMesh(FixPath(L"../../Assets/Models/helix.obj")), materials[1]));
+	movingEntities.push_back(entities->Create(assets->GetMesh(FixPath(L"../../Assets/Models/cylinder.obj")), materials[2]));
+	entities->GetTransform(movingEntities[2]).SetPosition(XMFLOAT3(3.0f, 0.0f, 0.0f));
 
 	// Floor Cube
-	floor = std::make_shared<Entity>(Entity(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device), materials[3]));
-	floor->GetTransform().SetScale(10.0f, 1.0f, 10.0f);
-	floor->GetTransform().SetPosition(0.0f, -3.0f, 0.0f);
+	EntityId floor = entities->Create(assets->GetMesh(FixPath(L"../../Assets/Models/cube.obj")), materials[3],
+		ENTITY_FLAG_NO_SHADOW | ENTITY_FLAG_OCCLUDER);
+	entities->GetTransform(floor).SetScale(10.0f, 1.0f, 10.0f);
+	entities->GetTransform(floor).SetPosition(0.0f, -3.0f, 0.0f);
+
+	// Merge any static entities - see StaticBatch.h
+	BuildStaticBatches(entities, assets->GetGeometryArena(), staticBatches);
 }
 
 
@@ -551,33 +922,189 @@ void Game::Update(float deltaTime, float totalTime)
 	// Entity UI
 	if (ImGui::TreeNode("Entities"))
 	{
-		for (int i = 0; i < entities.size(); i++)
+		if (entities->IsAlive(pickedEntity))
+			ImGui::Text("Picked: Entity %u (right click)", pickedEntity.Index);
+		else
+			ImGui::Text("Picked: None (right click)");
+
+		bool staticChanged = false;
+		for (unsigned int i = 0; i < entities->GetCount(); i++)
 		{
-			ImGui::PushID(i);
+			EntityId id = entities->GetIds()[i];
+			unsigned int flags = entities->GetFlags(id);
+			if (flags & ENTITY_FLAG_BATCH)
+				continue;
+
+			ImGui::PushID(id.Index);
 
-			ImGui::Text("Entity %i", i);
+			ImGui::Text("Entity %u", id.Index);
 
-			XMFLOAT3 pos = entities[i]->GetTransform().GetPosition();
+			Transform& transform = entities->GetTransform(id);
+			XMFLOAT3 pos = transform.GetPosition();
 			if (ImGui::DragFloat3("Position", &pos.x, 0.01f))
 			{
-				entities[i]->GetTransform().SetPosition(pos);
+				transform.SetPosition(pos);
 			}
 
-			XMFLOAT3 rot = entities[i]->GetTransform().GetPitchYawRoll();
+			XMFLOAT3 rot = transform.GetPitchYawRoll();
 			if (ImGui::DragFloat3("Rotation (Radians)", &rot.x, 0.01f))
 			{
-				entities[i]->GetTransform().SetRotation(rot);
+				transform.SetRotation(rot);
 			}
 
-			XMFLOAT3 scale = entities[i]->GetTransform().GetScale();
+			XMFLOAT3 scale = transform.GetScale();
 			if (ImGui::DragFloat3("Scale", &scale.x, 0.01f))
 			{
-				entities[i]->GetTransform().SetScale(scale);
+				transform.SetScale(scale);
+			}
+
+			bool isOccluder = (flags & ENTITY_FLAG_OCCLUDER) != 0;
+			if (ImGui::Checkbox("Occluder", &isOccluder))
+			{
+				flags = isOccluder ? flags | ENTITY_FLAG_OCCLUDER : flags & ~ENTITY_FLAG_OCCLUDER;
+				entities->SetFlags(id, flags);
 			}
 
+			bool isStatic = (flags & ENTITY_FLAG_STATIC) != 0;
+			if (ImGui::Checkbox("Static", &isStatic))
+			{
+				entities->SetFlags(id, isStatic ? flags | ENTITY_FLAG_STATIC : flags & ~ENTITY_FLAG_STATIC);
+				staticChanged = true;
+			}
+
+			ImGui::Text("LOD: %i of %i", entities->GetLod(id),
+				(int)entities->GetMesh(id)->GetLods().size());
+			ImGui::Text("Triangles: %i of %i", entities->GetDrawnTriangleCount(id),
+				entities->GetMesh(id)->GetIndexCount() / 3);
+
 			ImGui::PopID();
 		}
 		ImGui::TreePop();
+
+		// Not during the loop, since rebuilding adds and removes entities
+		if (staticChanged)
+			BuildStaticBatches(entities, assets->GetGeometryArena(), staticBatches);
+	}
+
+	// Render queue UI
+	if (ImGui::TreeNode("Render Queue"))
+	{
+		ImGui::Text("Visible: %i of %i", (int)visibleEntities.size(), (int)entities->GetCount());
+		ImGui::Text("Shadow casters: %i (%i rejected, as their shadows are out of view)",
+			(int)shadowCasterCount, (int)shadowCastersRejected);
+		ImGui::Text("Draws: %i (%i entities instanced)", renderStats.Draws, renderStats.Instances);
+		ImGui::Text("Shadow draws: %i (%i entities instanced)", shadowStats.Draws, shadowStats.Instances);
+		ImGui::Text("Shader binds: %i", renderStats.ShaderBinds);
+		ImGui::Text("Material binds: %i", renderStats.MaterialBinds);
+		ImGui::Text("Cull, build and sort: %.3f ms", renderQueueTime);
+		ImGui::Text("BVH nodes: %u (%u loose entities)", entities->GetBvh().GetNodeCount(),
+			entities->GetBvh().GetLooseCount());
+		ImGui::TreePop();
+	}
+
+	// Occlusion culling UI
+	if (ImGui::TreeNode("Occlusion Culling"))
+	{
+		ImGui::Checkbox("Enabled", &occlusionCulling);
+		ImGui::Text("Occluded: %i", occludedCount);
+		ImGui::Text("Occluder triangles: %u", occlusion.GetTriangleCount());
+		ImGui::Text("Draw and test: %.3f ms", occlusionTime);
+		ImGui::TreePop();
+	}
+
+	// Shadow cascade UI
+	if (ImGui::TreeNode("Shadow Cascades"))
+	{
+		ImGui::SliderInt("Cascades", &shadowCascadeCount, 1, MAX_SHADOW_CASCADES);
+		ImGui::SliderFloat("Log Split Blend", &shadowCascadeLambda, 0.0f, 1.0f);
+		if (ImGui::DragFloat3("Light Direction", &shadowLightDirection.x, 0.01f))
+		{
+			// A zero direction has nothing to look along
+			if (XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&shadowLightDirection))) < 1e-6f)
+				shadowLightDirection = XMFLOAT3(0.0f, -1.0f, 0.0f);
+		}
+		ImGui::Checkbox("Cache Static Casters", &shadowCaching);
+		ImGui::Text("Cached frames: %u of %u", shadowCachedFrames, shadowFrames);
+		ImGui::Text("Cascades cached: %u, redrawn: %u", shadowCacheHits, shadowCacheMisses);
+		if (ImGui::Button("Reset Counters"))
+		{
+			shadowFrames = 0;
+			shadowCachedFrames = 0;
+			shadowCacheHits = 0;
+			shadowCacheMisses = 0;
+		}
+		for (int i = 0; i < shadowCascadeCount; i++)
+		{
+			ImGui::Text("%i: %.2f to %.2f (%.2f texels per unit)", i,
+				shadowCascades[i].SplitNear, shadowCascades[i].SplitFar,
+				shadowMapResolution / (2.0f * shadowCascades[i].HalfSize));
+		}
+		ImGui::TreePop();
+	}
+
+	// Shadow atlas UI
+	if (ImGui::TreeNode("Shadow Atlas"))
+	{
+		ImGui::SliderFloat("Directional Distance", &shadowAtlasDistance, 1.0f, 100.0f);
+		ImGui::Text("Shadowed lights: %i of %i (the first has the cascades)",
+			shadowAtlasLights, (int)lights.size() - 1);
+		float atlasArea = (float)shadowAtlas.GetSize() * shadowAtlas.GetSize();
+		ImGui::Text("Atlas used: %.1f%% of %ix%i", 100.0f * shadowAtlas.GetUsedArea() / atlasArea,
+			shadowAtlas.GetSize(), shadowAtlas.GetSize());
+		ImGui::Text("Allocate: %.3f ms", shadowAtlasTime);
+		for (size_t i = 1; i < shadowAtlasFirstTiles.size(); i++)
+		{
+			int first = shadowAtlasFirstTiles[i];
+			if (first < 0)
+				ImGui::Text("Light %i: none (importance %.2f)", (int)i, shadowAtlasRequests[i].Importance);
+			else
+				ImGui::Text("Light %i: %i x %ix%i (importance %.2f)", (int)i, shadowAtlasRequests[i].TileCount,
+					shadowAtlasTiles[first].Size, shadowAtlasTiles[first].Size, shadowAtlasRequests[i].Importance);
+		}
+		ImGui::TreePop();
+	}
+
+	// Clustered lighting UI
+	if (ImGui::TreeNode("Clustered Lighting"))
+	{
+		ImGui::Checkbox("Clustered", &clusteredLighting);
+		ImGui::Text("Clusters: %ix%ix%i", CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+		ImGui::Text("Lights: %i (%u in every cluster)", (int)lights.size(), lightClusters.GetGlobalCount());
+		ImGui::Text("Indices: %u, most in one cluster: %u",
+			lightClusters.GetIndexCount(), lightClusters.GetMaxClusterCount());
+		ImGui::Text("Binning: %.3f ms", lightClusterTime);
+		ImGui::TreePop();
+	}
+
+	// Static batch UI
+	if (ImGui::TreeNode("Static Batches"))
+	{
+		int batchedEntities = 0;
+		double buildTime = 0.0;
+		for (const StaticBatch& batch : staticBatches)
+		{
+			batchedEntities += (int)batch.Sources.size();
+			buildTime += batch.BuildTime;
+		}
+		ImGui::Text("%i entities in %i draws", batchedEntities, (int)staticBatches.size());
+		ImGui::Text("Last built in: %.2f ms", buildTime);
+		ImGui::TreePop();
+	}
+
+	// Asset UI
+	if (ImGui::TreeNode("Assets"))
+	{
+		ImGui::Text("GPU Memory: %.1f MB", assets->GetMemorySize() / (1024.0f * 1024.0f));
+		ImGui::Text("Geometry Arena: %.1f of %.1f MB used",
+			assets->GetGeometryArena()->GetUsedSize() / (1024.0f * 1024.0f),
+			assets->GetGeometryArena()->GetMemorySize() / (1024.0f * 1024.0f));
+		for (const AssetInfo& asset : assets->GetAssetInfo())
+		{
+			size_t nameStart = asset.Path.find_last_of(L'\\');
+			std::string name = WideToNarrow(asset.Path.substr(nameStart == std::wstring::npos ? 0 : nameStart + 1));
+			ImGui::Text("%s: %li refs, %.1f KB", name.c_str(), asset.References, asset.MemorySize / 1024.0f);
+		}
+		ImGui::TreePop();
 	}
 
 	// Camera UI
@@ -610,13 +1137,24 @@ void Game::Update(float deltaTime, float totalTime)
 	}
 
 	ImGui::DragFloat("Blur", &blurRadius, 0.01f, 0.0f, 10.0f);
+	ImGui::DragFloat("LOD Error (px)", &lodPixelError, 0.05f, 0.0f, 20.0f);
 
 	ImGui::End(); // Ends the current window
 
-	entities[0]->GetTransform().SetPosition(2.0f * sinf(totalTime * .75f) - 2.0f, 2.0f, 2.0f);
-	entities[1]->GetTransform().SetPosition(0, sinf(totalTime * .75f), 0);
-	entities[1]->GetTransform().Rotate(0, deltaTime * .75f, 0);
-	entities[2]->GetTransform().SetPosition(3.0f, 0, 2.0f * sinf(totalTime * .75f));
+	entities->GetTransform(movingEntities[0]).SetPosition(2.0f * sinf(totalTime * .75f) - 2.0f, 2.0f, 2.0f);
+	entities->GetTransform(movingEntities[1]).SetPosition(0, sinf(totalTime * .75f), 0);
+	entities->GetTransform(movingEntities[1]).Rotate(0, deltaTime * .75f, 0);
+	entities->GetTransform(movingEntities[2]).SetPosition(3.0f, 0, 2.0f * sinf(totalTime * .75f));
+
+	// Rebuild the matrices of everything that moved, all at once
+	// - See TransformSystem.h for the details
+	TransformSystem::GetInstance().UpdateMatrices();
+
+	// Re-merge any static entities that were just moved
+	UpdateStaticBatches(entities, staticBatches, assets->GetGeometryArena());
+
+	// Then move every entity's bounds to match
+	entities->UpdateBounds();
 
 
 	// Determine new input capture
@@ -627,11 +1165,61 @@ void Game::Update(float deltaTime, float totalTime)
 	// Update the active camera
 	activeCamera->Update(deltaTime);
 
+	// Right clicking picks whatever's under the mouse
+	if (input.MouseRightPress())
+		PickEntity(input.GetMouseX(), input.GetMouseY());
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 }
 
+// --------------------------------------------------------
+// Casts a ray from the active camera through a pixel and
+// remembers the first entity its bounds hit
+// --------------------------------------------------------
+void Game::PickEntity(int mouseX, int mouseY)
+{
+	XMFLOAT4X4 view = activeCamera->GetViewMatrix();
+	XMFLOAT4X4 proj = activeCamera->GetProjectionMatrix();
+	XMMATRIX invViewProj = XMMatrixInverse(0, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+
+	// The pixel on the near and far planes, back in world space
+	float x = (mouseX + 0.5f) / windowWidth * 2.0f - 1.0f;
+	float y = 1.0f - (mouseY + 0.5f) / windowHeight * 2.0f;
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0.0f, 1.0f), invViewProj);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1.0f, 1.0f), invViewProj);
+
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, nearPoint);
+	XMStoreFloat3(&direction, farPoint - nearPoint);
+	pickedEntity = entities->Pick(origin, direction);
+}
+
+// --------------------------------------------------------
+// Picks each entity's mesh LOD from how big its bounding
+// sphere looks to the active camera
+// --------------------------------------------------------
+void Game::SelectLods()
+{
+	const unsigned int* flags = entities->GetFlags();
+	const CullBounds* bounds = entities->GetBounds();
+	Mesh* const* meshes = entities->GetMeshes();
+	int* lods = entities->GetLods();
+
+	for (unsigned int i = 0; i < entities->GetCount(); i++)
+	{
+		// Batched entities are drawn at full detail
+		if (flags[i] & (ENTITY_FLAG_STATIC | ENTITY_FLAG_BATCH))
+			continue;
+
+		float screenSize = GetProjectedSphereSize(bounds[i].Center, bounds[i].Radius,
+			activeCamera->GetViewMatrix(), activeCamera->GetProjectionMatrix(),
+			(float)windowHeight);
+		lods[i] = SelectMeshLod(meshes[i]->GetLods(), screenSize, lodPixelError);
+	}
+}
+
 // --------------------------------------------------------
 // Clear the screen, redraw everything, present to the user
 // --------------------------------------------------------
@@ -647,11 +1235,17 @@ void Game::Draw(float deltaTime, float totalTime)
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+		// Upload any meshes added since the last frame, and forget what
+		// was bound, as ImGui bound its own buffers at the end of it
+		assets->GetGeometryArena()->Flush(context);
+		assets->GetGeometryArena()->InvalidateBindings();
 	}
 
 	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 	context->ClearRenderTargetView(ppRTV.Get(), clearColor);
 
+	SelectLods();
 	RenderShadowMap();
 
 	context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
@@ -660,23 +1254,69 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - These steps are generally repeated for EACH object you draw
 	// - Other Direct3D calls will also be necessary to do more complex things
 	
-	for(std::shared_ptr<Entity> e : entities) {
-		e->GetMaterial()->GetPixelShader()->SetFloat3("cameraPos", activeCamera->GetTransform()->GetPosition());	
-		vertexShader->SetMatrix4x4("lightView", lightViewMatrix);
-		vertexShader->SetMatrix4x4("lightProjection", lightProjectionMatrix);
-
-		// Add light data
-		pixelShader->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
-		pixelShader->SetInt("lightNum", (int)lights.size());
+	// Per frame values, set once - the queue binds the rest
+	pixelShader->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
+	pixelShader->SetInt("lightNum", (int)lights.size());
+
+	// Each pixel finds its cluster from where it is on screen
+	// and its slice from its view depth, the same way the
+	// lights were binned
+	UploadLightClusters();
+	pixelShader->SetFloat2("clusterTileScale", XMFLOAT2(
+		(float)CLUSTER_X / windowWidth, (float)CLUSTER_Y / windowHeight));
+	pixelShader->SetFloat2("clusterDepthScaleBias", lightClusters.GetDepthScaleBias());
+	pixelShader->SetInt("globalLightCount", (int)lightClusters.GetGlobalCount());
+	pixelShader->SetShaderResourceView("LightClusters", lightClusterSRV);
+	pixelShader->SetShaderResourceView("LightIndices", lightIndexSRV);
+
+	// Each pixel picks its cascade by how far it is along the
+	// camera's forward, against the far end of each slice
+	XMFLOAT4X4 cascadeViewProjections[MAX_SHADOW_CASCADES] = {};
+	float cascadeSplits[MAX_SHADOW_CASCADES] = {};
+	for (int i = 0; i < shadowCascadeCount; i++)
+	{
+		cascadeViewProjections[i] = shadowCascades[i].ViewProjection;
+		cascadeSplits[i] = shadowCascades[i].SplitFar;
+	}
+	pixelShader->SetData("cascadeViewProjections", cascadeViewProjections, sizeof(cascadeViewProjections));
+	pixelShader->SetFloat4("cascadeSplits", cascadeSplits);
+	pixelShader->SetFloat3("cameraForward", activeCamera->GetTransform()->GetForward());
+	pixelShader->SetInt("cascadeCount", shadowCascadeCount);
+	pixelShader->SetShaderResourceView("ShadowMap", shadowSRV);
+	pixelShader->SetShaderResourceView("ShadowAtlas", shadowAtlasSRV);
+	pixelShader->SetShaderResourceView("ShadowAtlasTiles", shadowAtlasBufferSRV);
+	pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
+
+	// Sorted so draws sharing shaders and materials are together
+	// (static entities are drawn through their batch's entity)
+	auto queueStart = std::chrono::high_resolution_clock::now();
+	XMFLOAT4 cameraPlanes[6];
+	activeCamera->GetFrustumPlanes(cameraPlanes);
+	entities->Cull(cameraPlanes, visibleEntities);
+
+	// Then skip whatever's hidden behind the big occluders
+	occludedCount = 0;
+	if (occlusionCulling)
+	{
+		auto occlusionStart = std::chrono::high_resolution_clock::now();
+		XMFLOAT4X4 view = activeCamera->GetViewMatrix();
+		XMFLOAT4X4 projection = activeCamera->GetProjectionMatrix();
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+		occlusion.Begin(viewProjection);
+		entities->DrawOccluders(occlusion, visibleEntities);
+		occludedCount = entities->CullOccluded(occlusion, visibleEntities);
+		occlusionTime = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - occlusionStart).count();
+	}
 
-		pixelShader->SetShaderResourceView("ShadowMap", shadowSRV);
-		pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
+	renderQueue.Clear();
+	entities->QueueDraws(renderQueue, activeCamera, visibleEntities);
+	renderQueue.Sort();
+	renderQueueTime = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - queueStart).count();
 
-		e->Draw(context, activeCamera, totalTime);
-		
-	}
-	floor->GetMaterial()->GetPixelShader()->SetFloat3("cameraPos", activeCamera->GetTransform()->GetPosition());
-	floor->Draw(context, activeCamera, totalTime);
+	renderStats = entities->SubmitDraws(renderQueue, context, activeCamera, totalTime);
 	sky->Draw(activeCamera);
 
 	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
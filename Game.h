@@ -6,11 +6,16 @@
 #include <memory>
 #include <vector>
 #include "Mesh.h"
-#include "Entity.h"
+#include "EntityStore.h"
 #include "Camera.h"
 #include "SimpleShader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "AssetRegistry.h"
+#include "StaticBatch.h"
+#include "ShadowCascades.h"
+#include "ShadowAtlas.h"
+#include "LightClusters.h"
 
 class Game 
 	: public DXCore
@@ -36,6 +41,12 @@ private:
 	void CreateLights();
 	void CreateShadowMap();
 	void RenderShadowMap();
+	void RenderShadowAtlas();
+	void DrawShadowCasters(unsigned int casterSet);
+	void CreateLightClusterBuffers();
+	void UploadLightClusters();
+	void PickEntity(int mouseX, int mouseY);
+	void SelectLods();
 	void SetUpRenderTarget();
 
 	// Note the usage of ComPtr below
@@ -43,13 +54,34 @@ private:
 	//     Component Object Model, which DirectX objects do
 	//  - More info here: https://github.com/Microsoft/DirectXTK/wiki/ComPtr
 	
+	// Loaded meshes and textures
+	std::shared_ptr<AssetRegistry> assets;
+
 	// Shaders and shader-related constructs
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> packedInputLayout;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> instancedInputLayout;	// Plus per instance matrices
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader;
 	std::shared_ptr<SimplePixelShader> customPS;
 
-	std::vector<std::shared_ptr<Entity>> entities;
-	std::shared_ptr<Entity> floor;
+	std::shared_ptr<EntityStore> entities;
+	std::vector<EntityId> movingEntities;	// Animated in Update()
+	EntityId pickedEntity = {};				// Last right clicked, if any
+	std::vector<StaticBatch> staticBatches;	// Drawn in place of the static entities
+
+	std::vector<unsigned int> visibleEntities;	// Dense indices that survived culling,
+	std::vector<unsigned int> shadowCasters;	// against the camera and the light
+	unsigned int shadowCasterCount = 0;			// Summed over the cascades, like these
+	unsigned int shadowCastersRejected = 0;		// In the light, but not shadowing anything in view
+	RenderQueue renderQueue;
+	RenderStats renderStats = {};		// Of the last frame's submit
+	double renderQueueTime = 0.0;		// Culling, building and sorting, in milliseconds
+
+	OcclusionBuffer occlusion;			// Of the occluder entities, from the camera
+	bool occlusionCulling = true;
+	int occludedCount = 0;				// Last frame
+	double occlusionTime = 0.0;			// Drawing occluders and testing bounds, in milliseconds
 
 	std::shared_ptr<Camera> activeCamera;
 	std::vector<std::shared_ptr<Camera>> cameraList;
@@ -66,16 +98,60 @@ private:
 	std::shared_ptr<SimpleVertexShader> skyVertexShader;
 	std::shared_ptr<SimplePixelShader> skyPixelShader;
 
-	// Shadow mapping
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
+	// Shadow mapping - one slice of the array per cascade
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSVs[MAX_SHADOW_CASCADES];
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 	std::shared_ptr<SimpleVertexShader> shadowVertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedShadowVertexShader;
+	RenderQueue shadowQueue;
+	RenderStats shadowStats = {};
 	int shadowMapResolution;
-	float lightProjectionSize;
-	DirectX::XMFLOAT4X4 lightViewMatrix;
-	DirectX::XMFLOAT4X4 lightProjectionMatrix;
+	int shadowCascadeCount = 3;
+	float shadowCascadeLambda = SHADOW_CASCADE_LAMBDA;
+	DirectX::XMFLOAT3 shadowLightDirection;
+	ShadowCascade shadowCascades[MAX_SHADOW_CASCADES];	// Refitted to the camera every frame
+
+	// Static casters' depth, drawn only when a cascade's region
+	// moves or the static entities change, and copied into the
+	// shadow map before the dynamic casters are drawn over it
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowCacheTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowCacheDSVs[MAX_SHADOW_CASCADES];
+	ShadowCascadeRegion shadowRegions[MAX_SHADOW_CASCADES] = {};	// Where each cascade's box is kept
+	ShadowCacheKey shadowCacheKeys[MAX_SHADOW_CASCADES] = {};		// What each slice was drawn with
+	bool shadowCaching = true;
+	unsigned int shadowFrames = 0;
+	unsigned int shadowCachedFrames = 0;	// Where every cascade came from the cache
+	unsigned int shadowCacheHits = 0;		// Cascades, not frames
+	unsigned int shadowCacheMisses = 0;
+
+	// Every other light's shadows, in tiles of one big depth
+	// texture handed out each frame - see ShadowAtlas.h
+	ShadowAtlas shadowAtlas;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowAtlasDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowAtlasSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> shadowAtlasBuffer;					// SHADOW_ATLAS_MAX_TILES entries
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowAtlasBufferSRV;
+	std::vector<ShadowAtlasRequest> shadowAtlasRequests;	// One per light
+	std::vector<int> shadowAtlasFirstTiles;					// Likewise
+	std::vector<ShadowAtlasTile> shadowAtlasTiles;
+	std::vector<ShadowAtlasEntry> shadowAtlasEntries;		// Matching the tiles
+	float shadowAtlasDistance = 30.0f;	// How far into the view directional lights' tiles reach
+	int shadowAtlasLights = 0;			// Given tiles last frame
+	double shadowAtlasTime = 0.0;		// Allocating, in milliseconds
+
+	// Which lights reach each cluster of the view, so each pixel
+	// only shades those - see LightClusters.h
+	LightClusterGrid lightClusters;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightClusterBuffer;				// CLUSTER_COUNT entries
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightClusterSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightIndexBuffer;					// Grown as needed
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightIndexSRV;
+	unsigned int lightIndexCapacity = 0;
+	bool clusteredLighting = true;
+	double lightClusterTime = 0.0;		// Binning, in milliseconds
 
 	// Post Processing
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> ppSampler;
@@ -86,5 +162,8 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ppSRV;
 
 	float blurRadius = 0.0f;
+
+	// How far off (in pixels) a simplified mesh LOD can be
+	float lodPixelError = 1.0f;
 };
 
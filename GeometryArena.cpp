@@ -0,0 +1,172 @@
+#include "GeometryArena.h"
+
+GeometryArena::GeometryArena(Microsoft::WRL::ComPtr<ID3D11Device> device) :
+	device(device),
+	boundVertexBuffer(0),
+	boundIndexBuffer(0),
+	hasUploads(false)
+{
+	vertices.Allocator.Grow(GEOMETRY_ARENA_INITIAL_VERTICES);
+	vertices.BufferCapacity = 0;
+	vertices.Stride = sizeof(PackedVertex);
+	vertices.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	// Most meshes have 16-bit indices, so the 32-bit pool
+	// starts empty and only grows if something needs it
+	shortIndices.Allocator.Grow(GEOMETRY_ARENA_INITIAL_INDICES);
+	shortIndices.BufferCapacity = 0;
+	shortIndices.Stride = sizeof(unsigned short);
+	shortIndices.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+	longIndices.BufferCapacity = 0;
+	longIndices.Stride = sizeof(unsigned int);
+	longIndices.BindFlags = D3D11_BIND_INDEX_BUFFER;
+}
+
+GeometryArena::Pool& GeometryArena::GetIndexPool(unsigned int indexStride)
+{
+	return indexStride == sizeof(unsigned short) ? shortIndices : longIndices;
+}
+
+RangeAllocation GeometryArena::Allocate(Pool& pool, const void* data, unsigned int count)
+{
+	RangeAllocation allocation = { 0, 0, -1 };
+	if (count == 0)
+		return allocation;
+
+	while (!pool.Allocator.Allocate(count, allocation))
+	{
+		unsigned int capacity = pool.Allocator.GetCapacity();
+		pool.Allocator.Grow(capacity * 2 > capacity + count ? capacity * 2 : capacity + count);
+	}
+
+	Upload upload;
+	upload.Offset = allocation.Offset;
+	upload.Data.assign((const unsigned char*)data, (const unsigned char*)data + count * pool.Stride);
+	pool.Uploads.push_back(std::move(upload));
+	hasUploads = true;
+	return allocation;
+}
+
+GeometryRange GeometryArena::Add(const PackedVertex* _vertices, int numVertices,
+	const void* indices, int numIndices, unsigned int indexStride)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GeometryRange range = {};
+	range.IndexStride = indexStride;
+	range.Vertices = Allocate(vertices, _vertices, numVertices);
+	range.Indices = Allocate(GetIndexPool(indexStride), indices, numIndices);
+	return range;
+}
+
+void GeometryArena::Remove(GeometryRange& range)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	vertices.Allocator.Free(range.Vertices);
+	GetIndexPool(range.IndexStride).Allocator.Free(range.Indices);
+}
+
+void GeometryArena::FlushPool(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Pool& pool)
+{
+	// Replace a buffer that's too small, keeping what's in it
+	unsigned int capacity = pool.Allocator.GetCapacity();
+	if (pool.BufferCapacity < capacity)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.ByteWidth = capacity * pool.Stride;
+		desc.BindFlags = pool.BindFlags;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+		if (pool.Buffer)
+		{
+			D3D11_BOX box = { 0, 0, 0, pool.BufferCapacity * pool.Stride, 1, 1 };
+			context->CopySubresourceRegion(buffer.Get(), 0, 0, 0, 0, pool.Buffer.Get(), 0, &box);
+		}
+
+		pool.Buffer = buffer;
+		pool.BufferCapacity = capacity;
+	}
+
+	for (const Upload& upload : pool.Uploads)
+	{
+		D3D11_BOX box = {};
+		box.left = upload.Offset * pool.Stride;
+		box.right = box.left + (UINT)upload.Data.size();
+		box.bottom = 1;
+		box.back = 1;
+		context->UpdateSubresource(pool.Buffer.Get(), 0, &box, upload.Data.data(), 0, 0);
+	}
+	pool.Uploads.clear();
+}
+
+void GeometryArena::Flush(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	FlushPool(context, vertices);
+	FlushPool(context, shortIndices);
+	FlushPool(context, longIndices);
+	hasUploads = false;
+}
+
+void GeometryArena::Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int indexStride)
+{
+	// Normally everything was uploaded at the start of the frame,
+	// but a mesh loaded since then needs its data there before
+	// it's drawn (and buffers are only replaced on this thread,
+	// so reading them below without the lock is safe)
+	if (hasUploads)
+		Flush(context);
+
+	// Only rebind what's changed since the last call
+	Pool& indices = GetIndexPool(indexStride);
+	if (boundVertexBuffer != vertices.Buffer.Get())
+	{
+		UINT stride = sizeof(PackedVertex);
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, vertices.Buffer.GetAddressOf(), &stride, &offset);
+		boundVertexBuffer = vertices.Buffer.Get();
+	}
+	if (boundIndexBuffer != indices.Buffer.Get())
+	{
+		context->IASetIndexBuffer(indices.Buffer.Get(),
+			indexStride == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+		boundIndexBuffer = indices.Buffer.Get();
+	}
+}
+
+void GeometryArena::InvalidateBindings()
+{
+	boundVertexBuffer = 0;
+	boundIndexBuffer = 0;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetVertexBuffer()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return vertices.Buffer;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetIndexBuffer(unsigned int indexStride)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return GetIndexPool(indexStride).Buffer;
+}
+
+size_t GeometryArena::GetMemorySize()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (size_t)vertices.BufferCapacity * vertices.Stride +
+		(size_t)shortIndices.BufferCapacity * shortIndices.Stride +
+		(size_t)longIndices.BufferCapacity * longIndices.Stride;
+}
+
+size_t GeometryArena::GetUsedSize()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (size_t)vertices.Allocator.GetUsedSize() * vertices.Stride +
+		(size_t)shortIndices.Allocator.GetUsedSize() * shortIndices.Stride +
+		(size_t)longIndices.Allocator.GetUsedSize() * longIndices.Stride;
+}
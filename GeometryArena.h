@@ -0,0 +1,106 @@
+#pragma once
+#include <Windows.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "Vertex.h"
+#include "RangeAllocator.h"
+
+// Starting sizes of the shared buffers (they double when full)
+#define GEOMETRY_ARENA_INITIAL_VERTICES	(256 * 1024)
+#define GEOMETRY_ARENA_INITIAL_INDICES	(1024 * 1024)
+
+// --------------------------------------------------------
+// Where one mesh's vertices and indices live in the arena
+//
+// Indices stay relative to the mesh's first vertex, and are
+// drawn with Vertices.Offset as the base vertex, so meshes
+// with few enough vertices keep 16-bit indices
+// --------------------------------------------------------
+struct GeometryRange
+{
+	RangeAllocation Vertices;
+	RangeAllocation Indices;
+	unsigned int IndexStride;
+};
+
+// --------------------------------------------------------
+// One big vertex buffer and index buffer (per index size)
+// shared by every mesh, so drawing one mesh after another
+// doesn't need new buffers bound
+//
+// - Meshes can be added from any thread: the data is kept
+//   on the CPU until the next Flush(), which uploads it on
+//   the thread that draws, once a frame
+// - Buffers that fill up are replaced by ones twice the
+//   size, with the old contents copied across on the GPU
+// --------------------------------------------------------
+class GeometryArena
+{
+public:
+	GeometryArena(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Arenas own GPU resources, so they can't be copied
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	GeometryRange Add(const PackedVertex* vertices, int numVertices,
+		const void* indices, int numIndices, unsigned int indexStride);
+	void Remove(GeometryRange& range);
+
+	// Uploads anything added since last time - call once a
+	// frame before drawing anything
+	void Flush(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Binds the buffers for the given index size if they aren't
+	// already - this doesn't lock, so only call it (and the two
+	// around it) from the thread that draws
+	void Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int indexStride);
+
+	// Call after anything else binds its own vertex or index buffers
+	void InvalidateBindings();
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer(unsigned int indexStride);
+	size_t GetMemorySize();	// Of the GPU buffers, in bytes
+	size_t GetUsedSize();	// Of that, how much meshes are using
+
+private:
+	struct Upload
+	{
+		unsigned int Offset;	// In elements
+		std::vector<unsigned char> Data;
+	};
+
+	// One buffer and the allocator for its space
+	struct Pool
+	{
+		RangeAllocator Allocator;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> Buffer;
+		unsigned int BufferCapacity;	// Can lag the allocator's until the next Flush()
+		unsigned int Stride;
+		UINT BindFlags;
+		std::vector<Upload> Uploads;
+	};
+
+	RangeAllocation Allocate(Pool& pool, const void* data, unsigned int count);
+	void FlushPool(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Pool& pool);
+	Pool& GetIndexPool(unsigned int indexStride);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// Only touched by the thread that draws
+	ID3D11Buffer* boundVertexBuffer;
+	ID3D11Buffer* boundIndexBuffer;
+
+	// Set by Add() so Bind() can catch meshes added mid-frame
+	// without taking the lock
+	std::atomic<bool> hasUploads;
+
+	std::mutex mutex;	// Guards everything below
+	Pool vertices;
+	Pool shortIndices;
+	Pool longIndices;
+};
@@ -0,0 +1,37 @@
+#include "InstanceBatch.h"
+#include "Transform.h"
+
+void BuildInstanceGroups(const DrawPacket* packets, unsigned int count,
+	Mesh* const* meshes, Material* const* materials, const int* lods,
+	std::vector<InstanceGroup>& groups)
+{
+	groups.clear();
+	unsigned int first = 0;
+	while (first < count)
+	{
+		unsigned int start = packets[first].Entity;
+		unsigned int end = first + 1;
+		while (end < count)
+		{
+			unsigned int next = packets[end].Entity;
+			if (meshes[next] != meshes[start] || lods[next] != lods[start] ||
+				(materials && materials[next] != materials[start]))
+				break;
+			end++;
+		}
+
+		groups.push_back({ first, end - first });
+		first = end;
+	}
+}
+
+void PackInstances(const DrawPacket* packets, unsigned int count,
+	Transform* transforms, InstanceData* instances)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Transform& transform = transforms[packets[i].Entity];
+		instances[i].World = transform.GetWorldMatrix();
+		instances[i].WorldInverseTranspose = transform.GetWorldInverseTransposeMatrix();
+	}
+}
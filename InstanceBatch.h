@@ -0,0 +1,52 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "RenderQueue.h"
+
+class Mesh;
+class Material;
+class Transform;
+
+// Runs of matching draws shorter than this are drawn one at
+// a time, which keeps their meshlet culling
+#define INSTANCE_MIN_COUNT	2
+
+// --------------------------------------------------------
+// What the instanced vertex shaders read per instance, as
+// the second vertex buffer (input slot 1)
+// --------------------------------------------------------
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+};
+
+// --------------------------------------------------------
+// A run of packets [First, First + Count) in a sorted queue
+// that can all be drawn by one instanced draw
+// --------------------------------------------------------
+struct InstanceGroup
+{
+	unsigned int First;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// Splits a sorted queue's packets into runs of entities
+// with the same mesh, material and LOD
+//
+// Sort keys only bring these together - IDs can wrap in
+// their bits - so the actual pointers are compared. Pass no
+// materials to ignore them (for shadows, which don't use
+// them). Packets' Entity fields index the arrays.
+// --------------------------------------------------------
+void BuildInstanceGroups(const DrawPacket* packets, unsigned int count,
+	Mesh* const* meshes, Material* const* materials, const int* lods,
+	std::vector<InstanceGroup>& groups);
+
+// --------------------------------------------------------
+// Writes each packet's entity's matrices to instances, in
+// packet order, so a group's instances start at its First
+// --------------------------------------------------------
+void PackInstances(const DrawPacket* packets, unsigned int count,
+	Transform* transforms, InstanceData* instances);
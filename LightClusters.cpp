@@ -0,0 +1,227 @@
+#include "LightClusters.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+LightClusterGrid::LightClusterGrid() :
+	depthScale(0.0f),
+	depthBias(0.0f),
+	maxClusterCount(0)
+{
+	clusters.resize(CLUSTER_COUNT);
+}
+
+void LightClusterGrid::Build(const Light* lights, int lightCount,
+	const XMFLOAT4X4& view, const XMFLOAT4X4& projection,
+	float nearClip, float farClip)
+{
+	// Slice k starts at minDepth * (farClip / minDepth)^(k / CLUSTER_Z)
+	float minDepth = fmaxf(nearClip, CLUSTER_MIN_DEPTH);
+	depthScale = CLUSTER_Z / logf(fmaxf(farClip, minDepth * 2.0f) / minDepth);
+	depthBias = -logf(minDepth) * depthScale;
+	sliceDepths[0] = 0.0f;
+	for (int k = 1; k < CLUSTER_Z; k++)
+		sliceDepths[k] = expf((k - depthBias) / depthScale);
+	sliceDepths[CLUSTER_Z] = FLT_MAX;
+
+	// _11 and _22 are the cotangents of half the view's width
+	// and height, so edge i is where x / z reaches its share
+	// of the tangent - normals point right and up
+	float tanX = 1.0f / projection._11;
+	float tanY = 1.0f / projection._22;
+	for (int i = 0; i <= CLUSTER_X; i++)
+	{
+		float slope = (-1.0f + 2.0f * i / CLUSTER_X) * tanX;
+		float length = sqrtf(1.0f + slope * slope);
+		edgesX[i][0] = 1.0f / length;
+		edgesX[i][1] = -slope / length;
+	}
+	for (int j = 0; j <= CLUSTER_Y; j++)
+	{
+		float slope = (1.0f - 2.0f * j / CLUSTER_Y) * tanY;
+		float length = sqrtf(1.0f + slope * slope);
+		edgesY[j][0] = 1.0f / length;
+		edgesY[j][1] = -slope / length;
+	}
+
+	// Lights without a range light everything
+	globals.clear();
+	for (int i = 0; i < lightCount; i++)
+	{
+		if (lights[i].Type != LIGHT_TYPE_POINT && lights[i].Type != LIGHT_TYPE_SPOT)
+			globals.push_back((unsigned int)i);
+	}
+
+	// Each light's sphere in view space, and the slices it spans -
+	// if it's in view at all
+	bounds.resize(lightCount);
+	int rangeCount = GetRangeCount(lightCount, CLUSTER_MIN_THREAD_LIGHTS);
+	ParallelFor(lightCount, rangeCount, [&](int, int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			const Light& light = lights[i];
+			LightBounds& b = bounds[i];
+			b.FirstSlice = CLUSTER_Z;
+			b.LastSlice = -1;
+			if (light.Type != LIGHT_TYPE_POINT && light.Type != LIGHT_TYPE_SPOT)
+				continue;
+
+			const XMFLOAT3& p = light.Position;
+			b.X = p.x * view._11 + p.y * view._21 + p.z * view._31 + view._41;
+			b.Y = p.x * view._12 + p.y * view._22 + p.z * view._32 + view._42;
+			b.Z = p.x * view._13 + p.y * view._23 + p.z * view._33 + view._43;
+			b.Radius = light.Range;
+
+			if (b.Z + b.Radius < nearClip || b.Z - b.Radius > farClip ||
+				b.X * edgesX[0][0] + b.Z * edgesX[0][1] < -b.Radius ||
+				b.X * edgesX[CLUSTER_X][0] + b.Z * edgesX[CLUSTER_X][1] > b.Radius ||
+				b.Y * edgesY[0][0] + b.Z * edgesY[0][1] > b.Radius ||
+				b.Y * edgesY[CLUSTER_Y][0] + b.Z * edgesY[CLUSTER_Y][1] < -b.Radius)
+				continue;
+
+			b.FirstSlice = GetSlice(b.Z - b.Radius);
+			b.LastSlice = GetSlice(b.Z + b.Radius);
+		}
+	});
+
+	// Then every slice is binned on its own, into its own lists
+	int sliceRangeCount = rangeCount < CLUSTER_Z ? rangeCount : CLUSTER_Z;
+	ParallelFor(CLUSTER_Z, sliceRangeCount, [this](int, int first, int last)
+	{
+		for (int s = first; s < last; s++)
+			BinSlice(s);
+	});
+
+	// And joined up after the lights that light everything
+	indices.assign(globals.begin(), globals.end());
+	maxClusterCount = 0;
+	for (int s = 0; s < CLUSTER_Z; s++)
+	{
+		unsigned int base = (unsigned int)indices.size();
+		LightCluster* sliceClusters = &clusters[s * CLUSTER_X * CLUSTER_Y];
+		for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+		{
+			sliceClusters[c].Offset += base;
+			if (sliceClusters[c].Count > maxClusterCount)
+				maxClusterCount = sliceClusters[c].Count;
+		}
+		indices.insert(indices.end(), sliceIndices[s].begin(), sliceIndices[s].end());
+	}
+}
+
+void LightClusterGrid::BuildUnclustered(int lightCount)
+{
+	globals.resize(lightCount);
+	for (int i = 0; i < lightCount; i++)
+		globals[i] = (unsigned int)i;
+	indices = globals;
+	for (LightCluster& cluster : clusters)
+		cluster = { (unsigned int)lightCount, 0 };
+	maxClusterCount = 0;
+}
+
+const LightCluster* LightClusterGrid::GetClusters() { return clusters.data(); }
+const unsigned int* LightClusterGrid::GetIndices() { return indices.data(); }
+unsigned int LightClusterGrid::GetIndexCount() { return (unsigned int)indices.size(); }
+unsigned int LightClusterGrid::GetGlobalCount() { return (unsigned int)globals.size(); }
+unsigned int LightClusterGrid::GetMaxClusterCount() { return maxClusterCount; }
+
+XMFLOAT2 LightClusterGrid::GetDepthScaleBias()
+{
+	return XMFLOAT2(depthScale, depthBias);
+}
+
+// The same as the pixel shader works it out
+int LightClusterGrid::GetSlice(float depth)
+{
+	if (depth <= 0.0f)
+		return 0;
+	int slice = (int)floorf(logf(depth) * depthScale + depthBias);
+	return slice < 0 ? 0 : (slice >= CLUSTER_Z ? CLUSTER_Z - 1 : slice);
+}
+
+// --------------------------------------------------------
+// Counts the lights in each of a slice's clusters, lays
+// their lists out one after another, then fills them
+//
+// The part of a light's sphere inside the slice fits in a
+// smaller sphere, centered where the slice's nearest face
+// cuts through it, so that's what's tested against the
+// tile edges - a tile's skipped if the sphere's entirely
+// past either of its edges
+// --------------------------------------------------------
+void LightClusterGrid::BinSlice(int slice)
+{
+	std::vector<SliceLight>& found = sliceLights[slice];
+	found.clear();
+	LightCluster* sliceClusters = &clusters[slice * CLUSTER_X * CLUSTER_Y];
+	for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+		sliceClusters[c] = { 0, 0 };
+
+	float sliceNear = sliceDepths[slice];
+	float sliceFar = sliceDepths[slice + 1];
+	for (unsigned int i = 0; i < bounds.size(); i++)
+	{
+		const LightBounds& b = bounds[i];
+		if (slice < b.FirstSlice || slice > b.LastSlice)
+			continue;
+
+		float z = b.Z;
+		float radius = b.Radius;
+		if (z < sliceNear || z > sliceFar)
+		{
+			float face = z < sliceNear ? sliceNear : sliceFar;
+			float distance = face - z;
+			radius = sqrtf(fmaxf(radius * radius - distance * distance, 0.0f));
+			z = face;
+		}
+
+		SliceLight light = { i, 0, CLUSTER_X - 1, 0, CLUSTER_Y - 1 };
+		while (light.MinX <= light.MaxX &&
+			b.X * edgesX[light.MinX + 1][0] + z * edgesX[light.MinX + 1][1] > radius)
+			light.MinX++;
+		while (light.MaxX >= light.MinX &&
+			b.X * edgesX[light.MaxX][0] + z * edgesX[light.MaxX][1] < -radius)
+			light.MaxX--;
+		while (light.MinY <= light.MaxY &&
+			b.Y * edgesY[light.MinY + 1][0] + z * edgesY[light.MinY + 1][1] < -radius)
+			light.MinY++;
+		while (light.MaxY >= light.MinY &&
+			b.Y * edgesY[light.MaxY][0] + z * edgesY[light.MaxY][1] > radius)
+			light.MaxY--;
+		if (light.MinX > light.MaxX || light.MinY > light.MaxY)
+			continue;
+
+		for (int y = light.MinY; y <= light.MaxY; y++)
+		{
+			for (int x = light.MinX; x <= light.MaxX; x++)
+				sliceClusters[y * CLUSTER_X + x].Count++;
+		}
+		found.push_back(light);
+	}
+
+	unsigned int offset = 0;
+	for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+	{
+		sliceClusters[c].Offset = offset;
+		offset += sliceClusters[c].Count;
+		sliceClusters[c].Count = 0;
+	}
+
+	std::vector<unsigned int>& lightIndices = sliceIndices[slice];
+	lightIndices.resize(offset);
+	for (const SliceLight& light : found)
+	{
+		for (int y = light.MinY; y <= light.MaxY; y++)
+		{
+			for (int x = light.MinX; x <= light.MaxX; x++)
+			{
+				LightCluster& cluster = sliceClusters[y * CLUSTER_X + x];
+				lightIndices[cluster.Offset + cluster.Count++] = light.Light;
+			}
+		}
+	}
+}
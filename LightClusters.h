@@ -0,0 +1,109 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+
+// Clusters across, down and into the view - must match
+// PixelShader.hlsl
+#define CLUSTER_X			16
+#define CLUSTER_Y			9
+#define CLUSTER_Z			24
+#define CLUSTER_COUNT		(CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Depth slices are spaced logarithmically from here (or the
+// near plane, if it's further) to the far plane - anything
+// nearer goes in the first slice, so a tiny near plane
+// doesn't spend most of the slices right by the camera
+#define CLUSTER_MIN_DEPTH	0.1f
+
+// Fewest lights worth giving their own thread
+#define CLUSTER_MIN_THREAD_LIGHTS	256
+
+// --------------------------------------------------------
+// Where one cluster's lights are in the index list - must
+// match the uint2 the pixel shader reads
+// --------------------------------------------------------
+struct LightCluster
+{
+	unsigned int Offset;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// Bins lights into a grid of clusters (froxels) dividing
+// the camera's view, so each pixel only shades the lights
+// that can reach its cluster
+//
+// - Clusters are numbered x first, then y (top row first),
+//   then depth slice
+// - Lights with a range (point and spot) are binned by
+//   their range's sphere - first by the slices it spans,
+//   then, in each slice, by the tiles that the part of it
+//   in that slice can touch
+// - Lights without one (directional) light every cluster,
+//   so they go at the front of the index list instead, and
+//   every pixel shades those first
+// - Building works out each light's bounds, then bins it
+//   slice by slice, both spread over several threads
+// --------------------------------------------------------
+class LightClusterGrid
+{
+public:
+	LightClusterGrid();
+
+	void Build(const Light* lights, int lightCount,
+		const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+		float nearClip, float farClip);
+
+	// Every light in the front of the list, and none in any
+	// cluster - the same as shading them all everywhere
+	void BuildUnclustered(int lightCount);
+
+	const LightCluster* GetClusters();		// CLUSTER_COUNT of them
+	const unsigned int* GetIndices();
+	unsigned int GetIndexCount();
+	unsigned int GetGlobalCount();			// Lights at the front, lighting everything
+	unsigned int GetMaxClusterCount();		// Most lights in one cluster
+
+	// A view depth's slice is log(depth) * x + y, rounded
+	// down and clamped to the slices
+	DirectX::XMFLOAT2 GetDepthScaleBias();
+
+private:
+	// A light's sphere in view space, and the slices it spans
+	struct LightBounds
+	{
+		float X, Y, Z;
+		float Radius;
+		int FirstSlice;		// Past the last slice if it's out of view
+		int LastSlice;
+	};
+
+	// A light and the tiles it touches in one slice
+	struct SliceLight
+	{
+		unsigned int Light;
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	int GetSlice(float depth);
+	void BinSlice(int slice);
+
+	float depthScale;
+	float depthBias;
+	float sliceDepths[CLUSTER_Z + 1];		// Between the slices - the first is 0 and the last "infinite"
+
+	// Tile edges as planes through the eye, by their normal's
+	// x (or y) and z - a point's signed distance is
+	// x * Normal + z * NormalZ (or the same with y)
+	float edgesX[CLUSTER_X + 1][2];
+	float edgesY[CLUSTER_Y + 1][2];
+
+	std::vector<LightBounds> bounds;
+	std::vector<SliceLight> sliceLights[CLUSTER_Z];		// Each filled by whichever thread bins it
+	std::vector<unsigned int> sliceIndices[CLUSTER_Z];	// Likewise
+	std::vector<unsigned int> globals;
+	std::vector<LightCluster> clusters;
+	std::vector<unsigned int> indices;
+	unsigned int maxClusterCount;
+};
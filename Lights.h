@@ -15,5 +15,6 @@ struct Light
 	float Intensity;
 	DirectX::XMFLOAT3 Color;
 	float SpotFalloff;
-	DirectX::XMFLOAT3 Padding;
+	int ShadowTile;				// First of its tiles in the shadow atlas, or -1
+	DirectX::XMFLOAT2 Padding;
 };
\ No newline at end of file
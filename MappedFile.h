@@ -0,0 +1,31 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+
+// --------------------------------------------------------
+// Read-only memory mapping of an entire file
+//
+// The contents stay mapped (and valid) for the lifetime
+// of this object, so nothing has to be copied into a
+// separate buffer before parsing it
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile(const std::wstring& path);
+	~MappedFile();
+
+	// Mappings own OS handles, so they can't be copied
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool IsValid();
+	const char* GetData();
+	size_t GetSize();
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	size_t size;
+};
@@ -1,4 +1,8 @@
 #include "Material.h"
+#include <map>
+
+static unsigned int nextMaterialId = 0;
+static std::map<std::pair<void*, void*>, unsigned int> shaderIds;
 
 Material::Material(DirectX::XMFLOAT3 colorTint,
     std::shared_ptr<SimpleVertexShader> vs,
@@ -9,6 +13,8 @@ Material::Material(DirectX::XMFLOAT3 colorTint,
     ps(ps),
     roughness(roughness)
 {
+    id = nextMaterialId++;
+    UpdateShaderId();
 }
 
 Material::~Material()
@@ -33,6 +39,7 @@ std::shared_ptr<SimpleVertexShader> Material::GetVertexShader()
 void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> _vs)
 {
     vs = _vs;
+    UpdateShaderId();
 }
 
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader()
@@ -43,6 +50,17 @@ std::shared_ptr<SimplePixelShader> Material::GetPixelShader()
 void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> _ps)
 {
     ps = _ps;
+    UpdateShaderId();
+}
+
+std::shared_ptr<SimpleVertexShader> Material::GetInstancedVertexShader()
+{
+    return instancedVS;
+}
+
+void Material::SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> _instancedVS)
+{
+    instancedVS = _instancedVS;
 }
 
 
@@ -72,3 +90,19 @@ void Material::SetRoughness(float _roughness)
 {
     roughness = _roughness;
 }
+
+unsigned int Material::GetId()
+{
+    return id;
+}
+
+unsigned int Material::GetShaderId()
+{
+    return shaderId;
+}
+
+void Material::UpdateShaderId()
+{
+    auto found = shaderIds.insert({ { vs.get(), ps.get() }, (unsigned int)shaderIds.size() }).first;
+    shaderId = found->second;
+}
@@ -24,6 +24,12 @@ public:
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> _ps);
 
+	// A version of the vertex shader that reads each entity's
+	// matrices from an instance buffer (see InstanceBatch.h) -
+	// materials without one are never drawn instanced
+	std::shared_ptr<SimpleVertexShader> GetInstancedVertexShader();
+	void SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> _instancedVS);
+
 
 	void AddTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddSampler(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
@@ -32,9 +38,19 @@ public:
 	float GetRoughness();
 	void SetRoughness(float _roughness);
 
+	// For sorting draws - materials with the same pair of
+	// shaders share a shader ID
+	unsigned int GetId();
+	unsigned int GetShaderId();
+
 private:
+	void UpdateShaderId();
+
+	unsigned int id;
+	unsigned int shaderId;
 	DirectX::XMFLOAT3 colorTint;
 	std::shared_ptr<SimpleVertexShader> vs;
+	std::shared_ptr<SimpleVertexShader> instancedVS;
 	std::shared_ptr<SimplePixelShader> ps;
 	float roughness;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
@@ -1,376 +1,271 @@
 #include "Mesh.h"
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "TangentSpace.h"
 #include <vector>
-#include <fstream>
+#include <chrono>
+#include <atomic>
 
 using namespace DirectX;
 
+// Meshes can be loaded on several threads at once
+static std::atomic<unsigned int> nextMeshId(0);
 
 
 Mesh::Mesh(Vertex* _vertices,
-	int numOfVertices,
+	int _numOfVertices,
 	unsigned int* _indices,
 	int _numOfIndices,
-	Microsoft::WRL::ComPtr<ID3D11Device> _device)
+	std::shared_ptr<GeometryArena> _arena)
 {
+	arena = _arena;
+	geometry = {};
+	id = nextMeshId++;
+	sourceHash = 0;
 	numOfIndices = _numOfIndices;
+	boundsMin = XMFLOAT3(0, 0, 0);
+	boundsMax = XMFLOAT3(0, 0, 0);
+	uvMin = XMFLOAT2(0, 0);
+	uvMax = XMFLOAT2(0, 0);
+
+	CalculateBounds(_vertices, _numOfVertices);
+
+	std::vector<PackedVertex> packedVerts;
+	std::vector<unsigned char> packedIndices;
+	PackMesh(_vertices, _numOfVertices, _indices, _numOfIndices,
+		boundsMin, boundsMax, uvMin, uvMax, packedVerts, packedIndices);
+	AddGeometry(packedVerts.data(), _numOfVertices,
+		packedIndices.data(), _numOfIndices, GetIndexStride(_numOfVertices));
+
+	// Hand made meshes are drawn as they are
+	lods.push_back({ 0, (unsigned int)_numOfIndices, 0.0f });
+}
 
-	CreateBuffers(_vertices, numOfVertices, _indices, _numOfIndices, _device);
+Mesh::Mesh(const std::wstring& objFile, std::shared_ptr<GeometryArena> _arena)
+{
+	arena = _arena;
+	LoadObj(objFile, 0);
 }
 
-Mesh::Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+Mesh::Mesh(const std::wstring& objFile, unsigned long long _sourceHash, std::shared_ptr<GeometryArena> _arena)
 {
-	// Author: Chris Cascioli
-	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
-	// 
-	// - You are allowed to directly copy/paste this into your code base
-	//   for assignments, given that you clearly cite that this is not
-	//   code of your own design.
-	//
-	// - NOTE: You'll need to #include <fstream>
+	arena = _arena;
+	LoadObj(objFile, &_sourceHash);
+}
 
+// --------------------------------------------------------
+// Loads an .obj file, from its cache if that was built from
+// a file with the given hash (worked out here if it's null)
+// --------------------------------------------------------
+void Mesh::LoadObj(const std::wstring& objFile, const unsigned long long* knownHash)
+{
+	geometry = {};
+	id = nextMeshId++;
+	sourceHash = 0;
 	numOfIndices = 0;
+	numOfVertices = 0;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	boundsMin = XMFLOAT3(0, 0, 0);
+	boundsMax = XMFLOAT3(0, 0, 0);
+	uvMin = XMFLOAT2(0, 0);
+	uvMax = XMFLOAT2(0, 0);
 
+	auto loadStart = std::chrono::high_resolution_clock::now();
 
-	// File input object
-	std::ifstream obj(objFile);
-
-	// Check for successful open
-	if (!obj.is_open())
+	MappedFile source(objFile);
+	if (!source.IsValid())
 		return;
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	int vertCounter = 0;			// Count of vertices
-	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
-
-	// Still have data left?
-	while (obj.good())
+	// The cache is only valid if it was built from this exact file
+	sourceHash = knownHash ? *knownHash : HashMeshSource(source.GetData(), source.GetSize());
+	cacheFile = GetMeshCachePath(objFile);
+	bool fromCache = LoadFromCache();
+	if (!fromCache)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
-
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
+		// Parse the file into welded vertices and indices
+		// - See ObjLoader.cpp for the details
+		std::vector<Vertex> verts;
+		std::vector<UINT> indices;
+		ParseObjData(source.GetData(), source.GetSize(), verts, indices);
+		if (verts.empty() || indices.empty())
+			return;
+
+		int vertCounter = (int)verts.size();
+		int indexCounter = (int)indices.size();
+
+		// Reorder triangles for the post-transform vertex cache and
+		// overdraw, then vertices for fetch locality
+		// - See MeshOptimizer.cpp for the details
+#if defined(DEBUG) || defined(_DEBUG)
+		VertexCacheStats statsBefore = AnalyzeVertexCache(&indices[0], indexCounter, vertCounter);
+#endif
+		std::vector<int> clusterStarts(indexCounter / 3 + 1);
+		int clusterCount = OptimizeVertexCache(&indices[0], indexCounter, vertCounter, &clusterStarts[0]);
+		VertexCacheStats statsCache = AnalyzeVertexCache(&indices[0], indexCounter, vertCounter);
+		OptimizeOverdraw(&indices[0], indexCounter, &verts[0], vertCounter,
+			&clusterStarts[0], clusterCount, statsCache.ACMR * 1.05f);
+
+		// Split the full detail triangles into meshlets for culling
+		// - See Meshlet.cpp for the details
+		if (indexCounter / 3 >= MESHLET_MIN_MESH_TRIANGLES)
+			BuildMeshlets(&indices[0], indexCounter, &verts[0], vertCounter, meshlets);
+
+		// Simplified LODs go after the full detail triangles, sharing
+		// the vertices, so the fetch order has to account for all of them
+		// - See MeshLod.cpp and MeshSimplifier.cpp for the details
+		BuildMeshLods(indices, &verts[0], vertCounter, lods);
+		int allIndexCounter = (int)indices.size();
+		OptimizeVertexFetch(&verts[0], vertCounter, &indices[0], allIndexCounter);
+
+#if defined(DEBUG) || defined(_DEBUG)
+		VertexCacheStats statsAfter = AnalyzeVertexCache(&indices[0], indexCounter, vertCounter);
+		printf("Optimized %ls: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+			objFile.c_str(), statsBefore.ACMR, statsAfter.ACMR, statsBefore.ATVR, statsAfter.ATVR);
+#endif
+
+		// LODs only drop triangles, so the full detail ones are
+		// all the tangents need
+		// - See TangentSpace.cpp for the details
+		CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
+		CalculateBounds(&verts[0], vertCounter);
+
+		// Compress for the GPU - see VertexPacking.h
+		std::vector<PackedVertex> packedVerts;
+		std::vector<unsigned char> packedIndices;
+		PackMesh(&verts[0], vertCounter, &indices[0], allIndexCounter,
+			boundsMin, boundsMax, uvMin, uvMax, packedVerts, packedIndices);
+		unsigned int indexStride = GetIndexStride(vertCounter);
+		AddGeometry(packedVerts.data(), vertCounter, packedIndices.data(), allIndexCounter, indexStride);
+
+		// Save the results so the next run can skip all of the above
+		// (the stale cache's mapping is already closed, so it can be replaced)
+		bool cacheWritten = WriteMeshCache(cacheFile, sourceHash,
+			packedVerts.data(), vertCounter,
+			packedIndices.data(), allIndexCounter, indexStride, lods, meshlets,
+			boundsMin, boundsMax, uvMin, uvMax);
+		if (!cacheWritten)
 		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
-			}
-
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-			}
+			// Nothing to read back later, so hang on to them instead
+			packedVertices = std::move(packedVerts);
+			this->packedIndices = std::move(packedIndices);
+			cacheFile.clear();
+#if defined(DEBUG) || defined(_DEBUG)
+			printf("Failed to write mesh cache for %ls\n", objFile.c_str());
+#endif
 		}
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
-
-	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
-	CreateBuffers(&verts[0], vertCounter, &indices[0], indexCounter, device);
-
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is the number of vertices
-	// - "indexCounter" is the number of indices
-	// - Yes, these are effectively the same since OBJs do not index entire vertices!  This means
-	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
-	//    and detect duplicate vertices, but at that point it would be better to use a more
-	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
+	// The index buffer holds every LOD, but the mesh's
+	// index count is just the full detail one
+	numOfIndices = lods[0].IndexCount;
+
+#if defined(DEBUG) || defined(_DEBUG)
+	double loadMs = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - loadStart).count();
+	printf("Loaded %ls%s: %d verts, %d %d-bit indices in %.2f ms\n",
+		objFile.c_str(), fromCache ? " (cached)" : "", numOfVertices, numOfIndices,
+		indexFormat == DXGI_FORMAT_R16_UINT ? 16 : 32, loadMs);
+	for (size_t i = 1; i < lods.size(); i++)
+	{
+		printf("  LOD %d: %u triangles, error %.4f\n",
+			(int)i, lods[i].IndexCount / 3, lods[i].Error);
+	}
+	if (!meshlets.empty())
+		printf("  %d meshlets\n", (int)meshlets.size());
+#endif
 }
 
-void Mesh::CreateBuffers(Vertex* _vertices, int numOfVertices, unsigned int* _indices, int _numOfIndices, Microsoft::WRL::ComPtr<ID3D11Device> _device)
+// --------------------------------------------------------
+// Loads the mesh from its cache file if that's valid for
+// the source hash - the file's only mapped in here, so
+// it's closed again before a stale cache gets rewritten
+// --------------------------------------------------------
+bool Mesh::LoadFromCache()
 {
-	// Create Vertex buffer
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * numOfVertices;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = _vertices;
-	_device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-	
-	// Create Index buffer
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * _numOfIndices;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = _indices;
-	_device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
+	MappedFile cache(cacheFile);
+	const MeshCacheHeader* header = ValidateMeshCache(cache.GetData(), cache.GetSize(), sourceHash);
+	if (!header)
+		return false;
+
+	// The blobs are already laid out exactly like the GPU buffers,
+	// so they go straight from the mapped file to the arena
+	const PackedVertex* verts = (const PackedVertex*)(header + 1);
+	const void* indices = verts + header->VertexCount;
+	boundsMin = header->BoundsMin;
+	boundsMax = header->BoundsMax;
+	uvMin = header->UVMin;
+	uvMax = header->UVMax;
+	ReadMeshCacheLods(header, lods);
+	ReadMeshCacheMeshlets(header, meshlets);
+
+	AddGeometry(verts, header->VertexCount, indices, header->IndexCount, header->IndexStride);
+	return true;
+}
+
+void Mesh::AddGeometry(const PackedVertex* _vertices, int _numOfVertices, const void* _indices, int _numOfIndices, unsigned int _indexStride)
+{
+	// The mesh just gets ranges of the arena's shared buffers
+	// - See GeometryArena.h for the details
+	geometry = arena->Add(_vertices, _numOfVertices, _indices, _numOfIndices, _indexStride);
 
 	numOfIndices = _numOfIndices;
+	numOfVertices = _numOfVertices;
+	indexFormat = _indexStride == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 }
 
-// --------------------------------------------------------
-// Author: Chris Cascioli
-// Purpose: Calculates the tangents of the vertices in a mesh
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - Code originally adapted from: http://www.terathon.com/code/tangent.html
-//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
-//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
-//
-// - Note: For this code to work, your Vertex format must
-//         contain an XMFLOAT3 called Tangent
-//
-// - Be sure to call this BEFORE creating your D3D vertex/index buffers
-// --------------------------------------------------------
-void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+void Mesh::CalculateBounds(const Vertex* verts, int numVerts)
 {
-	// Reset tangents
-	for (int i = 0; i < numVerts; i++)
-	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
-	}
-
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
-	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
-
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
-
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
-
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
-
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
-
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
-
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
-
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
-
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
-	}
+	if (numVerts <= 0)
+		return;
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
+	XMVECTOR minPos = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxPos = minPos;
+	XMVECTOR minUV = XMLoadFloat2(&verts[0].UV);
+	XMVECTOR maxUV = minUV;
+	for (int i = 1; i < numVerts; i++)
 	{
-		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
-
-		// Use Gram-Schmidt orthonormalize to ensure
-		// the normal and tangent are exactly 90 degrees apart
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+		XMVECTOR pos = XMLoadFloat3(&verts[i].Position);
+		minPos = XMVectorMin(minPos, pos);
+		maxPos = XMVectorMax(maxPos, pos);
 
-		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+		XMVECTOR uv = XMLoadFloat2(&verts[i].UV);
+		minUV = XMVectorMin(minUV, uv);
+		maxUV = XMVectorMax(maxUV, uv);
 	}
+
+	XMStoreFloat3(&boundsMin, minPos);
+	XMStoreFloat3(&boundsMax, maxPos);
+	XMStoreFloat2(&uvMin, minUV);
+	XMStoreFloat2(&uvMax, maxUV);
 }
 
 Mesh::~Mesh()
 {
+	if (arena)
+		arena->Remove(geometry);
 }
 
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer()
 {
-	return vertexBuffer;
+	return arena->GetVertexBuffer();
 }
 
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
 {
-	return indexBuffer;
+	return arena->GetIndexBuffer(geometry.IndexStride);
+}
+
+unsigned int Mesh::GetBaseVertex()
+{
+	return geometry.Vertices.Offset;
+}
+
+unsigned int Mesh::GetFirstIndex()
+{
+	return geometry.Indices.Offset;
 }
 
 int Mesh::GetIndexCount()
@@ -378,27 +273,176 @@ int Mesh::GetIndexCount()
 	return numOfIndices;
 }
 
-void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+int Mesh::GetVertexCount()
+{
+	return numOfVertices;
+}
+
+size_t Mesh::GetMemorySize()
 {
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	// Set buffers in the input assembler (IA) stage
-	//  - Do this ONCE PER OBJECT, since each object may have different geometry
-	//  - For this demo, this step *could* simply be done once during Init()
-	//  - However, this needs to be done between EACH DrawIndexed() call
-	//     when drawing different geometry, so it's here as an example
-	context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	return (size_t)geometry.Vertices.Size * sizeof(PackedVertex) +
+		(size_t)geometry.Indices.Size * geometry.IndexStride;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundsMin()
+{
+	return boundsMin;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundsMax()
+{
+	return boundsMax;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundingSphereCenter()
+{
+	return XMFLOAT3(
+		(boundsMin.x + boundsMax.x) * 0.5f,
+		(boundsMin.y + boundsMax.y) * 0.5f,
+		(boundsMin.z + boundsMax.z) * 0.5f);
+}
+
+float Mesh::GetBoundingSphereRadius()
+{
+	// Half the diagonal of the bounds, so it holds the whole box
+	XMVECTOR extent = XMLoadFloat3(&boundsMax) - XMLoadFloat3(&boundsMin);
+	return XMVectorGetX(XMVector3Length(extent)) * 0.5f;
+}
+
+unsigned int Mesh::GetId()
+{
+	return id;
+}
+
+const std::vector<MeshLod>& Mesh::GetLods()
+{
+	return lods;
+}
+
+const std::vector<Meshlet>& Mesh::GetMeshlets()
+{
+	return meshlets;
+}
+
+void Mesh::GetGeometry(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+	if (lods.empty())
+		return;
+
+	if (!packedVertices.empty())
+	{
+		UnpackGeometry(packedVertices.data(), packedIndices.data(), verts, indices);
+		return;
+	}
+
+	// Only mapped for as long as it takes to unpack, and skipped
+	// if the cache has been replaced since the mesh was loaded
+	MappedFile cache(cacheFile);
+	const MeshCacheHeader* header = ValidateMeshCache(cache.GetData(), cache.GetSize(), sourceHash);
+	if (!header || header->VertexCount != (unsigned int)numOfVertices)
+		return;
+
+	const PackedVertex* cachedVerts = (const PackedVertex*)(header + 1);
+	UnpackGeometry(cachedVerts, cachedVerts + header->VertexCount, verts, indices);
+}
+
+void Mesh::UnpackGeometry(const PackedVertex* packedVerts, const void* packedIndices,
+	std::vector<Vertex>& unpackedVerts, std::vector<unsigned int>& unpackedIndices)
+{
+	unpackedVerts.resize(numOfVertices);
+	UnpackVertices(packedVerts, numOfVertices,
+		boundsMin, boundsMax, uvMin, uvMax, unpackedVerts.data());
+
+	// Just the full detail LOD, at whichever size they're stored
+	unpackedIndices.resize(lods[0].IndexCount);
+	for (unsigned int i = 0; i < lods[0].IndexCount; i++)
+	{
+		unsigned int index = lods[0].FirstIndex + i;
+		unpackedIndices[i] = indexFormat == DXGI_FORMAT_R16_UINT ?
+			((const unsigned short*)packedIndices)[index] :
+			((const unsigned int*)packedIndices)[index];
+	}
+}
+
+DirectX::XMFLOAT3 Mesh::GetPositionOffset()
+{
+	return boundsMin;
+}
+
+DirectX::XMFLOAT3 Mesh::GetPositionScale()
+{
+	return XMFLOAT3(
+		boundsMax.x - boundsMin.x,
+		boundsMax.y - boundsMin.y,
+		boundsMax.z - boundsMin.z);
+}
+
+DirectX::XMFLOAT2 Mesh::GetUVOffset()
+{
+	return uvMin;
+}
+
+DirectX::XMFLOAT2 Mesh::GetUVScale()
+{
+	return XMFLOAT2(uvMax.x - uvMin.x, uvMax.y - uvMin.y);
+}
+
+int Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int lod, const MeshletCullData* cull)
+{
+	// Nothing loaded
+	if (lods.empty())
+		return 0;
+
+	// Every LOD is a range of the same index buffer, and so is each
+	// meshlet of the full detail one - culled meshlets just leave gaps
+	visibleRanges.clear();
+	int drawnIndices = 0;
+	if (cull && lod == 0 && !meshlets.empty())
+		drawnIndices = CullMeshlets(meshlets.data(), (int)meshlets.size(), *cull, visibleRanges);
+	else
+	{
+		visibleRanges.push_back({ lods[lod].FirstIndex, lods[lod].IndexCount });
+		drawnIndices = lods[lod].IndexCount;
+	}
+
+	if (visibleRanges.empty())
+		return 0;
+
+	// Every mesh shares the arena's buffers, so this only
+	// binds anything if the last mesh drawn used other ones
+	arena->Bind(context, geometry.IndexStride);
 
 	// Tell Direct3D to draw
 	//  - Begins the rendering pipeline on the GPU
-	//  - Do this ONCE PER OBJECT you intend to draw
 	//  - This will use all currently set Direct3D resources (shaders, buffers, etc)
 	//  - DrawIndexed() uses the currently set INDEX BUFFER to look up corresponding
 	//     vertices in the currently set VERTEX BUFFER
-	context->DrawIndexed(
-		GetIndexCount(),     // The number of indices to use (we could draw a subset if we wanted)
-		0,     // Offset to the first index we want to use
-		0);    // Offset to add to each index when looking up vertices
-	
+	for (const IndexRange& range : visibleRanges)
+	{
+		context->DrawIndexed(
+			range.IndexCount,     // The number of indices to use (just this range's)
+			geometry.Indices.Offset + range.FirstIndex,     // Offset to the range's first index in the arena
+			geometry.Vertices.Offset);    // Offset to add to each index, since they start at the mesh's first vertex
+	}
+
+	return drawnIndices / 3;
+}
+
+int Mesh::DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int lod,
+	unsigned int instanceCount, unsigned int firstInstance)
+{
+	if (lods.empty() || instanceCount == 0)
+		return 0;
+
+	arena->Bind(context, geometry.IndexStride);
+	context->DrawIndexedInstanced(
+		lods[lod].IndexCount,
+		instanceCount,
+		geometry.Indices.Offset + lods[lod].FirstIndex,
+		geometry.Vertices.Offset,
+		firstInstance);
+
+	return lods[lod].IndexCount / 3;
 }
@@ -3,35 +3,104 @@
 #include <d3d11.h>
 #include <wrl/client.h>
 #include "Vertex.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+#include "GeometryArena.h"
 #include "DXCore.h"
 #include <memory>
+#include <vector>
 class Mesh
 {
 	private:
-		Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+		std::shared_ptr<GeometryArena> arena;
+		GeometryRange geometry;		// This mesh's part of the arena
+		unsigned int id;			// Unique to this mesh, for sorting draws
 		int numOfIndices;
+		int numOfVertices;
+		DXGI_FORMAT indexFormat;
+		DirectX::XMFLOAT3 boundsMin;
+		DirectX::XMFLOAT3 boundsMax;
+		DirectX::XMFLOAT2 uvMin;
+		DirectX::XMFLOAT2 uvMax;
+		std::vector<MeshLod> lods;
+		std::vector<Meshlet> meshlets;
+		std::vector<IndexRange> visibleRanges;	// Reused by every culled draw
 
-		void CreateBuffers(Vertex* _vertices,
-			int numOfVertices,
-			unsigned int* _indices,
+		// Where GetGeometry reads the packed buffers back from, so
+		// loaded meshes don't keep a CPU copy of them around
+		std::wstring cacheFile;
+		unsigned long long sourceHash;
+
+		// CPU copies, only kept when the cache couldn't be written
+		std::vector<PackedVertex> packedVertices;
+		std::vector<unsigned char> packedIndices;
+
+		void AddGeometry(const PackedVertex* _vertices,
+			int _numOfVertices,
+			const void* _indices,
 			int _numOfIndices,
-			Microsoft::WRL::ComPtr<ID3D11Device> _device);
+			unsigned int _indexStride);
 
-		void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+		void LoadObj(const std::wstring& objFile, const unsigned long long* knownHash);
+		void CalculateBounds(const Vertex* verts, int numVerts);
+		bool LoadFromCache();
+		void UnpackGeometry(const PackedVertex* verts, const void* indices,
+			std::vector<Vertex>& unpackedVerts, std::vector<unsigned int>& unpackedIndices);
 
 	public:
 		Mesh(Vertex* _vertices,
-			int numOfVertices,
+			int _numOfVertices,
 			unsigned int* _indices,
 			int _numOfIndices,
-			Microsoft::WRL::ComPtr<ID3D11Device> _device);
-		Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+			std::shared_ptr<GeometryArena> _arena);
+		Mesh(const std::wstring& objFile, std::shared_ptr<GeometryArena> _arena);
+
+		// For callers that already hashed the file's contents (with
+		// HashMeshSource), so it isn't read through a second time
+		Mesh(const std::wstring& objFile, unsigned long long _sourceHash, std::shared_ptr<GeometryArena> _arena);
 		~Mesh();
 
+		// Meshes own part of the arena, so they can't be copied
+		Mesh(const Mesh&) = delete;
+		Mesh& operator=(const Mesh&) = delete;
+
 		Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 		Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
-		int GetIndexCount();
-		void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+		unsigned int GetBaseVertex();	// Where the mesh starts in those buffers
+		unsigned int GetFirstIndex();
+		unsigned int GetId();
+		int GetIndexCount();	// Of the full detail LOD
+		int GetVertexCount();
+		size_t GetMemorySize();	// Of its part of the arena, in bytes
+		DirectX::XMFLOAT3 GetBoundsMin();
+		DirectX::XMFLOAT3 GetBoundsMax();
+		DirectX::XMFLOAT3 GetBoundingSphereCenter();
+		float GetBoundingSphereRadius();
+		const std::vector<MeshLod>& GetLods();
+
+		// Packed positions and UVs decode as offset + value * scale
+		DirectX::XMFLOAT3 GetPositionOffset();
+		DirectX::XMFLOAT3 GetPositionScale();
+		DirectX::XMFLOAT2 GetUVOffset();
+		DirectX::XMFLOAT2 GetUVScale();
+
+		const std::vector<Meshlet>& GetMeshlets();
+
+		// Unpacks the full detail LOD's vertices and indices, reading
+		// them back from the mesh's cache file (so it's only for meshes
+		// loaded from .obj files - others come back empty)
+		void GetGeometry(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+		// Draws one LOD, culling the full detail one's meshlets if
+		// given cull data, and returns how many triangles were sent
+		int Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int lod = 0,
+			const MeshletCullData* cull = 0);
+
+		// Draws one LOD once per instance, reading instances from
+		// firstInstance on in whatever's bound to input slot 1, and
+		// returns how many triangles each one sent (no meshlets are
+		// culled, as they'd differ per instance)
+		int DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int lod,
+			unsigned int instanceCount, unsigned int firstInstance);
 };
 
@@ -0,0 +1,118 @@
+#include "MeshCache.h"
+#include <cstring>
+
+unsigned long long HashMeshSource(const char* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+
+	// Fold the size in too, so a truncated file can't collide trivially
+	hash ^= (unsigned long long)size;
+	hash *= 1099511628211ull;
+	return hash;
+}
+
+std::wstring GetMeshCachePath(const std::wstring& objFile)
+{
+	return objFile + L".meshcache";
+}
+
+const MeshCacheHeader* ValidateMeshCache(const char* data, size_t size, unsigned long long sourceHash)
+{
+	if (!data || size < sizeof(MeshCacheHeader))
+		return 0;
+
+	const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+	if (header->Magic != MESH_CACHE_MAGIC ||
+		header->Version != MESH_CACHE_VERSION ||
+		header->VertexStride != sizeof(PackedVertex) ||
+		(header->IndexStride != sizeof(unsigned short) && header->IndexStride != sizeof(unsigned int)) ||
+		header->LodCount == 0 || header->LodCount > MAX_MESH_LODS ||
+		header->SourceHash != sourceHash)
+		return 0;
+
+	// Make sure the blobs are actually all there
+	size_t expectedSize = sizeof(MeshCacheHeader) +
+		(size_t)header->VertexCount * sizeof(PackedVertex) +
+		(size_t)header->IndexCount * header->IndexStride +
+		(size_t)header->LodCount * sizeof(MeshLod) +
+		(size_t)header->MeshletCount * sizeof(Meshlet);
+	if (size != expectedSize)
+		return 0;
+
+	// Every LOD has to stay inside the index buffer
+	std::vector<MeshLod> lods;
+	ReadMeshCacheLods(header, lods);
+	for (const MeshLod& lod : lods)
+	{
+		if (lod.FirstIndex > header->IndexCount ||
+			lod.IndexCount > header->IndexCount - lod.FirstIndex)
+			return 0;
+	}
+
+	// Meshlets all belong to the full detail LOD
+	std::vector<Meshlet> meshlets;
+	ReadMeshCacheMeshlets(header, meshlets);
+	for (const Meshlet& meshlet : meshlets)
+	{
+		if (meshlet.FirstIndex > lods[0].IndexCount ||
+			meshlet.IndexCount > lods[0].IndexCount - meshlet.FirstIndex)
+			return 0;
+	}
+
+	// Every index has to stay inside the mesh's vertices - the arena
+	// offsets them into a buffer shared with other meshes, so a bad one
+	// wouldn't fault, it'd just read someone else's vertices
+	// - Last, as it's the only check that reads more than the header
+	//   and tables, so a stale or cut short cache never gets this far
+	const char* indexData = (const char*)(header + 1) +
+		(size_t)header->VertexCount * sizeof(PackedVertex);
+	unsigned int maxIndex = 0;
+	if (header->IndexStride == sizeof(unsigned short))
+	{
+		for (unsigned int i = 0; i < header->IndexCount; i++)
+		{
+			unsigned short index;
+			memcpy(&index, indexData + i * sizeof(unsigned short), sizeof(unsigned short));
+			maxIndex = index > maxIndex ? index : maxIndex;
+		}
+	}
+	else
+	{
+		for (unsigned int i = 0; i < header->IndexCount; i++)
+		{
+			unsigned int index;
+			memcpy(&index, indexData + (size_t)i * sizeof(unsigned int), sizeof(unsigned int));
+			maxIndex = index > maxIndex ? index : maxIndex;
+		}
+	}
+	if (header->IndexCount > 0 && maxIndex >= header->VertexCount)
+		return 0;
+
+	return header;
+}
+
+void ReadMeshCacheLods(const MeshCacheHeader* header, std::vector<MeshLod>& lods)
+{
+	const char* table = (const char*)(header + 1) +
+		(size_t)header->VertexCount * sizeof(PackedVertex) +
+		(size_t)header->IndexCount * header->IndexStride;
+
+	lods.resize(header->LodCount);
+	memcpy(lods.data(), table, sizeof(MeshLod) * header->LodCount);
+}
+
+void ReadMeshCacheMeshlets(const MeshCacheHeader* header, std::vector<Meshlet>& meshlets)
+{
+	const char* table = (const char*)(header + 1) +
+		(size_t)header->VertexCount * sizeof(PackedVertex) +
+		(size_t)header->IndexCount * header->IndexStride +
+		(size_t)header->LodCount * sizeof(MeshLod);
+
+	meshlets.resize(header->MeshletCount);
+	memcpy(meshlets.data(), table, sizeof(Meshlet) * header->MeshletCount);
+}
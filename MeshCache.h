@@ -0,0 +1,89 @@
+#pragma once
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "Vertex.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+
+// "MESH" as little-endian characters
+#define MESH_CACHE_MAGIC	0x4853454D
+
+// Bump this whenever the layout of the header or the
+// Vertex struct changes, or meshes are processed differently
+// before being cached, so old caches get rebuilt
+// - 2: vertex cache, overdraw and vertex fetch optimization
+// - 3: packed vertices and 16-bit indices
+// - 4: LOD chain after the indices
+// - 5: meshlets after the LOD chain
+#define MESH_CACHE_VERSION	5
+
+// --------------------------------------------------------
+// Header at the start of a binary mesh cache file
+//
+// The file is laid out as:
+//  - MeshCacheHeader
+//  - VertexCount PackedVertex structs
+//  - IndexCount indices, IndexStride bytes each (every LOD)
+//  - LodCount MeshLod structs
+//  - MeshletCount Meshlet structs (for the full detail LOD)
+//
+// so both blobs can be handed straight to the GPU
+// from a memory mapping of the file
+// --------------------------------------------------------
+struct MeshCacheHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned long long SourceHash;	// Hash of the .obj file the cache was built from
+	unsigned int VertexCount;
+	unsigned int IndexCount;		// Across all LODs
+	unsigned int VertexStride;		// sizeof(PackedVertex) when the cache was written
+	DirectX::XMFLOAT3 BoundsMin;	// Local space bounds of the vertex positions,
+	DirectX::XMFLOAT3 BoundsMax;	// which the packed positions are relative to
+	DirectX::XMFLOAT2 UVMin;		// Same for the packed UVs
+	DirectX::XMFLOAT2 UVMax;
+	unsigned int IndexStride;		// 2 or 4
+	unsigned int LodCount;			// 1 to MAX_MESH_LODS
+	unsigned int MeshletCount;		// 0 for small meshes
+};
+
+// Hashes a whole source file (64-bit FNV-1a)
+unsigned long long HashMeshSource(const char* data, size_t size);
+
+// Returns the path of the cache file for a given .obj file
+std::wstring GetMeshCachePath(const std::wstring& objFile);
+
+// --------------------------------------------------------
+// Checks that a mapped cache file is complete, matches the
+// current format and was built from the given source hash
+//
+// Returns the header on success, or null if the cache
+// is missing, stale or damaged
+//
+// Reads every index to check it's in range, once the hash
+// and size match - about a millisecond per few million
+// indices (see MeshCacheTests --bench), far less than
+// hashing the source file to compare against
+// --------------------------------------------------------
+const MeshCacheHeader* ValidateMeshCache(const char* data, size_t size, unsigned long long sourceHash);
+
+// --------------------------------------------------------
+// Copy the LOD and meshlet tables out of a validated cache
+// (they may not be aligned after 16-bit indices)
+// --------------------------------------------------------
+void ReadMeshCacheLods(const MeshCacheHeader* header, std::vector<MeshLod>& lods);
+void ReadMeshCacheMeshlets(const MeshCacheHeader* header, std::vector<Meshlet>& meshlets);
+
+// Writes a cache file, returning false on failure (in
+// MeshCacheWrite.cpp, as swapping it in needs Windows)
+bool WriteMeshCache(const std::wstring& cacheFile,
+	unsigned long long sourceHash,
+	const PackedVertex* verts, int numVerts,
+	const void* indices, int numIndices, unsigned int indexStride,
+	const std::vector<MeshLod>& lods,
+	const std::vector<Meshlet>& meshlets,
+	DirectX::XMFLOAT3 boundsMin,
+	DirectX::XMFLOAT3 boundsMax,
+	DirectX::XMFLOAT2 uvMin,
+	DirectX::XMFLOAT2 uvMax);
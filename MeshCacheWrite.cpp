@@ -0,0 +1,52 @@
+#include "MeshCache.h"
+#include <Windows.h>
+#include <fstream>
+
+bool WriteMeshCache(const std::wstring& cacheFile,
+	unsigned long long sourceHash,
+	const PackedVertex* verts, int numVerts,
+	const void* indices, int numIndices, unsigned int indexStride,
+	const std::vector<MeshLod>& lods,
+	const std::vector<Meshlet>& meshlets,
+	DirectX::XMFLOAT3 boundsMin,
+	DirectX::XMFLOAT3 boundsMax,
+	DirectX::XMFLOAT2 uvMin,
+	DirectX::XMFLOAT2 uvMax)
+{
+	// Written next to the cache, then swapped in, so a failed or
+	// interrupted write never leaves a half written cache behind
+	std::wstring tempFile = cacheFile + L".tmp";
+	std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	MeshCacheHeader header = {};
+	header.Magic = MESH_CACHE_MAGIC;
+	header.Version = MESH_CACHE_VERSION;
+	header.SourceHash = sourceHash;
+	header.VertexCount = numVerts;
+	header.IndexCount = numIndices;
+	header.VertexStride = sizeof(PackedVertex);
+	header.BoundsMin = boundsMin;
+	header.BoundsMax = boundsMax;
+	header.UVMin = uvMin;
+	header.UVMax = uvMax;
+	header.IndexStride = indexStride;
+	header.LodCount = (unsigned int)lods.size();
+	header.MeshletCount = (unsigned int)meshlets.size();
+
+	file.write((const char*)&header, sizeof(MeshCacheHeader));
+	file.write((const char*)verts, sizeof(PackedVertex) * numVerts);
+	file.write((const char*)indices, (size_t)indexStride * numIndices);
+	file.write((const char*)lods.data(), sizeof(MeshLod) * lods.size());
+	file.write((const char*)meshlets.data(), sizeof(Meshlet) * meshlets.size());
+	file.close();
+
+	if (!file.good() ||
+		!MoveFileExW(tempFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
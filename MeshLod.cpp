@@ -0,0 +1,63 @@
+#include "MeshLod.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <cfloat>
+
+using namespace DirectX;
+
+void BuildMeshLods(std::vector<unsigned int>& indices,
+	const Vertex* verts, int numVerts,
+	std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	lods.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+
+	std::vector<unsigned int> lodIndices(indices.size());
+	while (lods.size() < MAX_MESH_LODS)
+	{
+		MeshLod previous = lods.back();
+		int target = (int)previous.IndexCount / 2;
+
+		// Each LOD is simplified from the last one (much quicker than
+		// starting over), so the errors add up along the chain
+		float lodError = 0.0f;
+		int count = SimplifyMesh(&lodIndices[0],
+			&indices[previous.FirstIndex], previous.IndexCount,
+			verts, numVerts,
+			target, MESH_LOD_MAX_ERROR - previous.Error, &lodError);
+
+		// Not worth an extra LOD if it barely got any simpler
+		if (count == 0 || count > (int)previous.IndexCount * 9 / 10)
+			break;
+
+		OptimizeVertexCache(&lodIndices[0], count, numVerts);
+
+		MeshLod lod = { (unsigned int)indices.size(), (unsigned int)count, previous.Error + lodError };
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.begin() + count);
+		lods.push_back(lod);
+	}
+}
+
+float GetProjectedSphereSize(XMFLOAT3 center, float radius,
+	XMFLOAT4X4 view, XMFLOAT4X4 projection,
+	float screenHeight)
+{
+	XMVECTOR viewCenter = XMVector3TransformCoord(XMLoadFloat3(&center), XMLoadFloat4x4(&view));
+	float depth = XMVectorGetZ(viewCenter);
+	if (depth <= radius)
+		return FLT_MAX;
+
+	// _22 is the vertical cotangent of half the field of view, so this
+	// is the sphere's diameter in NDC (2 units tall) scaled to pixels
+	return radius * projection._22 / depth * screenHeight;
+}
+
+int SelectMeshLod(const std::vector<MeshLod>& lods, float screenSize, float maxPixelError)
+{
+	for (int lod = (int)lods.size() - 1; lod > 0; lod--)
+	{
+		if (lods[lod].Error * screenSize <= maxPixelError)
+			return lod;
+	}
+	return 0;
+}
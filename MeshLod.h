@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+// Most LODs a mesh can have, including the full detail one
+#define MAX_MESH_LODS 5
+
+// LODs stop once they'd be further off than this from the
+// full detail mesh, relative to its size
+#define MESH_LOD_MAX_ERROR 0.1f
+
+// --------------------------------------------------------
+// One level of detail: a range of the mesh's index buffer
+// (all LODs share the same vertices)
+// --------------------------------------------------------
+struct MeshLod
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	float Error;	// Relative to the largest extent of the mesh
+};
+
+// --------------------------------------------------------
+// Builds simplified LODs, each about half the triangles of
+// the one before, until MAX_MESH_LODS or MESH_LOD_MAX_ERROR
+// is reached or the mesh stops getting simpler
+//
+// indices holds the full detail triangles on input, and
+// gets every LOD's triangles appended after them
+// --------------------------------------------------------
+void BuildMeshLods(std::vector<unsigned int>& indices,
+	const Vertex* verts, int numVerts,
+	std::vector<MeshLod>& lods);
+
+// --------------------------------------------------------
+// How many pixels tall a bounding sphere (in world space)
+// appears on screen, or FLT_MAX if the camera is inside it
+// --------------------------------------------------------
+float GetProjectedSphereSize(DirectX::XMFLOAT3 center, float radius,
+	DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 projection,
+	float screenHeight);
+
+// --------------------------------------------------------
+// Picks the simplest LOD whose error, for a mesh covering
+// screenSize pixels, stays under maxPixelError pixels
+// --------------------------------------------------------
+int SelectMeshLod(const std::vector<MeshLod>& lods, float screenSize, float maxPixelError);
@@ -0,0 +1,299 @@
+#include "MeshOptimizer.h"
+#include <vector>
+#include <algorithm>
+
+using namespace DirectX;
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, int numIndices, int numVerts, int cacheSize)
+{
+	VertexCacheStats stats = {};
+	if (numIndices < 3 || numVerts <= 0)
+		return stats;
+
+	// FIFO cache - a vertex is "in" the cache if it was
+	// added within the last cacheSize misses
+	std::vector<int> addedAt(numVerts, -cacheSize - 1);
+	std::vector<bool> used(numVerts, false);
+	int usedCount = 0;
+
+	for (int i = 0; i < numIndices; i++)
+	{
+		unsigned int v = indices[i];
+		if (stats.Misses - addedAt[v] > cacheSize)
+		{
+			addedAt[v] = stats.Misses;
+			stats.Misses++;
+		}
+
+		if (!used[v])
+		{
+			used[v] = true;
+			usedCount++;
+		}
+	}
+
+	stats.ACMR = (float)stats.Misses / (numIndices / 3);
+	stats.ATVR = (float)stats.Misses / usedCount;
+	return stats;
+}
+
+int OptimizeVertexCache(unsigned int* indices, int numIndices, int numVerts, int* clusterStarts, int cacheSize)
+{
+	int numTris = numIndices / 3;
+	if (numTris == 0 || numVerts <= 0)
+		return 0;
+
+	// Vertex -> triangle adjacency, stored as offsets into one array
+	std::vector<int> liveCount(numVerts, 0);
+	for (int i = 0; i < numTris * 3; i++)
+		liveCount[indices[i]]++;
+
+	std::vector<int> adjacencyStart(numVerts + 1, 0);
+	for (int v = 0; v < numVerts; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveCount[v];
+
+	std::vector<int> adjacency(numTris * 3);
+	std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (int i = 0; i < numTris * 3; i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> cacheTime(numVerts, 0);
+	std::vector<bool> emitted(numTris, false);
+	std::vector<int> deadEnd;
+	std::vector<int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(numTris * 3);
+
+	int time = cacheSize + 1;
+	int cursor = 0;
+	int clusterCount = 0;
+	int fanning = 0;
+
+	// The first fan always starts a cluster
+	if (clusterStarts) clusterStarts[clusterCount] = 0;
+	clusterCount++;
+
+	while (fanning >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++)
+		{
+			int t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveCount[v]--;
+
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Pick the candidate that will still be in the cache
+		// and has the fewest triangles left to emit
+		int next = -1;
+		int bestPriority = -1;
+		for (int v : candidates)
+		{
+			if (liveCount[v] <= 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize)
+				priority = time - cacheTime[v];
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next == -1)
+		{
+			// Dead end - back up to a recently used vertex...
+			while (!deadEnd.empty())
+			{
+				int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveCount[v] > 0)
+				{
+					next = v;
+					break;
+				}
+			}
+
+			// ...or skip ahead to the next unfinished vertex,
+			// which means the cache is effectively cold again
+			if (next == -1)
+			{
+				while (cursor < numVerts && liveCount[cursor] <= 0)
+					cursor++;
+
+				if (cursor < numVerts)
+				{
+					next = cursor;
+					if (clusterStarts) clusterStarts[clusterCount] = (int)output.size() / 3;
+					clusterCount++;
+				}
+			}
+		}
+
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+	return clusterCount;
+}
+
+void OptimizeOverdraw(unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	const int* clusterStarts, int clusterCount,
+	float acmrThreshold)
+{
+	int numTris = numIndices / 3;
+	if (numTris == 0 || clusterCount <= 0)
+		return;
+
+	// Split the hard (cold cache) clusters further wherever the
+	// cluster so far already has a good enough ACMR
+	// - "time" only counts up; jumping it past the cache size
+	//   empties the simulated cache without touching every vertex
+	std::vector<int> starts;
+	std::vector<int> addedAt(numVerts, -VERTEX_CACHE_SIZE - 1);
+	int time = 0;
+	for (int c = 0; c < clusterCount; c++)
+	{
+		int begin = clusterStarts[c];
+		int end = (c + 1 < clusterCount) ? clusterStarts[c + 1] : numTris;
+
+		// A repeated start is an empty cluster - it'd only give an
+		// empty range to sort
+		if (begin >= end)
+			continue;
+
+		int misses = 0;
+		int clusterBegin = begin;
+		starts.push_back(begin);
+		time += VERTEX_CACHE_SIZE + 1;
+
+		for (int t = begin; t < end; t++)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				unsigned int v = indices[t * 3 + i];
+				if (time - addedAt[v] > VERTEX_CACHE_SIZE)
+				{
+					addedAt[v] = time++;
+					misses++;
+				}
+			}
+
+			int clusterTris = t - clusterBegin + 1;
+			if (t + 1 < end && (float)misses / clusterTris <= acmrThreshold)
+			{
+				clusterBegin = t + 1;
+				starts.push_back(clusterBegin);
+				misses = 0;
+				time += VERTEX_CACHE_SIZE + 1;
+			}
+		}
+	}
+
+	// Mesh centroid, used to decide which way each cluster faces
+	XMVECTOR meshCenter = XMVectorZero();
+	for (int v = 0; v < numVerts; v++)
+		meshCenter += XMLoadFloat3(&verts[v].Position);
+	meshCenter = meshCenter / (float)(numVerts > 0 ? numVerts : 1);
+
+	// Sort clusters by how much they face away from the center,
+	// so the outer shell is drawn (and fills depth) first
+	struct ClusterSort
+	{
+		int Begin;
+		int End;
+		float Sort;
+	};
+
+	std::vector<ClusterSort> clusters(starts.size());
+	for (size_t c = 0; c < starts.size(); c++)
+	{
+		clusters[c].Begin = starts[c];
+		clusters[c].End = (c + 1 < starts.size()) ? starts[c + 1] : numTris;
+
+		XMVECTOR center = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for (int t = clusters[c].Begin; t < clusters[c].End; t++)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&verts[indices[t * 3 + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&verts[indices[t * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&verts[indices[t * 3 + 2]].Position);
+
+			// Area weighted, so the length of the cross product is used as is
+			XMVECTOR faceNormal = XMVector3Cross(p1 - p0, p2 - p0);
+			float faceArea = XMVectorGetX(XMVector3Length(faceNormal));
+
+			normal += faceNormal;
+			center += (p0 + p1 + p2) * (faceArea / 3.0f);
+			area += faceArea;
+		}
+
+		// Degenerate clusters have no facing, so they keep their place
+		// instead of handing a NaN to the sort
+		float normalLength = XMVectorGetX(XMVector3Length(normal));
+		if (area <= 0.0f || normalLength <= 0.0f)
+		{
+			clusters[c].Sort = 0.0f;
+			continue;
+		}
+
+		center = center / area;
+		clusters[c].Sort = XMVectorGetX(XMVector3Dot(center - meshCenter, normal / normalLength));
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(),
+		[](const ClusterSort& a, const ClusterSort& b) { return a.Sort > b.Sort; });
+
+	std::vector<unsigned int> output;
+	output.reserve(numTris * 3);
+	for (ClusterSort& c : clusters)
+		output.insert(output.end(), indices + c.Begin * 3, indices + c.End * 3);
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexFetch(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+{
+	std::vector<int> remap(numVerts, -1);
+	std::vector<Vertex> reordered;
+	reordered.reserve(numVerts);
+
+	for (int i = 0; i < numIndices; i++)
+	{
+		unsigned int v = indices[i];
+		if (remap[v] == -1)
+		{
+			remap[v] = (int)reordered.size();
+			reordered.push_back(verts[v]);
+		}
+		indices[i] = remap[v];
+	}
+
+	// Keep any unreferenced vertices at the end
+	for (int v = 0; v < numVerts; v++)
+	{
+		if (remap[v] == -1)
+			reordered.push_back(verts[v]);
+	}
+
+	std::copy(reordered.begin(), reordered.end(), verts);
+}
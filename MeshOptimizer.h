@@ -0,0 +1,51 @@
+#pragma once
+#include "Vertex.h"
+
+// Size of the simulated post-transform vertex cache
+#define VERTEX_CACHE_SIZE 16
+
+// --------------------------------------------------------
+// Results of simulating a FIFO post-transform cache
+//
+// - ACMR: cache misses per triangle (0.5 is ideal for
+//   big regular meshes, 3 is the worst case)
+// - ATVR: cache misses per used vertex (1 is ideal)
+// --------------------------------------------------------
+struct VertexCacheStats
+{
+	int Misses;
+	float ACMR;
+	float ATVR;
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, int numIndices, int numVerts, int cacheSize = VERTEX_CACHE_SIZE);
+
+// --------------------------------------------------------
+// Reorders triangles for the post-transform vertex cache
+// using Tipsify (Sander, Nehab & Barczak 2007)
+//
+// Fills clusterStarts (optional, numIndices / 3 entries
+// worth of space) with the first triangle of each run that
+// started with a cold cache, and returns how many there are
+// --------------------------------------------------------
+int OptimizeVertexCache(unsigned int* indices, int numIndices, int numVerts, int* clusterStarts = 0, int cacheSize = VERTEX_CACHE_SIZE);
+
+// --------------------------------------------------------
+// Reorders clusters of triangles (from OptimizeVertexCache)
+// so outward facing ones are drawn first, which cuts down
+// on overdraw without undoing the vertex cache ordering
+//
+// acmrThreshold controls how eagerly clusters are split:
+// higher values give more, smaller clusters (less overdraw)
+// at the cost of a few more cache misses
+// --------------------------------------------------------
+void OptimizeOverdraw(unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	const int* clusterStarts, int clusterCount,
+	float acmrThreshold);
+
+// --------------------------------------------------------
+// Reorders vertices in the order they're first referenced
+// so the vertex fetch walks memory mostly linearly
+// --------------------------------------------------------
+void OptimizeVertexFetch(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
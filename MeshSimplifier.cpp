@@ -0,0 +1,545 @@
+#include "MeshSimplifier.h"
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Open edges and seams are weighted up so they hold their shape
+#define SIMPLIFY_EDGE_WEIGHT 10.0f
+
+// How a vertex (or really, a position) is allowed to collapse
+enum SimplifyVertexKind
+{
+	SIMPLIFY_MANIFOLD,	// Interior, collapses towards any neighbour
+	SIMPLIFY_BORDER,	// On an open edge, only collapses along it
+	SIMPLIFY_SEAM,		// Split by a UV/normal seam, only collapses along it
+	SIMPLIFY_LOCKED		// Corners and anything more tangled, never moves
+};
+
+// --------------------------------------------------------
+// Symmetric 4x4 quadric, stored as the upper triangle,
+// plus the total weight of the planes added to it
+// --------------------------------------------------------
+struct Quadric
+{
+	float A00, A11, A22;
+	float A01, A02, A12;
+	float B0, B1, B2;
+	float C;
+	float Weight;
+};
+
+// Raw bits of the first "Count" floats of a vertex, so
+// vertices can be matched up exactly
+template<int Count>
+struct VertexBitsKey
+{
+	unsigned int Bits[Count];
+
+	bool operator==(const VertexBitsKey& other) const
+	{
+		return memcmp(Bits, other.Bits, sizeof(Bits)) == 0;
+	}
+};
+
+template<int Count>
+struct VertexBitsKeyHash
+{
+	size_t operator()(const VertexBitsKey<Count>& key) const
+	{
+		size_t hash = 2166136261u;
+		for (int i = 0; i < Count; i++)
+			hash = (hash ^ key.Bits[i]) * 16777619u;
+		return hash;
+	}
+};
+
+// Position only, or position, normal and UV (everything but the
+// tangent, which is calculated from the triangles afterwards)
+typedef VertexBitsKey<3> PositionKey;
+typedef VertexBitsKey<8> AttributeKey;
+
+struct Collapse
+{
+	unsigned int From;	// Both are position ids
+	unsigned int To;
+	float Error;		// Squared, relative to the mesh size
+};
+
+static void AddPlane(Quadric& q, XMFLOAT3 n, float d, float weight)
+{
+	q.A00 += weight * n.x * n.x;
+	q.A11 += weight * n.y * n.y;
+	q.A22 += weight * n.z * n.z;
+	q.A01 += weight * n.x * n.y;
+	q.A02 += weight * n.x * n.z;
+	q.A12 += weight * n.y * n.z;
+	q.B0 += weight * n.x * d;
+	q.B1 += weight * n.y * d;
+	q.B2 += weight * n.z * d;
+	q.C += weight * d * d;
+	q.Weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+	q.A00 += other.A00; q.A11 += other.A11; q.A22 += other.A22;
+	q.A01 += other.A01; q.A02 += other.A02; q.A12 += other.A12;
+	q.B0 += other.B0; q.B1 += other.B1; q.B2 += other.B2;
+	q.C += other.C;
+	q.Weight += other.Weight;
+}
+
+// Weighted average of the squared distances to the quadric's planes
+static float QuadricError(const Quadric& q, const XMFLOAT3& p)
+{
+	float rx = q.A00 * p.x + q.A01 * p.y + q.A02 * p.z;
+	float ry = q.A01 * p.x + q.A11 * p.y + q.A12 * p.z;
+	float rz = q.A02 * p.x + q.A12 * p.y + q.A22 * p.z;
+
+	float error = p.x * rx + p.y * ry + p.z * rz +
+		2.0f * (q.B0 * p.x + q.B1 * p.y + q.B2 * p.z) + q.C;
+
+	return q.Weight > 0.0f ? fabsf(error) / q.Weight : 0.0f;
+}
+
+static unsigned long long EdgeKey(unsigned int a, unsigned int b)
+{
+	return ((unsigned long long)a << 32) | b;
+}
+
+int SimplifyMesh(unsigned int* destination,
+	const unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	int targetIndexCount, float maxError,
+	float* resultError)
+{
+	numIndices = numIndices / 3 * 3;
+	std::copy(indices, indices + numIndices, destination);
+	if (resultError) *resultError = 0.0f;
+	if (numVerts <= 0 || numIndices == 0)
+		return numIndices;
+
+	// Scale positions down to a unit box, so errors come
+	// out relative to the size of the mesh
+	XMVECTOR minPos = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxPos = minPos;
+	for (int v = 1; v < numVerts; v++)
+	{
+		minPos = XMVectorMin(minPos, XMLoadFloat3(&verts[v].Position));
+		maxPos = XMVectorMax(maxPos, XMLoadFloat3(&verts[v].Position));
+	}
+
+	XMFLOAT3 extent;
+	XMStoreFloat3(&extent, maxPos - minPos);
+	float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	float invExtent = largestExtent > 0.0f ? 1.0f / largestExtent : 0.0f;
+
+	std::vector<XMFLOAT3> positions(numVerts);
+	for (int v = 0; v < numVerts; v++)
+		XMStoreFloat3(&positions[v], (XMLoadFloat3(&verts[v].Position) - minPos) * invExtent);
+
+	// Exact duplicates (which .obj files with repeated "v" lines
+	// end up with) would look like seams everywhere, so they're
+	// all swapped for the first copy up front
+	std::vector<unsigned int> original(numVerts);
+	std::unordered_map<AttributeKey, unsigned int, VertexBitsKeyHash<8>> firstWithAttributes;
+	for (int v = 0; v < numVerts; v++)
+	{
+		AttributeKey key;
+		memcpy(&key, &verts[v], sizeof(AttributeKey));
+		original[v] = firstWithAttributes.insert({ key, (unsigned int)v }).first->second;
+	}
+	for (int i = 0; i < numIndices; i++)
+		destination[i] = original[destination[i]];
+
+	// Vertices that only differ by UV or normal share a position id,
+	// and are linked into a ring of "wedges" of that position
+	std::vector<unsigned int> positionId(numVerts);
+	std::vector<unsigned int> wedgeNext(numVerts);
+	std::unordered_map<PositionKey, unsigned int, VertexBitsKeyHash<3>> firstAtPosition;
+	for (int v = 0; v < numVerts; v++)
+	{
+		PositionKey key;
+		memcpy(&key, &verts[v].Position, sizeof(PositionKey));
+		wedgeNext[v] = v;
+		if (original[v] != (unsigned int)v)
+		{
+			positionId[v] = positionId[original[v]];
+			continue;
+		}
+
+		auto result = firstAtPosition.insert({ key, (unsigned int)v });
+		unsigned int first = result.first->second;
+		positionId[v] = first;
+		if (first != (unsigned int)v)
+		{
+			wedgeNext[v] = wedgeNext[first];
+			wedgeNext[first] = v;
+		}
+	}
+
+	// Directed edges (in vertex space) of the current triangles,
+	// sorted so the opposite of an edge can be looked up
+	std::vector<unsigned long long> edges;
+	auto buildEdges = [&](const unsigned int* tris, int count)
+	{
+		edges.clear();
+		for (int i = 0; i < count; i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+				edges.push_back(EdgeKey(tris[i + e], tris[i + (e + 1) % 3]));
+		}
+		std::sort(edges.begin(), edges.end());
+	};
+	auto hasEdge = [&](unsigned int a, unsigned int b)
+	{
+		return std::binary_search(edges.begin(), edges.end(), EdgeKey(a, b));
+	};
+	auto hasPositionEdge = [&](unsigned int a, unsigned int b)
+	{
+		unsigned int wa = a;
+		do
+		{
+			unsigned int wb = b;
+			do
+			{
+				if (hasEdge(wa, wb))
+					return true;
+				wb = wedgeNext[wb];
+			} while (wb != b);
+			wa = wedgeNext[wa];
+		} while (wa != a);
+		return false;
+	};
+
+	// Classify each position by its open edges (those without an
+	// opposite): in position space they're borders, and in vertex
+	// space only they're seams
+	buildEdges(destination, numIndices);
+	std::vector<unsigned char> openOut(numVerts, 0);
+	std::vector<unsigned char> openIn(numVerts, 0);
+	std::vector<unsigned char> borderEdges(numVerts, 0);
+	for (int i = 0; i < numIndices; i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = destination[i + e];
+			unsigned int b = destination[i + (e + 1) % 3];
+			if (hasEdge(b, a))
+				continue;
+
+			if (openOut[a] < 255) openOut[a]++;
+			if (openIn[b] < 255) openIn[b]++;
+			if (!hasPositionEdge(b, a) && borderEdges[positionId[a]] < 255)
+				borderEdges[positionId[a]]++;
+		}
+	}
+
+	std::vector<unsigned char> kind(numVerts, SIMPLIFY_LOCKED);
+	bool anyUnlocked = false;
+	for (int v = 0; v < numVerts; v++)
+	{
+		if (positionId[v] != (unsigned int)v)
+			continue;
+
+		int wedges = 0;
+		bool singleOpenEdge = true;
+		bool closed = true;
+		unsigned int w = v;
+		do
+		{
+			wedges++;
+			singleOpenEdge = singleOpenEdge && openOut[w] == 1 && openIn[w] == 1;
+			closed = closed && openOut[w] == 0 && openIn[w] == 0;
+			w = wedgeNext[w];
+		} while (w != (unsigned int)v);
+
+		if (wedges == 1 && closed)
+			kind[v] = SIMPLIFY_MANIFOLD;
+		else if (wedges == 1 && singleOpenEdge)
+			kind[v] = SIMPLIFY_BORDER;
+		else if (wedges == 2 && singleOpenEdge && borderEdges[v] == 0)
+			kind[v] = SIMPLIFY_SEAM;
+
+		anyUnlocked = anyUnlocked || kind[v] != SIMPLIFY_LOCKED;
+	}
+
+	// Hard edged everywhere (like a cube), or not really a surface
+	if (!anyUnlocked)
+		return numIndices;
+
+	// Quadrics per position: the (area weighted) planes of
+	// every triangle around it, plus planes standing up along
+	// any open edge so borders and seams don't drift
+	std::vector<Quadric> quadrics(numVerts, Quadric{});
+	for (int i = 0; i < numIndices; i += 3)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&positions[destination[i + 0]]);
+		XMVECTOR p1 = XMLoadFloat3(&positions[destination[i + 1]]);
+		XMVECTOR p2 = XMLoadFloat3(&positions[destination[i + 2]]);
+		XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+		float doubleArea = XMVectorGetX(XMVector3Length(normal));
+		if (doubleArea <= 0.0f)
+			continue;
+
+		normal = normal / doubleArea;
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normal);
+		float d = -XMVectorGetX(XMVector3Dot(normal, p0));
+		for (int c = 0; c < 3; c++)
+			AddPlane(quadrics[positionId[destination[i + c]]], n, d, doubleArea * 0.5f);
+
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = destination[i + e];
+			unsigned int b = destination[i + (e + 1) % 3];
+			if (hasEdge(b, a))
+				continue;
+
+			XMVECTOR pa = XMLoadFloat3(&positions[a]);
+			XMVECTOR edge = XMLoadFloat3(&positions[b]) - pa;
+			float lengthSq = XMVectorGetX(XMVector3LengthSq(edge));
+			if (lengthSq <= 0.0f)
+				continue;
+
+			XMVECTOR edgeNormal = XMVector3Normalize(XMVector3Cross(edge, normal));
+			XMFLOAT3 en;
+			XMStoreFloat3(&en, edgeNormal);
+			float ed = -XMVectorGetX(XMVector3Dot(edgeNormal, pa));
+			AddPlane(quadrics[positionId[a]], en, ed, lengthSq * SIMPLIFY_EDGE_WEIGHT);
+			AddPlane(quadrics[positionId[b]], en, ed, lengthSq * SIMPLIFY_EDGE_WEIGHT);
+		}
+	}
+
+	std::vector<int> adjacencyStart(numVerts + 1);
+	std::vector<int> adjacency;
+	std::vector<int> fill;
+	std::vector<unsigned long long> positionEdges;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> remap(numVerts);
+	std::vector<unsigned char> touched(numVerts);
+	std::vector<std::pair<unsigned int, unsigned int>> wedgeTargets;
+
+	// Which wedge of position "to" is joined by an edge to wedge w
+	auto findPartner = [&](unsigned int w, unsigned int to) -> int
+	{
+		for (int a = adjacencyStart[w]; a < adjacencyStart[w + 1]; a++)
+		{
+			const unsigned int* tri = &destination[adjacency[a] * 3];
+			for (int c = 0; c < 3; c++)
+			{
+				if (positionId[tri[c]] == to)
+					return tri[c];
+			}
+		}
+		return -1;
+	};
+
+	auto canCollapse = [&](unsigned int from, unsigned int to)
+	{
+		switch (kind[from])
+		{
+		case SIMPLIFY_MANIFOLD:
+			return true;
+		case SIMPLIFY_BORDER:
+			// Only along the border itself
+			return (kind[to] == SIMPLIFY_BORDER || kind[to] == SIMPLIFY_LOCKED) &&
+				hasPositionEdge(from, to) != hasPositionEdge(to, from);
+		case SIMPLIFY_SEAM:
+		{
+			// Only along the seam itself
+			if (kind[to] != SIMPLIFY_SEAM && kind[to] != SIMPLIFY_LOCKED)
+				return false;
+
+			unsigned int wa = from;
+			do
+			{
+				unsigned int wb = to;
+				do
+				{
+					if (hasEdge(wa, wb) && !hasEdge(wb, wa))
+						return true;
+					wb = wedgeNext[wb];
+				} while (wb != to);
+				wa = wedgeNext[wa];
+			} while (wa != from);
+			return false;
+		}
+		default:
+			return false;
+		}
+	};
+
+	// Would moving position "from" onto "to" turn any of the
+	// triangles that survive the collapse over?
+	auto flipsTriangles = [&](unsigned int from, unsigned int to)
+	{
+		XMVECTOR target = XMLoadFloat3(&positions[to]);
+		unsigned int w = from;
+		do
+		{
+			for (int a = adjacencyStart[w]; a < adjacencyStart[w + 1]; a++)
+			{
+				const unsigned int* tri = &destination[adjacency[a] * 3];
+				if (positionId[tri[0]] == to || positionId[tri[1]] == to || positionId[tri[2]] == to)
+					continue;
+
+				XMVECTOR p[3];
+				XMVECTOR moved[3];
+				for (int c = 0; c < 3; c++)
+				{
+					p[c] = XMLoadFloat3(&positions[tri[c]]);
+					moved[c] = tri[c] == w ? target : p[c];
+				}
+
+				XMVECTOR before = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+				XMVECTOR after = XMVector3Cross(moved[1] - moved[0], moved[2] - moved[0]);
+				float dot = XMVectorGetX(XMVector3Dot(before, after));
+				float lengths = XMVectorGetX(XMVector3Length(before) * XMVector3Length(after));
+				if (dot <= lengths * 1e-2f)
+					return true;
+			}
+			w = wedgeNext[w];
+		} while (w != from);
+		return false;
+	};
+
+	float maxErrorSq = maxError * maxError;
+	float worstError = 0.0f;
+	int indexCount = numIndices;
+	targetIndexCount = targetIndexCount / 3 * 3;
+
+	// Each pass collapses as many independent edges as it can,
+	// cheapest first, then rebuilds the triangle list
+	while (indexCount > targetIndexCount)
+	{
+		// Vertex -> triangle adjacency, same layout as OptimizeVertexCache
+		std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+		for (int i = 0; i < indexCount; i++)
+			adjacencyStart[destination[i] + 1]++;
+		for (int v = 0; v < numVerts; v++)
+			adjacencyStart[v + 1] += adjacencyStart[v];
+
+		adjacency.resize(indexCount);
+		fill.assign(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (int i = 0; i < indexCount; i++)
+			adjacency[fill[destination[i]]++] = i / 3;
+
+		buildEdges(destination, indexCount);
+
+		// Every edge between two positions, once
+		positionEdges.clear();
+		for (int i = 0; i < indexCount; i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = positionId[destination[i + e]];
+				unsigned int b = positionId[destination[i + (e + 1) % 3]];
+				if (a != b)
+					positionEdges.push_back(EdgeKey(std::min(a, b), std::max(a, b)));
+			}
+		}
+		std::sort(positionEdges.begin(), positionEdges.end());
+		positionEdges.erase(std::unique(positionEdges.begin(), positionEdges.end()), positionEdges.end());
+
+		// Cheapest allowed direction of each edge
+		collapses.clear();
+		for (unsigned long long key : positionEdges)
+		{
+			unsigned int a = (unsigned int)(key >> 32);
+			unsigned int b = (unsigned int)(key & 0xFFFFFFFF);
+
+			Collapse collapse = { 0, 0, FLT_MAX };
+			if (canCollapse(a, b))
+				collapse = { a, b, QuadricError(quadrics[a], positions[b]) };
+			if (canCollapse(b, a))
+			{
+				float error = QuadricError(quadrics[b], positions[a]);
+				if (error < collapse.Error)
+					collapse = { b, a, error };
+			}
+
+			if (collapse.Error <= maxErrorSq)
+				collapses.push_back(collapse);
+		}
+
+		std::sort(collapses.begin(), collapses.end(),
+			[](const Collapse& x, const Collapse& y) { return x.Error < y.Error; });
+
+		// Apply them, skipping any that touch an area that
+		// already changed this pass
+		for (int v = 0; v < numVerts; v++)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		int trianglesToRemove = (indexCount - targetIndexCount) / 3;
+		int removed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (touched[collapse.From] || touched[collapse.To])
+				continue;
+
+			// Every wedge needs somewhere to go
+			wedgeTargets.clear();
+			unsigned int w = collapse.From;
+			do
+			{
+				int partner = findPartner(w, collapse.To);
+				if (partner < 0)
+					break;
+				wedgeTargets.push_back({ w, (unsigned int)partner });
+				w = wedgeNext[w];
+			} while (w != collapse.From);
+
+			if (w != collapse.From || wedgeTargets.empty() || flipsTriangles(collapse.From, collapse.To))
+				continue;
+
+			for (auto& target : wedgeTargets)
+			{
+				remap[target.first] = target.second;
+
+				// Lock down the whole neighbourhood until next pass
+				for (int a = adjacencyStart[target.first]; a < adjacencyStart[target.first + 1]; a++)
+				{
+					const unsigned int* tri = &destination[adjacency[a] * 3];
+					for (int c = 0; c < 3; c++)
+						touched[positionId[tri[c]]] = 1;
+				}
+			}
+
+			AddQuadric(quadrics[collapse.To], quadrics[collapse.From]);
+			worstError = std::max(worstError, collapse.Error);
+
+			removed += kind[collapse.From] == SIMPLIFY_BORDER ? 1 : 2;
+			if (removed >= trianglesToRemove)
+				break;
+		}
+
+		// Rewrite the triangles, dropping the ones that collapsed
+		int written = 0;
+		for (int i = 0; i < indexCount; i += 3)
+		{
+			unsigned int a = remap[destination[i + 0]];
+			unsigned int b = remap[destination[i + 1]];
+			unsigned int c = remap[destination[i + 2]];
+			if (positionId[a] == positionId[b] || positionId[b] == positionId[c] || positionId[a] == positionId[c])
+				continue;
+
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+
+		if (written == indexCount)
+			break;
+		indexCount = written;
+	}
+
+	if (resultError) *resultError = sqrtf(worstError);
+	return indexCount;
+}
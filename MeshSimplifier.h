@@ -0,0 +1,27 @@
+#pragma once
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Simplifies a triangle list with edge collapses, cheapest
+// first by quadric error (Garland & Heckbert 1997)
+//
+// - Only the indices change: vertices are collapsed onto
+//   their neighbours rather than moved, so every LOD of a
+//   mesh can share one vertex buffer
+// - Open borders and UV/normal seams only collapse along
+//   themselves, so they keep their shape
+// - Stops at targetIndexCount indices, or once the next
+//   collapse would cost more than maxError
+//
+// Errors are relative to the largest extent of the mesh
+// (0.01 = 1% of its size), and the largest one used is
+// written to resultError if given
+//
+// destination needs numIndices worth of space
+// Returns the number of indices written to it
+// --------------------------------------------------------
+int SimplifyMesh(unsigned int* destination,
+	const unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	int targetIndexCount, float maxError,
+	float* resultError = 0);
@@ -0,0 +1,280 @@
+#include "Meshlet.h"
+#include "FrustumCull.h"
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Works out the bounding sphere and normal cone of the
+// triangles in [firstIndex, firstIndex + indexCount)
+// --------------------------------------------------------
+static Meshlet FinishMeshlet(const unsigned int* indices,
+	unsigned int firstIndex, unsigned int indexCount,
+	const Vertex* verts)
+{
+	Meshlet meshlet = {};
+	meshlet.FirstIndex = firstIndex;
+	meshlet.IndexCount = indexCount;
+
+	// Sphere around the center of the triangles' bounds
+	XMVECTOR minPos = XMLoadFloat3(&verts[indices[firstIndex]].Position);
+	XMVECTOR maxPos = minPos;
+	for (unsigned int i = firstIndex; i < firstIndex + indexCount; i++)
+	{
+		XMVECTOR pos = XMLoadFloat3(&verts[indices[i]].Position);
+		minPos = XMVectorMin(minPos, pos);
+		maxPos = XMVectorMax(maxPos, pos);
+	}
+
+	XMVECTOR center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (unsigned int i = firstIndex; i < firstIndex + indexCount; i++)
+	{
+		XMVECTOR pos = XMLoadFloat3(&verts[indices[i]].Position);
+		radius = fmaxf(radius, XMVectorGetX(XMVector3Length(pos - center)));
+	}
+	XMStoreFloat3(&meshlet.Center, center);
+	meshlet.Radius = radius;
+
+	// Front faces are clockwise on screen, so (p1 - p0) x (p2 - p0)
+	// points out of the front of each triangle
+	XMVECTOR normals[MESHLET_MAX_TRIANGLES];
+	XMVECTOR corners[MESHLET_MAX_TRIANGLES];
+	int normalCount = 0;
+	XMVECTOR normalSum = XMVectorZero();
+	for (unsigned int i = firstIndex; i < firstIndex + indexCount; i += 3)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&verts[indices[i]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&verts[indices[i + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&verts[indices[i + 2]].Position);
+		XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+
+		// Degenerate triangles never get drawn, so they don't count
+		float length = XMVectorGetX(XMVector3Length(normal));
+		if (length < 1e-12f)
+			continue;
+
+		normals[normalCount] = normal / length;
+		corners[normalCount] = p0;
+		normalSum += normals[normalCount];
+		normalCount++;
+	}
+
+	meshlet.ConeCutoff = MESHLET_NO_CONE_CUTOFF;
+	float sumLength = XMVectorGetX(XMVector3Length(normalSum));
+	if (normalCount == 0 || sumLength < 1e-6f)
+		return meshlet;
+
+	// The widest angle between the average normal and any triangle's
+	// normal is the cone's half angle - past 90 degrees, some triangle
+	// faces the camera from every direction
+	XMVECTOR axis = normalSum / sumLength;
+	float minDot = 1.0f;
+	for (int t = 0; t < normalCount; t++)
+		minDot = fminf(minDot, XMVectorGetX(XMVector3Dot(axis, normals[t])));
+	if (minDot <= 0.0f)
+		return meshlet;
+
+	// Back the apex off along the axis until it's behind the plane of
+	// every triangle, so being in front of a plane means being outside
+	// the cone
+	float apexDistance = 0.0f;
+	for (int t = 0; t < normalCount; t++)
+	{
+		float planeDistance = XMVectorGetX(XMVector3Dot(center - corners[t], normals[t]));
+		float axisDot = XMVectorGetX(XMVector3Dot(axis, normals[t]));
+		apexDistance = fmaxf(apexDistance, planeDistance / axisDot);
+	}
+
+	XMStoreFloat3(&meshlet.ConeAxis, axis);
+	XMStoreFloat3(&meshlet.ConeApex, center - axis * apexDistance);
+	meshlet.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+	return meshlet;
+}
+
+void BuildMeshlets(unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	std::vector<Meshlet>& meshlets)
+{
+	meshlets.clear();
+	int numTris = numIndices / 3;
+	if (numTris == 0)
+		return;
+
+	// Triangles using each vertex, to find the neighbours of a meshlet
+	std::vector<int> vertexTriStart(numVerts + 1, 0);
+	for (int i = 0; i < numIndices; i++)
+		vertexTriStart[indices[i] + 1]++;
+	for (int v = 0; v < numVerts; v++)
+		vertexTriStart[v + 1] += vertexTriStart[v];
+	std::vector<int> vertexTris(numIndices);
+	std::vector<int> fill(vertexTriStart.begin(), vertexTriStart.end() - 1);
+	for (int i = 0; i < numIndices; i++)
+		vertexTris[fill[indices[i]]++] = i / 3;
+
+	std::vector<XMFLOAT3> triNormals(numTris);
+	for (int t = 0; t < numTris; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&verts[indices[t * 3]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&verts[indices[t * 3 + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&verts[indices[t * 3 + 2]].Position);
+		XMStoreFloat3(&triNormals[t], XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0)));
+	}
+
+	// Which meshlet each vertex was last used by, so counting the
+	// current meshlet's vertices doesn't need clearing between them
+	std::vector<int> vertexMeshlet(numVerts, -1);
+	std::vector<bool> used(numTris, false);
+	std::vector<unsigned int> ordered;
+	ordered.reserve(numIndices);
+
+	int nextSeed = 0;
+	while ((int)ordered.size() < numIndices)
+	{
+		int current = (int)meshlets.size();
+		unsigned int firstIndex = (unsigned int)ordered.size();
+		int meshletVerts[MESHLET_MAX_VERTICES];
+		int vertCount = 0;
+		int triCount = 0;
+		XMVECTOR normalSum = XMVectorZero();
+
+		// Seeds follow the existing order, which keeps the overdraw
+		// optimizer's outside-first ordering at the meshlet level
+		while (used[nextSeed])
+			nextSeed++;
+		int tri = nextSeed;
+
+		while (tri >= 0)
+		{
+			used[tri] = true;
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[tri * 3 + c];
+				ordered.push_back(v);
+				if (vertexMeshlet[v] != current)
+				{
+					vertexMeshlet[v] = current;
+					meshletVerts[vertCount++] = v;
+				}
+			}
+			triCount++;
+			normalSum += XMLoadFloat3(&triNormals[tri]);
+			if (triCount == MESHLET_MAX_TRIANGLES)
+				break;
+
+			// Grow into the unused neighbour that adds the fewest
+			// vertices, then faces closest to the meshlet so far -
+			// anything facing too far off is left for another
+			// meshlet, which keeps the normal cones narrow
+			XMVECTOR axis = XMVector3Normalize(normalSum);
+			int best = -1;
+			float bestScore = FLT_MAX;
+			for (int i = 0; i < vertCount; i++)
+			{
+				int v = meshletVerts[i];
+				for (int j = vertexTriStart[v]; j < vertexTriStart[v + 1]; j++)
+				{
+					int candidate = vertexTris[j];
+					if (used[candidate])
+						continue;
+
+					unsigned int a = indices[candidate * 3];
+					unsigned int b = indices[candidate * 3 + 1];
+					unsigned int c = indices[candidate * 3 + 2];
+					int newVerts =
+						(vertexMeshlet[a] != current) +
+						(vertexMeshlet[b] != current && b != a) +
+						(vertexMeshlet[c] != current && c != a && c != b);
+					float facing = XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&triNormals[candidate])));
+					if (vertCount + newVerts > MESHLET_MAX_VERTICES || facing < MESHLET_MIN_FACING)
+						continue;
+
+					float score = newVerts + (1.0f - facing);
+					if (score < bestScore)
+					{
+						bestScore = score;
+						best = candidate;
+					}
+				}
+			}
+			tri = best;
+		}
+
+		unsigned int indexCount = (unsigned int)ordered.size() - firstIndex;
+		meshlets.push_back(FinishMeshlet(&ordered[0], firstIndex, indexCount, verts));
+	}
+
+	memcpy(indices, &ordered[0], sizeof(unsigned int) * numIndices);
+}
+
+void BuildMeshletCullData(XMFLOAT4X4 world,
+	XMFLOAT4X4 worldInverseTranspose,
+	XMFLOAT4X4 view, XMFLOAT4X4 projection,
+	XMFLOAT3 cameraPosition,
+	MeshletCullData& cull)
+{
+	XMMATRIX worldMat = XMLoadFloat4x4(&world);
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, worldMat * XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+
+	// Planes in the mesh's local space, from the combined matrix
+	ExtractFrustumPlanes(m, cull.Planes);
+
+	XMMATRIX inverseWorld = XMMatrixTranspose(XMLoadFloat4x4(&worldInverseTranspose));
+	float determinant = XMVectorGetX(XMVector3Dot(worldMat.r[0], XMVector3Cross(worldMat.r[1], worldMat.r[2])));
+	XMStoreFloat3(&cull.CameraPosition, XMVector3TransformCoord(XMLoadFloat3(&cameraPosition), inverseWorld));
+
+	// Cones only survive rotation and uniform scale - a mirror flips
+	// the winding, and squashing bends the normals
+	float scaleX = XMVectorGetX(XMVector3Length(worldMat.r[0]));
+	float scaleY = XMVectorGetX(XMVector3Length(worldMat.r[1]));
+	float scaleZ = XMVectorGetX(XMVector3Length(worldMat.r[2]));
+	float maxScale = fmaxf(scaleX, fmaxf(scaleY, scaleZ));
+	float minScale = fminf(scaleX, fminf(scaleY, scaleZ));
+	cull.CullBackfaces = determinant > 0.0f && minScale >= maxScale * 0.999f;
+}
+
+int CullMeshlets(const Meshlet* meshlets, int meshletCount,
+	const MeshletCullData& cull,
+	std::vector<IndexRange>& ranges)
+{
+	ranges.clear();
+	int visibleIndices = 0;
+
+	XMVECTOR camera = XMLoadFloat3(&cull.CameraPosition);
+	for (int i = 0; i < meshletCount; i++)
+	{
+		const Meshlet& meshlet = meshlets[i];
+
+		// Entirely behind any one plane means outside the frustum
+		XMVECTOR center = XMLoadFloat3(&meshlet.Center);
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+			outside = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&cull.Planes[p]), center)) < -meshlet.Radius;
+		if (outside)
+			continue;
+
+		// Looking down the cone from behind its apex means
+		// every triangle faces away
+		if (cull.CullBackfaces && meshlet.ConeCutoff < 1.0f)
+		{
+			XMVECTOR toApex = XMLoadFloat3(&meshlet.ConeApex) - camera;
+			float axisDot = XMVectorGetX(XMVector3Dot(toApex, XMLoadFloat3(&meshlet.ConeAxis)));
+			if (axisDot >= meshlet.ConeCutoff * XMVectorGetX(XMVector3Length(toApex)))
+				continue;
+		}
+
+		// Neighbouring meshlets are neighbours in the index buffer
+		// too, so runs of them become a single draw
+		if (!ranges.empty() && ranges.back().FirstIndex + ranges.back().IndexCount == meshlet.FirstIndex)
+			ranges.back().IndexCount += meshlet.IndexCount;
+		else
+			ranges.push_back({ meshlet.FirstIndex, meshlet.IndexCount });
+
+		visibleIndices += meshlet.IndexCount;
+	}
+
+	return visibleIndices;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+// Meshlet size limits (the usual mesh shader sizes,
+// which keep clusters small enough to cull usefully)
+#define MESHLET_MAX_VERTICES	64
+#define MESHLET_MAX_TRIANGLES	124
+
+// Meshes with fewer triangles than this are cheaper to
+// draw in one go than to split up and cull
+#define MESHLET_MIN_MESH_TRIANGLES	(MESHLET_MAX_TRIANGLES * 4)
+
+// Cosine of the furthest a triangle can face from the
+// average of its meshlet (lower gives fuller meshlets,
+// higher gives narrower cones that cull more often)
+#define MESHLET_MIN_FACING		0.7f
+
+// Cone cutoff for meshlets whose triangles face too many
+// ways to ever be back-face culled as a group
+#define MESHLET_NO_CONE_CUTOFF	2.0f
+
+// --------------------------------------------------------
+// A small cluster of triangles, which is a contiguous
+// range of the mesh's index buffer
+//
+// The cone holds the normals of every triangle in the
+// meshlet: seen from anywhere inside the cone behind the
+// apex, all of them face away from the camera
+// --------------------------------------------------------
+struct Meshlet
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	DirectX::XMFLOAT3 Center;		// Bounding sphere, in local space
+	float Radius;
+	DirectX::XMFLOAT3 ConeApex;
+	float ConeCutoff;				// Sine of the cone's half angle
+	DirectX::XMFLOAT3 ConeAxis;
+};
+
+// A range of an index buffer to draw
+struct IndexRange
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+};
+
+// --------------------------------------------------------
+// Everything CullMeshlets needs, in the mesh's local space
+// so the meshlets don't need to be transformed
+// --------------------------------------------------------
+struct MeshletCullData
+{
+	DirectX::XMFLOAT4 Planes[6];	// Normalized, pointing into the frustum
+	DirectX::XMFLOAT3 CameraPosition;
+	bool CullBackfaces;				// Only valid without non-uniform or mirrored scale
+};
+
+// --------------------------------------------------------
+// Splits triangles into meshlets of at most
+// MESHLET_MAX_VERTICES and MESHLET_MAX_TRIANGLES, each
+// grown from a seed triangle into its neighbours
+//
+// Triangles are reordered so each meshlet is a contiguous
+// range of indices - the order within a meshlet is still
+// local enough for the vertex cache
+// --------------------------------------------------------
+void BuildMeshlets(unsigned int* indices, int numIndices,
+	const Vertex* verts, int numVerts,
+	std::vector<Meshlet>& meshlets);
+
+// --------------------------------------------------------
+// Moves the camera's frustum and position into the local
+// space of a mesh with the given world matrix (whose
+// inverse transpose saves inverting it here)
+// --------------------------------------------------------
+void BuildMeshletCullData(DirectX::XMFLOAT4X4 world,
+	DirectX::XMFLOAT4X4 worldInverseTranspose,
+	DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 projection,
+	DirectX::XMFLOAT3 cameraPosition,
+	MeshletCullData& cull);
+
+// --------------------------------------------------------
+// Drops meshlets outside the frustum or facing away from
+// the camera, merging the rest into as few index ranges
+// as possible
+//
+// Returns the number of indices left to draw
+// --------------------------------------------------------
+int CullMeshlets(const Meshlet* meshlets, int meshletCount,
+	const MeshletCullData& cull,
+	std::vector<IndexRange>& ranges);
@@ -0,0 +1,341 @@
+#include "ObjLoader.h"
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Based on Chris Cascioli's basic .OBJ loader, rewritten
+// to parse a memory mapped file with std::from_chars
+// instead of reading fixed size lines through sscanf_s
+// --------------------------------------------------------
+
+// Files smaller than this are parsed on a single thread
+#define OBJ_MIN_CHUNK_SIZE (256 * 1024)
+
+// Flags describing how each index of a face corner was written
+#define OBJ_RELATIVE_POSITION	0x01
+#define OBJ_RELATIVE_UV			0x02
+#define OBJ_RELATIVE_NORMAL		0x04
+#define OBJ_MISSING_UV			0x08
+#define OBJ_MISSING_NORMAL		0x10
+
+// One corner of a triangle, as read from an "f" line
+// - Absolute indices are already 0-based
+// - Relative indices are relative to the start of the
+//   chunk they were read in, and fixed up after merging
+struct ObjCorner
+{
+	int Position;
+	int UV;
+	int Normal;
+	unsigned int Flags;
+};
+
+// Everything read from one section of the file
+struct ObjChunk
+{
+	const char* Start;
+	const char* End;
+
+	std::vector<XMFLOAT3> Positions;
+	std::vector<XMFLOAT3> Normals;
+	std::vector<XMFLOAT2> UVs;
+	std::vector<ObjCorner> Corners; // 3 per triangle, in file winding order
+};
+
+// Identifies one unique OBJ vertex by its position, uv and normal indices
+struct ObjVertexKey
+{
+	unsigned int Position;
+	unsigned int UV;
+	unsigned int Normal;
+
+	bool operator==(const ObjVertexKey& other) const
+	{
+		return Position == other.Position && UV == other.UV && Normal == other.Normal;
+	}
+};
+
+struct ObjVertexKeyHash
+{
+	size_t operator()(const ObjVertexKey& key) const
+	{
+		// Mix the three indices together (FNV-1a style)
+		size_t hash = 2166136261u;
+		hash = (hash ^ key.Position) * 16777619u;
+		hash = (hash ^ key.UV) * 16777619u;
+		hash = (hash ^ key.Normal) * 16777619u;
+		return hash;
+	}
+};
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+static const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	p = SkipSpaces(p, end);
+	if (p < end && *p == '+') p++; // from_chars doesn't accept a leading +
+
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if (result.ec != std::errc())
+	{
+		value = 0.0f;
+		return p;
+	}
+	return result.ptr;
+}
+
+// Reads a single OBJ index and converts it to 0-based,
+// flagging it as relative when it was negative
+static const char* ParseIndex(const char* p, const char* end, int localCount, int& index, unsigned int& flags, unsigned int relativeFlag)
+{
+	int value = 0;
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if (result.ec != std::errc())
+	{
+		index = 0;
+		return p;
+	}
+
+	if (value < 0)
+	{
+		// -1 is the most recently defined element
+		index = localCount + value;
+		flags |= relativeFlag;
+	}
+	else
+	{
+		index = value - 1;
+	}
+	return result.ptr;
+}
+
+static void ParseFace(const char* p, const char* end, ObjChunk& chunk, std::vector<ObjCorner>& face)
+{
+	face.clear();
+
+	// Read every "p", "p/t", "p//n" or "p/t/n" corner on the line
+	while (true)
+	{
+		p = SkipSpaces(p, end);
+		if (p >= end || !(*p == '-' || (*p >= '0' && *p <= '9')))
+			break;
+
+		ObjCorner corner = { 0, 0, 0, OBJ_MISSING_UV | OBJ_MISSING_NORMAL };
+		p = ParseIndex(p, end, (int)chunk.Positions.size(), corner.Position, corner.Flags, OBJ_RELATIVE_POSITION);
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (p < end && *p != '/')
+			{
+				p = ParseIndex(p, end, (int)chunk.UVs.size(), corner.UV, corner.Flags, OBJ_RELATIVE_UV);
+				corner.Flags &= ~OBJ_MISSING_UV;
+			}
+
+			if (p < end && *p == '/')
+			{
+				p++;
+				p = ParseIndex(p, end, (int)chunk.Normals.size(), corner.Normal, corner.Flags, OBJ_RELATIVE_NORMAL);
+				corner.Flags &= ~OBJ_MISSING_NORMAL;
+			}
+		}
+
+		face.push_back(corner);
+
+		// Skip anything unexpected so a malformed corner can't stall the loop
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+			p++;
+	}
+
+	// Fan triangulate (the winding order is flipped while welding)
+	for (size_t i = 1; i + 1 < face.size(); i++)
+	{
+		chunk.Corners.push_back(face[0]);
+		chunk.Corners.push_back(face[i]);
+		chunk.Corners.push_back(face[i + 1]);
+	}
+}
+
+static void ParseChunk(ObjChunk& chunk)
+{
+	std::vector<ObjCorner> face;
+
+	const char* p = chunk.Start;
+	while (p < chunk.End)
+	{
+		// memchr is vectorized by the CRT, so this is a SIMD newline search
+		const char* lineEnd = (const char*)memchr(p, '\n', chunk.End - p);
+		if (!lineEnd)
+			lineEnd = chunk.End;
+
+		const char* line = SkipSpaces(p, lineEnd);
+		if (lineEnd - line >= 2)
+		{
+			if (line[0] == 'v' && line[1] == 'n')
+			{
+				XMFLOAT3 norm;
+				line = ParseFloat(line + 2, lineEnd, norm.x);
+				line = ParseFloat(line, lineEnd, norm.y);
+				ParseFloat(line, lineEnd, norm.z);
+				chunk.Normals.push_back(norm);
+			}
+			else if (line[0] == 'v' && line[1] == 't')
+			{
+				XMFLOAT2 uv;
+				line = ParseFloat(line + 2, lineEnd, uv.x);
+				ParseFloat(line, lineEnd, uv.y);
+				chunk.UVs.push_back(uv);
+			}
+			else if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+			{
+				XMFLOAT3 pos;
+				line = ParseFloat(line + 1, lineEnd, pos.x);
+				line = ParseFloat(line, lineEnd, pos.y);
+				ParseFloat(line, lineEnd, pos.z);
+				chunk.Positions.push_back(pos);
+			}
+			else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+			{
+				ParseFace(line + 1, lineEnd, chunk, face);
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+void ParseObjData(const char* data, size_t size,
+	std::vector<Vertex>& verts,
+	std::vector<unsigned int>& indices)
+{
+	// Split the file into roughly equal chunks, each ending on a line break
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	size_t chunkCount = size / OBJ_MIN_CHUNK_SIZE;
+	if (chunkCount > threadCount) chunkCount = threadCount;
+	if (chunkCount < 1) chunkCount = 1;
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* chunkStart = data;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		const char* chunkEnd = data + size;
+		if (c + 1 < chunkCount)
+		{
+			chunkEnd = data + size * (c + 1) / chunkCount;
+			if (chunkEnd < chunkStart) chunkEnd = chunkStart;
+			const char* lineBreak = (const char*)memchr(chunkEnd, '\n', data + size - chunkEnd);
+			chunkEnd = lineBreak ? lineBreak + 1 : data + size;
+		}
+
+		chunks[c].Start = chunkStart;
+		chunks[c].End = chunkEnd;
+		chunkStart = chunkEnd;
+	}
+
+	// Parse every chunk, using this thread for the first one
+	std::vector<std::thread> workers;
+	for (size_t c = 1; c < chunkCount; c++)
+		workers.push_back(std::thread(ParseChunk, std::ref(chunks[c])));
+	ParseChunk(chunks[0]);
+	for (std::thread& t : workers)
+		t.join();
+
+	// Merge the chunks in file order
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	size_t cornerCount = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		positions.insert(positions.end(), chunk.Positions.begin(), chunk.Positions.end());
+		normals.insert(normals.end(), chunk.Normals.begin(), chunk.Normals.end());
+		uvs.insert(uvs.end(), chunk.UVs.begin(), chunk.UVs.end());
+		cornerCount += chunk.Corners.size();
+	}
+
+	// Faces without UVs or normals share a single default one
+	unsigned int defaultUV = (unsigned int)uvs.size();
+	unsigned int defaultNormal = (unsigned int)normals.size();
+	uvs.push_back(XMFLOAT2(0, 0));
+	normals.push_back(XMFLOAT3(0, 1, 0));
+
+	// Weld corners into vertices, in the same order the original
+	// single threaded loader created them
+	std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> weldedVerts;
+	weldedVerts.reserve(cornerCount / 2);
+	indices.reserve(indices.size() + cornerCount);
+
+	// Returns the index of the welded vertex for a corner, only
+	// creating a new vertex the first time a triple is seen
+	int positionBase = 0;
+	int uvBase = 0;
+	int normalBase = 0;
+	auto GetWeldedVertex = [&](const ObjCorner& corner) -> unsigned int
+	{
+		ObjVertexKey key;
+		key.Position = corner.Position + ((corner.Flags & OBJ_RELATIVE_POSITION) ? positionBase : 0);
+		key.UV = (corner.Flags & OBJ_MISSING_UV) ? defaultUV :
+			corner.UV + ((corner.Flags & OBJ_RELATIVE_UV) ? uvBase : 0);
+		key.Normal = (corner.Flags & OBJ_MISSING_NORMAL) ? defaultNormal :
+			corner.Normal + ((corner.Flags & OBJ_RELATIVE_NORMAL) ? normalBase : 0);
+
+		// Clamp corners pointing outside the file's data
+		if (key.Position >= positions.size()) key.Position = 0;
+		if (key.UV >= uvs.size()) key.UV = defaultUV;
+		if (key.Normal >= normals.size()) key.Normal = defaultNormal;
+
+		auto found = weldedVerts.find(key);
+		if (found != weldedVerts.end())
+			return found->second;
+
+		Vertex v;
+		v.Position = positions[key.Position];
+		v.UV = uvs[key.UV];
+		v.Normal = normals[key.Normal];
+		v.Tangent = XMFLOAT3(0, 0, 0);
+
+		// Convert to a left-handed space for DirectX:
+		//  - Invert the Z position
+		//  - Invert the normal's Z
+		//  - Flip the winding order (done by the caller)
+		// and flip the UV since DirectX defines (0,0) as the
+		// top left of the texture
+		v.UV.y = 1.0f - v.UV.y;
+		v.Position.z *= -1.0f;
+		v.Normal.z *= -1.0f;
+
+		unsigned int index = (unsigned int)verts.size();
+		verts.push_back(v);
+		weldedVerts.insert({ key, index });
+		return index;
+	};
+
+	for (ObjChunk& chunk : chunks)
+	{
+		for (size_t c = 0; c + 2 < chunk.Corners.size(); c += 3)
+		{
+			unsigned int v1 = GetWeldedVertex(chunk.Corners[c]);
+			unsigned int v2 = GetWeldedVertex(chunk.Corners[c + 1]);
+			unsigned int v3 = GetWeldedVertex(chunk.Corners[c + 2]);
+
+			// Add the triangle (flipping the winding order)
+			indices.push_back(v1);
+			indices.push_back(v3);
+			indices.push_back(v2);
+		}
+
+		positionBase += (int)chunk.Positions.size();
+		uvBase += (int)chunk.UVs.size();
+		normalBase += (int)chunk.Normals.size();
+	}
+}
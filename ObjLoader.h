@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Parses .obj file data (usually a memory mapped file)
+// into welded vertices and a triangle list of indices
+// into them
+//
+// - Supports positions, uvs and normals, n-gons
+//   (fan triangulated) and negative (relative) indices
+// - Converts from a right-handed to a left-handed space
+//   and flips UVs, same as the original loader did
+// - Large files are split into chunks parsed on
+//   separate threads, then merged in file order
+// --------------------------------------------------------
+void ParseObjData(const char* data, size_t size,
+	std::vector<Vertex>& verts,
+	std::vector<unsigned int>& indices);
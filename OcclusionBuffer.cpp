@@ -0,0 +1,270 @@
+#include "OcclusionBuffer.h"
+#include "OcclusionBufferSimd.h"
+#include "CpuFeatures.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+
+	unsigned int size = 0;
+	for (int level = 0; level < OCCLUSION_LEVELS; level++)
+	{
+		levelOffsets[level] = size;
+		size += std::max(OCCLUSION_WIDTH >> level, 1) * std::max(OCCLUSION_HEIGHT >> level, 1);
+	}
+	depth.resize(size, 1.0f);
+}
+
+void OcclusionBuffer::Begin(const XMFLOAT4X4& _viewProjection)
+{
+	viewProjection = _viewProjection;
+	triangles.clear();
+	std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void OcclusionBuffer::AddOccluder(const XMFLOAT4X4& world,
+	const XMFLOAT3* positions, unsigned int vertexCount,
+	const unsigned int* indices, unsigned int indexCount)
+{
+	// Straight to clip space
+	XMMATRIX toClip = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&viewProjection);
+	clipPositions.resize(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		XMStoreFloat4(&clipPositions[v], XMVector3Transform(XMLoadFloat3(&positions[v]), toClip));
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		XMFLOAT4 corners[3] = { clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]] };
+		bool inFront[3] = { corners[0].z >= 0.0f, corners[1].z >= 0.0f, corners[2].z >= 0.0f };
+		if (inFront[0] && inFront[1] && inFront[2])
+		{
+			AddTriangle(corners);
+			continue;
+		}
+
+		// Clip to the near plane (z >= 0 in D3D's clip space), which
+		// leaves a triangle or a quad
+		XMFLOAT4 clipped[4];
+		int clippedCount = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			const XMFLOAT4& a = corners[c];
+			const XMFLOAT4& b = corners[(c + 1) % 3];
+			if (inFront[c])
+				clipped[clippedCount++] = a;
+			if (inFront[c] != inFront[(c + 1) % 3])
+			{
+				float t = a.z / (a.z - b.z);
+				clipped[clippedCount++] = XMFLOAT4(
+					a.x + (b.x - a.x) * t,
+					a.y + (b.y - a.y) * t,
+					0.0f,
+					a.w + (b.w - a.w) * t);
+			}
+		}
+
+		if (clippedCount >= 3)
+			AddTriangle(clipped);
+		if (clippedCount == 4)
+		{
+			XMFLOAT4 second[3] = { clipped[0], clipped[2], clipped[3] };
+			AddTriangle(second);
+		}
+	}
+}
+
+void OcclusionBuffer::AddTriangle(const XMFLOAT4* clip)
+{
+	// Onto the buffer's pixels, y down
+	float x[3], y[3], z[3];
+	for (int c = 0; c < 3; c++)
+	{
+		if (clip[c].w <= 0.0f)
+			return;
+		float invW = 1.0f / clip[c].w;
+		x[c] = (clip[c].x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[c] = (0.5f - clip[c].y * invW * 0.5f) * OCCLUSION_HEIGHT;
+		z[c] = clip[c].z * invW;
+	}
+
+	// Clockwise on screen is positive here - anything else is
+	// facing away, or edge on
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0.0f))
+		return;
+
+	// Pixels are sampled at their centers
+	OcclusionTriangle triangle;
+	triangle.MinX = std::max((int)ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f), 0);
+	triangle.MinY = std::max((int)ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f), 0);
+	triangle.MaxX = std::min((int)floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f), OCCLUSION_WIDTH - 1);
+	triangle.MaxY = std::min((int)floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f), OCCLUSION_HEIGHT - 1);
+	if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+		return;
+
+	for (int e = 0; e < 3; e++)
+	{
+		int a = e;
+		int b = (e + 1) % 3;
+		triangle.EdgeA[e] = y[a] - y[b];
+		triangle.EdgeB[e] = x[b] - x[a];
+		triangle.EdgeC[e] = (y[b] - y[a]) * x[a] - (x[b] - x[a]) * y[a];
+	}
+
+	// Depth is linear across the screen after the divide
+	float invArea = 1.0f / area;
+	triangle.DepthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+	triangle.DepthY = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) * invArea;
+	triangle.Depth = z[0] - triangle.DepthX * x[0] - triangle.DepthY * y[0];
+
+	triangles.push_back(triangle);
+}
+
+void OcclusionBuffer::Rasterize()
+{
+	// Bands of rows never share pixels, so the threads need no locks
+	int rangeCount = GetRangeCount(OCCLUSION_HEIGHT, OCCLUSION_MIN_ROWS);
+	bool avx2 = HasAvx2();
+	ParallelFor(OCCLUSION_HEIGHT, rangeCount, [&](int, int first, int last)
+	{
+		if (avx2)
+			RasterizeRowsAvx2(triangles.data(), (unsigned int)triangles.size(), depth.data(), first, last);
+		else
+			RasterizeRowsSse(triangles.data(), (unsigned int)triangles.size(), depth.data(), first, last);
+	});
+
+	BuildHierarchy();
+}
+
+void RasterizeRowsSse(const OcclusionTriangle* triangles, unsigned int triangleCount,
+	float* depth, int firstRow, int lastRow)
+{
+	RasterizeTriangleRows<SseLanes>(triangles, triangleCount, depth, firstRow, lastRow);
+}
+
+void OcclusionBuffer::BuildHierarchy()
+{
+	// Each texel is the farthest of the four under it
+	for (int level = 1; level < OCCLUSION_LEVELS; level++)
+	{
+		int width = std::max(OCCLUSION_WIDTH >> level, 1);
+		int height = std::max(OCCLUSION_HEIGHT >> level, 1);
+		int belowWidth = std::max(OCCLUSION_WIDTH >> (level - 1), 1);
+		int belowHeight = std::max(OCCLUSION_HEIGHT >> (level - 1), 1);
+		const float* below = &depth[levelOffsets[level - 1]];
+		float* texels = &depth[levelOffsets[level]];
+		for (int y = 0; y < height; y++)
+		{
+			const float* row0 = below + std::min(y * 2, belowHeight - 1) * belowWidth;
+			const float* row1 = below + std::min(y * 2 + 1, belowHeight - 1) * belowWidth;
+			for (int x = 0; x < width; x++)
+			{
+				int x0 = std::min(x * 2, belowWidth - 1);
+				int x1 = std::min(x * 2 + 1, belowWidth - 1);
+				texels[y * width + x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::IsBoxVisible(const CullBounds& bounds)
+{
+	// The screen rectangle and nearest depth of the box's corners,
+	// which are the clip space center plus or minus each axis
+	const XMFLOAT4X4& m = viewProjection;
+	const XMFLOAT3& c = bounds.Center;
+	const XMFLOAT3& e = bounds.Extents;
+	float center[4], axes[3][4];
+	for (int i = 0; i < 4; i++)
+	{
+		center[i] = c.x * m.m[0][i] + c.y * m.m[1][i] + c.z * m.m[2][i] + m.m[3][i];
+		axes[0][i] = e.x * m.m[0][i];
+		axes[1][i] = e.y * m.m[1][i];
+		axes[2][i] = e.z * m.m[2][i];
+	}
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float clip[4];
+		for (int i = 0; i < 4; i++)
+		{
+			clip[i] = center[i] +
+				((corner & 1) ? axes[0][i] : -axes[0][i]) +
+				((corner & 2) ? axes[1][i] : -axes[1][i]) +
+				((corner & 4) ? axes[2][i] : -axes[2][i]);
+		}
+		if (clip[2] < 0.0f || clip[3] <= 0.0f)
+			return true;
+
+		float invW = 1.0f / clip[3];
+		float x = (clip[0] * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (0.5f - clip[1] * invW * 0.5f) * OCCLUSION_HEIGHT;
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip[2] * invW);
+	}
+
+	if (maxX < 0.0f || maxY < 0.0f || minX >= OCCLUSION_WIDTH || minY >= OCCLUSION_HEIGHT)
+		return true;
+
+	// Every pixel the rectangle touches, not just their centers
+	int x0 = std::max((int)minX, 0);
+	int y0 = std::max((int)minY, 0);
+	int x1 = std::min((int)maxX, OCCLUSION_WIDTH - 1);
+	int y1 = std::min((int)maxY, OCCLUSION_HEIGHT - 1);
+
+	// The finest level where that's at most 2x2 texels
+	int level = 0;
+	while (level < OCCLUSION_LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+		level++;
+
+	int width = std::max(OCCLUSION_WIDTH >> level, 1);
+	const float* texels = &depth[levelOffsets[level]];
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (nearest <= texels[y * width + x])
+				return true;
+		}
+	}
+	return false;
+}
+
+unsigned int OcclusionBuffer::CullOccluded(const CullBounds* bounds, std::vector<unsigned int>& indices)
+{
+	// Nothing was drawn, so nothing can be hidden
+	if (triangles.empty())
+		return 0;
+
+	size_t kept = 0;
+	for (unsigned int index : indices)
+	{
+		if (IsBoxVisible(bounds[index]))
+			indices[kept++] = index;
+	}
+
+	unsigned int removed = (unsigned int)(indices.size() - kept);
+	indices.resize(kept);
+	return removed;
+}
+
+const float* OcclusionBuffer::GetDepth(int level)
+{
+	return &depth[levelOffsets[level]];
+}
+
+unsigned int OcclusionBuffer::GetTriangleCount()
+{
+	return (unsigned int)triangles.size();
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "FrustumCull.h"
+
+// Size of the depth buffer occluders are drawn into - it's
+// only compared against whole bounding boxes, so it can be
+// much coarser than the screen
+#define OCCLUSION_WIDTH		256
+#define OCCLUSION_HEIGHT	128
+
+// Mip levels of the hierarchical Z, from full size to 1x1
+#define OCCLUSION_LEVELS	9
+
+// Fewest rows worth giving their own thread
+#define OCCLUSION_MIN_ROWS	16
+
+// --------------------------------------------------------
+// A triangle set up for rasterizing, once, when it's added,
+// so the threads only read it
+// --------------------------------------------------------
+struct OcclusionTriangle
+{
+	float EdgeA[3], EdgeB[3], EdgeC[3];		// Inside where A * x + B * y + C >= 0 for all three
+	float Depth, DepthX, DepthY;			// Depth = Depth + DepthX * x + DepthY * y
+	int MinX, MinY, MaxX, MaxY;				// Pixels whose centers might be inside
+};
+
+// --------------------------------------------------------
+// A small CPU depth buffer of the scene's biggest objects
+// (occluders), for skipping anything hidden behind them
+// before it's ever sent to the GPU
+//
+// - Begin() clears it for a camera, AddOccluder() sets up
+//   triangles, and Rasterize() draws them all - several
+//   threads each take a band of rows, and fill 8 pixels at
+//   a time with AVX2 (on CPUs that have it) or 4 with SSE
+// - Each level of the hierarchical Z then holds the
+//   farthest depth of the 2x2 texels under it, so a box is
+//   hidden if its nearest point is behind the farthest
+//   depth of every texel its screen rectangle covers
+// - Depth is D3D's, 0 at the near plane and 1 at the far
+// --------------------------------------------------------
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	void Begin(const DirectX::XMFLOAT4X4& viewProjection);
+
+	// Triangles are clockwise from the front (as D3D draws
+	// them), and the back faces are skipped - the parts in
+	// front of the near plane are clipped off
+	void AddOccluder(const DirectX::XMFLOAT4X4& world,
+		const DirectX::XMFLOAT3* positions, unsigned int vertexCount,
+		const unsigned int* indices, unsigned int indexCount);
+
+	void Rasterize();
+
+	// False only if the box is certainly hidden - anything
+	// crossing the near plane or off screen is "visible"
+	bool IsBoxVisible(const CullBounds& bounds);
+
+	// Removes the hidden boxes' indices from a list of indices
+	// into bounds, keeping the order, and returns how many went
+	unsigned int CullOccluded(const CullBounds* bounds, std::vector<unsigned int>& indices);
+
+	const float* GetDepth(int level = 0);	// (OCCLUSION_WIDTH >> level) wide
+	unsigned int GetTriangleCount();		// Rasterized, after clipping and culling
+
+private:
+	void AddTriangle(const DirectX::XMFLOAT4* clip);
+	void BuildHierarchy();
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	std::vector<OcclusionTriangle> triangles;
+	std::vector<DirectX::XMFLOAT4> clipPositions;	// Of the occluder being added
+	std::vector<float> depth;						// Every level, full size first
+	unsigned int levelOffsets[OCCLUSION_LEVELS];
+};
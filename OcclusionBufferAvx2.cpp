@@ -0,0 +1,9 @@
+#include "OcclusionBufferSimd.h"
+
+// Only this file is built with AVX2 - see SimdLanes.h
+
+void RasterizeRowsAvx2(const OcclusionTriangle* triangles, unsigned int triangleCount,
+	float* depth, int firstRow, int lastRow)
+{
+	RasterizeTriangleRows<Avx2Lanes>(triangles, triangleCount, depth, firstRow, lastRow);
+}
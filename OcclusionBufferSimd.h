@@ -0,0 +1,71 @@
+#pragma once
+#include "OcclusionBuffer.h"
+#include "SimdLanes.h"
+
+// --------------------------------------------------------
+// Draws every triangle's part of rows [firstRow, lastRow)
+// into the full size level of the depth buffer, for each
+// instruction set - the AVX2 one is in OcclusionBufferAvx2.cpp,
+// and must only be called if HasAvx2()
+// --------------------------------------------------------
+void RasterizeRowsSse(const OcclusionTriangle* triangles, unsigned int triangleCount,
+	float* depth, int firstRow, int lastRow);
+void RasterizeRowsAvx2(const OcclusionTriangle* triangles, unsigned int triangleCount,
+	float* depth, int firstRow, int lastRow);
+
+// --------------------------------------------------------
+// Those, L::Count pixels at a time
+// --------------------------------------------------------
+template<typename L>
+void RasterizeTriangleRows(const OcclusionTriangle* triangles, unsigned int triangleCount,
+	float* depth, int firstRow, int lastRow)
+{
+	typedef typename L::Type Lanes;
+	const Lanes laneOffsets = L::Centers();
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		const OcclusionTriangle& triangle = triangles[t];
+		int minY = triangle.MinY > firstRow ? triangle.MinY : firstRow;
+		int maxY = triangle.MaxY < lastRow - 1 ? triangle.MaxY : lastRow - 1;
+		if (minY > maxY)
+			continue;
+
+		Lanes edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; e++)
+		{
+			edgeA[e] = L::Set(triangle.EdgeA[e]);
+			edgeB[e] = L::Set(triangle.EdgeB[e]);
+			edgeC[e] = L::Set(triangle.EdgeC[e]);
+		}
+		Lanes depthX = L::Set(triangle.DepthX);
+		Lanes depthY = L::Set(triangle.DepthY);
+		Lanes depthC = L::Set(triangle.Depth);
+
+		// Whole blocks of lanes, as the buffer's width is a
+		// multiple of them - the edges mask off the rest
+		int firstX = triangle.MinX & ~(L::Count - 1);
+		for (int y = minY; y <= maxY; y++)
+		{
+			Lanes centerY = L::Set(y + 0.5f);
+			Lanes rowEdge[3];
+			for (int e = 0; e < 3; e++)
+				rowEdge[e] = L::Add(L::Mul(edgeB[e], centerY), edgeC[e]);
+			Lanes rowDepth = L::Add(L::Mul(depthY, centerY), depthC);
+
+			float* row = &depth[y * OCCLUSION_WIDTH];
+			for (int x = firstX; x <= triangle.MaxX; x += L::Count)
+			{
+				Lanes centerX = L::Add(L::Set((float)x), laneOffsets);
+				Lanes inside = L::NonNegative(L::Add(L::Mul(edgeA[0], centerX), rowEdge[0]));
+				inside = L::And(inside, L::NonNegative(L::Add(L::Mul(edgeA[1], centerX), rowEdge[1])));
+				inside = L::And(inside, L::NonNegative(L::Add(L::Mul(edgeA[2], centerX), rowEdge[2])));
+				if (!L::Mask(inside))
+					continue;
+
+				Lanes pixelDepth = L::Add(L::Mul(depthX, centerX), rowDepth);
+				Lanes current = L::Load(row + x);
+				L::Store(row + x, L::Select(inside, L::Min(current, pixelDepth), current));
+			}
+		}
+	}
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+
+// --------------------------------------------------------
+// Splits [0, count) into one range per thread, once each
+// range would have at least minCount items
+// --------------------------------------------------------
+inline int GetRangeCount(int count, int minCount)
+{
+	// Asking can mean reading a file, so only ask once
+	static const int threadCount = (int)std::thread::hardware_concurrency();
+	int rangeCount = count / minCount;
+	if (rangeCount > threadCount) rangeCount = threadCount;
+	if (rangeCount < 1) rangeCount = 1;
+	return rangeCount;
+}
+
+// --------------------------------------------------------
+// Threads that stay alive for the whole run, taking ranges
+// off one queue, so ParallelFor doesn't start and stop a
+// thread per range every time it's called
+//
+// - Any thread can call Run(), even from inside a range of
+//   another Run(): callers work through the queue themselves
+//   while they wait, so nothing waits on a worker that's
+//   waiting on it
+// - One fewer worker than hardware threads, as the caller
+//   is always the other one
+// --------------------------------------------------------
+class WorkerPool
+{
+public:
+	// The one ParallelFor uses, started by the first call and
+	// stopped at exit
+	static WorkerPool& Get()
+	{
+		static WorkerPool pool((int)std::thread::hardware_concurrency() - 1);
+		return pool;
+	}
+
+	explicit WorkerPool(int workerCount) :
+		stopping(false)
+	{
+		for (int t = 0; t < workerCount; t++)
+			workers.push_back(std::thread([this]() { WorkerLoop(); }));
+	}
+
+	// Pools own threads, so they can't be copied
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Runs work(range, first, last) for each of rangeCount
+	// ranges of [0, count), this thread taking the first
+	template<typename Work>
+	void Run(int count, int rangeCount, Work& work)
+	{
+		Job job;
+		job.RunRange = [](void* work, int range, int first, int last) { (*(Work*)work)(range, first, last); };
+		job.Work = &work;
+		job.Count = count;
+		job.RangeCount = rangeCount;
+		job.Remaining = rangeCount - 1;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int r = 1; r < rangeCount; r++)
+				tasks.push_back({ &job, r });
+		}
+		wake.notify_all();
+
+		RunTask({ &job, 0 });
+
+		// Help with whatever's queued (ours or not) until the rest of
+		// ours are done - the job lives on this stack until then
+		while (job.Remaining > 0)
+		{
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (tasks.empty())
+				{
+					done.wait(lock, [&]() { return job.Remaining == 0 || !tasks.empty(); });
+					continue;
+				}
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			RunTask(task);
+			Finish(task);
+		}
+	}
+
+	int GetWorkerCount()
+	{
+		return (int)workers.size();
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+private:
+	struct Job
+	{
+		void (*RunRange)(void* work, int range, int first, int last);
+		void* Work;
+		int Count;
+		int RangeCount;
+		std::atomic<int> Remaining;	// Ranges past the first still running or queued
+	};
+
+	struct Task
+	{
+		Job* Owner;
+		int Range;
+	};
+
+	static void RunTask(Task task)
+	{
+		int first = (int)((long long)task.Owner->Count * task.Range / task.Owner->RangeCount);
+		int last = (int)((long long)task.Owner->Count * (task.Range + 1) / task.Owner->RangeCount);
+		task.Owner->RunRange(task.Owner->Work, task.Range, first, last);
+	}
+
+	// Wakes the job's caller if that was its last range - after
+	// this, the job may be gone
+	void Finish(Task task)
+	{
+		if (--task.Owner->Remaining == 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty())
+					return;
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			RunTask(task);
+			Finish(task);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;					// Guards everything below
+	std::condition_variable wake;		// For workers, when tasks are queued
+	std::condition_variable done;		// For callers, when a job's last range finishes
+	std::deque<Task> tasks;
+	bool stopping;
+};
+
+// --------------------------------------------------------
+// Runs work(range, first, last) for each of rangeCount
+// ranges of [0, count), spread over the WorkerPool, using
+// this thread for the first one
+// --------------------------------------------------------
+template<typename Work>
+void ParallelFor(int count, int rangeCount, Work work)
+{
+	if (rangeCount <= 1)
+	{
+		work(0, 0, count);
+		return;
+	}
+	WorkerPool::Get().Run(count, rangeCount, work);
+}
@@ -2,22 +2,99 @@
 
 #define MAX_LIGHTS 64
 
+// Must match ShadowCascades.h
+#define MAX_SHADOW_CASCADES 4
+
+// Must match LightClusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
 cbuffer ExternalData : register(b0)
 {
     float3 cameraPos;
     int lightNum;
     Light lights[MAX_LIGHTS];  
+    
+    matrix cascadeViewProjections[MAX_SHADOW_CASCADES];
+    float4 cascadeSplits; // Far view depth of each cascade
+    float3 cameraForward;
+    int cascadeCount;
+    
+    float2 clusterTileScale; // Clusters per pixel, across and down
+    float2 clusterDepthScaleBias; // A view depth's slice is log(depth) * x + y
+    int globalLightCount; // Lights at the front of LightIndices, lighting every cluster
 }
 
 Texture2D Albedo : register(t0);
 Texture2D NormalMap : register(t1);
 Texture2D RoughnessMap : register(t2);
 Texture2D MetalnessMap : register(t3);
-Texture2D ShadowMap : register(t4);
+Texture2DArray ShadowMap : register(t4); // A slice per cascade
+Texture2D ShadowAtlas : register(t5); // Every other light's tiles
+
+// Must match ShadowAtlasEntry in ShadowAtlas.h
+struct ShadowAtlasEntry
+{
+    matrix viewProjection;
+    float4 rect; // UV offset in xy, UV size in zw
+};
+StructuredBuffer<ShadowAtlasEntry> ShadowAtlasTiles : register(t6);
+
+// Each cluster's offset and count in LightIndices - after
+// the lights every cluster has
+StructuredBuffer<uint2> LightClusters : register(t7);
+StructuredBuffer<uint> LightIndices : register(t8);
 
 SamplerState BasicSampler : register(s0);
 SamplerComparisonState ShadowSampler : register(s1);
 
+// --------------------------------------------------------
+// How lit a point is by a light with tiles in the shadow
+// atlas - fully lit if it has none, or the point's outside
+// them (past a point light's range, or a directional
+// light's box)
+// --------------------------------------------------------
+float AtlasShadowAmount(Light light, float3 worldPosition)
+{
+    if (light.ShadowTile < 0)
+        return 1.0f;
+
+    // A point light has a tile per cube face, picked by the
+    // axis the point is furthest along
+    int tile = light.ShadowTile;
+    if (light.Type == LIGHT_TYPE_POINT)
+    {
+        float3 fromLight = worldPosition - light.Position;
+        float3 axes = abs(fromLight);
+        if (axes.x >= axes.y && axes.x >= axes.z)
+            tile += fromLight.x > 0 ? 0 : 1;
+        else if (axes.y >= axes.z)
+            tile += fromLight.y > 0 ? 2 : 3;
+        else
+            tile += fromLight.z > 0 ? 4 : 5;
+    }
+
+    ShadowAtlasEntry entry = ShadowAtlasTiles[tile];
+    float4 shadowPos = mul(entry.viewProjection, float4(worldPosition, 1.0f));
+    shadowPos.xyz /= shadowPos.w;
+    if (any(abs(shadowPos.xy) > 1.0f) || shadowPos.z > 1.0f)
+        return 1.0f;
+
+    // Into the tile, and kept half a texel from its edges so
+    // filtering never reaches into a neighbour
+    float2 shadowUV = shadowPos.xy * 0.5f + 0.5f;
+    shadowUV.y = 1 - shadowUV.y;
+    shadowUV = entry.rect.xy + shadowUV * entry.rect.zw;
+
+    float2 atlasSize;
+    ShadowAtlas.GetDimensions(atlasSize.x, atlasSize.y);
+    float2 halfTexel = 0.5f / atlasSize;
+    shadowUV = clamp(shadowUV, entry.rect.xy + halfTexel, entry.rect.xy + entry.rect.zw - halfTexel);
+
+    return ShadowAtlas.SampleCmpLevelZero(ShadowSampler, shadowUV, shadowPos.z).r;
+}
+
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
@@ -52,23 +129,41 @@ float4 main(VertexToPixel input) : SV_TARGET
     
     float3 specularColor = lerp(F0_NON_METAL, surfaceColor.rgb, metalness);
     
-    // Perform the perspective divide (divide by W) ourselves
-    input.shadowMapPos /= input.shadowMapPos.w;
-    // Convert the normalized device coordinates to UVs for sampling
-    float2 shadowUV = input.shadowMapPos.xy * 0.5f + 0.5f;
-    shadowUV.y = 1 - shadowUV.y; // Flip the Y
-    float distToLight = input.shadowMapPos.z;
+    // The nearest cascade whose slice of the view holds this
+    // pixel - anything past the last one is left unshadowed
+    float viewDepth = dot(input.worldPosition - cameraPos, cameraForward);
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    
+    float shadowAmount = 1.0f;
+    if (cascade < cascadeCount)
+    {
+        // Orthographic, so no divide by W is needed
+        float4 shadowMapPos = mul(cascadeViewProjections[cascade], float4(input.worldPosition, 1.0f));
+        // Convert the normalized device coordinates to UVs for sampling
+        float2 shadowUV = shadowMapPos.xy * 0.5f + 0.5f;
+        shadowUV.y = 1 - shadowUV.y; // Flip the Y
+        float distToLight = shadowMapPos.z;
 
+        shadowAmount = ShadowMap.SampleCmpLevelZero(
+            ShadowSampler,
+            float3(shadowUV, cascade),
+            distToLight).r;
+    }
     
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(
-        ShadowSampler,
-        shadowUV,
-        distToLight).r;
+    // Only the lights that can reach this pixel's cluster
+    uint2 tile = min(uint2(input.screenPosition.xy * clusterTileScale), uint2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    float slice = floor(log(max(viewDepth, 0.0001f)) * clusterDepthScaleBias.x + clusterDepthScaleBias.y);
+    uint clusterIndex = ((uint)clamp(slice, 0, CLUSTER_Z - 1) * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+    uint2 cluster = LightClusters[clusterIndex];
+    uint clusterLightNum = (uint)globalLightCount + cluster.y;
     
     float3 finalColor = float3(0, 0, 0);
     
-    for (int i = 0; i < lightNum; i++)
+    for (uint n = 0; n < clusterLightNum; n++)
     {
+        uint i = LightIndices[n < (uint)globalLightCount ? n : cluster.x + n - (uint)globalLightCount];
         Light currentLight = lights[i];
         
         switch (currentLight.Type)
@@ -79,11 +174,16 @@ float4 main(VertexToPixel input) : SV_TARGET
                 {
                     lightResult *= shadowAmount;
                 }
+                else
+                {
+                    lightResult *= AtlasShadowAmount(currentLight, input.worldPosition);
+                }
                 finalColor += lightResult;
                 break;
             
             case LIGHT_TYPE_POINT:
-                finalColor += PointLightPBR(currentLight, input.normal, roughness, metalness, surfaceColor, cameraPos, input.worldPosition, specularColor);
+                finalColor += PointLightPBR(currentLight, input.normal, roughness, metalness, surfaceColor, cameraPos, input.worldPosition, specularColor) *
+                    AtlasShadowAmount(currentLight, input.worldPosition);
                 break;
         }
     }
@@ -0,0 +1,280 @@
+#include "RangeAllocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit (x can't be 0)
+static int LowestBit(unsigned int x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return (int)index;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// Index of the highest set bit (x can't be 0)
+static int HighestBit(unsigned int x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(x);
+#endif
+}
+
+// --------------------------------------------------------
+// Which list a free range of this size goes in
+//
+// Sizes below RANGE_ALLOCATOR_SUBCLASSES each get their own
+// list in class 0, and each power of two above that is
+// split into RANGE_ALLOCATOR_SUBCLASSES even steps
+// --------------------------------------------------------
+static void GetSizeClass(unsigned int size, int& sizeClass, int& subclass)
+{
+	if (size < RANGE_ALLOCATOR_SUBCLASSES)
+	{
+		sizeClass = 0;
+		subclass = (int)size;
+		return;
+	}
+
+	int bit = HighestBit(size);
+	sizeClass = bit - RANGE_ALLOCATOR_SUBCLASS_BITS + 1;
+	subclass = (int)(size >> (bit - RANGE_ALLOCATOR_SUBCLASS_BITS)) - RANGE_ALLOCATOR_SUBCLASSES;
+}
+
+RangeAllocator::RangeAllocator(unsigned int capacity) :
+	lastBlock(-1),
+	classBitmap(0),
+	capacity(0),
+	usedSize(0),
+	allocationCount(0)
+{
+	for (int c = 0; c < RANGE_ALLOCATOR_CLASSES; c++)
+	{
+		subclassBitmaps[c] = 0;
+		for (int s = 0; s < RANGE_ALLOCATOR_SUBCLASSES; s++)
+			freeLists[c][s] = -1;
+	}
+
+	Grow(capacity);
+}
+
+int RangeAllocator::CreateBlock(unsigned int offset, unsigned int size)
+{
+	int block;
+	if (unusedBlocks.empty())
+	{
+		block = (int)blocks.size();
+		blocks.push_back({});
+	}
+	else
+	{
+		block = unusedBlocks.back();
+		unusedBlocks.pop_back();
+	}
+
+	blocks[block] = { offset, size, false, -1, -1, -1, -1 };
+	return block;
+}
+
+void RangeAllocator::InsertFree(int block)
+{
+	int sizeClass, subclass;
+	GetSizeClass(blocks[block].Size, sizeClass, subclass);
+
+	Block& b = blocks[block];
+	b.IsFree = true;
+	b.PrevFree = -1;
+	b.NextFree = freeLists[sizeClass][subclass];
+	if (b.NextFree >= 0)
+		blocks[b.NextFree].PrevFree = block;
+	freeLists[sizeClass][subclass] = block;
+
+	classBitmap |= 1u << sizeClass;
+	subclassBitmaps[sizeClass] |= 1u << subclass;
+}
+
+void RangeAllocator::RemoveFree(int block)
+{
+	int sizeClass, subclass;
+	GetSizeClass(blocks[block].Size, sizeClass, subclass);
+
+	Block& b = blocks[block];
+	if (b.PrevFree >= 0)
+		blocks[b.PrevFree].NextFree = b.NextFree;
+	else
+		freeLists[sizeClass][subclass] = b.NextFree;
+	if (b.NextFree >= 0)
+		blocks[b.NextFree].PrevFree = b.PrevFree;
+	b.IsFree = false;
+
+	// Clear the bits once the list is empty
+	if (freeLists[sizeClass][subclass] < 0)
+	{
+		subclassBitmaps[sizeClass] &= ~(1u << subclass);
+		if (subclassBitmaps[sizeClass] == 0)
+			classBitmap &= ~(1u << sizeClass);
+	}
+}
+
+bool RangeAllocator::Allocate(unsigned int size, RangeAllocation& allocation)
+{
+	allocation = { 0, 0, -1 };
+	if (size == 0)
+		return false;
+
+	// Round up to the next list boundary, so every range in the
+	// list we start searching from is big enough
+	unsigned int searchSize = size;
+	if (size >= RANGE_ALLOCATOR_SUBCLASSES)
+	{
+		unsigned int step = 1u << (HighestBit(size) - RANGE_ALLOCATOR_SUBCLASS_BITS);
+		if (searchSize > ~0u - (step - 1))
+			return false;
+		searchSize += step - 1;
+	}
+
+	int sizeClass, subclass;
+	GetSizeClass(searchSize, sizeClass, subclass);
+
+	// The first non-empty list at or above that one
+	unsigned int subclasses = subclassBitmaps[sizeClass] & (~0u << subclass);
+	if (subclasses == 0)
+	{
+		unsigned int classes = sizeClass + 1 < 32 ? classBitmap & (~0u << (sizeClass + 1)) : 0;
+		if (classes == 0)
+			return false;
+		sizeClass = LowestBit(classes);
+		subclasses = subclassBitmaps[sizeClass];
+	}
+	subclass = LowestBit(subclasses);
+
+	int block = freeLists[sizeClass][subclass];
+	RemoveFree(block);
+
+	// Give whatever's left over back as its own free range
+	if (blocks[block].Size > size)
+	{
+		int rest = CreateBlock(blocks[block].Offset + size, blocks[block].Size - size);
+		blocks[rest].PrevPhysical = block;
+		blocks[rest].NextPhysical = blocks[block].NextPhysical;
+		if (blocks[rest].NextPhysical >= 0)
+			blocks[blocks[rest].NextPhysical].PrevPhysical = rest;
+		else
+			lastBlock = rest;
+		blocks[block].NextPhysical = rest;
+		blocks[block].Size = size;
+		InsertFree(rest);
+	}
+
+	usedSize += size;
+	allocationCount++;
+	allocation = { blocks[block].Offset, size, block };
+	return true;
+}
+
+void RangeAllocator::Free(RangeAllocation& allocation)
+{
+	int block = allocation.Block;
+	allocation = { 0, 0, -1 };
+	if (block < 0 || blocks[block].IsFree)
+		return;
+
+	usedSize -= blocks[block].Size;
+	allocationCount--;
+
+	// Merge with a free range on either side
+	int prev = blocks[block].PrevPhysical;
+	if (prev >= 0 && blocks[prev].IsFree)
+	{
+		RemoveFree(prev);
+		blocks[prev].Size += blocks[block].Size;
+		blocks[prev].NextPhysical = blocks[block].NextPhysical;
+		if (blocks[prev].NextPhysical >= 0)
+			blocks[blocks[prev].NextPhysical].PrevPhysical = prev;
+		else
+			lastBlock = prev;
+		unusedBlocks.push_back(block);
+		block = prev;
+	}
+
+	int next = blocks[block].NextPhysical;
+	if (next >= 0 && blocks[next].IsFree)
+	{
+		RemoveFree(next);
+		blocks[block].Size += blocks[next].Size;
+		blocks[block].NextPhysical = blocks[next].NextPhysical;
+		if (blocks[block].NextPhysical >= 0)
+			blocks[blocks[block].NextPhysical].PrevPhysical = block;
+		else
+			lastBlock = block;
+		unusedBlocks.push_back(next);
+	}
+
+	InsertFree(block);
+}
+
+void RangeAllocator::Grow(unsigned int newCapacity)
+{
+	if (newCapacity <= capacity)
+		return;
+
+	// Extend the last range if it's free, or add a new one after it
+	unsigned int added = newCapacity - capacity;
+	if (lastBlock >= 0 && blocks[lastBlock].IsFree)
+	{
+		RemoveFree(lastBlock);
+		blocks[lastBlock].Size += added;
+		InsertFree(lastBlock);
+	}
+	else
+	{
+		int block = CreateBlock(capacity, added);
+		blocks[block].PrevPhysical = lastBlock;
+		if (lastBlock >= 0)
+			blocks[lastBlock].NextPhysical = block;
+		lastBlock = block;
+		InsertFree(block);
+	}
+
+	capacity = newCapacity;
+}
+
+unsigned int RangeAllocator::GetCapacity()
+{
+	return capacity;
+}
+
+unsigned int RangeAllocator::GetUsedSize()
+{
+	return usedSize;
+}
+
+unsigned int RangeAllocator::GetAllocationCount()
+{
+	return allocationCount;
+}
+
+unsigned int RangeAllocator::GetLargestFreeRange()
+{
+	if (classBitmap == 0)
+		return 0;
+
+	// Only the top list needs checking
+	int sizeClass = HighestBit(classBitmap);
+	int subclass = HighestBit(subclassBitmaps[sizeClass]);
+	unsigned int largest = 0;
+	for (int block = freeLists[sizeClass][subclass]; block >= 0; block = blocks[block].NextFree)
+	{
+		if (blocks[block].Size > largest)
+			largest = blocks[block].Size;
+	}
+	return largest;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+
+// Each power of two size class is split into this many
+// (as a power of two) finer classes
+#define RANGE_ALLOCATOR_SUBCLASS_BITS	4
+#define RANGE_ALLOCATOR_SUBCLASSES		(1 << RANGE_ALLOCATOR_SUBCLASS_BITS)
+#define RANGE_ALLOCATOR_CLASSES			(32 - RANGE_ALLOCATOR_SUBCLASS_BITS + 1)
+
+// --------------------------------------------------------
+// A range handed out by a RangeAllocator
+// --------------------------------------------------------
+struct RangeAllocation
+{
+	unsigned int Offset;
+	unsigned int Size;
+	int Block;				// Internal to the allocator, -1 if nothing was allocated
+};
+
+// --------------------------------------------------------
+// Hands out ranges of some larger space (like a buffer),
+// measured in whatever units the caller likes
+//
+// This is a two-level segregated fit (TLSF) allocator, after
+// Masmano et al. 2004: free ranges are kept in lists by size
+// class, with a bitmap of which lists have anything in them,
+// so allocating and freeing take constant time, and freed
+// ranges merge with free neighbours straight away
+//
+// Nothing here touches D3D, so it can be tested anywhere
+// --------------------------------------------------------
+class RangeAllocator
+{
+public:
+	RangeAllocator(unsigned int capacity = 0);
+
+	// Returns false (and leaves allocation empty) if there's
+	// no free range big enough
+	bool Allocate(unsigned int size, RangeAllocation& allocation);
+	void Free(RangeAllocation& allocation);
+
+	// Adds free space to the end
+	void Grow(unsigned int newCapacity);
+
+	unsigned int GetCapacity();
+	unsigned int GetUsedSize();
+	unsigned int GetAllocationCount();
+	unsigned int GetLargestFreeRange();
+
+private:
+	struct Block
+	{
+		unsigned int Offset;
+		unsigned int Size;
+		bool IsFree;
+		int PrevPhysical;	// Neighbours in the space, or -1
+		int NextPhysical;
+		int PrevFree;		// Neighbours in the free list, or -1
+		int NextFree;
+	};
+
+	int CreateBlock(unsigned int offset, unsigned int size);
+	void InsertFree(int block);
+	void RemoveFree(int block);
+
+	std::vector<Block> blocks;
+	std::vector<int> unusedBlocks;	// Slots in blocks to reuse
+	int lastBlock;					// The block at the end of the space
+
+	unsigned int classBitmap;
+	unsigned int subclassBitmaps[RANGE_ALLOCATOR_CLASSES];
+	int freeLists[RANGE_ALLOCATOR_CLASSES][RANGE_ALLOCATOR_SUBCLASSES];
+
+	unsigned int capacity;
+	unsigned int usedSize;
+	unsigned int allocationCount;
+};
@@ -0,0 +1,85 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+uint64_t MakeSortKey(unsigned int pass, unsigned int shader,
+	unsigned int material, unsigned int mesh, float depth)
+{
+	const uint64_t depthMax = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	uint64_t depthBits = depth <= 0.0f ? 0 :
+		depth >= 1.0f ? depthMax : (uint64_t)(depth * depthMax);
+
+	uint64_t key = pass & ((1u << RENDER_KEY_PASS_BITS) - 1);
+	key = (key << RENDER_KEY_SHADER_BITS) | (shader & ((1u << RENDER_KEY_SHADER_BITS) - 1));
+	key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+	key = (key << RENDER_KEY_MESH_BITS) | (mesh & ((1u << RENDER_KEY_MESH_BITS) - 1));
+	key = (key << RENDER_KEY_DEPTH_BITS) | depthBits;
+	return key;
+}
+
+void RenderQueue::Clear()
+{
+	packets.clear();
+}
+
+void RenderQueue::Add(uint64_t key, unsigned int entity)
+{
+	packets.push_back({ key, entity });
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = packets.size();
+	if (count < RENDER_QUEUE_MIN_RADIX_COUNT)
+	{
+		std::stable_sort(packets.begin(), packets.end(),
+			[](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+		return;
+	}
+
+	// One pass over the keys counts the digits of every byte
+	unsigned int counts[8][256] = {};
+	for (const DrawPacket& packet : packets)
+	{
+		uint64_t key = packet.Key;
+		for (int b = 0; b < 8; b++)
+			counts[b][(key >> (b * 8)) & 0xFF]++;
+	}
+
+	scratch.resize(count);
+	DrawPacket* source = packets.data();
+	DrawPacket* dest = scratch.data();
+	for (int b = 0; b < 8; b++)
+	{
+		// Every key has the same digit here, so the order stays as it is
+		unsigned int shift = b * 8;
+		if (counts[b][(source[0].Key >> shift) & 0xFF] == count)
+			continue;
+
+		// Turn the counts into where each digit's packets start
+		unsigned int offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			unsigned int digitCount = counts[b][d];
+			counts[b][d] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			dest[counts[b][(source[i].Key >> shift) & 0xFF]++] = source[i];
+		std::swap(source, dest);
+	}
+
+	// Odd number of passes, so the result is in the scratch
+	if (source != packets.data())
+		packets.swap(scratch);
+}
+
+const DrawPacket* RenderQueue::GetPackets()
+{
+	return packets.data();
+}
+
+unsigned int RenderQueue::GetCount()
+{
+	return (unsigned int)packets.size();
+}
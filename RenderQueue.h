@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Bits given to each part of a sort key, from the top down
+#define RENDER_KEY_PASS_BITS		4
+#define RENDER_KEY_SHADER_BITS		8
+#define RENDER_KEY_MATERIAL_BITS	12
+#define RENDER_KEY_MESH_BITS		16
+#define RENDER_KEY_DEPTH_BITS		24
+
+// Passes, in the order they're drawn
+#define RENDER_PASS_OPAQUE		0
+
+// Queues shorter than this use std::stable_sort,
+// which beats the radix sort's fixed costs
+#define RENDER_QUEUE_MIN_RADIX_COUNT	1024
+
+// --------------------------------------------------------
+// One draw: a sort key and the dense index of the entity
+// to draw (see EntityStore.h)
+// --------------------------------------------------------
+struct DrawPacket
+{
+	uint64_t Key;
+	unsigned int Entity;
+};
+
+// --------------------------------------------------------
+// What submitting a queue actually had to bind
+// --------------------------------------------------------
+struct RenderStats
+{
+	int Draws;
+	int Instances;		// Entities drawn by instanced draws
+	int ShaderBinds;
+	int MaterialBinds;
+};
+
+// --------------------------------------------------------
+// Packs a sort key, so sorting the keys groups draws by
+// pass, then shaders, then material, then mesh, and goes
+// front to back within those
+//
+// - IDs wider than their bits wrap, which only affects the
+//   order - whoever submits compares the actual state
+// - Depth is the distance from the camera over the far
+//   clip distance, clamped to [0, 1]
+// --------------------------------------------------------
+uint64_t MakeSortKey(unsigned int pass, unsigned int shader,
+	unsigned int material, unsigned int mesh, float depth);
+
+// --------------------------------------------------------
+// A list of draws for one frame, sorted by key
+//
+// Sort() is a stable LSD radix sort, a byte at a time,
+// which skips any byte that's the same in every key - so
+// with few shaders and materials most of the high bytes
+// cost nothing
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	void Clear();
+	void Add(uint64_t key, unsigned int entity);
+	void Sort();
+
+	const DrawPacket* GetPackets();
+	unsigned int GetCount();
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> scratch;	// Where each radix pass goes
+};
@@ -0,0 +1,493 @@
+#include "SceneBvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Which of the planes in mask the box is all the way inside
+// are dropped from the mask, or -1 if it's all the way
+// outside any of them
+// --------------------------------------------------------
+static int ClassifyBox(const XMFLOAT4 planes[6], int mask, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		if (!(mask & (1 << p)))
+			continue;
+
+		const XMFLOAT4& plane = planes[p];
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float reach = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (distance + reach < 0.0f)
+			return -1;
+		if (distance - reach >= 0.0f)
+			mask &= ~(1 << p);
+	}
+	return mask;
+}
+
+static bool BoxTouchesSphere(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, const XMFLOAT3& center, float radius)
+{
+	float dx = std::max(std::max(boxMin.x - center.x, center.x - boxMax.x), 0.0f);
+	float dy = std::max(std::max(boxMin.y - center.y, center.y - boxMax.y), 0.0f);
+	float dz = std::max(std::max(boxMin.z - center.z, center.z - boxMax.z), 0.0f);
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+// --------------------------------------------------------
+// Slab test - where along the ray it enters the box, or
+// FLT_MAX if it misses (or the box is all behind it)
+// --------------------------------------------------------
+static float RayEntersBox(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax,
+	const XMFLOAT3& origin, const XMFLOAT3& inverseDirection)
+{
+	float tx1 = (boxMin.x - origin.x) * inverseDirection.x, tx2 = (boxMax.x - origin.x) * inverseDirection.x;
+	float ty1 = (boxMin.y - origin.y) * inverseDirection.y, ty2 = (boxMax.y - origin.y) * inverseDirection.y;
+	float tz1 = (boxMin.z - origin.z) * inverseDirection.z, tz2 = (boxMax.z - origin.z) * inverseDirection.z;
+	float enter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+	float exit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+static void GetItemBox(const CullBounds& bounds, XMFLOAT3& boxMin, XMFLOAT3& boxMax)
+{
+	boxMin = XMFLOAT3(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+	boxMax = XMFLOAT3(bounds.Center.x + bounds.Extents.x, bounds.Center.y + bounds.Extents.y, bounds.Center.z + bounds.Extents.z);
+}
+
+SceneBvh::SceneBvh() :
+	itemCount(0),
+	movedCount(0)
+{
+}
+
+// --------------------------------------------------------
+// An item's box and center, copied out while building so
+// the splits shuffle compact records instead of chasing
+// indices into the caller's array
+// --------------------------------------------------------
+struct BuildItem
+{
+	float Min[3];
+	float Max[3];
+	float Center[3];
+	unsigned int Item;
+};
+
+void SceneBvh::Build(const CullBounds* bounds, unsigned int count)
+{
+	nodes.clear();
+	parents.clear();
+	loose.clear();
+	leafDirty.clear();
+	dirtyLeaves.clear();
+	items.resize(count);
+	itemLeaf.assign(count, BVH_NONE);
+	itemSlot.assign(count, BVH_NONE);
+	itemCount = count;
+	movedCount = 0;
+	if (count == 0)
+		return;
+
+	std::vector<BuildItem> work(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const CullBounds& b = bounds[i];
+		work[i] = {
+			{ b.Center.x - b.Extents.x, b.Center.y - b.Extents.y, b.Center.z - b.Extents.z },
+			{ b.Center.x + b.Extents.x, b.Center.y + b.Extents.y, b.Center.z + b.Extents.z },
+			{ b.Center.x, b.Center.y, b.Center.z },
+			i };
+	}
+
+	// Split top down, with a list of [node, first, count] still to do -
+	// children always come after their parents in the node list
+	nodes.reserve(count / BVH_LEAF_SIZE * 2 + 1);
+	nodes.push_back({});
+	parents.push_back(BVH_NONE);
+	std::vector<unsigned int> tasks = { 0, 0, count };
+	while (!tasks.empty())
+	{
+		unsigned int taskCount = tasks.back(); tasks.pop_back();
+		unsigned int first = tasks.back(); tasks.pop_back();
+		unsigned int node = tasks.back(); tasks.pop_back();
+
+		float boxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float boxMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		float centerMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float centerMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (unsigned int i = first; i < first + taskCount; i++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				boxMin[a] = std::min(boxMin[a], work[i].Min[a]);
+				boxMax[a] = std::max(boxMax[a], work[i].Max[a]);
+				centerMin[a] = std::min(centerMin[a], work[i].Center[a]);
+				centerMax[a] = std::max(centerMax[a], work[i].Center[a]);
+			}
+		}
+		nodes[node].Min = XMFLOAT3(boxMin[0], boxMin[1], boxMin[2]);
+		nodes[node].Max = XMFLOAT3(boxMax[0], boxMax[1], boxMax[2]);
+
+		if (taskCount <= BVH_LEAF_SIZE)
+		{
+			nodes[node].First = first;
+			nodes[node].Count = taskCount;
+			for (unsigned int i = first; i < first + taskCount; i++)
+			{
+				items[i] = work[i].Item;
+				itemLeaf[work[i].Item] = node;
+				itemSlot[work[i].Item] = i;
+			}
+			continue;
+		}
+
+		// Split at the middle of the centers along the longest axis,
+		// or at their median if that puts them all on one side
+		float spread[3] = { centerMax[0] - centerMin[0], centerMax[1] - centerMin[1], centerMax[2] - centerMin[2] };
+		int axis = spread[0] > spread[1] ? (spread[0] > spread[2] ? 0 : 2) : (spread[1] > spread[2] ? 1 : 2);
+		float split = (centerMin[axis] + centerMax[axis]) * 0.5f;
+		unsigned int middle = (unsigned int)(std::partition(work.begin() + first, work.begin() + first + taskCount,
+			[axis, split](const BuildItem& item) { return item.Center[axis] < split; }) - work.begin());
+		if (middle == first || middle == first + taskCount)
+		{
+			middle = first + taskCount / 2;
+			std::nth_element(work.begin() + first, work.begin() + middle, work.begin() + first + taskCount,
+				[axis](const BuildItem& a, const BuildItem& b) { return a.Center[axis] < b.Center[axis]; });
+		}
+
+		unsigned int child = (unsigned int)nodes.size();
+		nodes[node].First = child;
+		nodes[node].Count = BVH_NONE;
+		nodes.push_back({});
+		nodes.push_back({});
+		parents.push_back(node);
+		parents.push_back(node);
+		tasks.insert(tasks.end(), { child, first, middle - first });
+		tasks.insert(tasks.end(), { child + 1, middle, first + taskCount - middle });
+	}
+
+	leafDirty.resize(nodes.size(), 0);
+}
+
+void SceneBvh::Insert(unsigned int item)
+{
+	if (item >= itemLeaf.size())
+	{
+		itemLeaf.resize(item + 1, BVH_NONE);
+		itemSlot.resize(item + 1, BVH_NONE);
+	}
+
+	itemLeaf[item] = BVH_NONE;
+	itemSlot[item] = (unsigned int)loose.size();
+	loose.push_back(item);
+	itemCount++;
+}
+
+void SceneBvh::Remove(unsigned int item)
+{
+	if (item >= itemSlot.size() || itemSlot[item] == BVH_NONE)
+		return;
+
+	// The last item of the leaf (or loose list) fills the gap
+	unsigned int leaf = itemLeaf[item];
+	unsigned int slot = itemSlot[item];
+	if (leaf == BVH_NONE)
+	{
+		unsigned int last = loose.back();
+		loose[slot] = last;
+		itemSlot[last] = slot;
+		loose.pop_back();
+	}
+	else
+	{
+		BvhNode& node = nodes[leaf];
+		unsigned int last = items[node.First + node.Count - 1];
+		items[slot] = last;
+		itemSlot[last] = slot;
+		node.Count--;
+		if (!leafDirty[leaf])
+		{
+			leafDirty[leaf] = 1;
+			dirtyLeaves.push_back(leaf);
+		}
+	}
+
+	itemLeaf[item] = BVH_NONE;
+	itemSlot[item] = BVH_NONE;
+	itemCount--;
+}
+
+void SceneBvh::Rename(unsigned int from, unsigned int to)
+{
+	if (to >= itemLeaf.size())
+	{
+		itemLeaf.resize(to + 1, BVH_NONE);
+		itemSlot.resize(to + 1, BVH_NONE);
+	}
+
+	itemLeaf[to] = itemLeaf[from];
+	itemSlot[to] = itemSlot[from];
+	if (itemLeaf[to] == BVH_NONE)
+		loose[itemSlot[to]] = to;
+	else
+		items[itemSlot[to]] = to;
+
+	itemLeaf[from] = BVH_NONE;
+	itemSlot[from] = BVH_NONE;
+}
+
+void SceneBvh::MarkMoved(unsigned int item)
+{
+	movedCount++;
+
+	// Loose items are tested on their own anyway
+	unsigned int leaf = itemLeaf[item];
+	if (leaf != BVH_NONE && !leafDirty[leaf])
+	{
+		leafDirty[leaf] = 1;
+		dirtyLeaves.push_back(leaf);
+	}
+}
+
+void SceneBvh::RefitLeaf(unsigned int node, const CullBounds* bounds)
+{
+	// Empty leaves get an inside out box, which nothing touches
+	XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+	BvhNode& leaf = nodes[node];
+	for (unsigned int i = leaf.First; i < leaf.First + leaf.Count; i++)
+	{
+		XMVECTOR center = XMLoadFloat3(&bounds[items[i]].Center);
+		XMVECTOR extents = XMLoadFloat3(&bounds[items[i]].Extents);
+		boxMin = XMVectorMin(boxMin, center - extents);
+		boxMax = XMVectorMax(boxMax, center + extents);
+	}
+	XMStoreFloat3(&leaf.Min, boxMin);
+	XMStoreFloat3(&leaf.Max, boxMax);
+}
+
+// --------------------------------------------------------
+// Returns whether the node's box changed
+// --------------------------------------------------------
+bool SceneBvh::RefitInternal(unsigned int node)
+{
+	BvhNode& parent = nodes[node];
+	const BvhNode& left = nodes[parent.First];
+	const BvhNode& right = nodes[parent.First + 1];
+	XMFLOAT3 boxMin(std::min(left.Min.x, right.Min.x), std::min(left.Min.y, right.Min.y), std::min(left.Min.z, right.Min.z));
+	XMFLOAT3 boxMax(std::max(left.Max.x, right.Max.x), std::max(left.Max.y, right.Max.y), std::max(left.Max.z, right.Max.z));
+	bool changed =
+		boxMin.x != parent.Min.x || boxMin.y != parent.Min.y || boxMin.z != parent.Min.z ||
+		boxMax.x != parent.Max.x || boxMax.y != parent.Max.y || boxMax.z != parent.Max.z;
+	parent.Min = boxMin;
+	parent.Max = boxMax;
+	return changed;
+}
+
+void SceneBvh::Refit(const CullBounds* bounds)
+{
+	// With lots of changes, one pass back through the whole
+	// list is cheaper - children always come after their parents
+	if (dirtyLeaves.size() * BVH_REFIT_ALL_RATIO > nodes.size())
+	{
+		for (unsigned int node = (unsigned int)nodes.size(); node-- > 0;)
+		{
+			if (nodes[node].Count == BVH_NONE)
+				RefitInternal(node);
+			else if (leafDirty[node])
+			{
+				leafDirty[node] = 0;
+				RefitLeaf(node, bounds);
+			}
+		}
+		dirtyLeaves.clear();
+		return;
+	}
+
+	// Otherwise each changed leaf walks up until a node's box stays
+	// the same, since everything above that already matches it
+	for (unsigned int leaf : dirtyLeaves)
+	{
+		leafDirty[leaf] = 0;
+		RefitLeaf(leaf, bounds);
+		for (unsigned int node = parents[leaf]; node != BVH_NONE; node = parents[node])
+		{
+			if (!RefitInternal(node))
+				break;
+		}
+	}
+	dirtyLeaves.clear();
+}
+
+bool SceneBvh::NeedsRebuild()
+{
+	return
+		movedCount > itemCount * BVH_REBUILD_MOVED ||
+		loose.size() > itemCount * BVH_REBUILD_LOOSE;
+}
+
+void SceneBvh::CullFrustum(const XMFLOAT4 planes[6], const CullBounds* bounds,
+	std::vector<unsigned int>& visible)
+{
+	for (unsigned int item : loose)
+	{
+		if (IsBoxInFrustum(planes, bounds[item]))
+			visible.push_back(item);
+	}
+
+	if (nodes.empty())
+		return;
+
+	stack.clear();
+	stack.push_back(0x3F);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		unsigned int index = stack.back(); stack.pop_back();
+		int mask = (int)stack.back(); stack.pop_back();
+		const BvhNode& node = nodes[index];
+
+		if (mask != 0)
+		{
+			XMFLOAT3 center((node.Min.x + node.Max.x) * 0.5f, (node.Min.y + node.Max.y) * 0.5f, (node.Min.z + node.Max.z) * 0.5f);
+			XMFLOAT3 extents((node.Max.x - node.Min.x) * 0.5f, (node.Max.y - node.Min.y) * 0.5f, (node.Max.z - node.Min.z) * 0.5f);
+			mask = ClassifyBox(planes, mask, center, extents);
+			if (mask < 0)
+				continue;
+		}
+
+		if (node.Count == BVH_NONE)
+		{
+			stack.insert(stack.end(), { (unsigned int)mask, node.First, (unsigned int)mask, node.First + 1 });
+			continue;
+		}
+
+		// Only the planes the leaf straddles are left to test
+		for (unsigned int i = node.First; i < node.First + node.Count; i++)
+		{
+			unsigned int item = items[i];
+			if (mask == 0 || ClassifyBox(planes, mask, bounds[item].Center, bounds[item].Extents) >= 0)
+				visible.push_back(item);
+		}
+	}
+}
+
+void SceneBvh::QuerySphere(XMFLOAT3 center, float radius, const CullBounds* bounds,
+	std::vector<unsigned int>& found)
+{
+	XMFLOAT3 boxMin, boxMax;
+	for (unsigned int item : loose)
+	{
+		GetItemBox(bounds[item], boxMin, boxMax);
+		if (BoxTouchesSphere(boxMin, boxMax, center, radius))
+			found.push_back(item);
+	}
+
+	if (nodes.empty())
+		return;
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BvhNode& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!BoxTouchesSphere(node.Min, node.Max, center, radius))
+			continue;
+
+		if (node.Count == BVH_NONE)
+		{
+			stack.push_back(node.First);
+			stack.push_back(node.First + 1);
+			continue;
+		}
+
+		for (unsigned int i = node.First; i < node.First + node.Count; i++)
+		{
+			GetItemBox(bounds[items[i]], boxMin, boxMax);
+			if (BoxTouchesSphere(boxMin, boxMax, center, radius))
+				found.push_back(items[i]);
+		}
+	}
+}
+
+int SceneBvh::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, const CullBounds* bounds,
+	float* distance)
+{
+	XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	int hit = -1;
+	float nearest = FLT_MAX;
+	XMFLOAT3 boxMin, boxMax;
+	for (unsigned int item : loose)
+	{
+		GetItemBox(bounds[item], boxMin, boxMax);
+		float t = RayEntersBox(boxMin, boxMax, origin, inverseDirection);
+		if (t < nearest)
+		{
+			nearest = t;
+			hit = (int)item;
+		}
+	}
+
+	if (!nodes.empty())
+	{
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const BvhNode& node = nodes[stack.back()];
+			stack.pop_back();
+			if (RayEntersBox(node.Min, node.Max, origin, inverseDirection) >= nearest)
+				continue;
+
+			if (node.Count == BVH_NONE)
+			{
+				// Nearer child on top, so it's searched first and
+				// can rule out the other
+				const BvhNode& left = nodes[node.First];
+				const BvhNode& right = nodes[node.First + 1];
+				float leftT = RayEntersBox(left.Min, left.Max, origin, inverseDirection);
+				float rightT = RayEntersBox(right.Min, right.Max, origin, inverseDirection);
+				if (leftT < rightT)
+				{
+					stack.push_back(node.First + 1);
+					stack.push_back(node.First);
+				}
+				else
+				{
+					stack.push_back(node.First);
+					stack.push_back(node.First + 1);
+				}
+				continue;
+			}
+
+			for (unsigned int i = node.First; i < node.First + node.Count; i++)
+			{
+				GetItemBox(bounds[items[i]], boxMin, boxMax);
+				float t = RayEntersBox(boxMin, boxMax, origin, inverseDirection);
+				if (t < nearest)
+				{
+					nearest = t;
+					hit = (int)items[i];
+				}
+			}
+		}
+	}
+
+	if (distance)
+		*distance = nearest;
+	return hit;
+}
+
+unsigned int SceneBvh::GetNodeCount()
+{
+	return (unsigned int)nodes.size();
+}
+
+unsigned int SceneBvh::GetLooseCount()
+{
+	return (unsigned int)loose.size();
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "FrustumCull.h"
+
+// Most items a build puts in one leaf
+#define BVH_LEAF_SIZE		4
+
+// Refitting walks up from each changed leaf, unless more
+// than one leaf in this many changed - then it's one pass
+// over every node
+#define BVH_REFIT_ALL_RATIO	16
+
+// Marks a node as internal (its Count), or an item that's
+// not in a leaf (its leaf)
+#define BVH_NONE			0xFFFFFFFF
+
+// The tree is rebuilt once this fraction of its items have
+// moved since it was built, as refitting loosens it...
+#define BVH_REBUILD_MOVED	0.5f
+
+// ...or once the items added since then (which are tested
+// one by one until the next build) pass this fraction
+#define BVH_REBUILD_LOOSE	(1.0f / 16.0f)
+
+// --------------------------------------------------------
+// A node of the tree - internal nodes have Count set to
+// BVH_NONE and their children at First and First + 1,
+// leaves hold items [First, First + Count) of the item list
+// --------------------------------------------------------
+struct BvhNode
+{
+	DirectX::XMFLOAT3 Min;
+	unsigned int First;
+	DirectX::XMFLOAT3 Max;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// A bounding volume hierarchy over a set of boxes, so
+// queries only visit the parts of the scene they touch
+//
+// Items are just indices into an array of CullBounds that
+// the caller owns and passes in - the tree only keeps their
+// place in it
+//
+// - Build() splits the items at the middle of their
+//   centers along the longest axis (or their median, if
+//   they're all on one side), down to leaves of at most
+//   BVH_LEAF_SIZE
+// - Items that move are marked with MarkMoved(), and
+//   Refit() then grows or shrinks just their leaves and
+//   the nodes above them
+// - Inserted items go on a loose list that queries test
+//   directly, until the next build
+// - NeedsRebuild() says when the tree has loosened enough
+//   that building it again is worth it
+// --------------------------------------------------------
+class SceneBvh
+{
+public:
+	SceneBvh();
+
+	// Replaces the tree with one over items [0, count)
+	void Build(const CullBounds* bounds, unsigned int count);
+
+	void Insert(unsigned int item);
+	void Remove(unsigned int item);
+	void Rename(unsigned int from, unsigned int to);	// For items that move in the caller's array
+	void MarkMoved(unsigned int item);
+	void Refit(const CullBounds* bounds);
+	bool NeedsRebuild();
+
+	// Adds the items whose boxes are at least partly inside the
+	// planes to visible (see FrustumCull.h) - a node that's all
+	// the way inside one plane skips that plane below it
+	void CullFrustum(const DirectX::XMFLOAT4 planes[6], const CullBounds* bounds,
+		std::vector<unsigned int>& visible);
+
+	// Adds the items whose boxes touch the sphere to found
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, const CullBounds* bounds,
+		std::vector<unsigned int>& found);
+
+	// The item whose box the ray hits first, or -1 - distance is
+	// along the direction, which needs no particular length
+	int Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, const CullBounds* bounds,
+		float* distance);
+
+	unsigned int GetNodeCount();
+	unsigned int GetLooseCount();
+
+private:
+	void RefitLeaf(unsigned int node, const CullBounds* bounds);
+	bool RefitInternal(unsigned int node);
+
+	std::vector<BvhNode> nodes;
+	std::vector<unsigned int> parents;		// Of each node
+	std::vector<unsigned int> items;		// Leaves' items, a range each
+
+	// Per item
+	std::vector<unsigned int> itemLeaf;		// BVH_NONE if loose
+	std::vector<unsigned int> itemSlot;		// Into items, or loose
+
+	std::vector<unsigned int> loose;
+	std::vector<char> leafDirty;			// Per node
+	std::vector<unsigned int> dirtyLeaves;
+	std::vector<unsigned int> stack;		// For walking the tree (frustum culling
+											// pushes a plane mask with each node)
+	unsigned int itemCount;
+	unsigned int movedCount;				// Since the last build
+};
@@ -15,7 +15,8 @@ struct Light
     float Intensity;
     float3 Color;
     float SpotFalloff;
-    float3 Padding;
+    int ShadowTile; // First of its tiles in the shadow atlas, or -1
+    float2 Padding;
 };
 
 struct VertexShaderInput
@@ -25,12 +26,45 @@ struct VertexShaderInput
 	//  |   Name          Semantic
 	//  |    |                |
 	//  v    v                v
-    float3 localPosition : POSITION; // XYZ position
-    float3 normal        : NORMAL;
-    float2 uv			 : TEXCOORD;
-    float3 tangent       : TANGENT;
+    float4 localPosition : POSITION; // XYZ position, 0-1 across the mesh bounds
+    float4 normalTangent : NORMAL;   // Octahedral normal (xy) and tangent (zw)
+    float2 uv			 : TEXCOORD; // 0-1 across the mesh's UV bounds
 };
 
+// Per instance data for the instanced vertex shaders, which
+// must match InstanceData in InstanceBatch.h - the rows of
+// each C++ matrix, in the second vertex buffer
+struct InstanceInput
+{
+    float4 world[4]                 : WORLD_PER_INSTANCE;
+    float4 worldInverseTranspose[4] : WORLD_IT_PER_INSTANCE;
+};
+
+// Builds a matrix from an instance's rows, laid out the same
+// way as one read from a constant buffer (which reads the C++
+// rows as columns), so it's used the same way in mul()
+matrix InstanceMatrix(float4 rows[4])
+{
+    return transpose(float4x4(rows[0], rows[1], rows[2], rows[3]));
+}
+
+// Undoes the octahedral encoding of a unit vector
+// - Must match OctahedralEncode() in VertexPacking.cpp
+float3 OctahedralDecode(float2 e)
+{
+    float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+// Packed positions are stored relative to the mesh bounds
+// (UVs are too, but they're simple enough to just do inline)
+float3 DecodePosition(float4 packedPosition, float3 positionOffset, float3 positionScale)
+{
+    return positionOffset + packedPosition.xyz * positionScale;
+}
+
 
 struct VertexToPixel
 {
@@ -44,7 +78,6 @@ struct VertexToPixel
     float2 uv             : TEXCOORD;
     float3 tangent        : TANGENT;
     float3 worldPosition  : POSITION;
-    float4 shadowMapPos : SHADOW_POSITION;
 };
 
 struct VertexToPixel_Sky
@@ -0,0 +1,202 @@
+#include "ShadowAtlas.h"
+#include "FrustumCull.h"
+#include <algorithm>
+#include <cmath>
+
+// ImGui compiles its own copy of the packer as static, so
+// this file has one too
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "ImGui/imstb_rectpack.h"
+
+using namespace DirectX;
+
+float GetShadowImportance(const Light& light,
+	const XMFLOAT4X4& view, const XMFLOAT4X4& projection,
+	const XMFLOAT4 frustumPlanes[6])
+{
+	float brightness = light.Intensity * fmaxf(light.Color.x, fmaxf(light.Color.y, light.Color.z));
+	switch (light.Type)
+	{
+	case LIGHT_TYPE_DIRECTIONAL:
+		return brightness;
+
+	case LIGHT_TYPE_POINT:
+	{
+		CullBounds bounds = {};
+		bounds.Center = light.Position;
+		bounds.Radius = light.Range;
+		bounds.Extents = XMFLOAT3(light.Range, light.Range, light.Range);
+		if (!IsBoxInFrustum(frustumPlanes, bounds))
+			return 0.0f;
+
+		// _22 is the vertical cotangent of half the field of view, so
+		// this is the sphere's diameter over the screen's height -
+		// all of it, once the camera's inside
+		float depth = XMVectorGetZ(XMVector3TransformCoord(
+			XMLoadFloat3(&light.Position), XMLoadFloat4x4(&view)));
+		float coverage = depth <= light.Range ? 1.0f :
+			fminf(light.Range * projection._22 / depth, 1.0f);
+		return coverage * brightness;
+	}
+
+	default:
+		return 0.0f;
+	}
+}
+
+void BuildPointShadowFaces(XMFLOAT3 position, float range,
+	XMFLOAT4X4 views[SHADOW_ATLAS_FACES], XMFLOAT4X4& projection)
+{
+	// The same directions and ups as a cube map's faces
+	static const float faces[SHADOW_ATLAS_FACES][6] =
+	{
+		{ 1, 0, 0,	0, 1, 0 },
+		{ -1, 0, 0,	0, 1, 0 },
+		{ 0, 1, 0,	0, 0, -1 },
+		{ 0, -1, 0,	0, 0, 1 },
+		{ 0, 0, 1,	0, 1, 0 },
+		{ 0, 0, -1,	0, 1, 0 },
+	};
+
+	XMVECTOR eye = XMLoadFloat3(&position);
+	for (int f = 0; f < SHADOW_ATLAS_FACES; f++)
+	{
+		XMStoreFloat4x4(&views[f], XMMatrixLookToLH(eye,
+			XMVectorSet(faces[f][0], faces[f][1], faces[f][2], 0.0f),
+			XMVectorSet(faces[f][3], faces[f][4], faces[f][5], 0.0f)));
+	}
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, range * 0.01f, range));
+}
+
+ShadowAtlas::ShadowAtlas(int _size, int _maxTile, int _minTile) :
+	size(_size),
+	maxTile(_maxTile),
+	minTile(_minTile),
+	usedArea(0)
+{
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+}
+
+int ShadowAtlas::Allocate(const ShadowAtlasRequest* requests, int count,
+	std::vector<int>& firstTiles, std::vector<ShadowAtlasTile>& tiles)
+{
+	firstTiles.assign(count, -1);
+	tiles.clear();
+
+	// Most important first - ties keep their order, so the
+	// same lights give the same atlas frame to frame
+	order.clear();
+	for (int r = 0; r < count; r++)
+	{
+		if (requests[r].Importance > 0.0f && requests[r].TileCount > 0)
+			order.push_back(r);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+		{ return requests[a].Importance > requests[b].Importance; });
+
+	// Each size is the nearest power of two (in log terms) to the
+	// importance's share of the largest
+	tileSizes.assign(count, 0);
+	long long area = 0;
+	int tileCount = 0;
+	for (int r : order)
+	{
+		if (tileCount + requests[r].TileCount > SHADOW_ATLAS_MAX_TILES)
+			continue;
+		tileCount += requests[r].TileCount;
+
+		int tileSize = maxTile;
+		float halvings = roundf(-log2f(fminf(requests[r].Importance, 1.0f)));
+		for (int h = 0; h < halvings && tileSize > minTile; h++)
+			tileSize /= 2;
+		tileSizes[r] = tileSize;
+		area += (long long)requests[r].TileCount * tileSize * tileSize;
+	}
+
+	// Shrink the least important until it all fits by area, then
+	// drop them if even the smallest tiles don't
+	long long atlasArea = (long long)size * size;
+	for (int o = (int)order.size() - 1; o >= 0 && area > atlasArea; o--)
+	{
+		int r = order[o];
+		while (area > atlasArea && tileSizes[r] > minTile)
+		{
+			int half = tileSizes[r] / 2;
+			area -= (long long)requests[r].TileCount * (tileSizes[r] * tileSizes[r] - half * half);
+			tileSizes[r] = half;
+		}
+	}
+	for (int o = (int)order.size() - 1; o >= 0 && area > atlasArea; o--)
+	{
+		int r = order[o];
+		area -= (long long)requests[r].TileCount * tileSizes[r] * tileSizes[r];
+		tileSizes[r] = 0;
+	}
+
+	// One rectangle per tile, grouped by request
+	packerRects.clear();
+	for (int r : order)
+	{
+		if (tileSizes[r] == 0)
+			continue;
+		firstTiles[r] = (int)tiles.size();
+		for (int t = 0; t < requests[r].TileCount; t++)
+		{
+			stbrp_rect rect = {};
+			rect.id = (int)tiles.size();
+			rect.w = tileSizes[r];
+			rect.h = tileSizes[r];
+			packerRects.push_back(rect);
+			tiles.push_back({ 0, 0, tileSizes[r] });
+		}
+	}
+
+	packerNodes.resize(size);
+	stbrp_context context;
+	stbrp_init_target(&context, size, size, packerNodes.data(), (int)packerNodes.size());
+	stbrp_pack_rects(&context, packerRects.data(), (int)packerRects.size());
+
+	// The packer reorders the rectangles, so they're matched
+	// back up by ID - a request with any tile left out goes
+	// without, as its other tiles are no use alone
+	tilePacked.assign(tiles.size(), 0);
+	for (const stbrp_rect& rect : packerRects)
+	{
+		tiles[rect.id].X = rect.x;
+		tiles[rect.id].Y = rect.y;
+		tilePacked[rect.id] = rect.was_packed != 0;
+	}
+
+	int granted = 0;
+	usedArea = 0;
+	for (int r : order)
+	{
+		if (firstTiles[r] < 0)
+			continue;
+		bool allPacked = true;
+		for (int t = 0; t < requests[r].TileCount; t++)
+			allPacked &= tilePacked[firstTiles[r] + t] != 0;
+		if (!allPacked)
+		{
+			firstTiles[r] = -1;
+			continue;
+		}
+		granted++;
+		usedArea += requests[r].TileCount * tileSizes[r] * tileSizes[r];
+	}
+	return granted;
+}
+
+int ShadowAtlas::GetSize()
+{
+	return size;
+}
+
+int ShadowAtlas::GetUsedArea()
+{
+	return usedArea;
+}
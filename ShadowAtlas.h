@@ -0,0 +1,118 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+
+// From ImGui/imstb_rectpack.h, which only ShadowAtlas.cpp needs
+struct stbrp_node;
+struct stbrp_rect;
+
+// Width and height of the depth texture the lights share
+#define SHADOW_ATLAS_SIZE			4096
+
+// Tile sizes, all powers of two - a light's tiles shrink
+// toward the smallest before any light goes without
+#define SHADOW_ATLAS_MAX_TILE		1024
+#define SHADOW_ATLAS_MIN_TILE		64
+
+// Most tiles in one frame, and so entries in the buffer the
+// pixel shader reads them from
+#define SHADOW_ATLAS_MAX_TILES		256
+
+// Tiles a light needs - one for a directional light's box,
+// and one per cube face for a point light
+#define SHADOW_ATLAS_FACES			6
+
+// --------------------------------------------------------
+// What a light asks the atlas for - all of its tiles get
+// the same size, larger the more important it is
+// --------------------------------------------------------
+struct ShadowAtlasRequest
+{
+	float Importance;		// 1 for a full size tile, 0 for none
+	int TileCount;
+};
+
+// --------------------------------------------------------
+// Where a tile ended up, in texels
+// --------------------------------------------------------
+struct ShadowAtlasTile
+{
+	int X, Y;
+	int Size;
+};
+
+// --------------------------------------------------------
+// A tile as the pixel shader sees it, in a structured
+// buffer - must match ShadowAtlasEntry in PixelShader.hlsl
+// --------------------------------------------------------
+struct ShadowAtlasEntry
+{
+	DirectX::XMFLOAT4X4 ViewProjection;
+	DirectX::XMFLOAT4 Rect;		// UV offset in xy, UV size in zw
+};
+
+// --------------------------------------------------------
+// How much a light's shadows are worth, from how much of
+// the screen it lights and how brightly
+//
+// - Directional lights light the whole screen
+// - Point lights cover as much as their range's sphere
+//   does on screen, and nothing if it's out of view
+// - Anything else isn't shadowed
+// --------------------------------------------------------
+float GetShadowImportance(const Light& light,
+	const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+	const DirectX::XMFLOAT4 frustumPlanes[6]);
+
+// --------------------------------------------------------
+// The view for each face of a point light's cube, in the
+// order the pixel shader picks them (+X, -X, +Y, -Y, +Z,
+// -Z), and the 90 degree projection they share
+// --------------------------------------------------------
+void BuildPointShadowFaces(DirectX::XMFLOAT3 position, float range,
+	DirectX::XMFLOAT4X4 views[SHADOW_ATLAS_FACES], DirectX::XMFLOAT4X4& projection);
+
+// --------------------------------------------------------
+// Hands out tiles of one square texture to lights each
+// frame, by how important they are
+//
+// - Each light's tile size is the power of two nearest its
+//   importance times the largest size
+// - If they'd cover more than the atlas, the least important
+//   lights' tiles are halved (down to the smallest size)
+//   until they don't, then the least important are dropped
+// - The tiles are then packed with stb_rectpack, largest
+//   first - squares of powers of two that fit by area always
+//   pack, but anything left over is dropped to be safe
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(int size = SHADOW_ATLAS_SIZE,
+		int maxTile = SHADOW_ATLAS_MAX_TILE,
+		int minTile = SHADOW_ATLAS_MIN_TILE);
+	~ShadowAtlas();
+
+	// Fills firstTiles with the index of each request's first
+	// tile in tiles (its others follow it), or -1 if it got
+	// none, and returns how many requests got tiles
+	int Allocate(const ShadowAtlasRequest* requests, int count,
+		std::vector<int>& firstTiles, std::vector<ShadowAtlasTile>& tiles);
+
+	int GetSize();
+	int GetUsedArea();		// Texels, of the last Allocate()
+
+private:
+	int size;
+	int maxTile;
+	int minTile;
+	int usedArea;
+
+	// Kept between frames so they aren't reallocated
+	std::vector<int> order;			// Requests, most important first
+	std::vector<int> tileSizes;		// Per request, 0 if dropped
+	std::vector<stbrp_node> packerNodes;
+	std::vector<stbrp_rect> packerRects;
+	std::vector<char> tilePacked;		// By tile index, as the packer reorders its rectangles
+};
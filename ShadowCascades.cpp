@@ -0,0 +1,126 @@
+#include "ShadowCascades.h"
+#include <cmath>
+
+using namespace DirectX;
+
+void ComputeCascadeSplits(float nearClip, float farClip, int cascadeCount, float lambda, float splits[])
+{
+	splits[0] = nearClip;
+	for (int i = 1; i < cascadeCount; i++)
+	{
+		float fraction = (float)i / cascadeCount;
+		float logSplit = nearClip * powf(farClip / nearClip, fraction);
+		float evenSplit = nearClip + (farClip - nearClip) * fraction;
+		splits[i] = lambda * logSplit + (1.0f - lambda) * evenSplit;
+	}
+	splits[cascadeCount] = farClip;
+}
+
+void FitCascade(const XMFLOAT4X4& cameraView,
+	float fieldOfView, float aspectRatio,
+	float splitNear, float splitFar,
+	XMFLOAT3 lightDirection,
+	int resolution,
+	ShadowCascade& cascade,
+	ShadowCascadeRegion* region)
+{
+	// The slice's corners are spread * depth from its axis, so
+	// the sphere through all eight is centered on the axis where
+	// the near and far ones are equally far - unless that's past
+	// the far end, when the far corners' circle alone is enough
+	float tanHalf = tanf(fieldOfView * 0.5f);
+	float spread = tanHalf * tanHalf * (1.0f + aspectRatio * aspectRatio);
+	float centerDepth = (splitNear + splitFar) * 0.5f * (1.0f + spread);
+	float radius;
+	if (centerDepth >= splitFar)
+	{
+		centerDepth = splitFar;
+		radius = sqrtf(spread) * splitFar;
+	}
+	else
+	{
+		float alongAxis = centerDepth - splitNear;
+		radius = sqrtf(alongAxis * alongAxis + spread * splitNear * splitNear);
+	}
+
+	// Rounded up, so float error can't resize it frame to frame
+	radius = ceilf(radius * 16.0f) / 16.0f;
+
+	// The camera's world matrix holds its forward and position
+	XMMATRIX cameraWorld = XMMatrixInverse(0, XMLoadFloat4x4(&cameraView));
+	XMVECTOR center = cameraWorld.r[3] + XMVector3Normalize(cameraWorld.r[2]) * centerDepth;
+
+	// Looking along the light from the world's origin, so light
+	// space doesn't move with the camera and texels line up
+	XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), direction, up);
+	XMFLOAT3 lightCenter;
+	XMStoreFloat3(&lightCenter, XMVector3TransformCoord(center, lightView));
+
+	// Snapping moves the center by up to a texel, so the box is
+	// a texel wider than the sphere on each side to make up for
+	// it - its texel size stays fixed as long as the radius does.
+	// Depth is snapped the same way (reaching a texel further
+	// back), so the whole box only changes once the camera has
+	// moved a texel
+	float boxRadius = region ? radius * SHADOW_CASCADE_PADDING : radius;
+	float texelSize = 2.0f * boxRadius / (resolution - 2);
+	float halfSize = boxRadius + texelSize;
+	XMFLOAT3 sphereCenter = lightCenter;
+	lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+	lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+	lightCenter.z = floorf(lightCenter.z / texelSize) * texelSize;
+	float front = lightCenter.z - radius;
+	float back = lightCenter.z + radius + texelSize;
+
+	// A region's box stays put while the whole sphere is still
+	// inside it - a fresh one is at most a texel off the sphere's
+	// center, which the padding more than covers
+	if (region)
+	{
+		bool fits = region->Valid && region->HalfSize == halfSize &&
+			region->LightDirection.x == lightDirection.x &&
+			region->LightDirection.y == lightDirection.y &&
+			region->LightDirection.z == lightDirection.z &&
+			fabsf(sphereCenter.x - region->Center.x) + radius <= halfSize &&
+			fabsf(sphereCenter.y - region->Center.y) + radius <= halfSize &&
+			fabsf(sphereCenter.z - region->Center.z) + radius <= halfSize;
+		if (fits)
+			lightCenter = region->Center;
+		else
+		{
+			region->Center = lightCenter;
+			region->HalfSize = halfSize;
+			region->LightDirection = lightDirection;
+			region->Valid = true;
+		}
+		front = lightCenter.z - halfSize;
+		back = lightCenter.z + halfSize;
+	}
+
+	XMMATRIX lightProjection = XMMatrixOrthographicOffCenterLH(
+		lightCenter.x - halfSize, lightCenter.x + halfSize,
+		lightCenter.y - halfSize, lightCenter.y + halfSize,
+		front, back);
+
+	XMStoreFloat4x4(&cascade.View, lightView);
+	XMStoreFloat4x4(&cascade.Projection, lightProjection);
+	XMStoreFloat4x4(&cascade.ViewProjection, lightView * lightProjection);
+	cascade.SplitNear = splitNear;
+	cascade.SplitFar = splitFar;
+	cascade.Radius = radius;
+	cascade.HalfSize = halfSize;
+}
+
+bool IsShadowCacheHit(const ShadowCacheKey& cached, const ShadowCacheKey& current)
+{
+	const ShadowCascadeRegion& a = cached.Region;
+	const ShadowCascadeRegion& b = current.Region;
+	return a.Valid && b.Valid && cached.StaticVersion == current.StaticVersion &&
+		a.Center.x == b.Center.x && a.Center.y == b.Center.y && a.Center.z == b.Center.z &&
+		a.HalfSize == b.HalfSize &&
+		a.LightDirection.x == b.LightDirection.x &&
+		a.LightDirection.y == b.LightDirection.y &&
+		a.LightDirection.z == b.LightDirection.z;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <DirectXMath.h>
+
+// Most cascades the shadow map array has slices for - must
+// match MAX_SHADOW_CASCADES in PixelShader.hlsl
+#define MAX_SHADOW_CASCADES		4
+
+// Default blend between log (1) and even (0) split spacing
+#define SHADOW_CASCADE_LAMBDA	0.75f
+
+// How much bigger than its slice's sphere a cascade's box is
+// when it's kept in a region, so the camera can move around
+// inside it before it has to move
+#define SHADOW_CASCADE_PADDING	1.25f
+
+// --------------------------------------------------------
+// One slice of the camera's view, and the light's box
+// around it
+// --------------------------------------------------------
+struct ShadowCascade
+{
+	DirectX::XMFLOAT4X4 View;			// Shared by every cascade, looking along the light
+	DirectX::XMFLOAT4X4 Projection;
+	DirectX::XMFLOAT4X4 ViewProjection;
+	float SplitNear;					// View depths the slice covers
+	float SplitFar;
+	float Radius;						// Of the sphere around the slice
+	float HalfSize;						// Of the light's box, which sets its texels' size
+};
+
+// --------------------------------------------------------
+// Where a cascade's box was put in light space, so it can
+// stay there from frame to frame - anything drawn into it
+// (like the static casters' depth) holds until it moves
+// --------------------------------------------------------
+struct ShadowCascadeRegion
+{
+	DirectX::XMFLOAT3 Center;			// Light space, snapped to texels
+	float HalfSize;						// Of the box, on every axis
+	DirectX::XMFLOAT3 LightDirection;	// As given to FitCascade
+	bool Valid;
+};
+
+// --------------------------------------------------------
+// What a cascade's cached static casters were drawn with
+// --------------------------------------------------------
+struct ShadowCacheKey
+{
+	ShadowCascadeRegion Region;
+	unsigned int StaticVersion;			// EntityStore::GetStaticVersion()
+};
+
+// --------------------------------------------------------
+// Splits the view depths near to far into cascadeCount
+// slices with the "practical" scheme - each split is lambda
+// of the way from evenly spaced to logarithmically spaced -
+// and writes the cascadeCount + 1 split depths, from near
+// to far, into splits
+// --------------------------------------------------------
+void ComputeCascadeSplits(float nearClip, float farClip, int cascadeCount, float lambda, float splits[]);
+
+// --------------------------------------------------------
+// Fits a directional light's box around the slice of a
+// camera's frustum between two view depths
+//
+// - The box is square, around the smallest sphere holding
+//   the slice - that sphere's size depends only on the
+//   field of view and depths, so turning the camera never
+//   resizes the box
+// - The box's center is then snapped to whole shadow map
+//   texels in light space, so moving the camera slides the
+//   box a texel at a time and the shadows' edges don't
+//   shimmer - depth snaps too, so a still (or barely moving)
+//   camera gets exactly the same matrices frame to frame
+// - Depth runs from the sphere's front to its back - with
+//   depth clipping off, casters nearer the light than that
+//   still clamp onto the map
+// - Given a region, the box is SHADOW_CASCADE_PADDING times
+//   the sphere's size, and stays where the region has it
+//   while the sphere still fits inside. Once the camera has
+//   carried the sphere out of it (or the light, field of
+//   view or resolution changes) the box is fitted afresh
+//   and the region moved to it
+// --------------------------------------------------------
+void FitCascade(const DirectX::XMFLOAT4X4& cameraView,
+	float fieldOfView, float aspectRatio,
+	float splitNear, float splitFar,
+	DirectX::XMFLOAT3 lightDirection,
+	int resolution,
+	ShadowCascade& cascade,
+	ShadowCascadeRegion* region = 0);
+
+// --------------------------------------------------------
+// Whether static casters drawn with the cached key can be
+// reused now - only while their region hasn't moved (the
+// camera moving inside it doesn't matter) and no static
+// entity has changed
+// --------------------------------------------------------
+bool IsShadowCacheHit(const ShadowCacheKey& cached, const ShadowCacheKey& current);
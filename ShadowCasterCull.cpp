@@ -0,0 +1,122 @@
+#include "ShadowCasterCull.h"
+#include <cmath>
+
+using namespace DirectX;
+
+// A plane through three points, facing whichever side inside is on
+static XMVECTOR PlaneFacing(XMVECTOR a, XMVECTOR b, XMVECTOR c, XMVECTOR inside)
+{
+	XMVECTOR plane = XMPlaneNormalize(XMPlaneFromPoints(a, b, c));
+	if (XMVectorGetX(XMPlaneDotCoord(plane, inside)) < 0.0f)
+		plane = -plane;
+	return plane;
+}
+
+int BuildCasterVolume(const XMFLOAT4X4& cameraViewProjection,
+	XMFLOAT3 lightDirection,
+	XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES])
+{
+	// The frustum's corners, back from clip space - bit 0 of
+	// the index picks right over left, bit 1 top over bottom
+	// and bit 2 far over near
+	XMMATRIX toWorld = XMMatrixInverse(0, XMLoadFloat4x4(&cameraViewProjection));
+	XMVECTOR corners[8];
+	XMVECTOR center = XMVectorZero();
+	for (int c = 0; c < 8; c++)
+	{
+		corners[c] = XMVector3TransformCoord(XMVectorSet(
+			(c & 1) ? 1.0f : -1.0f,
+			(c & 2) ? 1.0f : -1.0f,
+			(c & 4) ? 1.0f : 0.0f,
+			1.0f), toWorld);
+		center += corners[c];
+	}
+	center *= 1.0f / 8.0f;
+
+	// Faces are numbered axis * 2 + side, and hold the four
+	// corners whose bit for that axis matches the side
+	XMVECTOR faces[6];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int side = 0; side < 2; side++)
+		{
+			int on[4];
+			int count = 0;
+			for (int c = 0; c < 8; c++)
+			{
+				if (((c >> axis) & 1) == side)
+					on[count++] = c;
+			}
+			faces[axis * 2 + side] = PlaneFacing(corners[on[0]], corners[on[1]], corners[on[3]], center);
+		}
+	}
+
+	// Sweeping toward the light keeps the faces that point
+	// that way - everything behind them is swept over
+	XMVECTOR towardLight = -XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	bool kept[6];
+	int planeCount = 0;
+	for (int f = 0; f < 6; f++)
+	{
+		kept[f] = XMVectorGetX(XMVector3Dot(faces[f], towardLight)) >= 0.0f;
+		if (kept[f])
+			XMStoreFloat4(&planes[planeCount++], faces[f]);
+	}
+
+	// Each edge joins the two corners that differ along one
+	// axis, between the faces of the other two axes
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int axisA = (axis + 1) % 3;
+		int axisB = (axis + 2) % 3;
+		for (int c = 0; c < 8; c++)
+		{
+			if ((c >> axis) & 1)
+				continue;
+
+			int faceA = axisA * 2 + ((c >> axisA) & 1);
+			int faceB = axisB * 2 + ((c >> axisB) & 1);
+			if (kept[faceA] == kept[faceB])
+				continue;
+
+			// Through the edge and along the light - skipped if the
+			// edge runs along the light too, as then neither face
+			// can be facing away from it
+			XMVECTOR start = corners[c];
+			XMVECTOR end = corners[c | (1 << axis)];
+			if (XMVectorGetX(XMVector3LengthSq(XMVector3Cross(end - start, towardLight))) < 1e-12f)
+				continue;
+			XMStoreFloat4(&planes[planeCount++], PlaneFacing(start, end, start + towardLight, center));
+		}
+	}
+	return planeCount;
+}
+
+bool IsBoxInsidePlanes(const XMFLOAT4* planes, int planeCount, const CullBounds& bounds)
+{
+	for (int p = 0; p < planeCount; p++)
+	{
+		const XMFLOAT4& plane = planes[p];
+		float distance = plane.x * bounds.Center.x + plane.y * bounds.Center.y + plane.z * bounds.Center.z + plane.w;
+		float reach = fabsf(plane.x) * bounds.Extents.x + fabsf(plane.y) * bounds.Extents.y +
+			fabsf(plane.z) * bounds.Extents.z;
+		if (distance + reach < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+unsigned int CullShadowCasters(const XMFLOAT4* planes, int planeCount,
+	const CullBounds* bounds, std::vector<unsigned int>& casters)
+{
+	size_t kept = 0;
+	for (unsigned int index : casters)
+	{
+		if (IsBoxInsidePlanes(planes, planeCount, bounds[index]))
+			casters[kept++] = index;
+	}
+
+	unsigned int rejected = (unsigned int)(casters.size() - kept);
+	casters.resize(kept);
+	return rejected;
+}
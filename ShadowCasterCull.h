@@ -0,0 +1,38 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "FrustumCull.h"
+
+// Most planes a caster volume can have: the frustum's six,
+// plus one per edge of its outline as seen from the light
+#define CASTER_VOLUME_MAX_PLANES	18
+
+// --------------------------------------------------------
+// Builds the planes around everything that can cast a
+// shadow into the camera's view - the camera's frustum
+// (the receivers) swept back toward a directional light
+// forever - and returns how many there are
+//
+// - The frustum's faces that look toward the light are
+//   kept, the ones that look away are dropped, and each
+//   edge between a kept and a dropped face adds a plane
+//   through it, parallel to the light
+// - Planes point inward, like ExtractFrustumPlanes()
+// --------------------------------------------------------
+int BuildCasterVolume(const DirectX::XMFLOAT4X4& cameraViewProjection,
+	DirectX::XMFLOAT3 lightDirection,
+	DirectX::XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES]);
+
+// --------------------------------------------------------
+// Whether a box is at least partly inside any number of
+// planes - conservative, like IsBoxInFrustum()
+// --------------------------------------------------------
+bool IsBoxInsidePlanes(const DirectX::XMFLOAT4* planes, int planeCount, const CullBounds& bounds);
+
+// --------------------------------------------------------
+// Takes the casters whose boxes are outside the volume out
+// of a list of indices into bounds, keeping the order, and
+// returns how many went
+// --------------------------------------------------------
+unsigned int CullShadowCasters(const DirectX::XMFLOAT4* planes, int planeCount,
+	const CullBounds* bounds, std::vector<unsigned int>& casters);
@@ -6,6 +6,9 @@ cbuffer externalData : register(b0)
     matrix world;
     matrix view;
     matrix projection;
+    
+    float3 positionOffset;
+    float3 positionScale;
 };
 // --------------------------------------------------------
 // A simplified vertex shader for rendering to a shadow map
@@ -13,5 +16,6 @@ cbuffer externalData : register(b0)
 float4 main(VertexShaderInput input) : SV_POSITION
 {
     matrix wvp = mul(projection, mul(view, world));
-    return mul(wvp, float4(input.localPosition, 1.0f));
+    float3 localPosition = DecodePosition(input.localPosition, positionOffset, positionScale);
+    return mul(wvp, float4(localPosition, 1.0f));
 }
\ No newline at end of file
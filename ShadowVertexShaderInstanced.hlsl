@@ -0,0 +1,22 @@
+#include "ShaderIncludes.hlsli"
+
+// Constant Buffer for external (C++) data
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+    
+    float3 positionOffset;
+    float3 positionScale;
+};
+// --------------------------------------------------------
+// ShadowVertexShader.hlsl, with the world matrix from the
+// instance buffer (see InstanceBatch.h)
+// --------------------------------------------------------
+float4 main(VertexShaderInput input, InstanceInput instance) : SV_POSITION
+{
+    matrix world = InstanceMatrix(instance.world);
+    matrix wvp = mul(projection, mul(view, world));
+    float3 localPosition = DecodePosition(input.localPosition, positionOffset, positionScale);
+    return mul(wvp, float4(localPosition, 1.0f));
+}
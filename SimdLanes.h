@@ -0,0 +1,64 @@
+#pragma once
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// --------------------------------------------------------
+// The SIMD operations the engine's wide loops are written
+// in, passed to them as a template parameter
+//
+// - Each loop is compiled for SSE in its own file, and for
+//   AVX2 in a matching *Avx2.cpp file that's the only thing
+//   built with AVX2, and HasAvx2() (CpuFeatures.h) picks
+//   one at runtime, so the game still runs on any x64 CPU
+// - The loops shouldn't call any other inline functions
+//   (std::min and so on): the linker keeps one copy of each,
+//   and it might be the AVX2 file's
+// --------------------------------------------------------
+struct SseLanes
+{
+	typedef __m128 Type;
+	static const int Count = 4;
+
+	static inline Type Set(float a) { return _mm_set1_ps(a); }
+	static inline Type Load(const float* p) { return _mm_loadu_ps(p); }
+	static inline void Store(float* p, Type a) { _mm_storeu_ps(p, a); }
+	static inline Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+	static inline Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+	static inline Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+	static inline Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+	static inline Type Min(Type a, Type b) { return _mm_min_ps(a, b); }
+	static inline Type And(Type a, Type b) { return _mm_and_ps(a, b); }
+	static inline Type NonNegative(Type a) { return _mm_cmpge_ps(a, _mm_setzero_ps()); }
+	static inline Type Select(Type mask, Type a, Type b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static inline int Mask(Type mask) { return _mm_movemask_ps(mask); }
+	static inline int NegativeMask(Type a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+
+	// 0.5, 1.5, 2.5... - pixel centers across a block
+	static inline Type Centers() { return _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); }
+};
+
+#if defined(__AVX2__)
+struct Avx2Lanes
+{
+	typedef __m256 Type;
+	static const int Count = 8;
+
+	static inline Type Set(float a) { return _mm256_set1_ps(a); }
+	static inline Type Load(const float* p) { return _mm256_loadu_ps(p); }
+	static inline void Store(float* p, Type a) { _mm256_storeu_ps(p, a); }
+	static inline Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+	static inline Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+	static inline Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+	static inline Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+	static inline Type Min(Type a, Type b) { return _mm256_min_ps(a, b); }
+	static inline Type And(Type a, Type b) { return _mm256_and_ps(a, b); }
+	static inline Type NonNegative(Type a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ); }
+	static inline Type Select(Type mask, Type a, Type b) { return _mm256_blendv_ps(b, a, mask); }
+	static inline int Mask(Type mask) { return _mm256_movemask_ps(mask); }
+	static inline int NegativeMask(Type a) { return _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ)); }
+
+	static inline Type Centers() { return _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f); }
+};
+#endif
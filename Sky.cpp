@@ -53,6 +53,8 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 
 	skyVS->SetMatrix4x4("view", camera->GetViewMatrix());
 	skyVS->SetMatrix4x4("projection", camera->GetProjectionMatrix());
+	skyVS->SetFloat3("positionOffset", skyMesh->GetPositionOffset());
+	skyVS->SetFloat3("positionScale", skyMesh->GetPositionScale());
 	skyVS->CopyAllBufferData();
 
 	skyMesh->Draw(context);
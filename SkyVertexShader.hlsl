@@ -4,23 +4,28 @@ cbuffer ExternalData : register(b0)
 {
     matrix view;
     matrix projection;
+    
+    float3 positionOffset;
+    float3 positionScale;
 }
 
 VertexToPixel_Sky main(VertexShaderInput input)
 {
     VertexToPixel_Sky output;
     
+    float3 localPosition = DecodePosition(input.localPosition, positionOffset, positionScale);
+    
     matrix viewNoTranslation = view;
     viewNoTranslation._14 = 0;
     viewNoTranslation._24 = 0;
     viewNoTranslation._34 = 0;
     
     matrix vp = mul(projection, viewNoTranslation);
-    output.position = mul(vp, float4(input.localPosition, 1.0f));
+    output.position = mul(vp, float4(localPosition, 1.0f));
     
     output.position.z = output.position.w;
     
-    output.sampleDir = input.localPosition;
+    output.sampleDir = localPosition;
     
     return output;
 }
\ No newline at end of file
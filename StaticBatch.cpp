@@ -0,0 +1,255 @@
+#include "StaticBatch.h"
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <cfloat>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// A mesh's geometry, unpacked once per build however many
+// entities use it
+// --------------------------------------------------------
+struct MeshGeometry
+{
+	std::vector<Vertex> Vertices;
+	std::vector<unsigned int> Indices;
+};
+
+typedef std::unordered_map<Mesh*, MeshGeometry> GeometryCache;
+
+static const MeshGeometry& GetGeometry(GeometryCache& cache, Mesh* mesh)
+{
+	auto found = cache.find(mesh);
+	if (found != cache.end())
+		return found->second;
+
+	MeshGeometry& geometry = cache[mesh];
+	mesh->GetGeometry(geometry.Vertices, geometry.Indices);
+	return geometry;
+}
+
+// Whether a mesh has any geometry to merge - there's none to
+// read back if its cache file was replaced since it loaded
+// (see Mesh::GetGeometry), and then its entities are left out
+// of the batches to draw themselves
+static bool HasGeometry(GeometryCache& cache, Mesh* mesh)
+{
+	return !GetGeometry(cache, mesh).Vertices.empty();
+}
+
+// Spreads the low 10 bits of x out to every third bit
+static unsigned int SpreadBits(unsigned int x)
+{
+	x &= 0x3FF;
+	x = (x | (x << 16)) & 0x030000FF;
+	x = (x | (x << 8)) & 0x0300F00F;
+	x = (x | (x << 4)) & 0x030C30C3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+// --------------------------------------------------------
+// Merges a batch's sources as they are now
+// --------------------------------------------------------
+static void BuildBatch(EntityStore& entities, StaticBatch& batch, GeometryCache& cache,
+	std::shared_ptr<GeometryArena> arena)
+{
+	auto buildStart = std::chrono::high_resolution_clock::now();
+
+	std::vector<MeshInstance> instances;
+	batch.SourceWorlds.clear();
+	for (EntityId e : batch.Sources)
+	{
+		const MeshGeometry& geometry = GetGeometry(cache, entities.GetMesh(e).get());
+		MeshInstance instance = {};
+		instance.Vertices = geometry.Vertices.data();
+		instance.VertexCount = (int)geometry.Vertices.size();
+		instance.Indices = geometry.Indices.data();
+		instance.IndexCount = (int)geometry.Indices.size();
+		instance.World = entities.GetTransform(e).GetWorldMatrix();
+		instance.WorldInverseTranspose = entities.GetTransform(e).GetWorldInverseTransposeMatrix();
+		instances.push_back(instance);
+		batch.SourceWorlds.push_back(instance.World);
+	}
+
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MergeMeshInstances(instances.data(), (int)instances.size(), verts, indices);
+
+	// The merged mesh is packed against its own (world space) bounds
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(
+		verts.data(), (int)verts.size(), indices.data(), (int)indices.size(), arena);
+	// Every source shares the material and whether it casts a shadow
+	entities.Destroy(batch.Merged);
+	batch.Merged = entities.Create(mesh, entities.GetMaterial(batch.Sources[0]),
+		ENTITY_FLAG_BATCH | (entities.GetFlags(batch.Sources[0]) & ENTITY_FLAG_NO_SHADOW));
+
+	batch.BuildTime = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - buildStart).count();
+}
+
+void BuildStaticBatches(std::shared_ptr<EntityStore> entities,
+	std::shared_ptr<GeometryArena> arena,
+	std::vector<StaticBatch>& batches)
+{
+	for (const StaticBatch& batch : batches)
+		entities->Destroy(batch.Merged);
+	batches.clear();
+
+	// Group by material, in the order they first show up - and
+	// apart from those sharing it that don't cast shadows, since
+	// the merged entity either casts one or doesn't
+	std::vector<std::vector<EntityId>> groups;
+	std::unordered_map<Material*, size_t> groupIndices[2];	// Casting shadows, then not
+	const unsigned int* flags = entities->GetFlags();
+	Mesh* const* meshes = entities->GetMeshes();
+	Material* const* materials = entities->GetMaterials();
+	GeometryCache cache;
+	for (unsigned int i = 0; i < entities->GetCount(); i++)
+	{
+		if (!(flags[i] & ENTITY_FLAG_STATIC))
+			continue;
+		if (!HasGeometry(cache, meshes[i]))
+		{
+			entities->SetFlags(entities->GetIds()[i], flags[i] & ~ENTITY_FLAG_STATIC);
+			continue;
+		}
+
+		std::unordered_map<Material*, size_t>& indices = groupIndices[(flags[i] & ENTITY_FLAG_NO_SHADOW) ? 1 : 0];
+		auto found = indices.find(materials[i]);
+		if (found == indices.end())
+		{
+			found = indices.insert({ materials[i], groups.size() }).first;
+			groups.push_back({});
+		}
+		groups[found->second].push_back(entities->GetIds()[i]);
+	}
+
+	for (std::vector<EntityId>& group : groups)
+	{
+		// Sort along a Z-order curve through the group's bounds,
+		// so neighbours in the list are neighbours in the world
+		XMVECTOR minPos = XMVectorReplicate(FLT_MAX);
+		XMVECTOR maxPos = XMVectorReplicate(-FLT_MAX);
+		for (EntityId e : group)
+		{
+			XMFLOAT3 position = entities->GetTransform(e).GetWorldPosition();
+			XMVECTOR pos = XMLoadFloat3(&position);
+			minPos = XMVectorMin(minPos, pos);
+			maxPos = XMVectorMax(maxPos, pos);
+		}
+		XMVECTOR extent = XMVectorMax(maxPos - minPos, XMVectorReplicate(1e-6f));
+
+		std::vector<std::pair<unsigned int, size_t>> order(group.size());
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			XMFLOAT3 position = entities->GetTransform(group[i]).GetWorldPosition();
+			XMFLOAT3 cell;
+			XMStoreFloat3(&cell, (XMLoadFloat3(&position) - minPos) / extent * 1023.0f);
+			unsigned int code = SpreadBits((unsigned int)cell.x)
+				| (SpreadBits((unsigned int)cell.y) << 1)
+				| (SpreadBits((unsigned int)cell.z) << 2);
+			order[i] = { code, i };
+		}
+		std::sort(order.begin(), order.end());
+
+		// Then cut the curve into batches by vertex count
+		StaticBatch batch = {};
+		int batchVertices = 0;
+		for (const std::pair<unsigned int, size_t>& o : order)
+		{
+			EntityId e = group[o.second];
+			int vertexCount = (int)GetGeometry(cache, entities->GetMesh(e).get()).Vertices.size();
+			if (!batch.Sources.empty() && batchVertices + vertexCount > STATIC_BATCH_MAX_VERTICES)
+			{
+				BuildBatch(*entities, batch, cache, arena);
+				batches.push_back(batch);
+				batch = {};
+				batchVertices = 0;
+			}
+			batch.Sources.push_back(e);
+			batchVertices += vertexCount;
+		}
+		if (!batch.Sources.empty())
+		{
+			BuildBatch(*entities, batch, cache, arena);
+			batches.push_back(batch);
+		}
+	}
+}
+
+int UpdateStaticBatches(std::shared_ptr<EntityStore> entities,
+	std::vector<StaticBatch>& batches,
+	std::shared_ptr<GeometryArena> arena)
+{
+	GeometryCache cache;
+	int rebuilt = 0;
+	for (size_t b = 0; b < batches.size();)
+	{
+		StaticBatch& batch = batches[b];
+
+		// Entities that are gone or aren't static any more drop out
+		// (the latter go back to drawing themselves), and any others
+		// that moved need merging again
+		bool changed = false;
+		unsigned int mergedShadow = entities->GetFlags(batch.Merged) & ENTITY_FLAG_NO_SHADOW;
+		for (size_t i = 0; i < batch.Sources.size();)
+		{
+			// One that's started or stopped casting a shadow belongs
+			// in another group, so they're all grouped again
+			if (entities->IsAlive(batch.Sources[i]) &&
+				(entities->GetFlags(batch.Sources[i]) & ENTITY_FLAG_NO_SHADOW) != mergedShadow)
+			{
+				BuildStaticBatches(entities, arena, batches);
+				return rebuilt + (int)batches.size();
+			}
+
+			if (!entities->IsAlive(batch.Sources[i]) ||
+				!(entities->GetFlags(batch.Sources[i]) & ENTITY_FLAG_STATIC))
+			{
+				batch.Sources.erase(batch.Sources.begin() + i);
+				batch.SourceWorlds.erase(batch.SourceWorlds.begin() + i);
+				changed = true;
+				continue;
+			}
+
+			XMFLOAT4X4 world = entities->GetTransform(batch.Sources[i]).GetWorldMatrix();
+			if (memcmp(&world, &batch.SourceWorlds[i], sizeof(XMFLOAT4X4)) != 0)
+				changed = true;
+			i++;
+		}
+
+		// Merging again reads the meshes back, which might not work
+		// any more
+		for (size_t i = 0; changed && i < batch.Sources.size();)
+		{
+			EntityId e = batch.Sources[i];
+			if (HasGeometry(cache, entities->GetMesh(e).get()))
+			{
+				i++;
+				continue;
+			}
+			entities->SetFlags(e, entities->GetFlags(e) & ~ENTITY_FLAG_STATIC);
+			batch.Sources.erase(batch.Sources.begin() + i);
+			batch.SourceWorlds.erase(batch.SourceWorlds.begin() + i);
+		}
+
+		if (batch.Sources.empty())
+		{
+			entities->Destroy(batch.Merged);
+			batches.erase(batches.begin() + b);
+			rebuilt++;
+			continue;
+		}
+
+		if (changed)
+		{
+			BuildBatch(*entities, batch, cache, arena);
+			rebuilt++;
+		}
+		b++;
+	}
+	return rebuilt;
+}
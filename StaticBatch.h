@@ -0,0 +1,53 @@
+#pragma once
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include "StaticBatchMerge.h"
+#include "EntityStore.h"
+#include "GeometryArena.h"
+
+// --------------------------------------------------------
+// Static entities sharing a material (and whether they
+// cast a shadow), merged into one mesh that's already in
+// world space
+//
+// Merged is an entity of its own (flagged as a batch) that
+// is drawn in their place, with an identity world matrix,
+// in a single DrawIndexed
+// --------------------------------------------------------
+struct StaticBatch
+{
+	std::vector<EntityId> Sources;
+	std::vector<DirectX::XMFLOAT4X4> SourceWorlds;	// As of the last build
+	EntityId Merged;
+	double BuildTime;								// Of the last build, in milliseconds
+};
+
+// --------------------------------------------------------
+// Groups the static entities by material (and whether
+// they cast a shadow) and merges each group into batches
+// of at most STATIC_BATCH_MAX_VERTICES, replacing whatever
+// batches held before (and destroying their merged
+// entities)
+//
+// Entities are sorted along a Z-order curve first, so each
+// batch covers a compact part of the world (which keeps
+// its packed positions precise)
+//
+// Entities whose mesh has no geometry to read back aren't
+// static any more, so they go on drawing themselves
+// --------------------------------------------------------
+void BuildStaticBatches(std::shared_ptr<EntityStore> entities,
+	std::shared_ptr<GeometryArena> arena,
+	std::vector<StaticBatch>& batches);
+
+// --------------------------------------------------------
+// Rebuilds just the batches with an entity that moved,
+// stopped being static or was destroyed since they were
+// built
+//
+// Returns the number of batches rebuilt
+// --------------------------------------------------------
+int UpdateStaticBatches(std::shared_ptr<EntityStore> entities,
+	std::vector<StaticBatch>& batches,
+	std::shared_ptr<GeometryArena> arena);
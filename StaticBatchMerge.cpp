@@ -0,0 +1,48 @@
+#include "StaticBatchMerge.h"
+
+using namespace DirectX;
+
+void MergeMeshInstances(const MeshInstance* instances, int instanceCount,
+	std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	size_t vertexCount = verts.size();
+	size_t indexCount = indices.size();
+	for (int i = 0; i < instanceCount; i++)
+	{
+		vertexCount += instances[i].VertexCount;
+		indexCount += instances[i].IndexCount;
+	}
+	verts.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	for (int i = 0; i < instanceCount; i++)
+	{
+		const MeshInstance& instance = instances[i];
+		XMMATRIX world = XMLoadFloat4x4(&instance.World);
+		XMMATRIX worldInverseTranspose = XMLoadFloat4x4(&instance.WorldInverseTranspose);
+
+		// Normals need the inverse transpose (for non-uniform scale),
+		// but tangents lie along the surface so they take the world
+		unsigned int baseVertex = (unsigned int)verts.size();
+		for (int v = 0; v < instance.VertexCount; v++)
+		{
+			Vertex vertex = instance.Vertices[v];
+			XMStoreFloat3(&vertex.Position, XMVector3TransformCoord(XMLoadFloat3(&vertex.Position), world));
+			XMStoreFloat3(&vertex.Normal, XMVector3Normalize(
+				XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), worldInverseTranspose)));
+			XMStoreFloat3(&vertex.Tangent, XMVector3Normalize(
+				XMVector3TransformNormal(XMLoadFloat3(&vertex.Tangent), world)));
+			verts.push_back(vertex);
+		}
+
+		// A mirroring transform turns clockwise triangles counter
+		// clockwise, so put them back the way they're culled
+		bool mirrored = XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f;
+		for (int t = 0; t + 2 < instance.IndexCount; t += 3)
+		{
+			indices.push_back(baseVertex + instance.Indices[t]);
+			indices.push_back(baseVertex + instance.Indices[t + (mirrored ? 2 : 1)]);
+			indices.push_back(baseVertex + instance.Indices[t + (mirrored ? 1 : 2)]);
+		}
+	}
+}
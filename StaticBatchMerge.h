@@ -0,0 +1,32 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Vertex.h"
+
+// Most vertices in one batch, so each batch keeps 16-bit
+// indices and moving one entity only rebuilds its batch
+#define STATIC_BATCH_MAX_VERTICES	65536
+
+// --------------------------------------------------------
+// One mesh placed in the world, to be merged with others
+// --------------------------------------------------------
+struct MeshInstance
+{
+	const Vertex* Vertices;
+	int VertexCount;
+	const unsigned int* Indices;
+	int IndexCount;
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+};
+
+// --------------------------------------------------------
+// Moves every instance's vertices into world space and
+// appends them (and their re-based indices) to verts and
+// indices
+//
+// Kept apart from StaticBatch.h, which needs Direct3D, so
+// it can be tested on its own
+// --------------------------------------------------------
+void MergeMeshInstances(const MeshInstance* instances, int instanceCount,
+	std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
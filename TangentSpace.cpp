@@ -0,0 +1,178 @@
+#include "TangentSpace.h"
+#include "ParallelFor.h"
+#include <vector>
+#include <cmath>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// One thread's share of the triangles, and its sums for
+// just the span of vertices they use (which is small,
+// since vertices are already in the order triangles use
+// them), so threads never write to the same place
+//
+// A lone range has no Sums, and sums straight into the
+// vertices' tangents instead
+// --------------------------------------------------------
+struct TangentRange
+{
+	unsigned int FirstVertex;
+	unsigned int LastVertex;
+	std::vector<XMFLOAT3> Sums;
+};
+
+// --------------------------------------------------------
+// Tangents of triangles [first, last), unnormalized and
+// pointing along increasing U, summed into each of their
+// vertices
+//
+// Adapted from Chris Cascioli's Mesh::CalculateTangents,
+// which came from http://foundationsofgameenginedev.com/FGED2-sample.pdf
+// (listing 7.4 in section 7.5)
+//
+// One triangle at a time: the loop is bound by fetching
+// corners and adding into vertices, not the maths, and
+// working out blocks of tangents in SIMD lanes before
+// summing them measured slower than this
+// --------------------------------------------------------
+static void SumTriangleTangents(Vertex* verts, const unsigned int* indices,
+	int first, int last, TangentMode mode, TangentRange& range)
+{
+	char* sums = range.Sums.empty() ? (char*)&verts[0].Tangent :
+		(char*)(&range.Sums[0] - range.FirstVertex);
+	size_t stride = range.Sums.empty() ? sizeof(Vertex) : sizeof(XMFLOAT3);
+	for (int t = first; t < last; t++)
+	{
+		const unsigned int* tri = &indices[t * 3];
+		const Vertex* v1 = &verts[tri[0]];
+		const Vertex* v2 = &verts[tri[1]];
+		const Vertex* v3 = &verts[tri[2]];
+
+		// Vectors relative to the first vertex's position and uv
+		float x1 = v2->Position.x - v1->Position.x;
+		float y1 = v2->Position.y - v1->Position.y;
+		float z1 = v2->Position.z - v1->Position.z;
+		float x2 = v3->Position.x - v1->Position.x;
+		float y2 = v3->Position.y - v1->Position.y;
+		float z2 = v3->Position.z - v1->Position.z;
+		float s1 = v2->UV.x - v1->UV.x;
+		float t1 = v2->UV.y - v1->UV.y;
+		float s2 = v3->UV.x - v1->UV.x;
+		float t2 = v3->UV.y - v1->UV.y;
+
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+		XMFLOAT3 tangent(
+			(t2 * x1 - t1 * x2) * r,
+			(t2 * y1 - t1 * y2) * r,
+			(t2 * z1 - t1 * z2) * r);
+
+		if (mode == TANGENTS_AREA_WEIGHTED)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				XMFLOAT3* sum = (XMFLOAT3*)(sums + tri[c] * stride);
+				sum->x += tangent.x;
+				sum->y += tangent.y;
+				sum->z += tangent.z;
+			}
+			continue;
+		}
+
+		// Triangles with no UV area have no direction to give
+		XMVECTOR faceTangent = XMLoadFloat3(&tangent);
+		if (XMVector3IsNaN(faceTangent) || XMVector3IsInfinite(faceTangent))
+			continue;
+
+		// MikkTSpace flattens everything onto the plane of each
+		// corner's normal, and weights by the angle there
+		for (int c = 0; c < 3; c++)
+		{
+			const Vertex& v = verts[tri[c]];
+			XMVECTOR normal = XMLoadFloat3(&v.Normal);
+			XMVECTOR position = XMLoadFloat3(&v.Position);
+			XMVECTOR edge1 = XMLoadFloat3(&verts[tri[(c + 1) % 3]].Position) - position;
+			XMVECTOR edge2 = XMLoadFloat3(&verts[tri[(c + 2) % 3]].Position) - position;
+			edge1 = XMVector3Normalize(edge1 - normal * XMVector3Dot(normal, edge1));
+			edge2 = XMVector3Normalize(edge2 - normal * XMVector3Dot(normal, edge2));
+
+			float cosAngle = XMVectorGetX(XMVector3Dot(edge1, edge2));
+			float angle = acosf(cosAngle < -1.0f ? -1.0f : cosAngle > 1.0f ? 1.0f : cosAngle);
+			XMVECTOR flatTangent = XMVector3Normalize(faceTangent - normal * XMVector3Dot(normal, faceTangent));
+			XMFLOAT3* sum = (XMFLOAT3*)(sums + tri[c] * stride);
+			XMStoreFloat3(sum, XMLoadFloat3(sum) + flatTangent * angle);
+		}
+	}
+}
+
+void CalculateTangents(Vertex* verts, int numVerts,
+	const unsigned int* indices, int numIndices,
+	TangentMode mode, int maxThreads)
+{
+	int numTris = numIndices / 3;
+	int rangeCount = GetRangeCount(numTris, TANGENT_MIN_THREAD_TRIANGLES);
+	if (maxThreads > 0 && rangeCount > maxThreads)
+		rangeCount = maxThreads;
+
+	// Each thread sums up its own triangles' tangents
+	std::vector<TangentRange> ranges(rangeCount);
+	ParallelFor(numTris, rangeCount, [&](int r, int first, int last)
+	{
+		TangentRange& range = ranges[r];
+		if (rangeCount == 1)
+		{
+			for (int v = 0; v < numVerts; v++)
+				verts[v].Tangent = XMFLOAT3(0, 0, 0);
+			SumTriangleTangents(verts, indices, first, last, mode, range);
+			return;
+		}
+
+		range.FirstVertex = numVerts;
+		range.LastVertex = 0;
+		for (int i = first * 3; i < last * 3; i++)
+		{
+			if (indices[i] < range.FirstVertex) range.FirstVertex = indices[i];
+			if (indices[i] > range.LastVertex) range.LastVertex = indices[i];
+		}
+		if (first == last)
+			return;
+
+		range.Sums.assign(range.LastVertex - range.FirstVertex + 1, XMFLOAT3(0, 0, 0));
+		SumTriangleTangents(verts, indices, first, last, mode, range);
+	});
+
+	// Then each vertex adds up its sums from every thread, in order,
+	// so a single thread gets exactly the same answer as summing
+	// straight into the vertices would
+	int vertexRangeCount = GetRangeCount(numVerts,
+		(int)((long long)TANGENT_MIN_THREAD_TRIANGLES * numVerts / (numTris > 0 ? numTris : 1)) + 1);
+	if (maxThreads > 0 && vertexRangeCount > maxThreads)
+		vertexRangeCount = maxThreads;
+	ParallelFor(numVerts, vertexRangeCount, [&](int, int first, int last)
+	{
+		for (int v = first; v < last; v++)
+		{
+			XMVECTOR tangent = rangeCount == 1 ? XMLoadFloat3(&verts[v].Tangent) : XMVectorZero();
+			for (const TangentRange& range : ranges)
+			{
+				if (!range.Sums.empty() && (unsigned int)v >= range.FirstVertex && (unsigned int)v <= range.LastVertex)
+					tangent += XMLoadFloat3(&range.Sums[v - range.FirstVertex]);
+			}
+
+			// Use Gram-Schmidt orthonormalize to ensure
+			// the normal and tangent are exactly 90 degrees apart
+			XMVECTOR normal = XMLoadFloat3(&verts[v].Normal);
+			tangent = XMVector3Normalize(
+				tangent - normal * XMVector3Dot(normal, tangent));
+
+			// MikkTSpace still gives a vertex with no usable
+			// triangles some tangent at right angles to its normal
+			if (mode == TANGENTS_MIKKTSPACE && XMVector3Equal(tangent, XMVectorZero()))
+			{
+				XMVECTOR axis = fabsf(verts[v].Normal.x) < 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+				tangent = XMVector3Normalize(XMVector3Cross(axis, normal));
+			}
+
+			XMStoreFloat3(&verts[v].Tangent, tangent);
+		}
+	});
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "Vertex.h"
+
+// Meshes smaller than this are done on a single thread
+#define TANGENT_MIN_THREAD_TRIANGLES	(64 * 1024)
+
+// --------------------------------------------------------
+// How each triangle's tangent is blended into its vertices
+//
+// - TANGENTS_AREA_WEIGHTED: summed as is, so bigger
+//   triangles count for more (the original behaviour)
+// - TANGENTS_MIKKTSPACE: flattened against the vertex
+//   normal, normalized and weighted by the triangle's angle
+//   at that corner, as MikkTSpace does, so normal maps baked
+//   by most DCC tools line up
+// --------------------------------------------------------
+enum TangentMode
+{
+	TANGENTS_AREA_WEIGHTED,
+	TANGENTS_MIKKTSPACE
+};
+
+// Which of the above meshes are built with
+// - Bump MESH_CACHE_VERSION when changing this
+#define MESH_TANGENT_MODE	TANGENTS_AREA_WEIGHTED
+
+// --------------------------------------------------------
+// Calculates a tangent for every vertex from its position,
+// normal and UV, replacing whatever Tangent held before
+//
+// Big meshes are split across up to maxThreads threads (0
+// for as many as help). With one thread the sums happen in
+// the same order as always, so results match exactly -
+// with more, vertices shared by two threads' triangles can
+// differ by float rounding
+// --------------------------------------------------------
+void CalculateTangents(Vertex* verts, int numVerts,
+	const unsigned int* indices, int numIndices,
+	TangentMode mode = MESH_TANGENT_MODE, int maxThreads = 0);
@@ -0,0 +1,239 @@
+#include "TestFramework.h"
+#include "AssetCache.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+// A loaded "mesh", remembering which file it came from
+struct TestAsset
+{
+	std::string Contents;
+};
+
+// Every spelling of the cube's path, and a copy of it, share one file's
+// contents, the way AssetRegistry hashes them after normalizing
+static const std::map<std::wstring, std::string> testFiles =
+{
+	{ L"c:\\game\\assets\\models\\cube.obj", "v cube" },
+	{ L"c:\\game\\assets\\models\\..\\models\\cube.obj", "v cube" },
+	{ L"c:\\game\\assets\\backup\\cube copy.obj", "v cube" },
+	{ L"c:\\game\\assets\\models\\sphere.obj", "v sphere" },
+	{ L"c:\\game\\assets\\models\\.\\sphere.obj", "v sphere" },
+};
+
+static unsigned long long HashTestFile(const std::wstring& path)
+{
+	return std::hash<std::string>()(testFiles.at(path));
+}
+
+static long CountReferences(const std::shared_ptr<TestAsset>& asset)
+{
+	return asset.use_count();
+}
+
+static void TestLoadsOnce()
+{
+	AssetCache<std::shared_ptr<TestAsset>> cache;
+	std::vector<std::wstring> paths;
+	for (auto& file : testFiles)
+		paths.push_back(file.first);
+
+	// Every thread asks for every spelling, in its own order, all at once,
+	// and the first load is slow so the others pile up behind it
+	std::map<std::string, std::atomic<int>> loads;
+	for (auto& file : testFiles)
+		loads[file.second] = 0;
+	const int threadCount = 8;
+	std::vector<std::vector<std::shared_ptr<TestAsset>>> results(threadCount);
+	std::atomic<bool> start(false);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937 random(t);
+			while (!start)
+				std::this_thread::yield();
+			for (int i = 0; i < 200; i++)
+			{
+				const std::wstring& path = paths[random() % paths.size()];
+				results[t].push_back(cache.GetOrLoad(path, HashTestFile(path),
+					[&](const std::wstring& file, unsigned long long, size_t& memorySize)
+				{
+					loads.at(testFiles.at(file))++;
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					memorySize = 100;
+					return std::make_shared<TestAsset>(TestAsset{ testFiles.at(file) });
+				}));
+			}
+		});
+	}
+	start = true;
+	for (std::thread& thread : threads)
+		thread.join();
+
+	// One load per file's contents, and everyone got that one
+	CHECK(loads.at("v cube") == 1);
+	CHECK(loads.at("v sphere") == 1);
+	std::map<std::string, TestAsset*> shared;
+	bool same = true, valid = true;
+	for (auto& result : results)
+	{
+		for (auto& asset : result)
+		{
+			valid &= asset != 0;
+			if (!asset)
+				continue;
+			TestAsset*& first = shared[asset->Contents];
+			first = first ? first : asset.get();
+			same &= asset.get() == first;
+		}
+	}
+	CHECK(valid);
+	CHECK(same);
+	CHECK(shared.size() == 2);
+
+	// Each asset is listed once, under one of its paths, with
+	// every result counted as a reference
+	std::vector<AssetInfo> info;
+	cache.GetInfo(info, CountReferences);
+	CHECK(info.size() == 2);
+	long references = 0;
+	bool knownPaths = true;
+	for (const AssetInfo& asset : info)
+	{
+		knownPaths &= testFiles.count(asset.Path) && HashTestFile(asset.Path) == asset.ContentHash;
+		references += asset.References;
+	}
+	CHECK(knownPaths);
+	CHECK(references == threadCount * 200);
+	CHECK(cache.GetMemorySize() == 200);
+
+	// Nothing's released while it's in use, and once it's not, asking
+	// again loads it again
+	std::shared_ptr<TestAsset> sphere;
+	for (auto& asset : results[0])
+		sphere = asset->Contents == "v sphere" ? asset : sphere;
+	for (auto& result : results)
+		result.clear();
+	cache.ReleaseUnused(CountReferences);
+	info.clear();
+	cache.GetInfo(info, CountReferences);
+	CHECK(sphere && info.size() == 1 && info[0].References == 1);
+
+	const std::wstring& cube = paths[0];
+	std::shared_ptr<TestAsset> reloaded = cache.GetOrLoad(cube, HashTestFile(cube),
+		[&](const std::wstring& file, unsigned long long, size_t& memorySize)
+	{
+		loads.at(testFiles.at(file))++;
+		memorySize = 100;
+		return std::make_shared<TestAsset>(TestAsset{ testFiles.at(file) });
+	});
+	CHECK(reloaded && reloaded->Contents == "v cube");
+	CHECK(loads.at("v cube") == 2);
+}
+
+static void TestFailedLoad()
+{
+	// The first load throws while others are waiting on it: they all
+	// see its exception, and nothing's left cached
+	AssetCache<std::shared_ptr<TestAsset>> cache;
+	const std::wstring sphere = L"c:\\game\\assets\\models\\sphere.obj";
+	unsigned long long hash = HashTestFile(sphere);
+	std::atomic<int> loads(0), failures(0);
+	auto failingLoad = [&](const std::wstring&, unsigned long long, size_t&) -> std::shared_ptr<TestAsset>
+	{
+		loads++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		throw std::runtime_error("Missing file");
+	};
+
+	const int threadCount = 4;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&]()
+		{
+			try
+			{
+				cache.GetOrLoad(sphere, hash, failingLoad);
+			}
+			catch (const std::runtime_error&)
+			{
+				failures++;
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	CHECK(failures == threadCount);
+	CHECK(loads >= 1);
+	std::vector<AssetInfo> info;
+	cache.GetInfo(info, CountReferences);
+	CHECK(info.empty());
+	CHECK(cache.GetMemorySize() == 0);
+
+	// So asking again loads it again, and this time it works
+	int before = loads;
+	std::shared_ptr<TestAsset> loaded = cache.GetOrLoad(sphere, hash,
+		[&](const std::wstring& file, unsigned long long, size_t& memorySize)
+	{
+		loads++;
+		memorySize = 100;
+		return std::make_shared<TestAsset>(TestAsset{ testFiles.at(file) });
+	});
+	CHECK(loaded && loaded->Contents == "v sphere");
+	CHECK(loads == before + 1);
+	CHECK(cache.GetMemorySize() == 100);
+}
+
+static void BenchLookups()
+{
+	// Already loaded assets, looked up from every thread at once
+	AssetCache<std::shared_ptr<TestAsset>> cache;
+	auto load = [](const std::wstring& file, unsigned long long, size_t&)
+	{
+		return std::make_shared<TestAsset>(TestAsset{ testFiles.at(file) });
+	};
+	for (auto& file : testFiles)
+		cache.GetOrLoad(file.first, HashTestFile(file.first), load);
+
+	const std::wstring& cube = testFiles.begin()->first;
+	unsigned long long hash = HashTestFile(cube);
+	for (int threadCount : { 1, 4 })
+	{
+		const int lookups = 200000;
+		double ms = TimeBest(3, [&]()
+		{
+			std::vector<std::thread> threads;
+			for (int t = 0; t < threadCount; t++)
+			{
+				threads.emplace_back([&]()
+				{
+					for (int i = 0; i < lookups; i++)
+						cache.GetOrLoad(cube, hash, load);
+				});
+			}
+			for (std::thread& thread : threads)
+				thread.join();
+		});
+		printf("%d thread(s): %.0f ns per loaded lookup\n", threadCount, ms * 1e6 / (lookups * threadCount));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestLoadsOnce();
+	TestFailedLoad();
+
+	if (BENCH)
+		BenchLookups();
+
+	return FinishTests("AssetCacheTests");
+}
@@ -0,0 +1,311 @@
+#include "TestFramework.h"
+#include "EntitySlots.h"
+#include "SceneBvh.h"
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// A store's slots with one component (a tag per entity) and
+// the BVH over its bounds, kept in step the way EntityStore
+// keeps its own
+// --------------------------------------------------------
+struct TestStore
+{
+	EntitySlots Slots;
+	std::vector<unsigned int> Tags;
+	std::vector<CullBounds> Bounds;
+	SceneBvh Bvh;
+
+	EntityId Create(unsigned int tag, const CullBounds& bounds)
+	{
+		EntityId id = Slots.Add();
+		Tags.push_back(tag);
+		Bounds.push_back(bounds);
+		Bvh.Insert(Slots.GetIndex(id));
+		return id;
+	}
+
+	void Destroy(EntityId id)
+	{
+		unsigned int last = Slots.GetCount() - 1;
+		unsigned int index = Slots.Remove(id);
+		Bvh.Remove(index);
+		if (index != last)
+		{
+			Bvh.Rename(last, index);
+			Tags[index] = Tags[last];
+			Bounds[index] = Bounds[last];
+		}
+		Tags.pop_back();
+		Bounds.pop_back();
+	}
+};
+
+static bool operator==(EntityId a, EntityId b)
+{
+	return a.Index == b.Index && a.Generation == b.Generation;
+}
+
+static unsigned long long Key(EntityId id)
+{
+	return ((unsigned long long)id.Index << 32) | id.Generation;
+}
+
+static CullBounds RandomBounds(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	CullBounds b;
+	b.Center = XMFLOAT3(-50 + 100 * u(random), -5 + 10 * u(random), -50 + 100 * u(random));
+	b.Extents = XMFLOAT3(0.1f + u(random), 0.1f + u(random), 0.1f + u(random));
+	b.Radius = sqrtf(b.Extents.x * b.Extents.x + b.Extents.y * b.Extents.y + b.Extents.z * b.Extents.z);
+	return b;
+}
+
+// Every live ID finds its own tag, and the dense IDs are exactly the live ones
+static bool MatchesLive(TestStore& store, const std::unordered_map<unsigned long long, unsigned int>& live)
+{
+	if (store.Slots.GetCount() != live.size() || store.Tags.size() != live.size())
+		return false;
+	for (unsigned int i = 0; i < store.Slots.GetCount(); i++)
+	{
+		EntityId id = store.Slots.GetIds()[i];
+		auto found = live.find(Key(id));
+		if (found == live.end() || !store.Slots.IsAlive(id) ||
+			store.Slots.GetIndex(id) != i || store.Tags[i] != found->second)
+			return false;
+	}
+	return true;
+}
+
+static void TestSwapRemove()
+{
+	// Random creates and destroys, checked against a map of what's alive
+	std::mt19937 random(15);
+	TestStore store;
+	std::unordered_map<unsigned long long, unsigned int> live;
+	std::vector<EntityId> ids;
+	unsigned int nextTag = 0;
+	bool matches = true;
+	for (int step = 0; step < 20000; step++)
+	{
+		if (ids.empty() || random() % 5 < 3)
+		{
+			EntityId id = store.Create(nextTag, RandomBounds(random));
+			live[Key(id)] = nextTag++;
+			ids.push_back(id);
+		}
+		else
+		{
+			// Sometimes the last dense one, which doesn't move anything
+			size_t i = random() % ids.size();
+			if (random() % 4 == 0)
+				i = std::find(ids.begin(), ids.end(), store.Slots.GetIds()[store.Slots.GetCount() - 1]) - ids.begin();
+			store.Destroy(ids[i]);
+			live.erase(Key(ids[i]));
+			ids[i] = ids.back();
+			ids.pop_back();
+		}
+		if (step % 97 == 0)
+			matches &= MatchesLive(store, live);
+	}
+	matches &= MatchesLive(store, live);
+	CHECK(matches);
+
+	// Down to nothing, one at a time from the front
+	while (!ids.empty())
+	{
+		store.Destroy(ids.front());
+		live.erase(Key(ids.front()));
+		ids.erase(ids.begin());
+		matches &= MatchesLive(store, live);
+	}
+	CHECK(matches);
+	CHECK(store.Slots.GetCount() == 0);
+}
+
+static void TestStaleIds()
+{
+	TestStore store;
+	std::mt19937 random(1);
+	EntityId a = store.Create(1, RandomBounds(random));
+	EntityId b = store.Create(2, RandomBounds(random));
+	store.Destroy(a);
+	CHECK(!store.Slots.IsAlive(a));
+	CHECK(store.Slots.IsAlive(b));
+
+	// The freed slot is reused, under a new generation, so the old
+	// ID still reads as dead rather than naming the new entity
+	EntityId c = store.Create(3, RandomBounds(random));
+	CHECK(c.Index == a.Index);
+	CHECK(c.Generation != a.Generation);
+	CHECK(!store.Slots.IsAlive(a));
+	CHECK(store.Slots.IsAlive(c));
+	CHECK(store.Tags[store.Slots.GetIndex(c)] == 3);
+	CHECK(store.Tags[store.Slots.GetIndex(b)] == 2);
+
+	// Reused over and over, only the latest is ever alive
+	std::vector<EntityId> old;
+	for (int k = 0; k < 100; k++)
+	{
+		old.push_back(c);
+		store.Destroy(c);
+		c = store.Create(4 + k, RandomBounds(random));
+	}
+	bool allStale = true;
+	for (EntityId id : old)
+		allStale &= !store.Slots.IsAlive(id) && id.Index == c.Index;
+	CHECK(allStale);
+
+	// IDs that never were, or name no entity, aren't alive either
+	CHECK(!store.Slots.IsAlive(EntityId{ 0, 0 }));
+	CHECK(!store.Slots.IsAlive(EntityId{ 1000, 1 }));
+	CHECK(!store.Slots.IsAlive(EntityId{ c.Index, 0 }));
+}
+
+static void TestGenerationWraparound()
+{
+	// A slot's generation skips zero when it wraps, since an ID with
+	// no generation means no entity
+	CHECK(NextGeneration(1) == 2);
+	CHECK(NextGeneration(UINT_MAX - 1) == UINT_MAX);
+	CHECK(NextGeneration(UINT_MAX) == 1);
+
+	// Every generation a slot goes through is alive only while it's current
+	TestStore store;
+	std::mt19937 random(2);
+	EntityId id = store.Create(0, RandomBounds(random));
+	unsigned int generation = id.Generation;
+	for (int k = 0; k < 1000; k++)
+	{
+		store.Destroy(id);
+		id = store.Create(0, RandomBounds(random));
+		generation = NextGeneration(generation);
+	}
+	CHECK(id.Generation == generation);
+	CHECK(store.Slots.IsAlive(id));
+}
+
+static void TestBvhRename()
+{
+	// Queries through the BVH, after entities move around the dense
+	// arrays, find the same entities as a scan of them
+	std::mt19937 random(21);
+	std::uniform_real_distribution<float> u(0, 1);
+	TestStore store;
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 2000; i++)
+		ids.push_back(store.Create(i, RandomBounds(random)));
+	store.Bvh.Build(store.Bounds.data(), store.Slots.GetCount());
+
+	bool matches = true;
+	for (int round = 0; round < 50; round++)
+	{
+		for (int k = 0; k < 40 && !ids.empty(); k++)
+		{
+			size_t i = random() % ids.size();
+			store.Destroy(ids[i]);
+			ids[i] = ids.back();
+			ids.pop_back();
+		}
+		for (int k = 0; k < 30; k++)
+			ids.push_back(store.Create(2000 + round * 100 + k, RandomBounds(random)));
+
+		// Some moved, refit or rebuilt as the store would
+		for (int k = 0; k < 20; k++)
+		{
+			unsigned int i = random() % store.Slots.GetCount();
+			store.Bounds[i] = RandomBounds(random);
+			store.Bvh.MarkMoved(i);
+		}
+		if (store.Bvh.NeedsRebuild())
+			store.Bvh.Build(store.Bounds.data(), store.Slots.GetCount());
+		else
+			store.Bvh.Refit(store.Bounds.data());
+
+		for (int q = 0; q < 10; q++)
+		{
+			XMFLOAT3 center(-50 + 100 * u(random), 0, -50 + 100 * u(random));
+			float radius = 2 + 10 * u(random);
+			std::vector<unsigned int> found;
+			store.Bvh.QuerySphere(center, radius, store.Bounds.data(), found);
+
+			std::vector<unsigned int> foundTags, expectedTags;
+			for (unsigned int i : found)
+				foundTags.push_back(store.Tags[i]);
+			for (unsigned int i = 0; i < store.Slots.GetCount(); i++)
+			{
+				const CullBounds& b = store.Bounds[i];
+				float dx = std::max(fabsf(b.Center.x - center.x) - b.Extents.x, 0.0f);
+				float dy = std::max(fabsf(b.Center.y - center.y) - b.Extents.y, 0.0f);
+				float dz = std::max(fabsf(b.Center.z - center.z) - b.Extents.z, 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= radius * radius)
+					expectedTags.push_back(store.Tags[i]);
+			}
+			std::sort(foundTags.begin(), foundTags.end());
+			std::sort(expectedTags.begin(), expectedTags.end());
+			matches &= foundTags == expectedTags;
+		}
+	}
+	CHECK(matches);
+}
+
+static void BenchScaling()
+{
+	// Creating, looking up and destroying (half, at random) as the
+	// store grows - each should stay about the same per entity
+	printf("%8s %12s %12s %12s\n", "entities", "create", "lookup", "destroy");
+	for (unsigned int count : { 1000u, 10000u, 100000u, 1000000u })
+	{
+		std::mt19937 random(count);
+		std::vector<CullBounds> bounds(count);
+		for (CullBounds& b : bounds)
+			b = RandomBounds(random);
+
+		double createMs = 1e9, lookupMs = 1e9, destroyMs = 1e9;
+		for (int run = 0; run < 3; run++)
+		{
+			TestStore store;
+			std::vector<EntityId> ids(count);
+			TestTimer timer;
+			for (unsigned int i = 0; i < count; i++)
+				ids[i] = store.Create(i, bounds[i]);
+			createMs = std::min(createMs, timer.GetMilliseconds());
+
+			std::vector<EntityId> order = ids;
+			std::shuffle(order.begin(), order.end(), random);
+			timer.Reset();
+			unsigned int sum = 0;
+			for (EntityId id : order)
+				sum += store.Slots.IsAlive(id) ? store.Tags[store.Slots.GetIndex(id)] : 0;
+			lookupMs = std::min(lookupMs, timer.GetMilliseconds());
+			if (sum == 0 && count > 1)
+				printf("(no lookups)\n");
+
+			timer.Reset();
+			for (unsigned int i = 0; i < count / 2; i++)
+				store.Destroy(order[i]);
+			destroyMs = std::min(destroyMs, timer.GetMilliseconds());
+		}
+		printf("%8u %9.1f ns %9.1f ns %9.1f ns\n", count,
+			createMs * 1e6 / count, lookupMs * 1e6 / count, destroyMs * 1e6 / (count / 2));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestSwapRemove();
+	TestStaleIds();
+	TestGenerationWraparound();
+	TestBvhRename();
+
+	if (BENCH)
+		BenchScaling();
+
+	return FinishTests("EntityStoreTests");
+}
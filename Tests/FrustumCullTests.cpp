@@ -0,0 +1,145 @@
+#include "TestFramework.h"
+#include "FrustumCullSimd.h"
+#include "CpuFeatures.h"
+#include <random>
+
+using namespace DirectX;
+
+// A random camera's planes, as the game's would be
+static void RandomFrustum(std::mt19937& random, XMFLOAT4 planes[6])
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	XMVECTOR eye = XMVectorSet(-10 + 20 * u(random), -5 + 10 * u(random), -10 + 20 * u(random), 1);
+	XMVECTOR forward = XMVector3Normalize(XMVectorSet(2 * u(random) - 1, 2 * u(random) - 1, 2 * u(random) - 1, 0));
+	XMMATRIX view = XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(0.5f + 1.5f * u(random), 1.0f + u(random), 0.1f + u(random), 10 + 40 * u(random));
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, view * projection);
+	ExtractFrustumPlanes(viewProjection, planes);
+}
+
+// Boxes all over, with a third pushed right up against a plane
+// (just in front, just behind or straddling it), where rounding
+// would show up if the two versions summed differently
+static std::vector<CullBounds> RandomBoxes(std::mt19937& random, const XMFLOAT4 planes[6], unsigned int count)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	std::vector<CullBounds> boxes(count);
+	for (CullBounds& box : boxes)
+	{
+		box.Center = XMFLOAT3(-60 + 120 * u(random), -60 + 120 * u(random), -60 + 120 * u(random));
+		box.Extents = XMFLOAT3(0.01f + 3 * u(random), 0.01f + 3 * u(random), 0.01f + 3 * u(random));
+		box.Radius = sqrtf(box.Extents.x * box.Extents.x + box.Extents.y * box.Extents.y + box.Extents.z * box.Extents.z);
+		if (random() % 3 == 0)
+		{
+			// Slide the center along the plane's normal until the box's
+			// furthest corner is about on it
+			const XMFLOAT4& plane = planes[random() % 6];
+			float distance = plane.x * box.Center.x + plane.y * box.Center.y + plane.z * box.Center.z + plane.w;
+			float reach = fabsf(plane.x) * box.Extents.x + fabsf(plane.y) * box.Extents.y + fabsf(plane.z) * box.Extents.z;
+			float move = -(distance + reach) + 1e-3f * (2 * u(random) - 1);
+			box.Center.x += plane.x * move;
+			box.Center.y += plane.y * move;
+			box.Center.z += plane.z * move;
+		}
+	}
+	return boxes;
+}
+
+// What every version has to match, one box at a time
+static std::vector<unsigned int> CullOneByOne(const XMFLOAT4 planes[6], const std::vector<CullBounds>& boxes)
+{
+	std::vector<unsigned int> visible;
+	for (unsigned int i = 0; i < boxes.size(); i++)
+	{
+		if (IsBoxInFrustum(planes, boxes[i]))
+			visible.push_back(i);
+	}
+	return visible;
+}
+
+typedef unsigned int (*CullFunction)(const XMFLOAT4[6], const CullBounds*, unsigned int, unsigned int*);
+
+// Whether a version gives the same indices, in the same order, without
+// writing past the count it was given room for
+static bool MatchesOneByOne(CullFunction cull, const XMFLOAT4 planes[6], const std::vector<CullBounds>& boxes)
+{
+	const unsigned int guard = 0xFEEDFACE;
+	std::vector<unsigned int> visible(boxes.size() + 1, guard);
+	unsigned int visibleCount = cull(planes, boxes.data(), (unsigned int)boxes.size(), visible.data());
+	bool guarded = visible[boxes.size()] == guard;
+	visible.resize(visibleCount);
+	return guarded && visible == CullOneByOne(planes, boxes);
+}
+
+static void TestMatchesOneByOne()
+{
+	// Every count up to a few blocks, so each tail length (0 to 7)
+	// comes up for both block sizes, and some longer runs
+	std::mt19937 random(17);
+	bool sse = true, avx2 = true, dispatched = true;
+	int visibleSeen = 0, culledSeen = 0;
+	for (int trial = 0; trial < 200; trial++)
+	{
+		XMFLOAT4 planes[6];
+		RandomFrustum(random, planes);
+		unsigned int count = trial < 40 ? trial : 40 + random() % 2000;
+		std::vector<CullBounds> boxes = RandomBoxes(random, planes, count);
+
+		sse &= MatchesOneByOne(CullBoxesSse, planes, boxes);
+		if (HasAvx2())
+			avx2 &= MatchesOneByOne(CullBoxesAvx2, planes, boxes);
+		dispatched &= MatchesOneByOne(CullBoxes, planes, boxes);
+
+		unsigned int visible = (unsigned int)CullOneByOne(planes, boxes).size();
+		visibleSeen += visible;
+		culledSeen += count - visible;
+	}
+	CHECK(sse);
+	CHECK(avx2);
+	CHECK(dispatched);
+
+	// And the boxes weren't all one way or the other
+	CHECK(visibleSeen > 1000);
+	CHECK(culledSeen > 1000);
+}
+
+static void BenchCull()
+{
+	std::mt19937 random(3);
+	XMFLOAT4 planes[6];
+	RandomFrustum(random, planes);
+	const unsigned int count = 1000000;
+	std::vector<CullBounds> boxes = RandomBoxes(random, planes, count);
+	std::vector<unsigned int> visible(count);
+
+	double oneByOneMs = TimeBest(5, [&]()
+	{
+		unsigned int visibleCount = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (IsBoxInFrustum(planes, boxes[i]))
+				visible[visibleCount++] = i;
+		}
+	});
+	double sseMs = TimeBest(5, [&]() { CullBoxesSse(planes, boxes.data(), count, visible.data()); });
+	printf("1M boxes: %.2f ms one by one, %.2f ms SSE (%.0f M boxes/s)\n",
+		oneByOneMs, sseMs, count / sseMs / 1000);
+	if (HasAvx2())
+	{
+		double avx2Ms = TimeBest(5, [&]() { CullBoxesAvx2(planes, boxes.data(), count, visible.data()); });
+		printf("1M boxes: %.2f ms AVX2 (%.0f M boxes/s)\n", avx2Ms, count / avx2Ms / 1000);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestMatchesOneByOne();
+
+	if (BENCH)
+		BenchCull();
+
+	return FinishTests("FrustumCullTests");
+}
@@ -0,0 +1,195 @@
+#include "TestFramework.h"
+#include "InstanceBatch.h"
+#include "TransformSystem.h"
+#include "Transform.h"
+#include <algorithm>
+#include <random>
+
+using namespace DirectX;
+
+// Groups only compare the pointers, so these never need to be
+// real meshes or materials
+static char meshSlots[4], materialSlots[4];
+static Mesh* FakeMesh(int i) { return reinterpret_cast<Mesh*>(&meshSlots[i]); }
+static Material* FakeMaterial(int i) { return reinterpret_cast<Material*>(&materialSlots[i]); }
+
+// Packets drawing the given entities, in that order
+static std::vector<DrawPacket> MakePackets(const std::vector<unsigned int>& entities)
+{
+	std::vector<DrawPacket> packets;
+	for (unsigned int entity : entities)
+		packets.push_back({ 0, entity });
+	return packets;
+}
+
+static bool SameGroups(const std::vector<InstanceGroup>& groups, const std::vector<InstanceGroup>& expected)
+{
+	if (groups.size() != expected.size())
+		return false;
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		if (groups[g].First != expected[g].First || groups[g].Count != expected[g].Count)
+			return false;
+	}
+	return true;
+}
+
+static void TestBreaks()
+{
+	// Entities out of order in the queue, so groups follow the
+	// packets rather than the entity indices:
+	//   packets 0-2: mesh 0, material 0, LOD 0
+	//   packet  3:   mesh 1 (breaks on the mesh)
+	//   packets 4-5: mesh 1, material 1 (breaks on the material)
+	//   packet  6:   mesh 1, material 1, LOD 1 (breaks on the LOD)
+	//   packet  7:   the same as packets 0-2, but not next to them
+	std::vector<unsigned int> order = { 5, 2, 7, 0, 3, 6, 1, 4 };
+	Mesh* meshes[8];
+	Material* materials[8];
+	int lods[8];
+	const int packetMesh[8] = { 0, 0, 0, 1, 1, 1, 1, 0 };
+	const int packetMaterial[8] = { 0, 0, 0, 0, 1, 1, 1, 0 };
+	const int packetLod[8] = { 0, 0, 0, 0, 0, 0, 1, 0 };
+	for (int p = 0; p < 8; p++)
+	{
+		meshes[order[p]] = FakeMesh(packetMesh[p]);
+		materials[order[p]] = FakeMaterial(packetMaterial[p]);
+		lods[order[p]] = packetLod[p];
+	}
+	std::vector<DrawPacket> packets = MakePackets(order);
+
+	std::vector<InstanceGroup> groups;
+	BuildInstanceGroups(packets.data(), 8, meshes, materials, lods, groups);
+	CHECK(SameGroups(groups, { { 0, 3 }, { 3, 1 }, { 4, 2 }, { 6, 1 }, { 7, 1 } }));
+
+	// Shadows pass no materials, so packet 3 joins packets 4-5
+	BuildInstanceGroups(packets.data(), 8, meshes, nullptr, lods, groups);
+	CHECK(SameGroups(groups, { { 0, 3 }, { 3, 3 }, { 6, 1 }, { 7, 1 } }));
+
+	// Nothing to draw, and a group left over from before is cleared
+	BuildInstanceGroups(packets.data(), 0, meshes, materials, lods, groups);
+	CHECK(groups.empty());
+}
+
+static void TestRandomQueues()
+{
+	// Sorted queues of random entities from a few meshes, materials and
+	// LODs, checked against splitting them by hand
+	std::mt19937 random(19);
+	bool matches = true, shadowMatches = true, covers = true;
+	for (int trial = 0; trial < 200; trial++)
+	{
+		unsigned int count = random() % 300;
+		std::vector<Mesh*> meshes(count);
+		std::vector<Material*> materials(count);
+		std::vector<int> lods(count);
+		for (unsigned int e = 0; e < count; e++)
+		{
+			meshes[e] = FakeMesh(random() % 3);
+			materials[e] = FakeMaterial(random() % 3);
+			lods[e] = random() % 2;
+		}
+
+		// Sorted by mesh, then material, then LOD, as the keys bring them
+		// together - with a few swapped so runs come back
+		std::vector<unsigned int> order(count);
+		for (unsigned int e = 0; e < count; e++)
+			order[e] = e;
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+		{
+			if (meshes[a] != meshes[b]) return meshes[a] < meshes[b];
+			if (materials[a] != materials[b]) return materials[a] < materials[b];
+			return lods[a] < lods[b];
+		});
+		for (int swap = 0; count > 1 && swap < 3; swap++)
+			std::swap(order[random() % count], order[random() % count]);
+		std::vector<DrawPacket> packets = MakePackets(order);
+
+		for (int shadow = 0; shadow < 2; shadow++)
+		{
+			Material* const* groupMaterials = shadow ? nullptr : materials.data();
+			std::vector<InstanceGroup> expected;
+			for (unsigned int p = 0; p < count; p++)
+			{
+				unsigned int e = order[p], previous = p ? order[p - 1] : 0;
+				bool joins = p > 0 && meshes[e] == meshes[previous] && lods[e] == lods[previous] &&
+					(shadow || materials[e] == materials[previous]);
+				if (joins)
+					expected.back().Count++;
+				else
+					expected.push_back({ p, 1 });
+			}
+
+			std::vector<InstanceGroup> groups;
+			BuildInstanceGroups(packets.data(), count, meshes.data(), groupMaterials, lods.data(), groups);
+			(shadow ? shadowMatches : matches) &= SameGroups(groups, expected);
+
+			// Back to back, from the first packet to the last
+			unsigned int next = 0;
+			for (const InstanceGroup& group : groups)
+			{
+				covers &= group.First == next && group.Count > 0;
+				next = group.First + group.Count;
+			}
+			covers &= next == count;
+		}
+	}
+	CHECK(matches);
+	CHECK(shadowMatches);
+	CHECK(covers);
+}
+
+static void TestPackOrder()
+{
+	// Each packet's instance is its own entity's, at the packet's
+	// index - so every group's instances start at its First
+	std::mt19937 random(5);
+	const unsigned int count = 37;
+	std::vector<Transform> transforms(count);
+	for (unsigned int e = 0; e < count; e++)
+	{
+		transforms[e].SetPosition((float)e, 2.0f * e, 3.0f * e);
+		transforms[e].SetScale(1.0f + e, 1.0f, 1.0f);
+	}
+	TransformSystem::GetInstance().UpdateMatrices();
+
+	std::vector<unsigned int> order(count);
+	for (unsigned int e = 0; e < count; e++)
+		order[e] = e;
+	std::shuffle(order.begin(), order.end(), random);
+	std::vector<DrawPacket> packets = MakePackets(order);
+
+	std::vector<InstanceData> instances(count + 1);
+	memset(&instances[count], 0xCD, sizeof(InstanceData));
+	PackInstances(packets.data(), count, transforms.data(), instances.data());
+
+	bool inOrder = true, sameMatrices = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int e = order[i];
+		inOrder &= instances[i].World._41 == (float)e && instances[i].World._11 == 1.0f + e;
+
+		XMFLOAT4X4 world = transforms[e].GetWorldMatrix();
+		XMFLOAT4X4 worldInverseTranspose = transforms[e].GetWorldInverseTransposeMatrix();
+		sameMatrices &= memcmp(&instances[i].World, &world, sizeof(world)) == 0;
+		sameMatrices &= memcmp(&instances[i].WorldInverseTranspose, &worldInverseTranspose, sizeof(worldInverseTranspose)) == 0;
+	}
+	CHECK(inOrder);
+	CHECK(sameMatrices);
+
+	// Only count instances are written
+	InstanceData untouched;
+	memset(&untouched, 0xCD, sizeof(untouched));
+	CHECK(memcmp(&instances[count], &untouched, sizeof(untouched)) == 0);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestBreaks();
+	TestRandomQueues();
+	TestPackOrder();
+
+	return FinishTests("InstanceBatchTests");
+}
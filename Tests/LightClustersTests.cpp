@@ -0,0 +1,178 @@
+#include "TestFramework.h"
+#include "LightClusters.h"
+#include <algorithm>
+#include <random>
+
+using namespace DirectX;
+
+// Point lights scattered over the scene, every fiftieth one directional
+static void MakeLights(int count, std::mt19937& random, std::vector<Light>& lights)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	lights.resize(count);
+	for (Light& light : lights)
+	{
+		light = {};
+		light.Type = random() % 50 == 0 ? LIGHT_TYPE_DIRECTIONAL : LIGHT_TYPE_POINT;
+		light.Position = XMFLOAT3(u(random) * 100 - 50, u(random) * 20 - 5, u(random) * 100 - 50);
+		light.Range = 0.3f + u(random) * (random() % 10 == 0 ? 20.0f : 3.0f);
+	}
+}
+
+// The cluster a view space point falls in, as the pixel shader
+// works it out, or -1 if it's off screen
+static int GetCluster(LightClusterGrid& grid, const XMFLOAT4X4& projection, XMFLOAT3 viewPoint)
+{
+	float sx = viewPoint.x / viewPoint.z * projection._11;
+	float sy = viewPoint.y / viewPoint.z * projection._22;
+	if (fabsf(sx) > 1 || fabsf(sy) > 1)
+		return -1;
+
+	int x = std::min((int)((sx * 0.5f + 0.5f) * CLUSTER_X), CLUSTER_X - 1);
+	int y = std::min((int)((0.5f - sy * 0.5f) * CLUSTER_Y), CLUSTER_Y - 1);
+	XMFLOAT2 scaleBias = grid.GetDepthScaleBias();
+	float slice = logf(viewPoint.z) * scaleBias.x + scaleBias.y;
+	int z = (int)std::min(std::max(slice, 0.0f), (float)CLUSTER_Z - 1);
+	return (z * CLUSTER_Y + y) * CLUSTER_X + x;
+}
+
+static void TestConservative()
+{
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> u(0, 1);
+	LightClusterGrid grid;
+	std::vector<Light> lights;
+	long long missing = 0, reaching = 0, listed = 0, samples = 0;
+	bool wellFormed = true;
+	for (int trial = 0; trial < 20; trial++)
+	{
+		// Random cameras, every other one with a tiny near plane
+		float fieldOfView = 0.5f + u(random) * 1.5f, aspectRatio = 0.6f + u(random) * 1.8f;
+		float nearClip = trial % 2 ? 0.0001f : 0.05f + u(random), farClip = 50 + u(random) * 150;
+		XMVECTOR eye = XMVectorSet(u(random) * 40 - 20, u(random) * 10, u(random) * 40 - 20, 0);
+		XMVECTOR forward = XMVector3Normalize(XMVectorSet(u(random) - 0.5f, (u(random) - 0.5f) * 0.5f, u(random) - 0.5f, 0));
+		XMMATRIX viewMatrix = XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0));
+		XMFLOAT4X4 view, projection;
+		XMStoreFloat4x4(&view, viewMatrix);
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(fieldOfView, aspectRatio, nearClip, farClip));
+
+		// Some lights right by the camera
+		int count = 500 + random() % 1500;
+		MakeLights(count, random, lights);
+		for (int k = 0; k < 20; k++)
+		{
+			lights[k].Type = LIGHT_TYPE_POINT;
+			XMStoreFloat3(&lights[k].Position, eye + XMVectorSet(u(random) - 0.5f, u(random) - 0.5f, u(random) - 0.5f, 0) * 2);
+		}
+		grid.Build(lights.data(), count, view, projection, nearClip, farClip);
+
+		// Directional lights at the front, and every cluster's list
+		// inside the index list after them
+		const LightCluster* clusters = grid.GetClusters();
+		const unsigned int* indices = grid.GetIndices();
+		unsigned int globalCount = grid.GetGlobalCount(), mostInCluster = 0;
+		for (unsigned int g = 0; g < globalCount; g++)
+			wellFormed &= lights[indices[g]].Type == LIGHT_TYPE_DIRECTIONAL;
+		wellFormed &= globalCount == (unsigned int)std::count_if(lights.begin(), lights.end(),
+			[](const Light& light) { return light.Type == LIGHT_TYPE_DIRECTIONAL; });
+		for (int c = 0; c < CLUSTER_COUNT; c++)
+		{
+			wellFormed &= clusters[c].Count == 0 ||
+				(clusters[c].Offset >= globalCount && clusters[c].Offset + clusters[c].Count <= grid.GetIndexCount());
+			mostInCluster = std::max(mostInCluster, clusters[c].Count);
+		}
+		wellFormed &= mostInCluster == grid.GetMaxClusterCount();
+
+		// Points in view, a quarter of them close to the near plane,
+		// are in a cluster listing every light that reaches them
+		for (int s = 0; s < 1000; s++)
+		{
+			float depth = s % 4 == 0 ? nearClip + u(random) * 2 : nearClip + (farClip - nearClip) * powf(u(random), 3.0f);
+			float halfHeight = depth / projection._22, halfWidth = depth / projection._11;
+			XMFLOAT3 viewPoint((u(random) * 2 - 1) * halfWidth, (u(random) * 2 - 1) * halfHeight, depth);
+			int cluster = GetCluster(grid, projection, viewPoint);
+			if (cluster < 0)
+				continue;
+
+			samples++;
+			listed += clusters[cluster].Count;
+			const unsigned int* first = indices + clusters[cluster].Offset;
+			const unsigned int* last = first + clusters[cluster].Count;
+			for (int i = 0; i < count; i++)
+			{
+				if (lights[i].Type != LIGHT_TYPE_POINT)
+					continue;
+
+				XMFLOAT3 lightPoint;
+				XMStoreFloat3(&lightPoint, XMVector3TransformCoord(XMLoadFloat3(&lights[i].Position), viewMatrix));
+				float dx = lightPoint.x - viewPoint.x, dy = lightPoint.y - viewPoint.y, dz = lightPoint.z - viewPoint.z;
+				if (sqrtf(dx * dx + dy * dy + dz * dz) >= lights[i].Range * 0.999f)
+					continue;
+
+				reaching++;
+				missing += std::find(first, last, (unsigned int)i) == last;
+			}
+		}
+	}
+	CHECK(wellFormed);
+	CHECK(reaching > 10000);
+	CHECK(missing == 0);
+
+	// Binning shouldn't list many more lights than actually reach
+	double meanListed = (double)listed / samples, meanReaching = (double)reaching / samples;
+	CHECK(meanListed < meanReaching * 2);
+	if (BENCH)
+		printf("mean cluster list %.1f lights, vs %.1f that reach the point\n", meanListed, meanReaching);
+}
+
+static void TestUnclustered()
+{
+	LightClusterGrid grid;
+	grid.BuildUnclustered(40);
+	CHECK(grid.GetGlobalCount() == 40 && grid.GetIndexCount() == 40);
+	CHECK(grid.GetMaxClusterCount() == 0);
+	bool empty = true;
+	for (int c = 0; c < CLUSTER_COUNT; c++)
+		empty &= grid.GetClusters()[c].Count == 0;
+	CHECK(empty);
+	CHECK(grid.GetIndices()[39] == 39);
+}
+
+static void BenchBuild()
+{
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> u(0, 1);
+	XMFLOAT4X4 view, projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, -40, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.0001f, 100.0f));
+
+	LightClusterGrid grid;
+	for (int count : { 1000, 4000, 16000 })
+	{
+		std::vector<Light> lights(count);
+		for (Light& light : lights)
+		{
+			light = {};
+			light.Type = LIGHT_TYPE_POINT;
+			light.Position = XMFLOAT3(u(random) * 100 - 50, u(random) * 10 - 2, u(random) * 100 - 50);
+			light.Range = 0.5f + u(random) * 2.5f;
+		}
+
+		double ms = TimeBest(20, [&]() { grid.Build(lights.data(), count, view, projection, 0.0001f, 100.0f); });
+		printf("%5d point lights: %.3f ms per Build, %u indices, at most %u in a cluster\n",
+			count, ms, grid.GetIndexCount(), grid.GetMaxClusterCount());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestConservative();
+	TestUnclustered();
+
+	if (BENCH)
+		BenchBuild();
+
+	return FinishTests("LightClustersTests");
+}
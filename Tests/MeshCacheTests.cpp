@@ -0,0 +1,187 @@
+#include "TestMeshes.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+#include "TangentSpace.h"
+#include "VertexPacking.h"
+#include <cfloat>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Everything Mesh::LoadObj does to a source file before it
+// caches it, laid out the way WriteMeshCache writes it
+// --------------------------------------------------------
+static std::vector<char> BuildCache(const std::vector<char>& source, unsigned long long sourceHash)
+{
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	ParseObjData(source.data(), source.size(), verts, indices);
+	int vertCount = (int)verts.size();
+	int indexCount = (int)indices.size();
+	if (vertCount == 0 || indexCount == 0)
+		return {};
+
+	std::vector<int> clusterStarts(indexCount / 3 + 1);
+	int clusterCount = OptimizeVertexCache(indices.data(), indexCount, vertCount, clusterStarts.data());
+	VertexCacheStats stats = AnalyzeVertexCache(indices.data(), indexCount, vertCount);
+	OptimizeOverdraw(indices.data(), indexCount, verts.data(), vertCount,
+		clusterStarts.data(), clusterCount, stats.ACMR * 1.05f);
+
+	std::vector<Meshlet> meshlets;
+	if (indexCount / 3 >= MESHLET_MIN_MESH_TRIANGLES)
+		BuildMeshlets(indices.data(), indexCount, verts.data(), vertCount, meshlets);
+	std::vector<MeshLod> lods;
+	BuildMeshLods(indices, verts.data(), vertCount, lods);
+	int allIndexCount = (int)indices.size();
+	OptimizeVertexFetch(verts.data(), vertCount, indices.data(), allIndexCount);
+	CalculateTangents(verts.data(), vertCount, indices.data(), indexCount);
+
+	MeshCacheHeader header = {};
+	header.BoundsMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	header.BoundsMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	header.UVMin = XMFLOAT2(FLT_MAX, FLT_MAX);
+	header.UVMax = XMFLOAT2(-FLT_MAX, -FLT_MAX);
+	for (const Vertex& v : verts)
+	{
+		XMStoreFloat3(&header.BoundsMin, XMVectorMin(XMLoadFloat3(&header.BoundsMin), XMLoadFloat3(&v.Position)));
+		XMStoreFloat3(&header.BoundsMax, XMVectorMax(XMLoadFloat3(&header.BoundsMax), XMLoadFloat3(&v.Position)));
+		XMStoreFloat2(&header.UVMin, XMVectorMin(XMLoadFloat2(&header.UVMin), XMLoadFloat2(&v.UV)));
+		XMStoreFloat2(&header.UVMax, XMVectorMax(XMLoadFloat2(&header.UVMax), XMLoadFloat2(&v.UV)));
+	}
+
+	std::vector<PackedVertex> packedVerts;
+	std::vector<unsigned char> packedIndices;
+	PackMesh(verts.data(), vertCount, indices.data(), allIndexCount,
+		header.BoundsMin, header.BoundsMax, header.UVMin, header.UVMax, packedVerts, packedIndices);
+
+	header.Magic = MESH_CACHE_MAGIC;
+	header.Version = MESH_CACHE_VERSION;
+	header.SourceHash = sourceHash;
+	header.VertexCount = vertCount;
+	header.IndexCount = allIndexCount;
+	header.VertexStride = sizeof(PackedVertex);
+	header.IndexStride = GetIndexStride(vertCount);
+	header.LodCount = (unsigned int)lods.size();
+	header.MeshletCount = (unsigned int)meshlets.size();
+
+	std::vector<char> cache;
+	auto append = [&](const void* data, size_t size)
+	{
+		cache.insert(cache.end(), (const char*)data, (const char*)data + size);
+	};
+	append(&header, sizeof(header));
+	append(packedVerts.data(), packedVerts.size() * sizeof(PackedVertex));
+	append(packedIndices.data(), packedIndices.size());
+	append(lods.data(), lods.size() * sizeof(MeshLod));
+	append(meshlets.data(), meshlets.size() * sizeof(Meshlet));
+	return cache;
+}
+
+static MeshCacheHeader* GetHeader(std::vector<char>& cache)
+{
+	return (MeshCacheHeader*)cache.data();
+}
+
+// Where index i is, in a cache with the given header
+static char* GetIndex(std::vector<char>& cache, unsigned int i)
+{
+	MeshCacheHeader* header = GetHeader(cache);
+	return cache.data() + sizeof(MeshCacheHeader) +
+		(size_t)header->VertexCount * sizeof(PackedVertex) + (size_t)i * header->IndexStride;
+}
+
+static void TestValidate()
+{
+	for (const char* model : testModels)
+	{
+		std::vector<char> source;
+		CHECK(ReadTestModel(model, source));
+		unsigned long long hash = HashMeshSource(source.data(), source.size());
+		std::vector<char> cache = BuildCache(source, hash);
+		CHECK(!cache.empty());
+		if (cache.empty())
+			continue;
+
+		// A cache built from this source is fine, and its tables read back
+		const MeshCacheHeader* header = ValidateMeshCache(cache.data(), cache.size(), hash);
+		CHECK(header == GetHeader(cache));
+		std::vector<MeshLod> lods;
+		ReadMeshCacheLods(GetHeader(cache), lods);
+		CHECK(lods.size() == GetHeader(cache)->LodCount && lods[0].FirstIndex == 0);
+
+		// From another source, or cut short, it isn't
+		CHECK(!ValidateMeshCache(cache.data(), cache.size(), hash + 1));
+		CHECK(!ValidateMeshCache(cache.data(), cache.size() - 1, hash));
+		CHECK(!ValidateMeshCache(cache.data(), sizeof(MeshCacheHeader) - 1, hash));
+		CHECK(!ValidateMeshCache(0, 0, hash));
+
+		// Nor is it with an index past the last vertex (in the last
+		// LOD, the last index the scan gets to)
+		std::vector<char> badIndex = cache;
+		unsigned int vertexCount = GetHeader(badIndex)->VertexCount;
+		char* last = GetIndex(badIndex, GetHeader(badIndex)->IndexCount - 1);
+		if (GetHeader(badIndex)->IndexStride == sizeof(unsigned short))
+		{
+			unsigned short index = (unsigned short)vertexCount;
+			memcpy(last, &index, sizeof(index));
+		}
+		else
+			memcpy(last, &vertexCount, sizeof(vertexCount));
+		CHECK(!ValidateMeshCache(badIndex.data(), badIndex.size(), hash));
+
+		// Or a LOD running off the end of the indices
+		std::vector<char> badLod = cache;
+		MeshLod lod = lods.back();
+		lod.IndexCount += 3;
+		memcpy(GetIndex(badLod, GetHeader(badLod)->IndexCount) + (lods.size() - 1) * sizeof(MeshLod), &lod, sizeof(lod));
+		CHECK(!ValidateMeshCache(badLod.data(), badLod.size(), hash));
+	}
+}
+
+static void BenchLoad()
+{
+	// Building a mesh from its source against loading its cache the way
+	// Mesh::LoadFromCache does: the source is hashed, then the cache is
+	// validated and its tables read (as a copy here rather than a mapping)
+	printf("%-22s %9s %12s %12s %12s %12s\n", "mesh", "indices", "from source", "from cache", "hash", "validate");
+	for (const char* model : testModels)
+	{
+		std::vector<char> source;
+		ReadTestModel(model, source);
+		unsigned long long hash = HashMeshSource(source.data(), source.size());
+		std::vector<char> cache;
+		double sourceMs = TimeBest(3, [&]() { cache = BuildCache(source, hash); });
+
+		std::vector<MeshLod> lods;
+		std::vector<Meshlet> meshlets;
+		double cacheMs = TimeBest(20, [&]()
+		{
+			const MeshCacheHeader* header = ValidateMeshCache(cache.data(), cache.size(),
+				HashMeshSource(source.data(), source.size()));
+			ReadMeshCacheLods(header, lods);
+			ReadMeshCacheMeshlets(header, meshlets);
+		});
+
+		// Of which: hashing the source, and validating (all but a few
+		// table reads of that is the scan over every index)
+		double hashMs = TimeBest(20, [&]() { HashMeshSource(source.data(), source.size()); });
+		double validateMs = TimeBest(20, [&]() { ValidateMeshCache(cache.data(), cache.size(), hash); });
+
+		printf("%-22s %9u %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n", model, GetHeader(cache)->IndexCount,
+			sourceMs, cacheMs, hashMs, validateMs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestValidate();
+
+	if (BENCH)
+		BenchLoad();
+
+	return FinishTests("MeshCacheTests");
+}
@@ -0,0 +1,190 @@
+#include "TestMeshes.h"
+#include "MeshOptimizer.h"
+
+// Runs the same passes as Mesh's constructor, returning the stats before and after
+static void Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices,
+	VertexCacheStats& before, VertexCacheStats& tipsify, VertexCacheStats& after)
+{
+	int numVerts = (int)verts.size();
+	int numIndices = (int)indices.size();
+	before = AnalyzeVertexCache(indices.data(), numIndices, numVerts);
+
+	std::vector<int> clusterStarts(numIndices / 3 + 1);
+	int clusterCount = OptimizeVertexCache(indices.data(), numIndices, numVerts, clusterStarts.data());
+	tipsify = AnalyzeVertexCache(indices.data(), numIndices, numVerts);
+	OptimizeOverdraw(indices.data(), numIndices, verts.data(), numVerts,
+		clusterStarts.data(), clusterCount, tipsify.ACMR * 1.05f);
+	OptimizeVertexFetch(verts.data(), numVerts, indices.data(), numIndices);
+	after = AnalyzeVertexCache(indices.data(), numIndices, numVerts);
+}
+
+// Checks that vertices are numbered in the order the indices first use them
+static bool IsFetchOrdered(const std::vector<unsigned int>& indices)
+{
+	unsigned int next = 0;
+	for (unsigned int index : indices)
+	{
+		if (index > next)
+			return false;
+		if (index == next)
+			next++;
+	}
+	return true;
+}
+
+static void TestAnalyze()
+{
+	// A lone triangle misses on every corner
+	unsigned int triangle[] = { 0, 1, 2 };
+	VertexCacheStats stats = AnalyzeVertexCache(triangle, 3, 3);
+	CHECK(stats.Misses == 3);
+	CHECK_NEAR(stats.ACMR, 3.0, 1e-6);
+	CHECK_NEAR(stats.ATVR, 1.0, 1e-6);
+
+	// A second triangle on the same edge only misses once more
+	unsigned int quad[] = { 0, 1, 2, 2, 1, 3 };
+	stats = AnalyzeVertexCache(quad, 6, 4);
+	CHECK(stats.Misses == 4);
+	CHECK_NEAR(stats.ACMR, 2.0, 1e-6);
+
+	// Vertices fall out of the FIFO after cacheSize others
+	unsigned int strip[] = { 0, 1, 2, 3, 4, 5, 0, 1, 2 };
+	CHECK(AnalyzeVertexCache(strip, 9, 6, 4).Misses == 9);
+	CHECK(AnalyzeVertexCache(strip, 9, 6, 6).Misses == 6);
+}
+
+static void TestSampleModels()
+{
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(model, verts, indices));
+
+		auto triangles = GetTriangleSet(verts.data(), indices.data(), indices.size());
+		size_t numVerts = verts.size();
+
+		VertexCacheStats before, tipsify, after;
+		Optimize(verts, indices, before, tipsify, after);
+
+		// Only the order changes
+		CHECK(verts.size() == numVerts);
+		CHECK(triangles == GetTriangleSet(verts.data(), indices.data(), indices.size()));
+		CHECK(IsFetchOrdered(indices));
+
+		// Never worse than the file's order, and overdraw sorting stays
+		// near the threshold it was given
+		CHECK(tipsify.ACMR <= before.ACMR + 1e-4f);
+		CHECK(after.ACMR <= tipsify.ACMR * 1.1f + 1e-4f);
+	}
+}
+
+static void TestGrid()
+{
+	// Shuffle a grid's triangles so the optimizer has something to fix
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(64, verts, indices);
+
+	unsigned int seed = 1;
+	for (size_t t = indices.size() / 3 - 1; t > 0; t--)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		size_t other = (seed >> 8) % (t + 1);
+		for (int c = 0; c < 3; c++)
+			std::swap(indices[t * 3 + c], indices[other * 3 + c]);
+	}
+
+	auto triangles = GetTriangleSet(verts.data(), indices.data(), indices.size());
+	VertexCacheStats before, tipsify, after;
+	Optimize(verts, indices, before, tipsify, after);
+
+	CHECK(triangles == GetTriangleSet(verts.data(), indices.data(), indices.size()));
+	CHECK(IsFetchOrdered(indices));
+	CHECK(before.ACMR > 2.0f);
+	CHECK(tipsify.ACMR < 0.8f);
+	CHECK(after.ATVR < 1.4f);
+}
+
+static void TestDegenerateClusters()
+{
+	// A grid, then a run of zero area triangles, with cluster starts
+	// repeated (empty clusters) before, between and after them
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(8, verts, indices);
+	int gridTris = (int)indices.size() / 3;
+	for (int t = 0; t < 4; t++)
+	{
+		unsigned int v = t + 1;
+		indices.insert(indices.end(), { v, v, v });
+	}
+	int numTris = (int)indices.size() / 3;
+
+	auto triangles = GetTriangleSet(verts.data(), indices.data(), indices.size());
+	int clusterStarts[] = { 0, 0, gridTris, gridTris, numTris };
+	OptimizeOverdraw(indices.data(), (int)indices.size(), verts.data(), (int)verts.size(),
+		clusterStarts, 5, 0.0f);
+	CHECK(triangles == GetTriangleSet(verts.data(), indices.data(), indices.size()));
+
+	// The zero area triangles still come out together, in their order
+	int firstDegenerate = -1;
+	for (int t = 0; t < numTris && firstDegenerate < 0; t++)
+	{
+		if (indices[t * 3] == indices[t * 3 + 1] && indices[t * 3] == indices[t * 3 + 2])
+			firstDegenerate = t;
+	}
+	bool together = firstDegenerate >= 0 && firstDegenerate + 4 <= numTris;
+	for (int t = 0; together && t < 4; t++)
+		together = indices[(firstDegenerate + t) * 3] == (unsigned int)t + 1;
+	CHECK(together);
+
+	// Nothing but degenerate clusters keeps its order
+	std::vector<unsigned int> flat = { 0, 0, 0, 1, 1, 1, 2, 2, 2 };
+	int flatStarts[] = { 0, 1, 1, 2, 3 };
+	OptimizeOverdraw(flat.data(), 9, verts.data(), (int)verts.size(), flatStarts, 5, 0.0f);
+	CHECK(flat == std::vector<unsigned int>({ 0, 0, 0, 1, 1, 1, 2, 2, 2 }));
+}
+
+static void BenchOptimize()
+{
+	printf("%-22s %8s  %-16s %-16s %s\n", "mesh", "tris", "ACMR", "ATVR", "time");
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		LoadTestModel(model, verts, indices);
+
+		VertexCacheStats before, tipsify, after;
+		TestTimer timer;
+		Optimize(verts, indices, before, tipsify, after);
+		double ms = timer.GetMilliseconds();
+		printf("%-22s %8zu  %.3f -> %.3f   %.3f -> %.3f   %.2f ms\n",
+			model, indices.size() / 3, before.ACMR, after.ACMR, before.ATVR, after.ATVR, ms);
+	}
+
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(625, verts, indices);
+	VertexCacheStats before, tipsify, after;
+	TestTimer timer;
+	Optimize(verts, indices, before, tipsify, after);
+	double ms = timer.GetMilliseconds();
+	printf("%-22s %8zu  %.3f -> %.3f   %.3f -> %.3f   %.2f ms\n",
+		"625x625 grid", indices.size() / 3, before.ACMR, after.ACMR, before.ATVR, after.ATVR, ms);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestAnalyze();
+	TestSampleModels();
+	TestGrid();
+	TestDegenerateClusters();
+
+	if (BENCH)
+		BenchOptimize();
+
+	return FinishTests("MeshOptimizerTests");
+}
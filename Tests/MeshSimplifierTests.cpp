@@ -0,0 +1,282 @@
+#include "TestMeshes.h"
+#include "MeshSimplifier.h"
+#include "MeshLod.h"
+#include <cfloat>
+#include <set>
+
+using namespace DirectX;
+
+static float Dot(XMFLOAT3 a, XMFLOAT3 b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static XMFLOAT3 Subtract(XMFLOAT3 a, XMFLOAT3 b)
+{
+	return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static XMFLOAT3 Along(XMFLOAT3 a, XMFLOAT3 b, float t)
+{
+	return XMFLOAT3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+// Distance from a point to the closest point on a triangle (Ericson's
+// Real-Time Collision Detection, 5.1.5)
+static float PointTriangleDistance(XMFLOAT3 p, XMFLOAT3 a, XMFLOAT3 b, XMFLOAT3 c)
+{
+	XMFLOAT3 ab = Subtract(b, a), ac = Subtract(c, a), ap = Subtract(p, a);
+	float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+	XMFLOAT3 closest;
+	if (d1 <= 0 && d2 <= 0)
+		closest = a;
+	else
+	{
+		XMFLOAT3 bp = Subtract(p, b);
+		float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+		XMFLOAT3 cp = Subtract(p, c);
+		float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+		float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+		if (d3 >= 0 && d4 <= d3)
+			closest = b;
+		else if (d6 >= 0 && d5 <= d6)
+			closest = c;
+		else if (vc <= 0 && d1 >= 0 && d3 <= 0)
+			closest = Along(a, b, d1 / (d1 - d3));
+		else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+			closest = Along(a, c, d2 / (d2 - d6));
+		else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+			closest = Along(b, c, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		else
+		{
+			float v = vb / (va + vb + vc), w = vc / (va + vb + vc);
+			closest = XMFLOAT3(a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w);
+		}
+	}
+
+	XMFLOAT3 offset = Subtract(p, closest);
+	return sqrtf(Dot(offset, offset));
+}
+
+static float GetLargestExtent(const std::vector<Vertex>& verts)
+{
+	XMFLOAT3 minimum = verts[0].Position, maximum = verts[0].Position;
+	for (const Vertex& v : verts)
+	{
+		minimum = XMFLOAT3(std::min(minimum.x, v.Position.x), std::min(minimum.y, v.Position.y), std::min(minimum.z, v.Position.z));
+		maximum = XMFLOAT3(std::max(maximum.x, v.Position.x), std::max(maximum.y, v.Position.y), std::max(maximum.z, v.Position.z));
+	}
+	return std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z));
+}
+
+// --------------------------------------------------------
+// How far the original vertices end up from a simplified
+// surface (brute force), relative to the mesh's size
+// --------------------------------------------------------
+static float MeasureLodError(const std::vector<Vertex>& verts, const unsigned int* original, int originalCount,
+	const unsigned int* simplified, int simplifiedCount)
+{
+	float worst = 0.0f;
+	for (int i = 0; i < originalCount; i++)
+	{
+		XMFLOAT3 p = verts[original[i]].Position;
+		float best = FLT_MAX;
+		for (int t = 0; t + 2 < simplifiedCount; t += 3)
+		{
+			best = std::min(best, PointTriangleDistance(p,
+				verts[simplified[t]].Position, verts[simplified[t + 1]].Position, verts[simplified[t + 2]].Position));
+		}
+		worst = std::max(worst, best);
+	}
+	return worst / GetLargestExtent(verts);
+}
+
+// Every index in range, and no degenerate triangles
+static void CheckTriangles(const unsigned int* indices, int count, int numVerts)
+{
+	CHECK(count % 3 == 0);
+	for (int t = 0; t + 2 < count; t += 3)
+	{
+		CHECK(indices[t] < (unsigned int)numVerts && indices[t + 1] < (unsigned int)numVerts && indices[t + 2] < (unsigned int)numVerts);
+		CHECK(indices[t] != indices[t + 1] && indices[t + 1] != indices[t + 2] && indices[t] != indices[t + 2]);
+	}
+}
+
+static void TestFlatGrid()
+{
+	// A flat grid can lose almost every triangle without moving,
+	// but its border has to keep its outline
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(32, verts, indices);
+	for (Vertex& v : verts)
+		v.Position.y = 0.0f;
+
+	std::vector<unsigned int> simplified(indices.size());
+	float error = -1.0f;
+	int count = SimplifyMesh(simplified.data(), indices.data(), (int)indices.size(),
+		verts.data(), (int)verts.size(), (int)indices.size() / 4, 0.01f, &error);
+
+	CHECK(count > 0 && count <= (int)indices.size() / 4);
+	CheckTriangles(simplified.data(), count, (int)verts.size());
+	CHECK(error >= 0.0f && error < 1e-4f);
+	CHECK(MeasureLodError(verts, indices.data(), (int)indices.size(), simplified.data(), count) < 1e-4f);
+
+	// Its corners have nowhere to collapse to along the border
+	std::set<unsigned int> used(simplified.begin(), simplified.begin() + count);
+	unsigned int corners[] = { 0, 32, 33 * 32, 33 * 33 - 1 };
+	for (unsigned int corner : corners)
+		CHECK(used.count(corner) == 1);
+
+	// Every triangle keeps facing up
+	for (int t = 0; t < count; t += 3)
+	{
+		XMFLOAT3 a = verts[simplified[t]].Position, b = verts[simplified[t + 1]].Position, c = verts[simplified[t + 2]].Position;
+		XMFLOAT3 ab = Subtract(b, a), ac = Subtract(c, a);
+		float normalY = ab.z * ac.x - ab.x * ac.z;
+		CHECK(normalY > 0.0f);
+	}
+
+	// With no error allowed on a curved mesh, it can only drop collinear
+	// and coplanar vertices, so the surface doesn't move
+	std::vector<Vertex> sphereVerts;
+	std::vector<unsigned int> sphereIndices;
+	CHECK(LoadTestModel("sphere.obj", sphereVerts, sphereIndices));
+	simplified.resize(sphereIndices.size());
+	count = SimplifyMesh(simplified.data(), sphereIndices.data(), (int)sphereIndices.size(),
+		sphereVerts.data(), (int)sphereVerts.size(), 3, 0.0f);
+	CHECK(MeasureLodError(sphereVerts, sphereIndices.data(), (int)sphereIndices.size(), simplified.data(), count) < 1e-5f);
+}
+
+static void TestLodChains()
+{
+	// How many LODs each sample model should get - hard edged
+	// meshes can't collapse anything without tearing a crease
+	struct ExpectedChain
+	{
+		const char* Model;
+		unsigned int MinLods;
+		unsigned int MaxLods;
+	};
+	ExpectedChain expected[] = {
+		{ "cube.obj", 1, 1 },
+		{ "cylinder.obj", 3, MAX_MESH_LODS },
+		{ "helix.obj", 1, 1 },
+		{ "sphere.obj", 3, MAX_MESH_LODS },
+		{ "torus.obj", 4, MAX_MESH_LODS },
+	};
+
+	for (const ExpectedChain& chain : expected)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(chain.Model, verts, indices));
+
+		std::vector<MeshLod> lods;
+		BuildMeshLods(indices, verts.data(), (int)verts.size(), lods);
+
+		CHECK(lods.size() >= chain.MinLods && lods.size() <= chain.MaxLods);
+		for (size_t l = 0; l < lods.size(); l++)
+		{
+			const MeshLod& lod = lods[l];
+			CheckTriangles(&indices[lod.FirstIndex], lod.IndexCount, (int)verts.size());
+			if (l == 0)
+			{
+				CHECK(lod.FirstIndex == 0 && lod.Error == 0.0f);
+				continue;
+			}
+
+			// Packed back to back, each one simpler and less accurate than the last
+			const MeshLod& previous = lods[l - 1];
+			CHECK(lod.FirstIndex == previous.FirstIndex + previous.IndexCount);
+			CHECK(lod.IndexCount <= previous.IndexCount * 9 / 10);
+			CHECK(lod.IndexCount >= previous.IndexCount / 2 - 3);
+			CHECK(lod.Error >= previous.Error);
+			CHECK(lod.Error <= MESH_LOD_MAX_ERROR);
+
+			// Quadrics measure the distance to the original triangles' planes
+			// rather than to the triangles themselves, so the real distance
+			// can come out higher - up to about 1.7x on the sample models
+			float measured = MeasureLodError(verts, &indices[0], lods[0].IndexCount, &indices[lod.FirstIndex], lod.IndexCount);
+			CHECK(measured <= lod.Error * 2.0f + 1e-3f);
+		}
+		CHECK(indices.size() == lods.back().FirstIndex + lods.back().IndexCount);
+	}
+}
+
+static void TestSelection()
+{
+	std::vector<MeshLod> lods = { { 0, 300, 0.0f }, { 300, 150, 0.002f }, { 450, 75, 0.01f }, { 525, 36, 0.05f } };
+	CHECK(SelectMeshLod(lods, 2000.0f, 1.0f) == 0);
+	CHECK(SelectMeshLod(lods, 500.0f, 1.0f) == 1);
+	CHECK(SelectMeshLod(lods, 100.0f, 1.0f) == 2);
+	CHECK(SelectMeshLod(lods, 20.0f, 1.0f) == 3);
+	CHECK(SelectMeshLod(lods, 5.0f, 1.0f) == 3);
+	CHECK(SelectMeshLod(lods, FLT_MAX, 1.0f) == 0);
+	CHECK(SelectMeshLod(std::vector<MeshLod>(1, lods[0]), 1.0f, 1.0f) == 0);
+
+	// A unit sphere d units in front of a 45 degree camera is
+	// 1 / (tan(22.5) * d) of the screen tall (diameter over 2 units of NDC)
+	XMFLOAT4X4 view, projection;
+	XMStoreFloat4x4(&view, XMMatrixLookAtLH(XMVectorSet(0, 0, -10, 0), XMVectorSet(0, 0, 0, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	for (float z : { 0.0f, 10.0f, 40.0f, 90.0f })
+	{
+		float expected = 720.0f / (tanf(XM_PIDIV4 / 2) * (z + 10.0f));
+		CHECK_NEAR(GetProjectedSphereSize(XMFLOAT3(0, 0, z), 1.0f, view, projection, 720.0f), expected, expected * 1e-4f);
+	}
+
+	// The camera's inside it, or it's behind the camera
+	CHECK(GetProjectedSphereSize(XMFLOAT3(0, 0, -10), 1.0f, view, projection, 720.0f) == FLT_MAX);
+	CHECK(GetProjectedSphereSize(XMFLOAT3(0, 0, -20), 1.0f, view, projection, 720.0f) == FLT_MAX);
+}
+
+static void BenchLods()
+{
+	const char* models[] = { "cylinder.obj", "sphere.obj", "torus.obj", "helix.obj" };
+	for (const char* model : models)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		LoadTestModel(model, verts, indices);
+
+		std::vector<MeshLod> lods;
+		TestTimer timer;
+		BuildMeshLods(indices, verts.data(), (int)verts.size(), lods);
+		double ms = timer.GetMilliseconds();
+
+		printf("%s: %.2f ms\n", model, ms);
+		for (size_t l = 0; l < lods.size(); l++)
+		{
+			float measured = MeasureLodError(verts, &indices[0], lods[0].IndexCount, &indices[lods[l].FirstIndex], lods[l].IndexCount);
+			printf("  LOD %zu: %6u triangles, error %.4f (measured %.4f)\n", l, lods[l].IndexCount / 3, lods[l].Error, measured);
+		}
+	}
+
+	// Something big enough for the collapse queue to matter
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(300, verts, indices);
+	std::vector<MeshLod> lods;
+	TestTimer timer;
+	BuildMeshLods(indices, verts.data(), (int)verts.size(), lods);
+	double ms = timer.GetMilliseconds();
+	printf("300x300 grid: %.1f ms for %zu LODs,", ms, lods.size());
+	for (const MeshLod& lod : lods)
+		printf(" %u", lod.IndexCount / 3);
+	printf(" triangles\n");
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestFlatGrid();
+	TestLodChains();
+	TestSelection();
+
+	if (BENCH)
+		BenchLods();
+
+	return FinishTests("MeshSimplifierTests");
+}
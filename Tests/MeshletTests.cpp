@@ -0,0 +1,279 @@
+#include "TestMeshes.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include <set>
+
+using namespace DirectX;
+
+// Builds meshlets after the same passes Mesh's constructor runs first
+static void PrepareMesh(std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<Meshlet>& meshlets)
+{
+	int numVerts = (int)verts.size();
+	int numIndices = (int)indices.size();
+	std::vector<int> clusterStarts(numIndices / 3 + 1);
+	int clusterCount = OptimizeVertexCache(indices.data(), numIndices, numVerts, clusterStarts.data());
+	VertexCacheStats stats = AnalyzeVertexCache(indices.data(), numIndices, numVerts);
+	OptimizeOverdraw(indices.data(), numIndices, verts.data(), numVerts,
+		clusterStarts.data(), clusterCount, stats.ACMR * 1.05f);
+	BuildMeshlets(indices.data(), numIndices, verts.data(), numVerts, meshlets);
+}
+
+static void GetBoundingSphere(const std::vector<Vertex>& verts, XMVECTOR& center, float& radius)
+{
+	XMVECTOR minimum = XMLoadFloat3(&verts[0].Position), maximum = minimum;
+	for (const Vertex& v : verts)
+	{
+		minimum = XMVectorMin(minimum, XMLoadFloat3(&v.Position));
+		maximum = XMVectorMax(maximum, XMLoadFloat3(&v.Position));
+	}
+	center = (minimum + maximum) * 0.5f;
+	radius = XMVectorGetX(XMVector3Length(maximum - minimum)) * 0.5f;
+}
+
+// Results of orbiting a camera around a mesh
+struct OrbitResult
+{
+	double CulledFraction;		// Average share of triangles culled
+	double BackFacingFraction;	// Average share that really faced away
+	double DrawsPerFrame;
+	int WronglyCulled;			// Triangles dropped that were visible
+};
+
+// --------------------------------------------------------
+// Orbits the camera around the mesh at distance times its
+// bounding radius, looking off center when close, and
+// checks that every culled triangle was back-facing or
+// entirely outside a frustum plane
+// --------------------------------------------------------
+static OrbitResult Orbit(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices,
+	const std::vector<Meshlet>& meshlets, float distance, bool offCenter)
+{
+	XMVECTOR center;
+	float radius;
+	GetBoundingSphere(verts, center, radius);
+
+	XMFLOAT4X4 world, projection;
+	XMStoreFloat4x4(&world, XMMatrixIdentity());
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 100.0f));
+
+	OrbitResult result = {};
+	int triangleCount = (int)indices.size() / 3;
+	const int steps = 64;
+	for (int step = 0; step < steps; step++)
+	{
+		float angle = XM_2PI * step / steps;
+		float d = distance * radius;
+		XMVECTOR eye = center + XMVectorSet(cosf(angle) * d, 0.4f * d * sinf(angle * 2), sinf(angle) * d, 0);
+		XMVECTOR target = offCenter ? center + XMVectorSet(radius * cosf(angle + 1), 0, radius * sinf(angle + 1), 0) : center;
+
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookAtLH(eye, target, XMVectorSet(0, 1, 0, 0)));
+		XMFLOAT3 eyePosition;
+		XMStoreFloat3(&eyePosition, eye);
+
+		MeshletCullData cull;
+		BuildMeshletCullData(world, world, view, projection, eyePosition, cull);
+		std::vector<IndexRange> ranges;
+		int visible = CullMeshlets(meshlets.data(), (int)meshlets.size(), cull, ranges);
+
+		std::vector<char> drawn(triangleCount, 0);
+		int drawnIndices = 0;
+		for (const IndexRange& range : ranges)
+		{
+			for (unsigned int t = range.FirstIndex; t < range.FirstIndex + range.IndexCount; t += 3)
+				drawn[t / 3] = 1;
+			drawnIndices += range.IndexCount;
+		}
+		CHECK(drawnIndices == visible);
+
+		int backFacing = 0;
+		for (int t = 0; t < triangleCount; t++)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&verts[indices[t * 3]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&verts[indices[t * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&verts[indices[t * 3 + 2]].Position);
+			XMVECTOR normal = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+			bool facesAway = XMVectorGetX(XMVector3Dot(normal, XMVector3Normalize(p0 - eye))) >= -1e-4f;
+			backFacing += facesAway;
+			if (drawn[t] || facesAway)
+				continue;
+
+			bool outside = false;
+			for (int p = 0; p < 6; p++)
+			{
+				XMVECTOR plane = XMLoadFloat4(&cull.Planes[p]);
+				outside |= XMVectorGetX(XMPlaneDotCoord(plane, p0)) < 0 &&
+					XMVectorGetX(XMPlaneDotCoord(plane, p1)) < 0 &&
+					XMVectorGetX(XMPlaneDotCoord(plane, p2)) < 0;
+			}
+			result.WronglyCulled += !outside;
+		}
+
+		result.CulledFraction += 1.0 - (double)visible / indices.size();
+		result.BackFacingFraction += (double)backFacing / triangleCount;
+		result.DrawsPerFrame += ranges.size();
+	}
+
+	result.CulledFraction /= steps;
+	result.BackFacingFraction /= steps;
+	result.DrawsPerFrame /= steps;
+	return result;
+}
+
+static void TestMeshletLimits()
+{
+	const char* models[] = { "helix.obj", "sphere.obj", "torus.obj" };
+	for (const char* model : models)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		std::vector<Meshlet> meshlets;
+		CHECK(LoadTestModel(model, verts, indices));
+		auto triangles = GetTriangleSet(verts.data(), indices.data(), indices.size());
+		PrepareMesh(verts, indices, meshlets);
+
+		// Triangles are only reordered
+		CHECK(triangles == GetTriangleSet(verts.data(), indices.data(), indices.size()));
+		CHECK(meshlets.size() >= indices.size() / 3 / MESHLET_MAX_TRIANGLES);
+
+		unsigned int nextIndex = 0;
+		for (const Meshlet& meshlet : meshlets)
+		{
+			// Back to back ranges covering every triangle
+			CHECK(meshlet.FirstIndex == nextIndex);
+			CHECK(meshlet.IndexCount > 0 && meshlet.IndexCount % 3 == 0);
+			CHECK(meshlet.IndexCount / 3 <= MESHLET_MAX_TRIANGLES);
+			nextIndex = meshlet.FirstIndex + meshlet.IndexCount;
+
+			std::set<unsigned int> used(indices.begin() + meshlet.FirstIndex, indices.begin() + nextIndex);
+			CHECK(used.size() <= MESHLET_MAX_VERTICES);
+
+			// The sphere holds every vertex
+			XMVECTOR center = XMLoadFloat3(&meshlet.Center);
+			for (unsigned int index : used)
+			{
+				float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&verts[index].Position) - center));
+				CHECK(distance <= meshlet.Radius * 1.0001f + 1e-5f);
+			}
+
+			// Cones have a unit axis, or are switched off
+			CHECK(meshlet.ConeCutoff == MESHLET_NO_CONE_CUTOFF ||
+				fabsf(XMVectorGetX(XMVector3Length(XMLoadFloat3(&meshlet.ConeAxis))) - 1.0f) < 1e-4f);
+		}
+		CHECK(nextIndex == indices.size());
+	}
+}
+
+static void TestCulling()
+{
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	std::vector<Meshlet> meshlets;
+	CHECK(LoadTestModel("helix.obj", verts, indices));
+	PrepareMesh(verts, indices, meshlets);
+
+	// Close up, looking off center, a good share gets culled
+	OrbitResult near = Orbit(verts, indices, meshlets, 1.2f, true);
+	CHECK(near.WronglyCulled == 0);
+	CHECK(near.CulledFraction > 0.2);
+
+	// From further out everything is in view, so only cones cull
+	OrbitResult far = Orbit(verts, indices, meshlets, 3.0f, false);
+	CHECK(far.WronglyCulled == 0);
+	CHECK(far.CulledFraction > 0.05);
+	CHECK(far.CulledFraction <= far.BackFacingFraction);
+}
+
+static void TestCullData()
+{
+	// A rotated, uniformly scaled and moved mesh
+	XMMATRIX worldMatrix = XMMatrixScaling(2, 2, 2) * XMMatrixRotationRollPitchYaw(0.3f, 1.1f, -0.4f) * XMMatrixTranslation(5, -1, 3);
+	XMFLOAT4X4 world, worldInverseTranspose, view, projection, identity;
+	XMStoreFloat4x4(&world, worldMatrix);
+	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, worldMatrix)));
+	XMStoreFloat4x4(&view, XMMatrixLookAtLH(XMVectorSet(0, 2, -10, 0), XMVectorSet(4, 0, 3, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	XMFLOAT3 camera(0, 2, -10);
+	MeshletCullData local, worldSpace;
+	BuildMeshletCullData(world, worldInverseTranspose, view, projection, camera, local);
+	BuildMeshletCullData(identity, identity, view, projection, camera, worldSpace);
+	CHECK(local.CullBackfaces);
+
+	// The camera lands where the world matrix would put it back
+	XMFLOAT3 worldCamera;
+	XMStoreFloat3(&worldCamera, XMVector3TransformCoord(XMLoadFloat3(&local.CameraPosition), worldMatrix));
+	CHECK_NEAR(worldCamera.x, camera.x, 1e-4);
+	CHECK_NEAR(worldCamera.y, camera.y, 1e-4);
+	CHECK_NEAR(worldCamera.z, camera.z, 1e-4);
+
+	// Local points are on the same side of the local planes as their
+	// world positions are of the world planes
+	unsigned int seed = 7;
+	auto Random = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f * 40.0f - 20.0f;
+	};
+	for (int i = 0; i < 1000; i++)
+	{
+		XMVECTOR point = XMVectorSet(Random(), Random(), Random(), 1);
+		XMVECTOR worldPoint = XMVector3TransformCoord(point, worldMatrix);
+		for (int p = 0; p < 6; p++)
+		{
+			float localSide = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&local.Planes[p]), point));
+			float worldSide = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&worldSpace.Planes[p]), worldPoint));
+			CHECK(fabsf(worldSide) < 1e-3f || (localSide > 0) == (worldSide > 0));
+		}
+	}
+
+	// Squashed or mirrored meshes can't trust their cones
+	XMMATRIX squashed = XMMatrixScaling(1, 3, 1);
+	XMMATRIX mirrored = XMMatrixScaling(-1, 1, 1);
+	for (XMMATRIX matrix : { squashed, mirrored })
+	{
+		XMStoreFloat4x4(&world, matrix);
+		XMStoreFloat4x4(&worldInverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, matrix)));
+		BuildMeshletCullData(world, worldInverseTranspose, view, projection, camera, local);
+		CHECK(!local.CullBackfaces);
+	}
+}
+
+static void BenchCulling()
+{
+	const char* models[] = { "helix.obj", "sphere.obj", "torus.obj" };
+	for (const char* model : models)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		std::vector<Meshlet> meshlets;
+		LoadTestModel(model, verts, indices);
+
+		TestTimer timer;
+		PrepareMesh(verts, indices, meshlets);
+		double ms = timer.GetMilliseconds();
+
+		OrbitResult near = Orbit(verts, indices, meshlets, 1.2f, true);
+		OrbitResult far = Orbit(verts, indices, meshlets, 3.0f, false);
+		printf("%s: %zu meshlets (%.2f ms)\n", model, meshlets.size(), ms);
+		printf("  1.2 radii, off center: %.1f%% culled (%.1f%% back-facing), %.1f draws\n",
+			near.CulledFraction * 100, near.BackFacingFraction * 100, near.DrawsPerFrame);
+		printf("  3 radii, centered:     %.1f%% culled (%.1f%% back-facing), %.1f draws\n",
+			far.CulledFraction * 100, far.BackFacingFraction * 100, far.DrawsPerFrame);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestMeshletLimits();
+	TestCulling();
+	TestCullData();
+
+	if (BENCH)
+		BenchCulling();
+
+	return FinishTests("MeshletTests");
+}
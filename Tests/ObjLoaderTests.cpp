@@ -0,0 +1,348 @@
+#include "TestFramework.h"
+#include "ObjLoader.h"
+#include <map>
+#include <sstream>
+#include <tuple>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// The loader ParseObjData replaced: getline into a fixed
+// buffer, sscanf on each line and welding through a map.
+// It only reads "p/t/n" triangles and quads, so it's only
+// given files written that way
+// --------------------------------------------------------
+static void ReferenceLoad(const std::vector<char>& data, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	std::istringstream obj(std::string(data.begin(), data.end()));
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	std::map<std::tuple<unsigned int, unsigned int, unsigned int>, unsigned int> welded;
+
+	auto GetVertex = [&](unsigned int p, unsigned int t, unsigned int n)
+	{
+		auto key = std::make_tuple(p, t, n);
+		auto found = welded.find(key);
+		if (found != welded.end())
+			return found->second;
+
+		Vertex v = {};
+		v.Position = positions[p - 1];
+		v.UV = uvs[t - 1];
+		v.Normal = normals[n - 1];
+		v.UV.y = 1.0f - v.UV.y;
+		v.Position.z *= -1.0f;
+		v.Normal.z *= -1.0f;
+
+		unsigned int index = (unsigned int)verts.size();
+		verts.push_back(v);
+		welded[key] = index;
+		return index;
+	};
+
+	char chars[100];
+	while (obj.getline(chars, 100))
+	{
+		if (chars[0] == 'v' && chars[1] == 'n')
+		{
+			XMFLOAT3 n;
+			sscanf(chars, "vn %f %f %f", &n.x, &n.y, &n.z);
+			normals.push_back(n);
+		}
+		else if (chars[0] == 'v' && chars[1] == 't')
+		{
+			XMFLOAT2 uv;
+			sscanf(chars, "vt %f %f", &uv.x, &uv.y);
+			uvs.push_back(uv);
+		}
+		else if (chars[0] == 'v')
+		{
+			XMFLOAT3 p;
+			sscanf(chars, "v %f %f %f", &p.x, &p.y, &p.z);
+			positions.push_back(p);
+		}
+		else if (chars[0] == 'f')
+		{
+			unsigned int i[12];
+			int read = sscanf(chars, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u",
+				&i[0], &i[1], &i[2], &i[3], &i[4], &i[5],
+				&i[6], &i[7], &i[8], &i[9], &i[10], &i[11]);
+
+			unsigned int a = GetVertex(i[0], i[1], i[2]);
+			unsigned int b = GetVertex(i[3], i[4], i[5]);
+			unsigned int c = GetVertex(i[6], i[7], i[8]);
+			indices.push_back(a);
+			indices.push_back(c);
+			indices.push_back(b);
+
+			if (read == 12)
+			{
+				unsigned int d = GetVertex(i[9], i[10], i[11]);
+				indices.push_back(a);
+				indices.push_back(d);
+				indices.push_back(c);
+			}
+		}
+	}
+}
+
+static void Parse(const std::string& text, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+	ParseObjData(text.data(), text.size(), verts, indices);
+}
+
+static bool SameVertex(const Vertex& a, const Vertex& b)
+{
+	return a.Position.x == b.Position.x && a.Position.y == b.Position.y && a.Position.z == b.Position.z &&
+		a.Normal.x == b.Normal.x && a.Normal.y == b.Normal.y && a.Normal.z == b.Normal.z &&
+		a.UV.x == b.UV.x && a.UV.y == b.UV.y;
+}
+
+static bool SameMesh(const std::vector<Vertex>& vertsA, const std::vector<unsigned int>& indicesA,
+	const std::vector<Vertex>& vertsB, const std::vector<unsigned int>& indicesB)
+{
+	if (vertsA.size() != vertsB.size() || indicesA != indicesB)
+		return false;
+
+	for (size_t i = 0; i < vertsA.size(); i++)
+		if (!SameVertex(vertsA[i], vertsB[i]))
+			return false;
+	return true;
+}
+
+// --------------------------------------------------------
+// A grid of quads in "p/t/n" form, optionally with every
+// face index written relative to the end of the file so
+// far, which is big enough to be split into chunks
+// --------------------------------------------------------
+static std::string MakeGridObj(int size, bool relative)
+{
+	std::string obj;
+	char line[128];
+	obj += "vn 0 1 0\n";
+	for (int y = 0; y <= size; y++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			snprintf(line, sizeof(line), "v %g %g %g\nvt %g %g\n",
+				x * 0.25f, (x * y % 7) * 0.01f, y * 0.25f, x / (float)size, y / (float)size);
+			obj += line;
+		}
+	}
+
+	int row = size + 1;
+	int vertexCount = row * row;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int corners[4] = { y * row + x + 1, y * row + x + 2, (y + 1) * row + x + 2, (y + 1) * row + x + 1 };
+			if (relative)
+			{
+				for (int& c : corners)
+					c -= vertexCount + 1;
+				snprintf(line, sizeof(line), "f %d/%d/-1 %d/%d/-1 %d/%d/-1 %d/%d/-1\n",
+					corners[0], corners[0], corners[1], corners[1], corners[2], corners[2], corners[3], corners[3]);
+			}
+			else
+			{
+				snprintf(line, sizeof(line), "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n",
+					corners[0], corners[0], corners[1], corners[1], corners[2], corners[2], corners[3], corners[3]);
+			}
+			obj += line;
+		}
+	}
+	return obj;
+}
+
+static void TestSampleModels()
+{
+	for (const char* model : testModels)
+	{
+		std::vector<char> data;
+		CHECK(ReadTestModel(model, data));
+
+		std::vector<Vertex> verts, referenceVerts;
+		std::vector<unsigned int> indices, referenceIndices;
+		ParseObjData(data.data(), data.size(), verts, indices);
+		ReferenceLoad(data, referenceVerts, referenceIndices);
+
+		CHECK(!indices.empty());
+		CHECK(SameMesh(verts, indices, referenceVerts, referenceIndices));
+	}
+}
+
+static void TestFaceFormats()
+{
+	std::vector<Vertex> verts, otherVerts;
+	std::vector<unsigned int> indices, otherIndices;
+
+	const char* quadData =
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+		"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+		"vn 0 0 1\n";
+
+	// Negative indices count back from the last element so far
+	Parse(std::string(quadData) + "f 1/1/1 2/2/1 3/3/1 4/4/1\n", verts, indices);
+	Parse(std::string(quadData) + "f -4/-4/-1 -3/-3/-1 -2/-2/-1 -1/-1/-1\n", otherVerts, otherIndices);
+	CHECK(indices.size() == 6 && verts.size() == 4);
+	CHECK(SameMesh(verts, indices, otherVerts, otherIndices));
+
+	// Flipped into a left-handed space
+	CHECK(verts[0].Normal.z == -1.0f);
+	CHECK(verts[0].UV.y == 1.0f);
+
+	// CRLF line endings, tabs and a leading + don't change anything
+	Parse("v\t0 0 0\r\nv +1 0 0\r\nv 1 1 0\r\nv 0 1 0\r\n"
+		"vt 0 0\r\nvt 1 0\r\nvt 1 1\r\nvt 0 1\r\n"
+		"vn 0 0 1\r\n"
+		"f 1/1/1 2/2/1 3/3/1 4/4/1\r\n", otherVerts, otherIndices);
+	CHECK(SameMesh(verts, indices, otherVerts, otherIndices));
+
+	// N-gons are fan triangulated
+	Parse("v 0 0 0\nv 1 0 0\nv 2 1 0\nv 1 2 0\nv 0 1 0\nf 1 2 3 4 5\n", verts, indices);
+	CHECK(verts.size() == 5);
+	CHECK(indices.size() == 9);
+	CHECK(indices.size() == 9 && indices[0] == 0 && indices[3] == 0 && indices[6] == 0);
+
+	// Corners without UVs or normals get a default one
+	Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", verts, indices);
+	CHECK(verts.size() == 3 && indices.size() == 3);
+	CHECK(verts[0].UV.x == 0.0f && verts[0].UV.y == 1.0f);
+	CHECK(verts[0].Normal.y == 1.0f);
+
+	Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 1 0 0\nf 1//1 2//1 3//1\n", verts, indices);
+	CHECK(verts.size() == 3 && verts[2].Normal.x == 1.0f);
+
+	// Lines longer than the old 100 character buffer aren't cut short
+	std::string longLine = "v 0.50000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000 2 3\n";
+	Parse(longLine + "v 1 0 0\nv 0 1 0\nf 1 2 3\n", verts, indices);
+	CHECK(verts.size() == 3 && verts[0].Position.x == 0.5f && verts[0].Position.y == 2.0f && verts[0].Position.z == -3.0f);
+
+	// Comments, groups and out of range indices are harmless
+	Parse("# comment\ng group\ns 1\nv 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 9\n", verts, indices);
+	CHECK(indices.size() == 3);
+	Parse("", verts, indices);
+	CHECK(verts.empty() && indices.empty());
+}
+
+static void TestLargeFile()
+{
+	// Big enough to be split into chunks on a machine with several cores,
+	// with relative indices that have to be fixed up across chunk borders
+	std::string obj = MakeGridObj(160, false);
+	std::string relativeObj = MakeGridObj(160, true);
+	CHECK(obj.size() > 4 * 256 * 1024);
+
+	std::vector<Vertex> verts, relativeVerts, referenceVerts;
+	std::vector<unsigned int> indices, relativeIndices, referenceIndices;
+	Parse(obj, verts, indices);
+	Parse(relativeObj, relativeVerts, relativeIndices);
+	ReferenceLoad(std::vector<char>(obj.begin(), obj.end()), referenceVerts, referenceIndices);
+
+	CHECK(indices.size() == 160 * 160 * 6);
+	CHECK(SameMesh(verts, indices, referenceVerts, referenceIndices));
+	CHECK(SameMesh(verts, indices, relativeVerts, relativeIndices));
+}
+
+static void BenchSampleModels()
+{
+	// Without welding, every corner of every triangle would be its own vertex
+	printf("%-22s %10s %10s %7s %10s\n", "mesh", "unwelded", "welded", "ratio", "parse");
+	for (const char* model : testModels)
+	{
+		std::vector<char> data;
+		ReadTestModel(model, data);
+
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		double ms = TimeBest(20, [&]()
+		{
+			verts.clear();
+			indices.clear();
+			ParseObjData(data.data(), data.size(), verts, indices);
+		});
+		printf("%-22s %10zu %10zu %6.2fx %7.3f ms\n", model, indices.size(), verts.size(),
+			(double)indices.size() / verts.size(), ms);
+	}
+}
+
+static void BenchHelix()
+{
+	std::vector<char> data;
+	ReadTestModel("helix.obj", data);
+
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	double parseMs = TimeBest(20, [&]()
+	{
+		verts.clear();
+		indices.clear();
+		ParseObjData(data.data(), data.size(), verts, indices);
+	});
+	double referenceMs = TimeBest(5, [&]()
+	{
+		verts.clear();
+		indices.clear();
+		ReferenceLoad(data, verts, indices);
+	});
+	printf("helix.obj (%zu KB): %.2f ms, previous loader %.2f ms\n", data.size() / 1024, parseMs, referenceMs);
+}
+
+static void BenchTenMillionFaces()
+{
+	// A 2237 x 2237 vertex grid of triangles, about 10M faces
+	const int size = 2236;
+	std::string obj;
+	obj.reserve(400u * 1024 * 1024);
+	char line[96];
+	for (int y = 0; y <= size; y++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			snprintf(line, sizeof(line), "v %d.5 %d %d.25\n", x, (x ^ y) & 15, y);
+			obj += line;
+		}
+	}
+
+	int row = size + 1;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int a = y * row + x + 1;
+			snprintf(line, sizeof(line), "f %d %d %d\nf %d %d %d\n", a, a + 1, a + row + 1, a, a + row + 1, a + row);
+			obj += line;
+		}
+	}
+
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	TestTimer timer;
+	ParseObjData(obj.data(), obj.size(), verts, indices);
+	double ms = timer.GetMilliseconds();
+
+	CHECK(indices.size() == (size_t)size * size * 6);
+	printf("%zu faces (%zu MB): %.0f ms, %.0f MB/s\n", indices.size() / 3, obj.size() >> 20, ms, (obj.size() >> 20) / (ms / 1000.0));
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestSampleModels();
+	TestFaceFormats();
+	TestLargeFile();
+
+	if (BENCH)
+	{
+		BenchSampleModels();
+		BenchHelix();
+		BenchTenMillionFaces();
+	}
+
+	return FinishTests("ObjLoaderTests");
+}
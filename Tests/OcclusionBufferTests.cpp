@@ -0,0 +1,331 @@
+#include "TestFramework.h"
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <random>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// A unit cube with its faces clockwise from outside, as
+// D3D draws them
+// --------------------------------------------------------
+static void MakeCube(std::vector<XMFLOAT3>& positions, std::vector<unsigned int>& indices)
+{
+	positions.clear();
+	indices.clear();
+	for (int c = 0; c < 8; c++)
+		positions.push_back(XMFLOAT3((c & 1) ? 0.5f : -0.5f, (c & 2) ? 0.5f : -0.5f, (c & 4) ? 0.5f : -0.5f));
+
+	int faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+	for (auto& face : faces)
+	{
+		unsigned int halves[2][3] = {
+			{ (unsigned int)face[0], (unsigned int)face[1], (unsigned int)face[2] },
+			{ (unsigned int)face[0], (unsigned int)face[2], (unsigned int)face[3] } };
+		for (auto& triangle : halves)
+		{
+			XMVECTOR a = XMLoadFloat3(&positions[triangle[0]]);
+			XMVECTOR b = XMLoadFloat3(&positions[triangle[1]]);
+			XMVECTOR c = XMLoadFloat3(&positions[triangle[2]]);
+			XMVECTOR normal = XMVector3Cross(b - a, c - a);
+			if (XMVectorGetX(XMVector3Dot(normal, a + b + c)) < 0)
+				std::swap(triangle[1], triangle[2]);
+			indices.insert(indices.end(), triangle, triangle + 3);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Draws the triangles entirely past the near plane pixel
+// by pixel in double precision, keeping the nearest depth
+// --------------------------------------------------------
+static void ReferenceRasterize(const XMFLOAT4X4& viewProjection, const XMFLOAT4X4& world,
+	const std::vector<XMFLOAT3>& positions, const std::vector<unsigned int>& indices, std::vector<float>& depth)
+{
+	XMMATRIX m = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&viewProjection);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		XMFLOAT4 clip[3];
+		for (int k = 0; k < 3; k++)
+			XMStoreFloat4(&clip[k], XMVector3Transform(XMLoadFloat3(&positions[indices[i + k]]), m));
+		if (clip[0].z < 0 || clip[1].z < 0 || clip[2].z < 0)
+			continue;
+
+		double x[3], y[3], z[3];
+		for (int k = 0; k < 3; k++)
+		{
+			x[k] = (clip[k].x / clip[k].w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+			y[k] = (0.5f - clip[k].y / clip[k].w * 0.5f) * OCCLUSION_HEIGHT;
+			z[k] = clip[k].z / clip[k].w;
+		}
+		double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area <= 0)
+			continue;
+
+		for (int py = 0; py < OCCLUSION_HEIGHT; py++)
+		{
+			for (int px = 0; px < OCCLUSION_WIDTH; px++)
+			{
+				double sx = px + 0.5, sy = py + 0.5;
+				double w0 = (x[2] - x[1]) * (sy - y[1]) - (y[2] - y[1]) * (sx - x[1]);
+				double w1 = (x[0] - x[2]) * (sy - y[2]) - (y[0] - y[2]) * (sx - x[2]);
+				double w2 = (x[1] - x[0]) * (sy - y[0]) - (y[1] - y[0]) * (sx - x[0]);
+				if (w0 < 0 || w1 < 0 || w2 < 0)
+					continue;
+
+				float& d = depth[py * OCCLUSION_WIDTH + px];
+				d = std::min(d, (float)((w0 * z[0] + w1 * z[1] + w2 * z[2]) / area));
+			}
+		}
+	}
+}
+
+static XMFLOAT4X4 GetTestViewProjection()
+{
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 1, 0, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 2.0f, 0.1f, 100.0f);
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, view * projection);
+	return viewProjection;
+}
+
+static XMFLOAT4X4 RandomWorld(std::mt19937& random, float maxScale, float nearest)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world,
+		XMMatrixScaling(0.5f + maxScale * u(random), 0.5f + maxScale * u(random), 0.5f + maxScale * u(random)) *
+		XMMatrixRotationRollPitchYawFromVector(XMVectorSet(6 * u(random), 6 * u(random), 6 * u(random), 0)) *
+		XMMatrixTranslation(-20 + 40 * u(random), -8 + 16 * u(random), nearest + 40 * u(random)));
+	return world;
+}
+
+static void TestRasterizer()
+{
+	std::mt19937 random(7);
+	std::vector<XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	MakeCube(positions, indices);
+	XMFLOAT4X4 viewProjection = GetTestViewProjection();
+
+	// Coverage matches the reference exactly, and depth very nearly
+	int coverageMismatches = 0, covered = 0;
+	float worstDepth = 0.0f;
+	std::vector<float> reference;
+	OcclusionBuffer buffer;
+	for (int scene = 0; scene < 50; scene++)
+	{
+		buffer.Begin(viewProjection);
+		reference.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+		for (int k = 0; k < 10; k++)
+		{
+			XMFLOAT4X4 world = RandomWorld(random, 6, 8);
+			buffer.AddOccluder(world, positions.data(), (unsigned int)positions.size(), indices.data(), (unsigned int)indices.size());
+			ReferenceRasterize(viewProjection, world, positions, indices, reference);
+		}
+		buffer.Rasterize();
+
+		const float* depth = buffer.GetDepth();
+		for (int i = 0; i < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; i++)
+		{
+			if ((depth[i] < 1.0f) != (reference[i] < 1.0f))
+				coverageMismatches++;
+			else
+				worstDepth = std::max(worstDepth, fabsf(depth[i] - reference[i]));
+			covered += reference[i] < 1.0f;
+		}
+
+		// Each hierarchy level holds the farthest of the four texels under it
+		bool farthest = true;
+		for (int level = 1; level < OCCLUSION_LEVELS; level++)
+		{
+			const float* fine = buffer.GetDepth(level - 1);
+			const float* coarse = buffer.GetDepth(level);
+			int width = OCCLUSION_WIDTH >> level, height = std::max(OCCLUSION_HEIGHT >> level, 1);
+			int fineWidth = width * 2, fineHeight = std::max(OCCLUSION_HEIGHT >> (level - 1), 1);
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					float expected = 0.0f;
+					for (int dy = 0; dy < 2; dy++)
+						for (int dx = 0; dx < 2; dx++)
+							expected = std::max(expected, fine[std::min(y * 2 + dy, fineHeight - 1) * fineWidth + x * 2 + dx]);
+					farthest &= coarse[y * width + x] == expected;
+				}
+			}
+		}
+		CHECK(farthest);
+	}
+	CHECK(covered > 100000);
+	CHECK(coverageMismatches == 0);
+	CHECK(worstDepth < 1e-5f);
+}
+
+// Fills a buffer with a wall and a floor, and scatters boxes behind them
+static void MakeDenseScene(OcclusionBuffer& buffer, const XMFLOAT4X4& viewProjection, int count,
+	std::vector<CullBounds>& bounds, std::vector<unsigned int>& inFrustum, std::mt19937& random)
+{
+	std::vector<XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	MakeCube(positions, indices);
+
+	XMFLOAT4X4 wall, floor;
+	XMStoreFloat4x4(&wall, XMMatrixScaling(14, 6, 1) * XMMatrixTranslation(-3, 1, 10));
+	XMStoreFloat4x4(&floor, XMMatrixScaling(200, 1, 200) * XMMatrixTranslation(0, -3, 0));
+	buffer.Begin(viewProjection);
+	buffer.AddOccluder(wall, positions.data(), 8, indices.data(), 36);
+	buffer.AddOccluder(floor, positions.data(), 8, indices.data(), 36);
+	buffer.Rasterize();
+
+	std::uniform_real_distribution<float> u(0, 1);
+	bounds.resize(count);
+	for (CullBounds& b : bounds)
+	{
+		b.Center = XMFLOAT3(-30 + 60 * u(random), -2.5f + 6 * u(random), 12 + 60 * u(random));
+		b.Extents = XMFLOAT3(0.25f + 0.5f * u(random), 0.25f + 0.5f * u(random), 0.25f + 0.5f * u(random));
+		b.Radius = sqrtf(b.Extents.x * b.Extents.x + b.Extents.y * b.Extents.y + b.Extents.z * b.Extents.z);
+	}
+
+	// Frustum culled first, as the game does
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	inFrustum.resize(count);
+	inFrustum.resize(CullBoxes(planes, bounds.data(), count, inFrustum.data()));
+}
+
+static void TestCulling()
+{
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> u(0, 1);
+	XMFLOAT4X4 viewProjection = GetTestViewProjection();
+	XMMATRIX viewProjectionMatrix = XMLoadFloat4x4(&viewProjection);
+
+	OcclusionBuffer buffer;
+	std::vector<CullBounds> bounds;
+	std::vector<unsigned int> inFrustum;
+	MakeDenseScene(buffer, viewProjection, 10000, bounds, inFrustum, random);
+
+	std::vector<unsigned int> visible = inFrustum;
+	unsigned int removed = buffer.CullOccluded(bounds.data(), visible);
+	CHECK(removed + visible.size() == inFrustum.size());
+	CHECK(removed > inFrustum.size() / 2);
+	CHECK(std::is_sorted(visible.begin(), visible.end()));
+
+	// Random points on every hidden box are all behind the depth buffer
+	std::vector<char> kept(bounds.size(), 0);
+	for (unsigned int i : visible)
+		kept[i] = 1;
+	const float* depth = buffer.GetDepth();
+	int inFront = 0;
+	for (unsigned int i : inFrustum)
+	{
+		if (kept[i])
+			continue;
+
+		CHECK(!buffer.IsBoxVisible(bounds[i]));
+		for (int s = 0; s < 64; s++)
+		{
+			XMFLOAT3 c = bounds[i].Center, e = bounds[i].Extents;
+			XMVECTOR point = XMVectorSet(c.x + e.x * (2 * u(random) - 1), c.y + e.y * (2 * u(random) - 1), c.z + e.z * (2 * u(random) - 1), 1);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(point, viewProjectionMatrix));
+			int px = (int)((clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH);
+			int py = (int)((0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT);
+			if (px >= 0 && py >= 0 && px < OCCLUSION_WIDTH && py < OCCLUSION_HEIGHT)
+				inFront += clip.z / clip.w < depth[py * OCCLUSION_WIDTH + px];
+		}
+	}
+	CHECK(inFront == 0);
+
+	// Boxes crossing the near plane, off screen, or in front of
+	// the wall are always visible
+	CHECK(buffer.IsBoxVisible({ XMFLOAT3(0, 1, 0), 1, XMFLOAT3(0.5f, 0.5f, 0.5f), 0 }));
+	CHECK(buffer.IsBoxVisible({ XMFLOAT3(0, 1, -20), 1, XMFLOAT3(0.5f, 0.5f, 0.5f), 0 }));
+	CHECK(buffer.IsBoxVisible({ XMFLOAT3(-3, 1, 5), 1, XMFLOAT3(0.5f, 0.5f, 0.5f), 0 }));
+	CHECK(!buffer.IsBoxVisible({ XMFLOAT3(-3, 1, 30), 1, XMFLOAT3(0.5f, 0.5f, 0.5f), 0 }));
+
+	// Nothing's hidden by an empty buffer
+	buffer.Begin(viewProjection);
+	buffer.Rasterize();
+	visible = inFrustum;
+	CHECK(buffer.CullOccluded(bounds.data(), visible) == 0);
+	CHECK(buffer.GetTriangleCount() == 0);
+
+	// A floor reaching back past the camera is clipped at the near
+	// plane, and still hides what's under it
+	std::vector<XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	MakeCube(positions, indices);
+	XMFLOAT4X4 floor;
+	XMStoreFloat4x4(&floor, XMMatrixScaling(200, 1, 200) * XMMatrixTranslation(0, -3, 0));
+	buffer.Begin(viewProjection);
+	buffer.AddOccluder(floor, positions.data(), 8, indices.data(), 36);
+	buffer.Rasterize();
+	CHECK(buffer.GetTriangleCount() > 0);
+	CHECK(!buffer.IsBoxVisible({ XMFLOAT3(0, -3, 20), 1, XMFLOAT3(0.2f, 0.2f, 0.2f), 0 }));
+	CHECK(buffer.IsBoxVisible({ XMFLOAT3(0, -2, 20), 1, XMFLOAT3(0.2f, 0.2f, 0.2f), 0 }));
+}
+
+static void BenchOcclusion()
+{
+	std::mt19937 random(7);
+	XMFLOAT4X4 viewProjection = GetTestViewProjection();
+
+	for (int count : { 1000, 10000, 100000 })
+	{
+		OcclusionBuffer buffer;
+		std::vector<CullBounds> bounds;
+		std::vector<unsigned int> inFrustum, visible;
+		MakeDenseScene(buffer, viewProjection, count, bounds, inFrustum, random);
+
+		unsigned int removed = 0;
+		double cullMs = TimeBest(count >= 100000 ? 3 : 30, [&]()
+		{
+			visible = inFrustum;
+			removed = buffer.CullOccluded(bounds.data(), visible);
+		});
+		printf("%6d boxes: %6zu in frustum, %6u occluded (%.0f%%), culling %.3f ms\n",
+			count, inFrustum.size(), removed, 100.0 * removed / inFrustum.size(), cullMs);
+	}
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	MakeCube(positions, indices);
+	for (int count : { 10, 100, 1000 })
+	{
+		std::vector<XMFLOAT4X4> worlds(count);
+		for (XMFLOAT4X4& world : worlds)
+			world = RandomWorld(random, 4, 3);
+
+		OcclusionBuffer buffer;
+		double setupMs = 1e9, rasterMs = 1e9;
+		for (int run = 0; run < 50; run++)
+		{
+			TestTimer timer;
+			buffer.Begin(viewProjection);
+			for (XMFLOAT4X4& world : worlds)
+				buffer.AddOccluder(world, positions.data(), 8, indices.data(), 36);
+			setupMs = std::min(setupMs, timer.GetMilliseconds());
+
+			timer.Reset();
+			buffer.Rasterize();
+			rasterMs = std::min(rasterMs, timer.GetMilliseconds());
+		}
+		printf("%5d cube occluders: %5u triangles, setup %.3f ms, raster and hierarchy %.3f ms\n",
+			count, buffer.GetTriangleCount(), setupMs, rasterMs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestRasterizer();
+	TestCulling();
+
+	if (BENCH)
+		BenchOcclusion();
+
+	return FinishTests("OcclusionBufferTests");
+}
@@ -0,0 +1,151 @@
+#include "TestFramework.h"
+#include "ParallelFor.h"
+#include <atomic>
+#include <thread>
+
+// The machine running the tests may have one core, which gives
+// ParallelFor's pool no workers, so these bring their own
+static const int testWorkers = 3;
+
+// Every index is visited once, by the range that owns it
+static bool CoversOnce(WorkerPool& pool, int count, int rangeCount)
+{
+	std::vector<std::atomic<int>> visits(count);
+	std::vector<std::atomic<int>> ranges(rangeCount);
+	std::atomic<int> badRanges(0);
+	auto work = [&](int range, int first, int last)
+	{
+		ranges[range]++;
+		badRanges += first > last || (range == 0 && first != 0) || (range == rangeCount - 1 && last != count);
+		for (int i = first; i < last; i++)
+			visits[i]++;
+	};
+	pool.Run(count, rangeCount, work);
+
+	bool once = badRanges == 0;
+	for (std::atomic<int>& v : visits)
+		once &= v == 1;
+	for (std::atomic<int>& r : ranges)
+		once &= r == 1;
+	return once;
+}
+
+static void TestRanges()
+{
+	WorkerPool pool(testWorkers);
+	bool covered = true;
+	for (int rangeCount = 1; rangeCount <= 17; rangeCount++)
+		for (int count : { 0, 1, 5, 16, 100, 1001 })
+			covered &= CoversOnce(pool, count, rangeCount);
+	CHECK(covered);
+
+	// And through ParallelFor itself, with however many workers it has
+	bool viaParallelFor = true;
+	for (int rangeCount : { 1, 2, 8 })
+	{
+		std::vector<std::atomic<int>> visits(1000);
+		ParallelFor(1000, rangeCount, [&](int, int first, int last)
+		{
+			for (int i = first; i < last; i++)
+				visits[i]++;
+		});
+		for (std::atomic<int>& v : visits)
+			viaParallelFor &= v == 1;
+	}
+	CHECK(viaParallelFor);
+}
+
+static void TestNested()
+{
+	// Ranges that run jobs themselves, which can't wait on
+	// workers that are all busy waiting on them
+	WorkerPool pool(testWorkers);
+	std::atomic<long long> sum(0);
+	auto inner = [&](int, int first, int last)
+	{
+		long long local = 0;
+		for (int i = first; i < last; i++)
+			local += i;
+		sum += local;
+	};
+	auto outer = [&](int, int first, int last)
+	{
+		for (int o = first; o < last; o++)
+			pool.Run(1000, 8, inner);
+	};
+	pool.Run(8, 8, outer);
+	CHECK(sum == 8 * 999 * 1000 / 2);
+}
+
+static void TestConcurrentCallers()
+{
+	// Several threads using the pool at once, as loading threads and
+	// the main thread do, each getting back only its own ranges
+	WorkerPool pool(testWorkers);
+	const int callerCount = 4, calls = 200;
+	std::vector<std::thread> callers;
+	std::atomic<int> failures(0);
+	for (int c = 0; c < callerCount; c++)
+	{
+		callers.push_back(std::thread([&, c]()
+		{
+			for (int call = 0; call < calls; call++)
+				failures += !CoversOnce(pool, 100 + c * 37 + call, 1 + (c + call) % 8);
+		}));
+	}
+	for (std::thread& caller : callers)
+		caller.join();
+	CHECK(failures == 0);
+}
+
+static void BenchOverhead()
+{
+	// A small job's cost is mostly the handoff, which used to be a
+	// thread started and joined per range
+	WorkerPool pool(testWorkers);
+	std::vector<float> data(4096, 1.0f);
+	auto scale = [&](int, int first, int last)
+	{
+		for (int i = first; i < last; i++)
+			data[i] *= 1.0001f;
+	};
+	for (int rangeCount : { 2, 4, 8 })
+	{
+		const int calls = 2000;
+		double poolMs = TimeBest(3, [&]()
+		{
+			for (int call = 0; call < calls; call++)
+				pool.Run((int)data.size(), rangeCount, scale);
+		});
+		double threadsMs = TimeBest(3, [&]()
+		{
+			for (int call = 0; call < calls; call++)
+			{
+				std::vector<std::thread> threads;
+				for (int r = 0; r < rangeCount; r++)
+				{
+					threads.push_back(std::thread(scale, r,
+						(int)data.size() * r / rangeCount, (int)data.size() * (r + 1) / rangeCount));
+				}
+				for (std::thread& t : threads)
+					t.join();
+			}
+		});
+		printf("%d ranges of 4096 floats: %.1f us per call with %d workers, %.1f us starting a thread per range\n",
+			rangeCount, poolMs * 1000 / calls, pool.GetWorkerCount(), threadsMs * 1000 / calls);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestRanges();
+	TestNested();
+	TestConcurrentCallers();
+
+	if (BENCH)
+		BenchOverhead();
+
+	return FinishTests("ParallelForTests");
+}
@@ -0,0 +1,186 @@
+#include "TestFramework.h"
+#include "RangeAllocator.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+// Checks a new allocation is in bounds and doesn't overlap any live one (offset -> size)
+static bool FitsBetween(const std::map<unsigned int, unsigned int>& used, const RangeAllocation& allocation, unsigned int capacity)
+{
+	if (allocation.Offset + allocation.Size > capacity)
+		return false;
+
+	auto next = used.lower_bound(allocation.Offset);
+	if (next != used.end() && next->first < allocation.Offset + allocation.Size)
+		return false;
+	if (next != used.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second > allocation.Offset)
+			return false;
+	}
+	return true;
+}
+
+static void TestBasics()
+{
+	RangeAllocator allocator(1000);
+	RangeAllocation a, b, c;
+	CHECK(allocator.Allocate(100, a) && a.Offset == 0 && a.Size == 100);
+	CHECK(allocator.Allocate(200, b) && b.Size == 200);
+	CHECK(allocator.GetUsedSize() == 300 && allocator.GetAllocationCount() == 2);
+
+	// Too big, and zero sized, requests leave the allocation empty
+	CHECK(!allocator.Allocate(800, c));
+	CHECK(c.Block == -1);
+	CHECK(!allocator.Allocate(0, c));
+	CHECK(c.Block == -1);
+	CHECK(allocator.GetLargestFreeRange() == 700);
+
+	// Growing adds onto the free space at the end
+	allocator.Grow(1500);
+	CHECK(allocator.GetCapacity() == 1500);
+	CHECK(allocator.GetLargestFreeRange() == 1200);
+	CHECK(allocator.Allocate(800, c));
+
+	// Freeing merges with free neighbours on both sides
+	allocator.Free(b);
+	CHECK(b.Block == -1);
+	allocator.Free(a);
+	CHECK(allocator.GetLargestFreeRange() == std::max(300u, 1500u - c.Offset - c.Size));
+	allocator.Free(c);
+	CHECK(allocator.GetUsedSize() == 0 && allocator.GetAllocationCount() == 0);
+	CHECK(allocator.GetLargestFreeRange() == 1500);
+
+	// Freeing an empty allocation does nothing
+	allocator.Free(c);
+	CHECK(allocator.GetLargestFreeRange() == 1500);
+
+	// An empty allocator can still grow into use
+	RangeAllocator empty;
+	CHECK(!empty.Allocate(1, a));
+	empty.Grow(64);
+	CHECK(empty.Allocate(64, a) && a.Offset == 0);
+}
+
+static void TestRandomWorkload()
+{
+	// Random allocations, frees and growth, checked against a map of live ranges
+	std::mt19937 random(7);
+	for (int round = 0; round < 20; round++)
+	{
+		RangeAllocator allocator(100000 + round * 1000);
+		std::vector<RangeAllocation> live;
+		std::map<unsigned int, unsigned int> used;
+		bool valid = true;
+
+		for (int op = 0; op < 20000; op++)
+		{
+			if (live.empty() || random() % 3)
+			{
+				unsigned int size = 1 + random() % (random() % 4 == 0 ? 5000 : 64);
+				RangeAllocation allocation;
+				if (allocator.Allocate(size, allocation))
+				{
+					valid &= allocation.Size == size && FitsBetween(used, allocation, allocator.GetCapacity());
+					used[allocation.Offset] = size;
+					live.push_back(allocation);
+				}
+				else if (random() % 50 == 0)
+				{
+					allocator.Grow(allocator.GetCapacity() + random() % 20000);
+				}
+			}
+			else
+			{
+				size_t k = random() % live.size();
+				used.erase(live[k].Offset);
+				allocator.Free(live[k]);
+				live[k] = live.back();
+				live.pop_back();
+			}
+		}
+		CHECK(valid);
+
+		unsigned int usedSize = 0;
+		for (auto& range : used)
+			usedSize += range.second;
+		CHECK(usedSize == allocator.GetUsedSize());
+		CHECK(live.size() == allocator.GetAllocationCount());
+
+		// Everything merges back into one range
+		for (RangeAllocation& allocation : live)
+			allocator.Free(allocation);
+		CHECK(allocator.GetUsedSize() == 0);
+		CHECK(allocator.GetLargestFreeRange() == allocator.GetCapacity());
+	}
+}
+
+static void BenchAllocator()
+{
+	std::mt19937 random(7);
+
+	// Free and reallocate random ranges out of 64k live ones
+	{
+		RangeAllocator allocator(1u << 28);
+		std::vector<RangeAllocation> live(1 << 16);
+		for (RangeAllocation& allocation : live)
+			allocator.Allocate(1 + random() % 4096, allocation);
+
+		const int pairs = 5000000;
+		TestTimer timer;
+		for (int i = 0; i < pairs; i++)
+		{
+			RangeAllocation& allocation = live[random() & 0xFFFF];
+			allocator.Free(allocation);
+			allocator.Allocate(1 + random() % 4096, allocation);
+		}
+		printf("free + allocate: %.1f ns\n", timer.GetMilliseconds() * 1e6 / pairs);
+	}
+
+	// Mesh-like sizes, churning at about 75% full
+	{
+		unsigned int capacity = 1u << 22;
+		RangeAllocator allocator(capacity);
+		std::vector<RangeAllocation> live;
+		std::lognormal_distribution<double> sizes(7.0, 1.2);
+		int failed = 0, attempts = 0;
+		for (int i = 0; i < 200000; i++)
+		{
+			if (allocator.GetUsedSize() < capacity * 3 / 4)
+			{
+				RangeAllocation allocation;
+				attempts++;
+				if (allocator.Allocate((unsigned int)std::min(sizes(random), 60000.0) + 1, allocation))
+					live.push_back(allocation);
+				else
+					failed++;
+			}
+			else
+			{
+				size_t k = random() % live.size();
+				allocator.Free(live[k]);
+				live[k] = live.back();
+				live.pop_back();
+			}
+		}
+
+		unsigned int freeSize = capacity - allocator.GetUsedSize();
+		printf("at %.0f%% full: largest free range %u of %u (%.1f%% external fragmentation), %d of %d allocations failed\n",
+			100.0 * allocator.GetUsedSize() / capacity, allocator.GetLargestFreeRange(), freeSize,
+			100.0 * (1.0 - (double)allocator.GetLargestFreeRange() / freeSize), failed, attempts);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestBasics();
+	TestRandomWorkload();
+
+	if (BENCH)
+		BenchAllocator();
+
+	return FinishTests("RangeAllocatorTests");
+}
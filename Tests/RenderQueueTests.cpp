@@ -0,0 +1,147 @@
+#include "TestFramework.h"
+#include "RenderQueue.h"
+#include <algorithm>
+#include <random>
+
+static void TestSortKeys()
+{
+	// Each part outranks everything below it
+	CHECK(MakeSortKey(1, 0, 0, 0, 0.0f) > MakeSortKey(0, 255, 4095, 65535, 1.0f));
+	CHECK(MakeSortKey(0, 1, 0, 0, 0.0f) > MakeSortKey(0, 0, 4095, 65535, 1.0f));
+	CHECK(MakeSortKey(0, 0, 1, 0, 0.0f) > MakeSortKey(0, 0, 0, 65535, 1.0f));
+	CHECK(MakeSortKey(0, 0, 0, 1, 0.0f) > MakeSortKey(0, 0, 0, 0, 1.0f));
+
+	// Front to back, clamped to [0, 1]
+	CHECK(MakeSortKey(0, 0, 0, 0, 0.25f) < MakeSortKey(0, 0, 0, 0, 0.5f));
+	CHECK(MakeSortKey(0, 0, 0, 0, -3.0f) == MakeSortKey(0, 0, 0, 0, 0.0f));
+	CHECK(MakeSortKey(0, 0, 0, 0, 7.0f) == MakeSortKey(0, 0, 0, 0, 1.0f));
+	CHECK(MakeSortKey(0, 0, 0, 0, 1.0f) == (1ull << RENDER_KEY_DEPTH_BITS) - 1);
+
+	// IDs wider than their bits wrap rather than spilling upwards
+	CHECK(MakeSortKey(0, 0, 0, 1 << RENDER_KEY_MESH_BITS, 0.0f) == 0);
+	CHECK(MakeSortKey(0, 0, (1 << RENDER_KEY_MATERIAL_BITS) + 3, 0, 0.0f) == MakeSortKey(0, 0, 3, 0, 0.0f));
+}
+
+// Fills a queue with keys like QueueDraws builds, over the given number
+// of shader pairs and materials, in random order
+static void FillQueue(RenderQueue& queue, int count, int shaders, int materials, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+	queue.Clear();
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int material = random() % materials;
+		queue.Add(MakeSortKey(RENDER_PASS_OPAQUE, material % shaders, material, random() % 64, depth(random)), i);
+	}
+}
+
+// Sorts the queue, and checks it against std::stable_sort of the
+// same packets - key and entity both, at every position
+static bool SortMatchesStableSort(RenderQueue& queue)
+{
+	std::vector<DrawPacket> expected(queue.GetPackets(), queue.GetPackets() + queue.GetCount());
+	std::stable_sort(expected.begin(), expected.end(),
+		[](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+
+	queue.Sort();
+	if (queue.GetCount() != expected.size())
+		return false;
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		const DrawPacket& packet = queue.GetPackets()[i];
+		if (packet.Key != expected[i].Key || packet.Entity != expected[i].Entity)
+			return false;
+	}
+	return true;
+}
+
+static void TestSort()
+{
+	std::mt19937 random(16);
+	RenderQueue queue;
+
+	// Either side of the radix threshold, with both odd and
+	// even numbers of radix passes
+	for (int count : { 0, 1, 100, RENDER_QUEUE_MIN_RADIX_COUNT - 1, RENDER_QUEUE_MIN_RADIX_COUNT, 5000, 100000 })
+	{
+		FillQueue(queue, count, 4, 16, random);
+		CHECK(SortMatchesStableSort(queue));
+	}
+
+	// Every byte the same but the lowest, and every byte different
+	queue.Clear();
+	for (int i = 0; i < 3000; i++)
+		queue.Add(random() % 7, i);
+	CHECK(SortMatchesStableSort(queue));
+	queue.Clear();
+	for (int i = 0; i < 3000; i++)
+		queue.Add(((uint64_t)random() << 32) | random(), i);
+	CHECK(SortMatchesStableSort(queue));
+
+	// Identical keys keep the order they were added in
+	queue.Clear();
+	for (int i = 0; i < 2000; i++)
+		queue.Add(MakeSortKey(0, 1, 2, 3, 0.5f), i);
+	queue.Sort();
+	bool inOrder = true;
+	for (unsigned int i = 0; i < queue.GetCount(); i++)
+		inOrder &= queue.GetPackets()[i].Entity == i;
+	CHECK(inOrder);
+
+	// Sorted, 16 materials over 4 shader pairs change state 4 and 16 times
+	FillQueue(queue, 100000, 4, 16, random);
+	queue.Sort();
+	int shaderChanges = 0, materialChanges = 0;
+	for (unsigned int i = 1; i < queue.GetCount(); i++)
+	{
+		uint64_t key = queue.GetPackets()[i].Key, last = queue.GetPackets()[i - 1].Key;
+		shaderChanges += (key >> (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS)) !=
+			(last >> (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS));
+		materialChanges += (key >> (RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS)) !=
+			(last >> (RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS));
+	}
+	CHECK(shaderChanges + 1 == 4);
+	CHECK(materialChanges + 1 == 16);
+}
+
+static void BenchSort()
+{
+	std::mt19937 random(16);
+	RenderQueue queue;
+	printf("draws  build     radix     std::stable_sort\n");
+	for (int count : { 1000, 10000, 100000 })
+	{
+		double buildMs = TimeBest(30, [&]() { FillQueue(queue, count, 4, 16, random); });
+
+		double radixMs = 1e9;
+		double stableMs = 1e9;
+		for (int run = 0; run < 30; run++)
+		{
+			FillQueue(queue, count, 4, 16, random);
+			std::vector<DrawPacket> packets(queue.GetPackets(), queue.GetPackets() + count);
+
+			TestTimer timer;
+			queue.Sort();
+			radixMs = std::min(radixMs, timer.GetMilliseconds());
+
+			timer.Reset();
+			std::stable_sort(packets.begin(), packets.end(),
+				[](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+			stableMs = std::min(stableMs, timer.GetMilliseconds());
+		}
+		printf("%-6d %.3f ms  %.3f ms  %.3f ms\n", count, buildMs, radixMs, stableMs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestSortKeys();
+	TestSort();
+
+	if (BENCH)
+		BenchSort();
+
+	return FinishTests("RenderQueueTests");
+}
@@ -0,0 +1,299 @@
+#include "TestFramework.h"
+#include "SceneBvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <random>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Linear scans every query is checked against
+// --------------------------------------------------------
+static bool BoxTouchesSphere(const CullBounds& b, XMFLOAT3 center, float radius)
+{
+	float dx = std::max(fabsf(b.Center.x - center.x) - b.Extents.x, 0.0f);
+	float dy = std::max(fabsf(b.Center.y - center.y) - b.Extents.y, 0.0f);
+	float dz = std::max(fabsf(b.Center.z - center.z) - b.Extents.z, 0.0f);
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+static float RayEntersBox(const CullBounds& b, XMFLOAT3 origin, XMFLOAT3 direction)
+{
+	const float* center = &b.Center.x;
+	const float* extents = &b.Extents.x;
+	const float* o = &origin.x;
+	const float* d = &direction.x;
+	float enter = 0.0f, exit = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float inverse = 1.0f / d[axis];
+		float a = (center[axis] - extents[axis] - o[axis]) * inverse;
+		float b = (center[axis] + extents[axis] - o[axis]) * inverse;
+		enter = std::max(enter, std::min(a, b));
+		exit = std::min(exit, std::max(a, b));
+	}
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+static std::vector<unsigned int> LinearFrustum(const XMFLOAT4 planes[6], const std::vector<CullBounds>& bounds)
+{
+	std::vector<unsigned int> visible;
+	for (unsigned int i = 0; i < bounds.size(); i++)
+	{
+		if (IsBoxInFrustum(planes, bounds[i]))
+			visible.push_back(i);
+	}
+	return visible;
+}
+
+static std::vector<unsigned int> Sorted(std::vector<unsigned int> items)
+{
+	std::sort(items.begin(), items.end());
+	return items;
+}
+
+// A camera looking out over the scene from just above it
+static void GetTestPlanes(XMFLOAT4 planes[6])
+{
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 10, 0, 0),
+		XMVector3Normalize(XMVectorSet(0.4f, -0.15f, 1, 0)), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 300.0f);
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, view * projection);
+	ExtractFrustumPlanes(viewProjection, planes);
+}
+
+// Boxes spread over a square that grows with the count, so
+// roughly the same number are visible however many there are
+static std::vector<CullBounds> MakeScene(unsigned int count, std::mt19937& random)
+{
+	float size = sqrtf((float)count) * 5.0f;
+	std::uniform_real_distribution<float> position(-size, size), height(0, 20), extent(0.25f, 3);
+	std::vector<CullBounds> bounds(count);
+	for (CullBounds& b : bounds)
+	{
+		b.Center = XMFLOAT3(position(random), height(random), position(random));
+		b.Extents = XMFLOAT3(extent(random), extent(random), extent(random));
+		b.Radius = sqrtf(b.Extents.x * b.Extents.x + b.Extents.y * b.Extents.y + b.Extents.z * b.Extents.z);
+		b.Padding = 0;
+	}
+	return bounds;
+}
+
+// Frustum, sphere and ray queries all agree with the linear scans
+static bool QueriesMatch(SceneBvh& bvh, const std::vector<CullBounds>& bounds, const XMFLOAT4 planes[6], std::mt19937& random)
+{
+	std::vector<unsigned int> found;
+	bvh.CullFrustum(planes, bounds.data(), found);
+	if (Sorted(found) != LinearFrustum(planes, bounds))
+		return false;
+
+	float size = sqrtf((float)bounds.size()) * 5.0f;
+	std::uniform_real_distribution<float> position(-size, size);
+	for (int q = 0; q < 20; q++)
+	{
+		XMFLOAT3 center(position(random), 10, position(random));
+		found.clear();
+		bvh.QuerySphere(center, 20.0f, bounds.data(), found);
+		std::vector<unsigned int> expected;
+		for (unsigned int i = 0; i < bounds.size(); i++)
+		{
+			if (BoxTouchesSphere(bounds[i], center, 20.0f))
+				expected.push_back(i);
+		}
+		if (Sorted(found) != expected)
+			return false;
+
+		// Ties can hit either box, but not at a different distance
+		XMFLOAT3 origin(position(random), 30, position(random)), direction(0.3f, -1, 0.2f);
+		float distance;
+		int hit = bvh.Raycast(origin, direction, bounds.data(), &distance);
+		float nearest = FLT_MAX;
+		int nearestHit = -1;
+		for (unsigned int i = 0; i < bounds.size(); i++)
+		{
+			float t = RayEntersBox(bounds[i], origin, direction);
+			if (t < nearest)
+			{
+				nearest = t;
+				nearestHit = (int)i;
+			}
+		}
+		if (hit != nearestHit && distance != nearest)
+			return false;
+	}
+	return true;
+}
+
+static void TestQueries()
+{
+	std::mt19937 random(3);
+	XMFLOAT4 planes[6];
+	GetTestPlanes(planes);
+
+	for (unsigned int count : { 0u, 1u, 3u, 1000u, 10000u })
+	{
+		std::vector<CullBounds> bounds = MakeScene(count, random);
+		SceneBvh bvh;
+		bvh.Build(bounds.data(), count);
+		CHECK(QueriesMatch(bvh, bounds, planes, random));
+
+		// Refitting after a few move, then after nearly all of them do
+		for (float fraction : { 0.01f, 0.9f })
+		{
+			for (unsigned int k = 0; k < count * fraction; k++)
+			{
+				unsigned int i = random() % count;
+				bounds[i].Center.x += 2.5f;
+				bounds[i].Extents.y *= 1.5f;
+				bvh.MarkMoved(i);
+			}
+			bvh.Refit(bounds.data());
+			CHECK(QueriesMatch(bvh, bounds, planes, random));
+		}
+	}
+
+	// Everything in one spot still builds leaves of the right size
+	std::vector<CullBounds> stacked(100, CullBounds{ XMFLOAT3(1, 2, 3), 1, XMFLOAT3(1, 1, 1), 0 });
+	SceneBvh bvh;
+	bvh.Build(stacked.data(), 100);
+	CHECK(bvh.GetNodeCount() < 100);
+	CHECK(QueriesMatch(bvh, stacked, planes, random));
+}
+
+static void TestEdits()
+{
+	// Creates and swap-removes, as EntityStore does, with refits
+	// and rebuilds along the way
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> position(-300, 300), extent(0.25f, 3);
+	XMFLOAT4 planes[6];
+	GetTestPlanes(planes);
+
+	std::vector<CullBounds> bounds(20000);
+	for (CullBounds& b : bounds)
+		b = { XMFLOAT3(position(random), position(random) * 0.03f, position(random)), 1, XMFLOAT3(extent(random), extent(random), extent(random)), 0 };
+	SceneBvh bvh;
+	bvh.Build(bounds.data(), (unsigned int)bounds.size());
+
+	bool valid = true;
+	int rebuilds = 0;
+	for (int step = 0; step < 20000 && valid; step++)
+	{
+		int op = random() % 3;
+		if (op == 0)
+		{
+			bounds.push_back({ XMFLOAT3(position(random), 0, position(random)), 1, XMFLOAT3(1, 1, 1), 0 });
+			bvh.Insert((unsigned int)bounds.size() - 1);
+		}
+		else if (op == 1 && bounds.size() > 1)
+		{
+			unsigned int i = random() % bounds.size(), last = (unsigned int)bounds.size() - 1;
+			bvh.Remove(i);
+			if (i != last)
+			{
+				bvh.Rename(last, i);
+				bounds[i] = bounds[last];
+			}
+			bounds.pop_back();
+		}
+		else
+		{
+			unsigned int i = random() % bounds.size();
+			bounds[i].Center.z += 3;
+			bvh.MarkMoved(i);
+		}
+
+		if (step % 50 == 0)
+		{
+			if (bvh.NeedsRebuild())
+			{
+				bvh.Build(bounds.data(), (unsigned int)bounds.size());
+				rebuilds++;
+			}
+			else
+			{
+				bvh.Refit(bounds.data());
+			}
+
+			std::vector<unsigned int> visible;
+			bvh.CullFrustum(planes, bounds.data(), visible);
+			valid &= Sorted(visible) == LinearFrustum(planes, bounds);
+		}
+	}
+	CHECK(valid);
+	CHECK(rebuilds > 0);
+}
+
+static void BenchQueries()
+{
+	std::mt19937 random(3);
+	XMFLOAT4 planes[6];
+	GetTestPlanes(planes);
+
+	printf("items    build      cull bvh/linear     sphere bvh/linear   ray bvh/linear      refit 1%%\n");
+	for (unsigned int count : { 1000u, 10000u, 100000u, 1000000u })
+	{
+		std::vector<CullBounds> bounds = MakeScene(count, random);
+		SceneBvh bvh;
+		double buildMs = TimeBest(3, [&]() { bvh.Build(bounds.data(), count); });
+
+		float size = sqrtf((float)count) * 5.0f;
+		std::uniform_real_distribution<float> position(-size, size);
+		XMFLOAT3 center(position(random), 10, position(random));
+		XMFLOAT3 origin(position(random), 30, position(random)), direction(0.3f, -1, 0.2f);
+		std::vector<unsigned int> found, linear(count);
+		int runs = count >= 1000000 ? 5 : 50;
+
+		double cullMs = TimeBest(runs, [&]() { found.clear(); bvh.CullFrustum(planes, bounds.data(), found); });
+		double cullLinearMs = TimeBest(runs, [&]() { CullBoxes(planes, bounds.data(), count, linear.data()); });
+		double sphereMs = TimeBest(runs, [&]() { found.clear(); bvh.QuerySphere(center, 20.0f, bounds.data(), found); });
+		double sphereLinearMs = TimeBest(runs, [&]()
+		{
+			found.clear();
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (BoxTouchesSphere(bounds[i], center, 20.0f))
+					found.push_back(i);
+			}
+		});
+		float distance;
+		double rayMs = TimeBest(runs, [&]() { bvh.Raycast(origin, direction, bounds.data(), &distance); });
+		double rayLinearMs = TimeBest(runs, [&]()
+		{
+			distance = FLT_MAX;
+			for (unsigned int i = 0; i < count; i++)
+				distance = std::min(distance, RayEntersBox(bounds[i], origin, direction));
+		});
+
+		double refitMs = 1e9;
+		for (int run = 0; run < 5; run++)
+		{
+			for (unsigned int k = 0; k < count / 100; k++)
+			{
+				unsigned int i = random() % count;
+				bounds[i].Center.x += 0.5f;
+				bvh.MarkMoved(i);
+			}
+			TestTimer timer;
+			bvh.Refit(bounds.data());
+			refitMs = std::min(refitMs, timer.GetMilliseconds());
+		}
+
+		printf("%-8u %-10.2f %.3f/%-14.3f %.4f/%-13.3f %.4f/%-13.3f %.3f ms\n", count, buildMs,
+			cullMs, cullLinearMs, sphereMs, sphereLinearMs, rayMs, rayLinearMs, refitMs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestQueries();
+	TestEdits();
+
+	if (BENCH)
+		BenchQueries();
+
+	return FinishTests("SceneBvhTests");
+}
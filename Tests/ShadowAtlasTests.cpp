@@ -0,0 +1,215 @@
+#include "TestFramework.h"
+#include "ShadowAtlas.h"
+#include "FrustumCull.h"
+#include <algorithm>
+#include <random>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Random frames of lights, each either a directional light
+// (one tile) or a point light (six), with some unshadowed
+// --------------------------------------------------------
+static void MakeRequests(int count, std::mt19937& random, std::vector<ShadowAtlasRequest>& requests)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	requests.resize(count);
+	for (ShadowAtlasRequest& request : requests)
+	{
+		request.TileCount = random() % 3 == 0 ? 1 : SHADOW_ATLAS_FACES;
+		request.Importance = u(random) < 0.1f ? 0.0f : powf(u(random), 2.0f) * 1.5f;
+	}
+}
+
+static void TestAllocate()
+{
+	std::mt19937 random(11);
+	ShadowAtlas atlas;
+	std::vector<ShadowAtlasRequest> requests;
+	std::vector<int> firstTiles;
+	std::vector<ShadowAtlasTile> tiles;
+
+	int overlaps = 0, outside = 0, badSizes = 0, outOfOrder = 0, packerDrops = 0, wrongCounts = 0;
+	double fill = 0.0;
+	const int frames = 3000;
+	const long long atlasArea = (long long)SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		int count = 1 + random() % 64;
+		MakeRequests(count, random, requests);
+		int granted = atlas.Allocate(requests.data(), count, firstTiles, tiles);
+
+		std::vector<ShadowAtlasTile> live;
+		std::vector<std::pair<float, int>> sizes;
+		int grantedCount = 0, grantedTiles = 0;
+		long long area = 0;
+		for (int r = 0; r < count; r++)
+		{
+			if (firstTiles[r] < 0)
+				continue;
+			grantedCount++;
+			grantedTiles += requests[r].TileCount;
+
+			// In bounds, a power of two in range, and the same for all of a light's tiles
+			int tileSize = tiles[firstTiles[r]].Size;
+			for (int t = 0; t < requests[r].TileCount; t++)
+			{
+				const ShadowAtlasTile& tile = tiles[firstTiles[r] + t];
+				live.push_back(tile);
+				area += (long long)tile.Size * tile.Size;
+				outside += tile.X < 0 || tile.Y < 0 || tile.X + tile.Size > SHADOW_ATLAS_SIZE || tile.Y + tile.Size > SHADOW_ATLAS_SIZE;
+				badSizes += tile.Size < SHADOW_ATLAS_MIN_TILE || tile.Size > SHADOW_ATLAS_MAX_TILE ||
+					(tile.Size & (tile.Size - 1)) || tile.Size != tileSize;
+			}
+			sizes.push_back({ requests[r].Importance, tileSize });
+		}
+		wrongCounts += granted != grantedCount || area != atlas.GetUsedArea();
+
+		// No light gets a smaller tile than a less important one
+		for (auto& a : sizes)
+			for (auto& b : sizes)
+				outOfOrder += a.first > b.first && a.second < b.second;
+
+		for (size_t a = 0; a < live.size(); a++)
+		{
+			for (size_t b = a + 1; b < live.size(); b++)
+			{
+				const ShadowAtlasTile& p = live[a];
+				const ShadowAtlasTile& q = live[b];
+				overlaps += p.X < q.X + q.Size && q.X < p.X + p.Size && p.Y < q.Y + q.Size && q.Y < p.Y + p.Size;
+			}
+		}
+
+		// Every light that went without was dropped for area or for the
+		// tile cap, never because the packer couldn't place it
+		for (int r = 0; r < count; r++)
+		{
+			if (firstTiles[r] >= 0 || requests[r].Importance <= 0.0f)
+				continue;
+			bool noRoom = area + (long long)requests[r].TileCount * SHADOW_ATLAS_MIN_TILE * SHADOW_ATLAS_MIN_TILE > atlasArea;
+			bool noTiles = grantedTiles + requests[r].TileCount > SHADOW_ATLAS_MAX_TILES;
+			packerDrops += !noRoom && !noTiles;
+		}
+		fill += (double)area / atlasArea;
+	}
+	CHECK(overlaps == 0);
+	CHECK(outside == 0);
+	CHECK(badSizes == 0);
+	CHECK(outOfOrder == 0);
+	CHECK(packerDrops == 0);
+	CHECK(wrongCounts == 0);
+	CHECK(fill / frames > 0.5);
+	if (BENCH)
+		printf("mean fill over %d frames: %.1f%%\n", frames, 100.0 * fill / frames);
+
+	// Importance 1 gets the largest tile, and a quarter two sizes down
+	ShadowAtlasRequest pair[2] = { { 1.0f, 1 }, { 0.25f, 1 } };
+	CHECK(atlas.Allocate(pair, 2, firstTiles, tiles) == 2);
+	CHECK(tiles[firstTiles[0]].Size == SHADOW_ATLAS_MAX_TILE);
+	CHECK(tiles[firstTiles[1]].Size == SHADOW_ATLAS_MAX_TILE / 4);
+
+	// Nothing asked for, nothing given
+	ShadowAtlasRequest none = { 0.0f, SHADOW_ATLAS_FACES };
+	CHECK(atlas.Allocate(&none, 1, firstTiles, tiles) == 0);
+	CHECK(firstTiles[0] == -1 && tiles.empty() && atlas.GetUsedArea() == 0);
+}
+
+static void TestImportance()
+{
+	XMFLOAT4X4 view, projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 0, -5, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+
+	Light light = {};
+	light.Type = LIGHT_TYPE_DIRECTIONAL;
+	light.Intensity = 2.0f;
+	light.Color = XMFLOAT3(0.5f, 0.25f, 0.1f);
+	CHECK_NEAR(GetShadowImportance(light, view, projection, planes), 1.0, 1e-6);
+
+	// Point lights count for less the farther away they are, nothing
+	// out of view, and everything with the camera inside their range
+	light.Type = LIGHT_TYPE_POINT;
+	light.Range = 2.0f;
+	light.Color = XMFLOAT3(1, 1, 1);
+	light.Position = XMFLOAT3(0, 0, 5);
+	float nearer = GetShadowImportance(light, view, projection, planes);
+	light.Position = XMFLOAT3(0, 0, 25);
+	float farther = GetShadowImportance(light, view, projection, planes);
+	CHECK(nearer > farther && farther > 0.0f);
+	light.Position = XMFLOAT3(0, 0, -20);
+	CHECK(GetShadowImportance(light, view, projection, planes) == 0.0f);
+	light.Position = XMFLOAT3(0, 0, -4);
+	CHECK_NEAR(GetShadowImportance(light, view, projection, planes), 2.0, 1e-6);
+
+	light.Type = LIGHT_TYPE_SPOT;
+	CHECK(GetShadowImportance(light, view, projection, planes) == 0.0f);
+}
+
+static void TestPointFaces()
+{
+	// Every direction lands inside the face its major axis picks,
+	// as the pixel shader picks them
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> u(-1, 1);
+	XMFLOAT3 position(3, -2, 7);
+	float range = 10.0f;
+	XMFLOAT4X4 views[SHADOW_ATLAS_FACES], projection;
+	BuildPointShadowFaces(position, range, views, projection);
+
+	int outside = 0;
+	for (int i = 0; i < 10000; i++)
+	{
+		XMFLOAT3 d(u(random), u(random), u(random));
+		float ax = fabsf(d.x), ay = fabsf(d.y), az = fabsf(d.z);
+		int face = ax >= ay && ax >= az ? (d.x > 0 ? 0 : 1) : ay >= az ? (d.y > 0 ? 2 : 3) : (d.z > 0 ? 4 : 5);
+
+		XMVECTOR point = XMLoadFloat3(&position) + XMVector3Normalize(XMLoadFloat3(&d)) * (range * 0.5f);
+		XMFLOAT3 clip;
+		XMStoreFloat3(&clip, XMVector3TransformCoord(point, XMLoadFloat4x4(&views[face]) * XMLoadFloat4x4(&projection)));
+		outside += fabsf(clip.x) > 1.0001f || fabsf(clip.y) > 1.0001f || clip.z < 0 || clip.z > 1;
+	}
+	CHECK(outside == 0);
+}
+
+static void BenchAllocate()
+{
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> u(0, 1);
+	ShadowAtlas atlas;
+	std::vector<int> firstTiles;
+	std::vector<ShadowAtlasTile> tiles;
+	for (int count : { 8, 32, 64 })
+	{
+		std::vector<ShadowAtlasRequest> requests(count);
+		for (ShadowAtlasRequest& request : requests)
+			request = { u(random), SHADOW_ATLAS_FACES };
+
+		const int runs = 2000;
+		int granted = 0;
+		double ms = TimeBest(3, [&]()
+		{
+			for (int run = 0; run < runs; run++)
+				granted = atlas.Allocate(requests.data(), count, firstTiles, tiles);
+		});
+		printf("%d point lights (%d tiles): %.1f us per Allocate, %d granted\n",
+			count, count * SHADOW_ATLAS_FACES, ms * 1000 / runs, granted);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestAllocate();
+	TestImportance();
+	TestPointFaces();
+
+	if (BENCH)
+		BenchAllocate();
+
+	return FinishTests("ShadowAtlasTests");
+}
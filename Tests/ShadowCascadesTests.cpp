@@ -0,0 +1,320 @@
+#include "TestFramework.h"
+#include "ShadowCascades.h"
+#include <random>
+
+using namespace DirectX;
+
+static void TestSplits()
+{
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> u(0, 1);
+	bool increasing = true, ends = true;
+	for (int trial = 0; trial < 2000; trial++)
+	{
+		float nearClip = 0.01f + u(random), farClip = nearClip + 5 + u(random) * 995;
+		int count = 1 + trial % MAX_SHADOW_CASCADES;
+		float splits[MAX_SHADOW_CASCADES + 1];
+		ComputeCascadeSplits(nearClip, farClip, count, u(random), splits);
+
+		ends &= splits[0] == nearClip && splits[count] == farClip;
+		for (int i = 0; i < count; i++)
+			increasing &= splits[i + 1] > splits[i];
+	}
+	CHECK(ends);
+	CHECK(increasing);
+
+	// Lambda 0 is evenly spaced, and 1 logarithmically
+	float splits[5];
+	ComputeCascadeSplits(1.0f, 101.0f, 4, 0.0f, splits);
+	CHECK_NEAR(splits[1], 26.0, 1e-4);
+	CHECK_NEAR(splits[2], 51.0, 1e-4);
+	ComputeCascadeSplits(1.0f, 10000.0f, 4, 1.0f, splits);
+	CHECK_NEAR(splits[1], 10.0, 1e-3);
+	CHECK_NEAR(splits[2], 100.0, 1e-2);
+	CHECK_NEAR(splits[3], 1000.0, 1e-1);
+}
+
+static void TestFit()
+{
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> u(0, 1);
+	int uncovered = 0, resized = 0, offTexel = 0;
+	double worstSnap = 0.0;
+	for (int trial = 0; trial < 2000; trial++)
+	{
+		float nearClip = 0.01f + u(random), farClip = nearClip + 5 + u(random) * 995;
+		int count = 2 + trial % 3;
+		float splits[MAX_SHADOW_CASCADES + 1];
+		ComputeCascadeSplits(nearClip, farClip, count, u(random), splits);
+
+		float fieldOfView = 0.3f + u(random) * 1.8f, aspectRatio = 0.5f + u(random) * 2.0f;
+		int resolution = 512 << (trial % 3);
+		XMVECTOR eye = XMVectorSet(u(random) * 200 - 100, u(random) * 50, u(random) * 200 - 100, 0);
+		XMVECTOR forward = XMVector3Normalize(XMVectorSet(u(random) - 0.5f, u(random) - 0.5f, u(random) - 0.5f, 0));
+		XMFLOAT3 light = trial % 50 == 0 ? XMFLOAT3(0, -1, 0) : XMFLOAT3(u(random) - 0.5f, -u(random), u(random) - 0.5f);
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0)));
+
+		for (int i = 0; i < count; i++)
+		{
+			ShadowCascade cascade;
+			FitCascade(view, fieldOfView, aspectRatio, splits[i], splits[i + 1], light, resolution, cascade);
+			CHECK(cascade.SplitNear == splits[i] && cascade.SplitFar == splits[i + 1]);
+
+			// Every corner of the slice is inside the light's clip box
+			XMMATRIX sliceToWorld = XMMatrixInverse(0,
+				XMLoadFloat4x4(&view) * XMMatrixPerspectiveFovLH(fieldOfView, aspectRatio, splits[i], splits[i + 1]));
+			XMMATRIX viewProjection = XMLoadFloat4x4(&cascade.ViewProjection);
+			for (int k = 0; k < 8; k++)
+			{
+				XMVECTOR corner = XMVector3TransformCoord(XMVectorSet(k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f, k & 4 ? 1.0f : 0.0f, 1), sliceToWorld);
+				XMFLOAT3 clip;
+				XMStoreFloat3(&clip, XMVector3TransformCoord(corner, viewProjection));
+				const float e = 1e-4f;
+				uncovered += fabsf(clip.x) > 1 + e || fabsf(clip.y) > 1 + e || clip.z < -e || clip.z > 1 + e;
+			}
+
+			// Turning the camera in place keeps the box's size
+			XMFLOAT4X4 turned;
+			XMStoreFloat4x4(&turned, XMMatrixLookToLH(eye,
+				XMVector3Normalize(XMVectorSet(u(random) - 0.5f, u(random) - 0.5f, u(random) - 0.5f, 0)), XMVectorSet(0, 1, 0, 0)));
+			ShadowCascade turnedCascade;
+			FitCascade(turned, fieldOfView, aspectRatio, splits[i], splits[i + 1], light, resolution, turnedCascade);
+			resized += turnedCascade.Radius != cascade.Radius;
+
+			// Moving it slides a fixed world point by whole texels, give
+			// or take float error in projecting points 1000 units out
+			XMFLOAT4X4 moved;
+			XMStoreFloat4x4(&moved, XMMatrixLookToLH(eye + XMVectorSet(u(random) * 3, u(random) * 3, u(random) * 3, 0),
+				forward, XMVectorSet(0, 1, 0, 0)));
+			ShadowCascade movedCascade;
+			FitCascade(moved, fieldOfView, aspectRatio, splits[i], splits[i + 1], light, resolution, movedCascade);
+			XMVECTOR point = XMVectorSet(1.5f, 2.5f, -3.5f, 1);
+			XMFLOAT3 before, after;
+			XMStoreFloat3(&before, XMVector3TransformCoord(point, viewProjection));
+			XMStoreFloat3(&after, XMVector3TransformCoord(point, XMLoadFloat4x4(&movedCascade.ViewProjection)));
+			for (float texels : { (before.x - after.x) * 0.5f * resolution, (before.y - after.y) * 0.5f * resolution })
+			{
+				double snap = fabs(texels - std::round(texels));
+				worstSnap = std::max(worstSnap, snap);
+				offTexel += snap > 0.05;
+			}
+		}
+	}
+	CHECK(uncovered == 0);
+	CHECK(resized == 0);
+	CHECK(offTexel == 0);
+	if (BENCH)
+		printf("worst texel snap error %.4f texels\n", worstSnap);
+}
+
+static void TestStability()
+{
+	// A still or barely moving camera gets exactly the same
+	// matrices frame to frame, so cached shadows stay valid
+	float splits[4];
+	ComputeCascadeSplits(0.0001f, 100.0f, 3, SHADOW_CASCADE_LAMBDA, splits);
+	for (float creep : { 0.0f, 0.0005f })
+	{
+		XMFLOAT4X4 last[3] = {};
+		int same = 0;
+		for (int frame = 0; frame < 60; frame++)
+		{
+			XMFLOAT4X4 view;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(creep * frame, 0, -5, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+			for (int i = 0; i < 3; i++)
+			{
+				ShadowCascade cascade;
+				FitCascade(view, XM_PIDIV4, 16.0f / 9.0f, splits[i], splits[i + 1], XMFLOAT3(0, -1, 1), 1024, cascade);
+				same += frame > 0 && memcmp(&cascade.ViewProjection, &last[i], sizeof(XMFLOAT4X4)) == 0;
+				last[i] = cascade.ViewProjection;
+			}
+		}
+		if (creep == 0.0f)
+			CHECK(same == 59 * 3);
+		else
+			CHECK(same > 59 * 3 / 2);
+	}
+}
+
+// Whether every corner of the slice is inside the light's clip box
+static bool CoversSlice(const XMFLOAT4X4& view, float fieldOfView, float aspectRatio,
+	float splitNear, float splitFar, const ShadowCascade& cascade)
+{
+	XMMATRIX sliceToWorld = XMMatrixInverse(0,
+		XMLoadFloat4x4(&view) * XMMatrixPerspectiveFovLH(fieldOfView, aspectRatio, splitNear, splitFar));
+	XMMATRIX viewProjection = XMLoadFloat4x4(&cascade.ViewProjection);
+	for (int k = 0; k < 8; k++)
+	{
+		XMVECTOR corner = XMVector3TransformCoord(XMVectorSet(k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f, k & 4 ? 1.0f : 0.0f, 1), sliceToWorld);
+		XMFLOAT3 clip;
+		XMStoreFloat3(&clip, XMVector3TransformCoord(corner, viewProjection));
+		const float e = 1e-4f;
+		if (fabsf(clip.x) > 1 + e || fabsf(clip.y) > 1 + e || clip.z < -e || clip.z > 1 + e)
+			return false;
+	}
+	return true;
+}
+
+static void TestCacheKey()
+{
+	ShadowCacheKey cached = {};
+	cached.Region.Center = XMFLOAT3(1, 2, 3);
+	cached.Region.HalfSize = 10;
+	cached.Region.LightDirection = XMFLOAT3(0, -1, 1);
+	cached.Region.Valid = true;
+	cached.StaticVersion = 5;
+	CHECK(IsShadowCacheHit(cached, cached));
+
+	// Nothing drawn yet, or nothing to draw with
+	ShadowCacheKey invalid = cached;
+	invalid.Region.Valid = false;
+	CHECK(!IsShadowCacheHit(invalid, cached));
+	CHECK(!IsShadowCacheHit(cached, invalid));
+	CHECK(!IsShadowCacheHit(ShadowCacheKey{}, ShadowCacheKey{}));
+
+	// A static entity changed, the region moved or resized, or the light turned
+	ShadowCacheKey changed = cached;
+	changed.StaticVersion++;
+	CHECK(!IsShadowCacheHit(cached, changed));
+	changed = cached;
+	changed.Region.Center.y += 0.125f;
+	CHECK(!IsShadowCacheHit(cached, changed));
+	changed = cached;
+	changed.Region.HalfSize *= 2;
+	CHECK(!IsShadowCacheHit(cached, changed));
+	changed = cached;
+	changed.Region.LightDirection.x = 0.01f;
+	CHECK(!IsShadowCacheHit(cached, changed));
+}
+
+// --------------------------------------------------------
+// Hits and misses of each cascade's cache over a run of
+// frames, the way Game::RenderShadowMap keys them
+// --------------------------------------------------------
+struct CacheRun
+{
+	int Hits;
+	int Misses;
+	bool Covered;	// Every box held its whole slice
+};
+
+template<typename CameraAt>
+static CacheRun RunCache(int frames, CameraAt cameraAt, XMFLOAT3 (*lightAt)(int), unsigned int (*versionAt)(int))
+{
+	const float fieldOfView = XM_PIDIV4, aspectRatio = 16.0f / 9.0f;
+	float splits[4];
+	ComputeCascadeSplits(0.01f, 100.0f, 3, SHADOW_CASCADE_LAMBDA, splits);
+	ShadowCascadeRegion regions[3] = {};
+	ShadowCacheKey keys[3] = {};
+	CacheRun run = { 0, 0, true };
+	for (int frame = 0; frame < frames; frame++)
+	{
+		XMFLOAT4X4 view = cameraAt(frame);
+		for (int i = 0; i < 3; i++)
+		{
+			ShadowCascade cascade;
+			FitCascade(view, fieldOfView, aspectRatio, splits[i], splits[i + 1], lightAt(frame), 1024, cascade, &regions[i]);
+			run.Covered &= CoversSlice(view, fieldOfView, aspectRatio, splits[i], splits[i + 1], cascade);
+
+			ShadowCacheKey key = { regions[i], versionAt(frame) };
+			if (IsShadowCacheHit(keys[i], key))
+				run.Hits++;
+			else
+			{
+				keys[i] = key;
+				run.Misses++;
+			}
+		}
+	}
+	return run;
+}
+
+static XMFLOAT3 FixedLight(int) { return XMFLOAT3(0, -1, 1); }
+static unsigned int FixedVersion(int) { return 1; }
+
+static XMFLOAT4X4 LookTo(XMVECTOR eye, XMVECTOR forward)
+{
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(eye, XMVector3Normalize(forward), XMVectorSet(0, 1, 0, 0)));
+	return view;
+}
+
+static void TestCacheRegions()
+{
+	// 4 seconds at 60 frames a second, 3 cascades a frame
+	const int frames = 240, lookups = frames * 3;
+	auto still = [](int) { return LookTo(XMVectorSet(0, 2, -5, 0), XMVectorSet(0, 0, 1, 0)); };
+	auto walking = [](int frame) { return LookTo(XMVectorSet(4.0f * frame / 60, 2, -5, 0), XMVectorSet(0.2f, -0.1f, 1, 0)); };
+	auto turning = [](int frame)
+	{
+		float angle = 0.5f * frame / 60;
+		return LookTo(XMVectorSet(0, 2, -5, 0), XMVectorSet(sinf(angle), -0.1f, cosf(angle), 0));
+	};
+
+	// A still camera only misses the first frame
+	CacheRun run = RunCache(frames, still, FixedLight, FixedVersion);
+	CHECK(run.Misses == 3 && run.Hits == lookups - 3);
+	CHECK(run.Covered);
+
+	// Walking or turning moves each region now and then, rather than
+	// every frame as the boxes themselves move (bigger cascades,
+	// further out, sweep further when turning)
+	run = RunCache(frames, walking, FixedLight, FixedVersion);
+	CHECK(run.Misses < lookups / 10);
+	CHECK(run.Covered);
+	int walkingMisses = run.Misses;
+	run = RunCache(frames, turning, FixedLight, FixedVersion);
+	CHECK(run.Misses < lookups / 4);
+	CHECK(run.Covered);
+	int turningMisses = run.Misses;
+
+	// Anything static changing, or the light turning, misses every cascade
+	run = RunCache(frames, still, FixedLight, [](int frame) { return 1u + frame / 60; });
+	CHECK(run.Misses == 3 * 4);
+	run = RunCache(frames, still, [](int frame) { return XMFLOAT3(0.001f * (frame / 30), -1, 1); }, FixedVersion);
+	CHECK(run.Misses == 3 * 8);
+
+	if (BENCH)
+	{
+		printf("static cache over %d cascade draws: %d redrawn walking at 4 u/s, %d turning at 0.5 rad/s\n",
+			lookups, walkingMisses, turningMisses);
+	}
+}
+
+static void BenchFit()
+{
+	float splits[MAX_SHADOW_CASCADES + 1];
+	ComputeCascadeSplits(0.01f, 100.0f, MAX_SHADOW_CASCADES, SHADOW_CASCADE_LAMBDA, splits);
+	printf("game splits: %g %g %g %g %g\n", splits[0], splits[1], splits[2], splits[3], splits[4]);
+
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 0, -5, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	ShadowCascade cascades[MAX_SHADOW_CASCADES];
+	const int runs = 100000;
+	double ms = TimeBest(5, [&]()
+	{
+		for (int run = 0; run < runs; run++)
+		{
+			for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+				FitCascade(view, XM_PIDIV4, 16.0f / 9.0f, splits[i], splits[i + 1], XMFLOAT3(0, -1, 1), 2048, cascades[i]);
+		}
+	});
+	printf("fitting %d cascades: %.2f us\n", MAX_SHADOW_CASCADES, ms * 1000 / runs);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestSplits();
+	TestFit();
+	TestStability();
+	TestCacheKey();
+	TestCacheRegions();
+
+	if (BENCH)
+		BenchFit();
+
+	return FinishTests("ShadowCascadesTests");
+}
@@ -0,0 +1,174 @@
+#include "TestFramework.h"
+#include "ShadowCasterCull.h"
+#include <algorithm>
+#include <random>
+
+using namespace DirectX;
+
+// Whether the ray from a point along a direction ever enters the
+// frustum, clipping it against each plane in turn
+static bool DoesRayEnterFrustum(const XMFLOAT4 planes[6], XMFLOAT3 p, XMFLOAT3 direction)
+{
+	float enter = 0.0f, exit = 1e30f;
+	for (int i = 0; i < 6; i++)
+	{
+		float distance = planes[i].x * p.x + planes[i].y * p.y + planes[i].z * p.z + planes[i].w + 1e-4f;
+		float toward = planes[i].x * direction.x + planes[i].y * direction.y + planes[i].z * direction.z;
+		if (toward == 0.0f)
+		{
+			if (distance < 0.0f)
+				return false;
+		}
+		else if (toward > 0.0f)
+			enter = std::max(enter, -distance / toward);
+		else
+			exit = std::min(exit, -distance / toward);
+	}
+	return enter <= exit;
+}
+
+static void TestCasterVolume()
+{
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> u(0, 1);
+	int rejected = 0, total = 0, shadowsSeen = 0, keptShadowsSeen = 0, mostPlanes = 0;
+	for (int trial = 0; trial < 300; trial++)
+	{
+		// Random cameras and lights, and every tenth light along the view
+		XMVECTOR eye = XMVectorSet(-10 + 20 * u(random), -5 + 10 * u(random), -10 + 20 * u(random), 1);
+		XMVECTOR forward = XMVector3Normalize(XMVectorSet(2 * u(random) - 1, 2 * u(random) - 1, 2 * u(random) - 1, 0));
+		XMMATRIX view = XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(0.5f + 1.5f * u(random), 1.0f + u(random), 0.1f + u(random), 10 + 40 * u(random));
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, view * projection);
+		XMFLOAT4 frustum[6];
+		ExtractFrustumPlanes(viewProjection, frustum);
+
+		XMFLOAT3 light;
+		XMStoreFloat3(&light, trial % 10 == 0 ? forward :
+			XMVector3Normalize(XMVectorSet(2 * u(random) - 1, 2 * u(random) - 1, 2 * u(random) - 1, 0)));
+
+		XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES];
+		int planeCount = BuildCasterVolume(viewProjection, light, planes);
+		mostPlanes = std::max(mostPlanes, planeCount);
+
+		for (int b = 0; b < 300; b++)
+		{
+			CullBounds box = {};
+			box.Center = XMFLOAT3(-60 + 120 * u(random), -60 + 120 * u(random), -60 + 120 * u(random));
+			box.Extents = XMFLOAT3(0.2f + 3 * u(random), 0.2f + 3 * u(random), 0.2f + 3 * u(random));
+			total++;
+			if (IsBoxInsidePlanes(planes, planeCount, box))
+			{
+				keptShadowsSeen += DoesRayEnterFrustum(frustum, box.Center, light);
+				continue;
+			}
+			rejected++;
+
+			// A rejected box's shadow never reaches the view: points on
+			// it swept along the light (from the point itself, so boxes
+			// in view count too) all stay outside the frustum
+			for (int s = 0; s < 40; s++)
+			{
+				XMFLOAT3 p(
+					box.Center.x + box.Extents.x * (2 * u(random) - 1),
+					box.Center.y + box.Extents.y * (2 * u(random) - 1),
+					box.Center.z + box.Extents.z * (2 * u(random) - 1));
+				shadowsSeen += DoesRayEnterFrustum(frustum, p, light);
+			}
+		}
+	}
+	CHECK(rejected > total / 10);
+	CHECK(shadowsSeen == 0);
+	CHECK(keptShadowsSeen > 0);
+	CHECK(mostPlanes <= CASTER_VOLUME_MAX_PLANES);
+}
+
+// The game's camera, looking down +Z from (0, 0, -5), with
+// the light shining down and forward
+static int BuildGameVolume(XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES])
+{
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 0, -5, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.0001f, 100.0f);
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, view * projection);
+	XMFLOAT3 light;
+	XMStoreFloat3(&light, XMVector3Normalize(XMVectorSet(0, -1, 1, 0)));
+	return BuildCasterVolume(viewProjection, light, planes);
+}
+
+// Casters spread through the light's box around the scene
+static std::vector<CullBounds> MakeCasters(int count, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> u(0, 1);
+	std::vector<CullBounds> bounds(count);
+	for (CullBounds& b : bounds)
+		b = { XMFLOAT3(-5 + 10 * u(random), -3 + 6 * u(random), -5 + 10 * u(random)), 0.17f, XMFLOAT3(0.1f, 0.1f, 0.1f), 0 };
+	return bounds;
+}
+
+static void TestCullShadowCasters()
+{
+	std::mt19937 random(11);
+	XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES];
+	int planeCount = BuildGameVolume(planes);
+	std::vector<CullBounds> bounds = MakeCasters(1000, random);
+
+	// Filtered in place, in order, agreeing with IsBoxInsidePlanes
+	std::vector<unsigned int> casters;
+	for (unsigned int i = 0; i < bounds.size(); i += 2)
+		casters.push_back(i);
+	size_t before = casters.size();
+	unsigned int removed = CullShadowCasters(planes, planeCount, bounds.data(), casters);
+	CHECK(removed > 0 && removed < before);
+	CHECK(casters.size() + removed == before);
+	CHECK(std::is_sorted(casters.begin(), casters.end()));
+
+	unsigned int expected = 0;
+	for (unsigned int i = 0; i < bounds.size(); i += 2)
+		expected += IsBoxInsidePlanes(planes, planeCount, bounds[i]);
+	CHECK(casters.size() == expected);
+	bool agrees = true;
+	for (unsigned int i : casters)
+		agrees &= IsBoxInsidePlanes(planes, planeCount, bounds[i]) && i % 2 == 0;
+	CHECK(agrees);
+
+	std::vector<unsigned int> none;
+	CHECK(CullShadowCasters(planes, planeCount, bounds.data(), none) == 0);
+}
+
+static void BenchCullShadowCasters()
+{
+	std::mt19937 random(11);
+	for (int count : { 1000, 10000, 100000 })
+	{
+		std::vector<CullBounds> bounds = MakeCasters(count, random);
+		std::vector<unsigned int> casters;
+		XMFLOAT4 planes[CASTER_VOLUME_MAX_PLANES];
+		int planeCount = 0;
+		unsigned int removed = 0;
+		double ms = TimeBest(20, [&]()
+		{
+			casters.resize(count);
+			for (int i = 0; i < count; i++)
+				casters[i] = i;
+			planeCount = BuildGameVolume(planes);
+			removed = CullShadowCasters(planes, planeCount, bounds.data(), casters);
+		});
+		printf("%6d casters in the light's box: %u rejected (%.0f%%), %d planes, %.3f ms\n",
+			count, removed, 100.0 * removed / count, planeCount, ms);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestCasterVolume();
+	TestCullShadowCasters();
+
+	if (BENCH)
+		BenchCullShadowCasters();
+
+	return FinishTests("ShadowCasterCullTests");
+}
@@ -0,0 +1,239 @@
+#include "TestMeshes.h"
+#include "StaticBatchMerge.h"
+#include <random>
+
+using namespace DirectX;
+
+static MeshInstance MakeInstance(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices,
+	FXMMATRIX world)
+{
+	MeshInstance instance = {};
+	instance.Vertices = verts.data();
+	instance.VertexCount = (int)verts.size();
+	instance.Indices = indices.data();
+	instance.IndexCount = (int)indices.size();
+	XMStoreFloat4x4(&instance.World, world);
+	XMStoreFloat4x4(&instance.WorldInverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, world)));
+	return instance;
+}
+
+// The way a triangle faces, from its corners in index order
+static XMVECTOR FaceNormal(const std::vector<Vertex>& verts, const unsigned int* triangle)
+{
+	XMVECTOR p0 = XMLoadFloat3(&verts[triangle[0]].Position);
+	XMVECTOR p1 = XMLoadFloat3(&verts[triangle[1]].Position);
+	XMVECTOR p2 = XMLoadFloat3(&verts[triangle[2]].Position);
+	return XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+}
+
+static void TestWorldTransform()
+{
+	// A sloped triangle, stretched along x: its normal has to follow
+	// the slope's new angle rather than just rotate with it
+	std::vector<Vertex> verts(3);
+	verts[0].Position = XMFLOAT3(0, 0, 0);
+	verts[1].Position = XMFLOAT3(1, 1, 0);
+	verts[2].Position = XMFLOAT3(0, 0, 1);
+	for (Vertex& v : verts)
+	{
+		v.Normal = XMFLOAT3(0.70710678f, -0.70710678f, 0);
+		v.Tangent = XMFLOAT3(0.70710678f, 0.70710678f, 0);
+		v.UV = XMFLOAT2(0.25f, 0.75f);
+	}
+	std::vector<unsigned int> indices = { 0, 1, 2 };
+
+	XMMATRIX world = XMMatrixScaling(2, 1, 1) * XMMatrixRotationRollPitchYaw(0, 0.6f, 0) * XMMatrixTranslation(3, -4, 5);
+	MeshInstance instance = MakeInstance(verts, indices, world);
+	std::vector<Vertex> merged;
+	std::vector<unsigned int> mergedIndices;
+	MergeMeshInstances(&instance, 1, merged, mergedIndices);
+	CHECK(merged.size() == 3);
+	CHECK(mergedIndices == indices);
+
+	float positionError = 0, normalError = 0, tangentError = 0, uvError = 0;
+	XMVECTOR faceNormal = FaceNormal(merged, mergedIndices.data());
+	XMVECTOR edge = XMVector3Normalize(XMLoadFloat3(&merged[1].Position) - XMLoadFloat3(&merged[0].Position));
+	for (int v = 0; v < 3; v++)
+	{
+		XMVECTOR expected = XMVector3TransformCoord(XMLoadFloat3(&verts[v].Position), world);
+		positionError = fmaxf(positionError, XMVectorGetX(XMVector3Length(XMLoadFloat3(&merged[v].Position) - expected)));
+
+		// Still facing out of the (stretched) surface, and still
+		// along the edge it started along
+		normalError = fmaxf(normalError, XMVectorGetX(XMVector3Length(XMLoadFloat3(&merged[v].Normal) - faceNormal)));
+		tangentError = fmaxf(tangentError, XMVectorGetX(XMVector3Length(XMLoadFloat3(&merged[v].Tangent) - edge)));
+		uvError = fmaxf(uvError, fabsf(merged[v].UV.x - 0.25f) + fabsf(merged[v].UV.y - 0.75f));
+	}
+	CHECK_NEAR(positionError, 0, 1e-5);
+	CHECK_NEAR(normalError, 0, 1e-5);
+	CHECK_NEAR(tangentError, 0, 1e-5);
+	CHECK(uvError == 0);
+}
+
+static void TestMirroredWinding()
+{
+	// Every model's triangles should face the way their normals do
+	// after merging, whether or not the transform mirrors them
+	const XMMATRIX worlds[] =
+	{
+		XMMatrixRotationRollPitchYaw(0.3f, 1.2f, -0.4f) * XMMatrixTranslation(1, 2, 3),
+		XMMatrixScaling(-1, 1, 1),
+		XMMatrixScaling(2, -3, 0.5f) * XMMatrixRotationRollPitchYaw(0.8f, 0, 0),
+		XMMatrixScaling(-1, -1, -1),
+	};
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(model, verts, indices));
+
+		// Double sided models face both ways, so count the triangles
+		// that face with their normals rather than expecting all of them
+		auto countFacing = [](const std::vector<Vertex>& v, const std::vector<unsigned int>& i)
+		{
+			int facing = 0;
+			for (size_t t = 0; t + 2 < i.size(); t += 3)
+			{
+				XMVECTOR normal = XMLoadFloat3(&v[i[t]].Normal) + XMLoadFloat3(&v[i[t + 1]].Normal) +
+					XMLoadFloat3(&v[i[t + 2]].Normal);
+				facing += XMVectorGetX(XMVector3Dot(FaceNormal(v, &i[t]), normal)) > 0.0f;
+			}
+			return facing;
+		};
+		int facing = countFacing(verts, indices);
+
+		for (const XMMATRIX& world : worlds)
+		{
+			MeshInstance instance = MakeInstance(verts, indices, world);
+			std::vector<Vertex> merged;
+			std::vector<unsigned int> mergedIndices;
+			MergeMeshInstances(&instance, 1, merged, mergedIndices);
+			CHECK(mergedIndices.size() == indices.size());
+			CHECK(countFacing(merged, mergedIndices) == facing);
+		}
+	}
+}
+
+static void TestRebasedIndices()
+{
+	// Appended after what's already there, each instance's indices
+	// moved past the vertices before it
+	std::vector<Vertex> cube, sphere;
+	std::vector<unsigned int> cubeIndices, sphereIndices;
+	CHECK(LoadTestModel("cube.obj", cube, cubeIndices));
+	CHECK(LoadTestModel("sphere.obj", sphere, sphereIndices));
+
+	std::vector<Vertex> merged(5);
+	std::vector<unsigned int> mergedIndices = { 0, 1, 2, 2, 1, 3 };
+	MeshInstance instances[] =
+	{
+		MakeInstance(cube, cubeIndices, XMMatrixTranslation(1, 0, 0)),
+		MakeInstance(sphere, sphereIndices, XMMatrixTranslation(0, 1, 0)),
+		MakeInstance(cube, cubeIndices, XMMatrixTranslation(0, 0, 1)),
+	};
+	MergeMeshInstances(instances, 3, merged, mergedIndices);
+
+	size_t cubeVerts = cube.size(), sphereVerts = sphere.size();
+	CHECK(merged.size() == 5 + cubeVerts * 2 + sphereVerts);
+	CHECK(mergedIndices.size() == 6 + cubeIndices.size() * 2 + sphereIndices.size());
+	CHECK(std::vector<unsigned int>(mergedIndices.begin(), mergedIndices.begin() + 6) ==
+		std::vector<unsigned int>({ 0, 1, 2, 2, 1, 3 }));
+
+	// Not mirrored, so each index is the source's plus the base
+	bool rebased = true;
+	const unsigned int* next = mergedIndices.data() + 6;
+	const unsigned int bases[] = { 5, 5 + (unsigned int)cubeVerts, 5 + (unsigned int)(cubeVerts + sphereVerts) };
+	for (int i = 0; i < 3; i++)
+	{
+		for (int index = 0; index < instances[i].IndexCount; index++)
+			rebased &= *next++ == bases[i] + instances[i].Indices[index];
+	}
+	CHECK(rebased);
+
+	// And each vertex is its source's, moved by its offset
+	bool moved = true;
+	const XMFLOAT3 offsets[] = { XMFLOAT3(1, 0, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, 1) };
+	for (int i = 0; i < 3; i++)
+	{
+		for (int v = 0; v < instances[i].VertexCount; v++)
+		{
+			const XMFLOAT3& from = instances[i].Vertices[v].Position;
+			const XMFLOAT3& to = merged[bases[i] + v].Position;
+			moved &= fabsf(to.x - from.x - offsets[i].x) + fabsf(to.y - from.y - offsets[i].y) +
+				fabsf(to.z - from.z - offsets[i].z) < 1e-5f;
+		}
+	}
+	CHECK(moved);
+}
+
+static void BenchMerge()
+{
+	// 10k objects spread over a few materials, cut into batches the way
+	// BuildStaticBatches does: every draw they took before against the
+	// merged batches' draws, and how long merging all of them takes
+	const int objectCount = 10000, materialCount = 4;
+	std::vector<std::vector<Vertex>> verts(std::size(testModels));
+	std::vector<std::vector<unsigned int>> indices(std::size(testModels));
+	for (size_t m = 0; m < std::size(testModels); m++)
+		LoadTestModel(testModels[m], verts[m], indices[m]);
+
+	std::mt19937 random(10);
+	std::uniform_real_distribution<float> u(0, 1);
+	std::vector<std::vector<MeshInstance>> groups(materialCount);
+	size_t totalVertices = 0;
+	for (int o = 0; o < objectCount; o++)
+	{
+		size_t model = random() % std::size(testModels);
+		XMMATRIX world = XMMatrixScaling(0.5f + u(random), 0.5f + u(random), 0.5f + u(random)) *
+			XMMatrixRotationRollPitchYaw(6 * u(random), 6 * u(random), 6 * u(random)) *
+			XMMatrixTranslation(200 * u(random), 10 * u(random), 200 * u(random));
+		groups[random() % materialCount].push_back(MakeInstance(verts[model], indices[model], world));
+		totalVertices += verts[model].size();
+	}
+
+	std::vector<std::pair<const MeshInstance*, int>> batches;
+	for (std::vector<MeshInstance>& group : groups)
+	{
+		size_t first = 0;
+		int batchVertices = 0;
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			if (i > first && batchVertices + group[i].VertexCount > STATIC_BATCH_MAX_VERTICES)
+			{
+				batches.push_back({ &group[first], (int)(i - first) });
+				first = i;
+				batchVertices = 0;
+			}
+			batchVertices += group[i].VertexCount;
+		}
+		batches.push_back({ &group[first], (int)(group.size() - first) });
+	}
+
+	std::vector<Vertex> merged;
+	std::vector<unsigned int> mergedIndices;
+	double ms = TimeBest(5, [&]()
+	{
+		for (auto& batch : batches)
+		{
+			merged.clear();
+			mergedIndices.clear();
+			MergeMeshInstances(batch.first, batch.second, merged, mergedIndices);
+		}
+	});
+	printf("%d objects (%zu vertices): %d draws -> %zu, merged in %.2f ms (%.2f us per object)\n",
+		objectCount, totalVertices, objectCount, batches.size(), ms, ms * 1000 / objectCount);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestWorldTransform();
+	TestMirroredWinding();
+	TestRebasedIndices();
+
+	if (BENCH)
+		BenchMerge();
+
+	return FinishTests("StaticBatchTests");
+}
@@ -0,0 +1,244 @@
+#include "TestMeshes.h"
+#include "TangentSpace.h"
+#include "ParallelFor.h"
+#include <random>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// The routine CalculateTangents replaced, verbatim apart
+// from being a free function
+// --------------------------------------------------------
+static void ReferenceTangents(Vertex* verts, int numVerts, const unsigned int* indices, int numIndices)
+{
+	for (int i = 0; i < numVerts; i++)
+		verts[i].Tangent = XMFLOAT3(0, 0, 0);
+
+	for (int i = 0; i < numIndices;)
+	{
+		unsigned int i1 = indices[i++];
+		unsigned int i2 = indices[i++];
+		unsigned int i3 = indices[i++];
+		Vertex* v1 = &verts[i1];
+		Vertex* v2 = &verts[i2];
+		Vertex* v3 = &verts[i3];
+
+		float x1 = v2->Position.x - v1->Position.x;
+		float y1 = v2->Position.y - v1->Position.y;
+		float z1 = v2->Position.z - v1->Position.z;
+
+		float x2 = v3->Position.x - v1->Position.x;
+		float y2 = v3->Position.y - v1->Position.y;
+		float z2 = v3->Position.z - v1->Position.z;
+
+		float s1 = v2->UV.x - v1->UV.x;
+		float t1 = v2->UV.y - v1->UV.y;
+		float s2 = v3->UV.x - v1->UV.x;
+		float t2 = v3->UV.y - v1->UV.y;
+
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+		float tx = (t2 * x1 - t1 * x2) * r;
+		float ty = (t2 * y1 - t1 * y2) * r;
+		float tz = (t2 * z1 - t1 * z2) * r;
+
+		v1->Tangent.x += tx; v1->Tangent.y += ty; v1->Tangent.z += tz;
+		v2->Tangent.x += tx; v2->Tangent.y += ty; v2->Tangent.z += tz;
+		v3->Tangent.x += tx; v3->Tangent.y += ty; v3->Tangent.z += tz;
+	}
+
+	for (int i = 0; i < numVerts; i++)
+	{
+		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+		tangent = XMVector3Normalize(tangent - normal * XMVector3Dot(normal, tangent));
+		XMStoreFloat3(&verts[i].Tangent, tangent);
+	}
+}
+
+// --------------------------------------------------------
+// A wavy grid with normals to match, its UVs mirrored
+// across the middle and jittered a little, so tangents
+// vary from vertex to vertex
+// --------------------------------------------------------
+static void MakeWavyGrid(int width, int height, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> jitter(-0.002f, 0.002f);
+	verts.clear();
+	indices.clear();
+	for (int y = 0; y <= height; y++)
+	{
+		for (int x = 0; x <= width; x++)
+		{
+			float fx = x * 0.01f, fy = y * 0.01f;
+			float dx = 0.6f * cosf(fx * 3) * cosf(fy * 2), dz = -0.4f * sinf(fx * 3) * sinf(fy * 2);
+
+			Vertex v = {};
+			v.Position = XMFLOAT3(fx, 0.2f * sinf(fx * 3) * cosf(fy * 2), fy);
+			XMStoreFloat3(&v.Normal, XMVector3Normalize(XMVectorSet(-dx, 1, -dz, 0)));
+			v.UV = XMFLOAT2((x < width / 2 ? fx : width * 0.01f - fx) + jitter(random), fy + jitter(random));
+			verts.push_back(v);
+		}
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			unsigned int a = y * (width + 1) + x, b = a + 1, c = a + width + 1, d = c + 1;
+			unsigned int quad[6] = { a, c, b, b, c, d };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+static float AngleDegrees(XMFLOAT3 a, XMFLOAT3 b)
+{
+	float cosine = XMVectorGetX(XMVector3Dot(XMVector3Normalize(XMLoadFloat3(&a)), XMVector3Normalize(XMLoadFloat3(&b))));
+	return acosf(std::max(-1.0f, std::min(1.0f, cosine))) * 180.0f / XM_PI;
+}
+
+// How far the new routine's tangents are from the reference, at worst
+static float CompareToReference(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices, bool& identical,
+	int maxThreads = 0)
+{
+	std::vector<Vertex> reference = verts, result = verts;
+	ReferenceTangents(reference.data(), (int)reference.size(), indices.data(), (int)indices.size());
+	CalculateTangents(result.data(), (int)result.size(), indices.data(), (int)indices.size(), TANGENTS_AREA_WEIGHTED, maxThreads);
+
+	identical = true;
+	float worst = 0.0f;
+	for (size_t i = 0; i < verts.size(); i++)
+	{
+		identical &= memcmp(&reference[i].Tangent, &result[i].Tangent, sizeof(XMFLOAT3)) == 0;
+		XMVECTOR difference = XMLoadFloat3(&reference[i].Tangent) - XMLoadFloat3(&result[i].Tangent);
+		worst = std::max(worst, XMVectorGetX(XMVector3Length(difference)));
+	}
+	return worst;
+}
+
+static void TestMatchesReference()
+{
+	// Small meshes run on one thread, in the same order, so they match exactly
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(model, verts, indices));
+
+		bool identical;
+		CompareToReference(verts, indices, identical);
+		CHECK(identical);
+	}
+
+	// Big enough to be split across threads on a machine with several cores,
+	// where vertices shared between threads can round differently
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeWavyGrid(400, 200, verts, indices);
+	CHECK(indices.size() / 3 >= TANGENT_MIN_THREAD_TRIANGLES);
+
+	bool identical;
+	float worst = CompareToReference(verts, indices, identical);
+	CHECK(worst < 1e-5f);
+
+	// Unless it's kept to one
+	CompareToReference(verts, indices, identical, 1);
+	CHECK(identical);
+}
+
+static void TestMikkTSpace()
+{
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(model, verts, indices));
+
+		std::vector<Vertex> areaWeighted = verts;
+		CalculateTangents(verts.data(), (int)verts.size(), indices.data(), (int)indices.size(), TANGENTS_MIKKTSPACE);
+		CalculateTangents(areaWeighted.data(), (int)verts.size(), indices.data(), (int)indices.size(), TANGENTS_AREA_WEIGHTED);
+
+		// Unit length and perpendicular to the normal, and usually
+		// close to the area weighted tangent
+		double angleSum = 0.0;
+		for (size_t i = 0; i < verts.size(); i++)
+		{
+			XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+			CHECK_NEAR(XMVectorGetX(XMVector3Length(tangent)), 1.0, 1e-4);
+			CHECK(fabsf(XMVectorGetX(XMVector3Dot(tangent, XMLoadFloat3(&verts[i].Normal)))) < 1e-4f);
+			angleSum += AngleDegrees(verts[i].Tangent, areaWeighted[i].Tangent);
+		}
+		CHECK(angleSum / verts.size() < 2.0);
+	}
+
+	// A single right angled triangle with UVs along its edges
+	// has its tangent along U in either mode
+	Vertex triangle[3] = {};
+	triangle[0].Position = XMFLOAT3(0, 0, 0);
+	triangle[1].Position = XMFLOAT3(0, 0, 1);
+	triangle[2].Position = XMFLOAT3(1, 0, 0);
+	triangle[0].UV = XMFLOAT2(0, 0);
+	triangle[1].UV = XMFLOAT2(0, 1);
+	triangle[2].UV = XMFLOAT2(1, 0);
+	for (Vertex& v : triangle)
+		v.Normal = XMFLOAT3(0, 1, 0);
+	unsigned int indices[3] = { 0, 1, 2 };
+	for (TangentMode mode : { TANGENTS_AREA_WEIGHTED, TANGENTS_MIKKTSPACE })
+	{
+		CalculateTangents(triangle, 3, indices, 3, mode);
+		for (const Vertex& v : triangle)
+		{
+			CHECK_NEAR(v.Tangent.x, 1.0, 1e-6);
+			CHECK_NEAR(v.Tangent.y, 0.0, 1e-6);
+			CHECK_NEAR(v.Tangent.z, 0.0, 1e-6);
+		}
+	}
+}
+
+static void BenchTangents()
+{
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeWavyGrid(1000, 500, verts, indices);
+	int triangleCount = (int)indices.size() / 3;
+	int threadCount = GetRangeCount(triangleCount, TANGENT_MIN_THREAD_TRIANGLES);
+
+	// The routine this replaced, then on one thread and on all of them
+	std::vector<Vertex> result = verts;
+	double referenceMs = TimeBest(3, [&]()
+	{
+		ReferenceTangents(result.data(), (int)result.size(), indices.data(), (int)indices.size());
+	});
+	printf("%d triangles: previous %.1f ms\n", triangleCount, referenceMs);
+	for (TangentMode mode : { TANGENTS_AREA_WEIGHTED, TANGENTS_MIKKTSPACE })
+	{
+		double singleMs = TimeBest(3, [&]()
+		{
+			CalculateTangents(result.data(), (int)result.size(), indices.data(), (int)indices.size(), mode, 1);
+		});
+		double threadedMs = TimeBest(3, [&]()
+		{
+			CalculateTangents(result.data(), (int)result.size(), indices.data(), (int)indices.size(), mode);
+		});
+		printf("  %-14s 1 thread %.1f ms, %d threads %.1f ms\n", mode == TANGENTS_AREA_WEIGHTED ? "area weighted" : "MikkTSpace",
+			singleMs, threadCount, threadedMs);
+	}
+
+	bool identical;
+	float worst = CompareToReference(verts, indices, identical);
+	printf("  area weighted vs previous: %s, worst difference %.1e\n", identical ? "identical" : "not identical", worst);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestMatchesReference();
+	TestMikkTSpace();
+
+	if (BENCH)
+		BenchTangents();
+
+	return FinishTests("TangentSpaceTests");
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Bare bones checks for the headless tests
+//
+// Every test is its own executable that CTest runs, and
+// it fails if any CHECK did. Running one with --bench
+// also times it against bigger inputs (see BENCH)
+// --------------------------------------------------------
+
+static int testChecks = 0;
+static int testFailures = 0;
+static bool testBenchmarks = false;
+
+#define CHECK(condition) \
+	do { \
+		testChecks++; \
+		if (!(condition)) \
+		{ \
+			testFailures++; \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		} \
+	} while (0)
+
+// Like CHECK, but prints both values when they're further apart than the tolerance
+#define CHECK_NEAR(a, b, tolerance) \
+	do { \
+		testChecks++; \
+		double checkA = (double)(a); \
+		double checkB = (double)(b); \
+		if (!(std::fabs(checkA - checkB) <= (tolerance))) \
+		{ \
+			testFailures++; \
+			printf("%s(%d): CHECK_NEAR(%s, %s) failed: %g vs %g\n", \
+				__FILE__, __LINE__, #a, #b, checkA, checkB); \
+		} \
+	} while (0)
+
+// Only true when the test was run with --bench
+#define BENCH testBenchmarks
+
+inline void StartTests(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--bench") == 0)
+			testBenchmarks = true;
+}
+
+// Returns the exit code for main()
+inline int FinishTests(const char* name)
+{
+	printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+	return testFailures == 0 ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Wall clock time since the timer was created or reset
+// --------------------------------------------------------
+class TestTimer
+{
+public:
+	TestTimer() : start(std::chrono::steady_clock::now()) {}
+
+	void Reset()
+	{
+		start = std::chrono::steady_clock::now();
+	}
+
+	double GetMilliseconds()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// Runs the function the given number of times and returns the fastest, in ms
+template<typename Function>
+double TimeBest(int runs, Function function)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; i++)
+	{
+		TestTimer timer;
+		function();
+		double ms = timer.GetMilliseconds();
+		best = ms < best ? ms : best;
+	}
+	return best;
+}
+
+// --------------------------------------------------------
+// Reads one of the models in Assets/Models, returning
+// false if it couldn't be opened
+// --------------------------------------------------------
+inline bool ReadTestModel(const char* name, std::vector<char>& data)
+{
+	std::ifstream file(std::string(TEST_MODEL_PATH) + name, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// The sample models every mesh test runs against
+inline constexpr const char* testModels[] = { "cube.obj", "cylinder.obj", "helix.obj", "sphere.obj", "torus.obj", "quad.obj", "quad_double_sided.obj" };
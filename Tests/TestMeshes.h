@@ -0,0 +1,89 @@
+#pragma once
+#include "TestFramework.h"
+#include "ObjLoader.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+// --------------------------------------------------------
+// Meshes shared by the mesh processing tests (these need
+// ObjLoader.cpp linked in)
+// --------------------------------------------------------
+
+// Parses one of the sample models, leaving both vectors empty on failure
+inline bool LoadTestModel(const char* name, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+
+	std::vector<char> data;
+	if (!ReadTestModel(name, data))
+		return false;
+
+	ParseObjData(data.data(), data.size(), verts, indices);
+	return !indices.empty();
+}
+
+// --------------------------------------------------------
+// A size x size quad grid in the XZ plane, gently rippled
+// so it isn't perfectly flat, with UVs across the whole
+// grid and up facing normals
+// --------------------------------------------------------
+inline void MakeGridMesh(int size, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+
+	int row = size + 1;
+	for (int y = 0; y <= size; y++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			Vertex v = {};
+			v.Position = DirectX::XMFLOAT3((float)x, 0.1f * sinf(x * 0.7f) * cosf(y * 0.3f), (float)y);
+			v.Normal = DirectX::XMFLOAT3(0, 1, 0);
+			v.UV = DirectX::XMFLOAT2(x / (float)size, y / (float)size);
+			verts.push_back(v);
+		}
+	}
+
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			unsigned int a = y * row + x;
+			unsigned int quad[6] = { a, a + row, a + 1, a + 1, a + row, a + row + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Every triangle's corner positions, each rotated to start
+// at its smallest corner (keeping the winding) and then
+// sorted, so two index buffers can be compared regardless
+// of triangle order or vertex numbering
+// --------------------------------------------------------
+inline std::vector<std::array<float, 9>> GetTriangleSet(const Vertex* verts, const unsigned int* indices, size_t numIndices)
+{
+	std::vector<std::array<float, 9>> triangles;
+	triangles.reserve(numIndices / 3);
+	for (size_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		std::array<std::array<float, 3>, 3> corners;
+		for (int c = 0; c < 3; c++)
+		{
+			const DirectX::XMFLOAT3& p = verts[indices[i + c]].Position;
+			corners[c] = { p.x, p.y, p.z };
+		}
+		std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+
+		std::array<float, 9> triangle;
+		for (int c = 0; c < 9; c++)
+			triangle[c] = corners[c / 3][c % 3];
+		triangles.push_back(triangle);
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
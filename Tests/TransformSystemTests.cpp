@@ -0,0 +1,487 @@
+#include "TestFramework.h"
+#include "TransformSystem.h"
+#include "Transform.h"
+#include "ParallelFor.h"
+#include <random>
+
+using namespace DirectX;
+
+// Largest difference, relative to the size of the reference value
+static double MatrixError(const XMFLOAT4X4& m, const XMFLOAT4X4& reference)
+{
+	double worst = 0.0;
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			worst = std::max(worst, fabs(m.m[r][c] - reference.m[r][c]) / (1.0 + fabs(reference.m[r][c])));
+	return worst;
+}
+
+// The S * R * T and full inverse the transforms used to be built with
+static void ReferenceMatrices(XMFLOAT3 position, XMFLOAT3 pitchYawRoll, XMFLOAT3 scale, XMFLOAT4X4& world, XMFLOAT4X4& worldInverseTranspose)
+{
+	XMMATRIX m =
+		XMMatrixScaling(scale.x, scale.y, scale.z) *
+		XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z) *
+		XMMatrixTranslation(position.x, position.y, position.z);
+	XMStoreFloat4x4(&world, m);
+	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, m)));
+}
+
+static void TestMatchesReference()
+{
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> u(-1, 1);
+	TransformSystem& system = TransformSystem::GetInstance();
+
+	// Not a whole number of SIMD blocks, so the last block is partly empty
+	const int count = 1001;
+	std::vector<Transform> transforms(count);
+	std::vector<XMFLOAT3> pitchYawRoll(count);
+	for (int i = 0; i < count; i++)
+	{
+		pitchYawRoll[i] = XMFLOAT3(u(random) * 1.5f, u(random) * 3.1f, u(random) * 3.1f);
+		transforms[i].SetPosition(u(random) * 100, u(random) * 100, u(random) * 100);
+		transforms[i].SetRotation(pitchYawRoll[i]);
+		transforms[i].SetScale(0.2f + fabsf(u(random)) * 3, 0.2f + fabsf(u(random)) * 3, 0.2f + fabsf(u(random)) * 3);
+	}
+	CHECK(system.GetDirtyCount() >= (unsigned int)count);
+
+	// Matrices read before the batch update are built on their own
+	std::vector<XMFLOAT4X4> lazy(count);
+	for (int i = 0; i < count; i += 2)
+		lazy[i] = transforms[i].GetWorldMatrix();
+	system.UpdateMatrices();
+	CHECK(system.GetDirtyCount() == 0);
+
+	double worldError = 0.0, inverseTransposeError = 0.0;
+	bool identical = true;
+	for (int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+		XMFLOAT4X4 referenceWorld, referenceInverseTranspose;
+		ReferenceMatrices(transforms[i].GetPosition(), pitchYawRoll[i], transforms[i].GetScale(), referenceWorld, referenceInverseTranspose);
+		worldError = std::max(worldError, MatrixError(world, referenceWorld));
+		inverseTransposeError = std::max(inverseTransposeError, MatrixError(transforms[i].GetWorldInverseTransposeMatrix(), referenceInverseTranspose));
+
+		// ...with the same maths as the batch, bit for bit
+		if (i % 2 == 0)
+			identical &= memcmp(&lazy[i], &world, sizeof(world)) == 0;
+	}
+	CHECK(worldError < 1e-5);
+	CHECK(inverseTransposeError < 1e-4);
+	CHECK(identical);
+}
+
+static void TestNonUniformInverseTranspose()
+{
+	// Strongly non-uniform scales, on roots (whose inverse transposes
+	// come from the scale and rotation) and on children of scaled
+	// parents (from the world matrix's cofactors), where the world is
+	// sheared and the inverse transpose is no longer a rotation
+	std::mt19937 random(14);
+	std::uniform_real_distribution<float> u(-1, 1);
+	const int count = 1000;
+	std::vector<Transform> transforms(count);
+	for (int i = 0; i < count; i++)
+	{
+		transforms[i].SetPosition(u(random) * 10, u(random) * 10, u(random) * 10);
+		transforms[i].SetRotation(u(random) * 3, u(random) * 3, u(random) * 3);
+		transforms[i].SetScale(powf(10, u(random) * 1.3f), powf(10, u(random) * 1.3f), powf(10, u(random) * 1.3f));
+		if (i % 2)
+			transforms[i].SetParent(&transforms[i - 1]);
+	}
+	TransformSystem::GetInstance().UpdateMatrices();
+
+	double error[2] = {}, perpendicular[2] = {};
+	for (int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+		XMFLOAT4X4 inverseTranspose = transforms[i].GetWorldInverseTransposeMatrix(), reference;
+		XMMATRIX w = XMLoadFloat4x4(&world);
+		XMStoreFloat4x4(&reference, XMMatrixTranspose(XMMatrixInverse(0, w)));
+		error[i % 2] = std::max(error[i % 2], MatrixError(inverseTranspose, reference));
+
+		// Which is what keeps normals at right angles to the surface
+		XMVECTOR normal = XMVector3Normalize(XMVectorSet(u(random), u(random), u(random), 0));
+		XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(normal, XMVectorSet(u(random), u(random), u(random), 0)));
+		XMVECTOR worldNormal = XMVector3Normalize(XMVector3TransformNormal(normal, XMLoadFloat4x4(&inverseTranspose)));
+		XMVECTOR worldTangent = XMVector3Normalize(XMVector3TransformNormal(tangent, w));
+		perpendicular[i % 2] = std::max(perpendicular[i % 2], (double)fabsf(XMVectorGetX(XMVector3Dot(worldNormal, worldTangent))));
+	}
+	CHECK(error[0] < 1e-4);
+	CHECK(error[1] < 1e-4);
+	CHECK(perpendicular[0] < 1e-4);
+	CHECK(perpendicular[1] < 1e-4);
+}
+
+static void TestHandles()
+{
+	TransformSystem& system = TransformSystem::GetInstance();
+	unsigned int liveBefore = system.GetCount();
+	{
+		Transform a;
+		a.SetPosition(1, 2, 3);
+		a.SetScale(2, 2, 2);
+		CHECK(system.GetCount() == liveBefore + 1);
+
+		// Copies get their own transform, with the same values
+		Transform b(a);
+		CHECK(system.GetCount() == liveBefore + 2);
+		XMFLOAT4X4 wa = a.GetWorldMatrix(), wb = b.GetWorldMatrix();
+		CHECK(memcmp(&wa, &wb, sizeof(wa)) == 0);
+		b.SetPosition(4, 5, 6);
+		CHECK(a.GetPosition().x == 1 && b.GetPosition().x == 4);
+
+		// Moves take the other's transform over
+		Transform c(std::move(b));
+		CHECK(system.GetCount() == liveBefore + 2);
+		CHECK(c.GetPosition().x == 4);
+		a = c;
+		CHECK(a.GetPosition().y == 5);
+	}
+	CHECK(system.GetCount() == liveBefore);
+
+	// Freed slots are reused, and start out as identity
+	Transform fresh;
+	XMFLOAT4X4 world = fresh.GetWorldMatrix(), identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	CHECK(memcmp(&world, &identity, sizeof(world)) == 0);
+}
+
+static void TestRelocation()
+{
+	TransformSystem& system = TransformSystem::GetInstance();
+	unsigned int liveBefore = system.GetCount();
+
+	// Growing a dense array moves its transforms rather than
+	// copying them, so nothing is created or destroyed
+	std::vector<Transform> transforms;
+	for (int i = 0; i < 1000; i++)
+	{
+		transforms.emplace_back();
+		transforms.back().SetPosition((float)i, 0, 0);
+	}
+	CHECK(system.GetCount() == liveBefore + 1000);
+
+	// Swap-removal, as entity stores do
+	for (int k = 0; k < 500; k++)
+	{
+		size_t i = (k * 7919) % transforms.size();
+		transforms[i] = std::move(transforms.back());
+		transforms.pop_back();
+	}
+	CHECK(system.GetCount() == liveBefore + 500);
+
+	// Every survivor still has its own, distinct values
+	std::vector<bool> seen(1000, false);
+	bool distinct = true;
+	for (Transform& t : transforms)
+	{
+		int i = (int)t.GetPosition().x;
+		distinct &= !seen[i];
+		seen[i] = true;
+	}
+	CHECK(distinct);
+
+	transforms.clear();
+	CHECK(system.GetCount() == liveBefore);
+}
+
+// A transform's local matrix, built straight from its values
+static XMMATRIX LocalMatrix(Transform& t)
+{
+	XMFLOAT3 position = t.GetPosition(), scale = t.GetScale();
+	XMFLOAT4 rotation = t.GetRotation();
+	return
+		XMMatrixScaling(scale.x, scale.y, scale.z) *
+		XMMatrixRotationQuaternion(XMLoadFloat4(&rotation)) *
+		XMMatrixTranslation(position.x, position.y, position.z);
+}
+
+// Worst error of every world and inverse transpose matrix against
+// the product of the local matrices up its chain of parents
+static void CheckHierarchy(std::vector<Transform>& transforms, const std::vector<int>& parents)
+{
+	double worldError = 0.0, inverseTransposeError = 0.0;
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		XMMATRIX m = LocalMatrix(transforms[i]);
+		for (int p = parents[i]; p != -1; p = parents[p])
+			m = m * LocalMatrix(transforms[p]);
+
+		XMFLOAT4X4 world, inverseTranspose;
+		XMStoreFloat4x4(&world, m);
+		XMStoreFloat4x4(&inverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, m)));
+		worldError = std::max(worldError, MatrixError(transforms[i].GetWorldMatrix(), world));
+		inverseTransposeError = std::max(inverseTransposeError, MatrixError(transforms[i].GetWorldInverseTransposeMatrix(), inverseTranspose));
+	}
+	CHECK(worldError < 1e-5);
+	CHECK(inverseTransposeError < 1e-4);
+}
+
+// Reads every step'th world matrix, runs the batch update,
+// and checks it came up with the same ones
+static bool LazyMatchesBatch(std::vector<Transform>& transforms, int step)
+{
+	std::vector<XMFLOAT4X4> lazy(transforms.size());
+	for (size_t i = 0; i < transforms.size(); i += step)
+		lazy[i] = transforms[i].GetWorldMatrix();
+	TransformSystem::GetInstance().UpdateMatrices();
+
+	bool identical = true;
+	for (size_t i = 0; i < transforms.size(); i += step)
+	{
+		XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+		identical &= memcmp(&lazy[i], &world, sizeof(world)) == 0;
+	}
+	return identical;
+}
+
+static void TestHierarchy()
+{
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> u(-1, 1);
+
+	// A random forest, each parent created before its children
+	const int count = 2000;
+	std::vector<Transform> transforms(count);
+	std::vector<int> parents(count, -1);
+	for (int i = 0; i < count; i++)
+	{
+		transforms[i].SetPosition(u(random) * 3, u(random) * 3, u(random) * 3);
+		transforms[i].SetRotation(u(random) * 3, u(random) * 3, u(random) * 3);
+		transforms[i].SetScale(0.5f + fabsf(u(random)), 0.5f + fabsf(u(random)), 0.5f + fabsf(u(random)));
+		if (i > 0 && random() % 4)
+		{
+			parents[i] = random() % i;
+			transforms[i].SetParent(&transforms[parents[i]]);
+		}
+	}
+	CHECK(LazyMatchesBatch(transforms, 3));
+	CheckHierarchy(transforms, parents);
+	CHECK(TransformSystem::GetInstance().GetDepthCount() > 3);
+
+	// Move a few, some of them parents
+	for (int k = 0; k < 50; k++)
+		transforms[random() % count].SetPosition(u(random), u(random), u(random));
+	CHECK(LazyMatchesBatch(transforms, 7));
+	CheckHierarchy(transforms, parents);
+
+	// Reparent and unparent - parenting to a descendant is ignored
+	for (int k = 0; k < 300; k++)
+	{
+		int i = random() % count, p = random() % count;
+		if (k % 5 == 0)
+		{
+			transforms[i].SetParent(nullptr);
+			parents[i] = -1;
+			continue;
+		}
+
+		bool cycle = false;
+		for (int q = p; q != -1; q = parents[q])
+			cycle |= q == i;
+		transforms[i].SetParent(&transforms[p]);
+		if (!cycle)
+			parents[i] = p;
+	}
+	TransformSystem::GetInstance().UpdateMatrices();
+	CheckHierarchy(transforms, parents);
+
+	// Children of a destroyed transform become roots, keeping their local values
+	Transform* parent = new Transform();
+	Transform child;
+	parent->SetPosition(1, 2, 3);
+	child.SetPosition(1, 0, 0);
+	child.SetParent(parent);
+	XMFLOAT3 position = child.GetWorldPosition();
+	CHECK(position.x == 2 && position.y == 2 && position.z == 3);
+	delete parent;
+	TransformSystem::GetInstance().UpdateMatrices();
+	position = child.GetWorldPosition();
+	CHECK(!child.HasParent());
+	CHECK(position.x == 1 && position.y == 0 && position.z == 0);
+}
+
+static void BenchUpdate()
+{
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> u(-1, 1);
+	TransformSystem& system = TransformSystem::GetInstance();
+
+	for (int count : { 100000, 1000000 })
+	{
+		std::vector<Transform> transforms(count);
+		for (Transform& t : transforms)
+		{
+			t.SetPosition(u(random), u(random), u(random));
+			t.SetRotation(u(random), u(random), u(random));
+			t.SetScale(1, 2, 3);
+		}
+
+		double batchMs = 1e9;
+		for (int run = 0; run < 5; run++)
+		{
+			for (Transform& t : transforms)
+				t.SetPosition(t.GetPosition());
+			TestTimer timer;
+			system.UpdateMatrices();
+			batchMs = std::min(batchMs, timer.GetMilliseconds());
+		}
+
+		// One at a time, as every matrix used to be built
+		for (Transform& t : transforms)
+			t.SetPosition(t.GetPosition());
+		TestTimer timer;
+		for (Transform& t : transforms)
+			t.GetWorldMatrix();
+		double singleMs = timer.GetMilliseconds();
+
+		// Every tenth one dirty
+		for (int i = 0; i < count; i += 10)
+			transforms[i].SetPosition(transforms[i].GetPosition());
+		timer.Reset();
+		system.UpdateMatrices();
+		double sparseMs = timer.GetMilliseconds();
+
+		printf("%7d transforms: batch %.2f ms (%.1f ns each), one at a time %.2f ms, every 10th dirty %.2f ms\n",
+			count, batchMs, batchMs * 1e6 / count, singleMs, sparseMs);
+	}
+}
+
+static void BenchMatrixBuild()
+{
+	// One transform's matrices at a time, the old way against the new:
+	// Euler angles to a rotation matrix and a general inverse, against
+	// a stored quaternion and the inverse transpose from its rows
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> u(-1, 1);
+	const int count = 1000000;
+	std::vector<XMFLOAT3> positions(count), pitchYawRolls(count), scales(count);
+	std::vector<XMFLOAT4> rotations(count);
+	for (int i = 0; i < count; i++)
+	{
+		positions[i] = XMFLOAT3(u(random) * 100, u(random) * 100, u(random) * 100);
+		pitchYawRolls[i] = XMFLOAT3(u(random) * 3, u(random) * 3, u(random) * 3);
+		scales[i] = XMFLOAT3(0.5f + fabsf(u(random)), 0.5f + fabsf(u(random)), 0.5f + fabsf(u(random)));
+		XMStoreFloat4(&rotations[i], XMQuaternionRotationRollPitchYaw(pitchYawRolls[i].x, pitchYawRolls[i].y, pitchYawRolls[i].z));
+	}
+	std::vector<XMFLOAT4X4> worlds(count), inverseTransposes(count);
+
+	double eulerMs = TimeBest(3, [&]()
+	{
+		for (int i = 0; i < count; i++)
+			ReferenceMatrices(positions[i], pitchYawRolls[i], scales[i], worlds[i], inverseTransposes[i]);
+	});
+
+	double quaternionMs = TimeBest(3, [&]()
+	{
+		for (int i = 0; i < count; i++)
+		{
+			XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&rotations[i]));
+			XMVECTOR scale = XMLoadFloat3(&scales[i]);
+			XMVECTOR position = XMLoadFloat3(&positions[i]);
+			XMStoreFloat4x4(&worlds[i], XMMatrixScalingFromVector(scale) * rotation * XMMatrixTranslationFromVector(position));
+
+			// Rotation rows over their scale, with -(position . row) / scale last
+			XMVECTOR inverseScale = XMVectorReciprocal(scale);
+			XMVECTOR inverseScales[3] = { XMVectorSplatX(inverseScale), XMVectorSplatY(inverseScale), XMVectorSplatZ(inverseScale) };
+			XMMATRIX inverseTranspose;
+			for (int r = 0; r < 3; r++)
+			{
+				XMVECTOR row = rotation.r[r] * inverseScales[r];
+				inverseTranspose.r[r] = XMVectorSetW(row, -XMVectorGetX(XMVector3Dot(position, row)));
+			}
+			inverseTranspose.r[3] = XMVectorSet(0, 0, 0, 1);
+			XMStoreFloat4x4(&inverseTransposes[i], inverseTranspose);
+		}
+	});
+
+	// And a child's, from its world matrix: the general inverse against
+	// the cofactors the system uses (reading it back builds it)
+	std::vector<Transform> transforms(2 * count / 10);
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		transforms[i].SetPosition(positions[i]);
+		transforms[i].SetRotation(pitchYawRolls[i]);
+		transforms[i].SetScale(scales[i]);
+		if (i % 2)
+			transforms[i].SetParent(&transforms[i - 1]);
+	}
+	TransformSystem::GetInstance().UpdateMatrices();
+	for (size_t i = 1; i < transforms.size(); i += 2)
+		worlds[i] = transforms[i].GetWorldMatrix();
+	double inverseMs = TimeBest(3, [&]()
+	{
+		for (size_t i = 1; i < transforms.size(); i += 2)
+			XMStoreFloat4x4(&inverseTransposes[i], XMMatrixTranspose(XMMatrixInverse(0, XMLoadFloat4x4(&worlds[i]))));
+	});
+	TestTimer timer;
+	for (size_t i = 1; i < transforms.size(); i += 2)
+		transforms[i].GetWorldInverseTransposeMatrix();
+	double cofactorMs = timer.GetMilliseconds();
+
+	printf("1M transforms, one thread: Euler + XMMatrixInverse %.2f ms, quaternion + analytic %.2f ms (%.1fx)\n",
+		eulerMs, quaternionMs, eulerMs / quaternionMs);
+	printf("%zu child inverse transposes: XMMatrixInverse %.2f ms, cofactors %.2f ms (%.1fx)\n",
+		transforms.size() / 2, inverseMs, cofactorMs, inverseMs / cofactorMs);
+}
+
+static void BenchHierarchy()
+{
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> u(-1, 1);
+	TransformSystem& system = TransformSystem::GetInstance();
+
+	// 100k nodes with four children each
+	const int count = 100000;
+	std::vector<Transform> transforms(count);
+	for (int i = 0; i < count; i++)
+	{
+		transforms[i].SetPosition(u(random), u(random), u(random));
+		transforms[i].SetRotation(u(random), u(random), u(random));
+		if (i > 0)
+			transforms[i].SetParent(&transforms[(i - 1) / 4]);
+	}
+	system.UpdateMatrices();
+	printf("%d node hierarchy, %u levels, %d threads for the biggest level\n",
+		count, system.GetDepthCount(), GetRangeCount(count * 3 / 4, TRANSFORM_MIN_THREAD_NODES));
+
+	auto time = [&](const char* what, auto change)
+	{
+		double best = 1e9;
+		for (int run = 0; run < 7; run++)
+		{
+			change();
+			TestTimer timer;
+			system.UpdateMatrices();
+			best = std::min(best, timer.GetMilliseconds());
+		}
+		printf("  %-34s %.3f ms\n", what, best);
+	};
+	time("root moved (everything)", [&]() { transforms[0].SetPosition(u(random), 0, 0); });
+	time("every node moved", [&]() { for (Transform& t : transforms) t.SetPosition(t.GetPosition()); });
+	time("one depth 3 subtree (~1.3k nodes)", [&]() { transforms[30].SetPosition(u(random), 0, 0); });
+	time("100 random nodes", [&]() { for (int k = 0; k < 100; k++) transforms[random() % count].SetPosition(u(random), 0, 0); });
+	time("nothing", [&]() {});
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestMatchesReference();
+	TestNonUniformInverseTranspose();
+	TestHandles();
+	TestRelocation();
+	TestHierarchy();
+
+	if (BENCH)
+	{
+		BenchMatrixBuild();
+		BenchUpdate();
+		BenchHierarchy();
+	}
+
+	return FinishTests("TransformSystemTests");
+}
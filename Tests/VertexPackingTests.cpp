@@ -0,0 +1,293 @@
+#include "TestMeshes.h"
+#include "VertexPacking.h"
+#include <random>
+
+using namespace DirectX;
+
+// One 16-bit UNORM step is 1/65535 of the extent, so rounding is off by at most half of that
+#define UNORM16_ERROR (0.5f / 65535.0f)
+
+// Octahedral vectors are 16-bit SNORM pairs, which keeps unit vectors within this many
+// degrees (the worst spots, about 0.028, are where the folds meet)
+#define OCTAHEDRAL_MAX_DEGREES 0.03f
+
+static float AngleDegrees(XMFLOAT3 a, XMFLOAT3 b)
+{
+	float dot = a.x * b.x + a.y * b.y + a.z * b.z;
+	float lengths = sqrtf((a.x * a.x + a.y * a.y + a.z * a.z) * (b.x * b.x + b.y * b.y + b.z * b.z));
+	float cosine = std::max(-1.0f, std::min(1.0f, dot / lengths));
+	return acosf(cosine) * 180.0f / XM_PI;
+}
+
+static XMFLOAT3 RandomUnitVector(std::mt19937& random)
+{
+	std::normal_distribution<float> normal;
+	XMFLOAT3 v;
+	float length;
+	do
+	{
+		v = XMFLOAT3(normal(random), normal(random), normal(random));
+		length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	} while (length < 1e-6f);
+	return XMFLOAT3(v.x / length, v.y / length, v.z / length);
+}
+
+// Packs and unpacks a single vertex through the same path meshes use
+static Vertex RoundTrip(const Vertex& v, XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, XMFLOAT2 uvMin, XMFLOAT2 uvMax)
+{
+	PackedVertex packed;
+	Vertex unpacked;
+	PackVertices(&v, 1, boundsMin, boundsMax, uvMin, uvMax, &packed);
+	UnpackVertices(&packed, 1, boundsMin, boundsMax, uvMin, uvMax, &unpacked);
+	return unpacked;
+}
+
+// Worst error of a whole mesh after packing, relative to the bounds
+struct PackingError
+{
+	float Position;	// Fraction of the extent on that axis
+	float UV;		// Same
+	float Normal;	// Degrees
+	float Tangent;
+};
+
+static PackingError MeasureRoundTrip(const std::vector<Vertex>& verts)
+{
+	XMFLOAT3 boundsMin = verts[0].Position, boundsMax = verts[0].Position;
+	XMFLOAT2 uvMin = verts[0].UV, uvMax = verts[0].UV;
+	for (const Vertex& v : verts)
+	{
+		boundsMin = XMFLOAT3(std::min(boundsMin.x, v.Position.x), std::min(boundsMin.y, v.Position.y), std::min(boundsMin.z, v.Position.z));
+		boundsMax = XMFLOAT3(std::max(boundsMax.x, v.Position.x), std::max(boundsMax.y, v.Position.y), std::max(boundsMax.z, v.Position.z));
+		uvMin = XMFLOAT2(std::min(uvMin.x, v.UV.x), std::min(uvMin.y, v.UV.y));
+		uvMax = XMFLOAT2(std::max(uvMax.x, v.UV.x), std::max(uvMax.y, v.UV.y));
+	}
+
+	std::vector<PackedVertex> packed(verts.size());
+	std::vector<Vertex> unpacked(verts.size());
+	PackVertices(verts.data(), (int)verts.size(), boundsMin, boundsMax, uvMin, uvMax, packed.data());
+	UnpackVertices(packed.data(), (int)verts.size(), boundsMin, boundsMax, uvMin, uvMax, unpacked.data());
+
+	// Flat axes decode exactly, so they count as zero error
+	auto Relative = [](float a, float b, float extent)
+	{
+		return extent > 0.0f ? fabsf(a - b) / extent : fabsf(a - b);
+	};
+
+	PackingError error = {};
+	for (size_t i = 0; i < verts.size(); i++)
+	{
+		const Vertex& a = verts[i];
+		const Vertex& b = unpacked[i];
+		error.Position = std::max(error.Position, Relative(a.Position.x, b.Position.x, boundsMax.x - boundsMin.x));
+		error.Position = std::max(error.Position, Relative(a.Position.y, b.Position.y, boundsMax.y - boundsMin.y));
+		error.Position = std::max(error.Position, Relative(a.Position.z, b.Position.z, boundsMax.z - boundsMin.z));
+		error.UV = std::max(error.UV, Relative(a.UV.x, b.UV.x, uvMax.x - uvMin.x));
+		error.UV = std::max(error.UV, Relative(a.UV.y, b.UV.y, uvMax.y - uvMin.y));
+		error.Normal = std::max(error.Normal, AngleDegrees(a.Normal, b.Normal));
+		error.Tangent = std::max(error.Tangent, AngleDegrees(a.Tangent, b.Tangent));
+	}
+	return error;
+}
+
+static void TestOctahedral()
+{
+	// Axes, including both poles, come back exactly
+	XMFLOAT3 axes[] = {
+		XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0),
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, -1, 0),
+		XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1) };
+	for (XMFLOAT3 axis : axes)
+	{
+		Vertex v = {};
+		v.Normal = axis;
+		v.Tangent = axis;
+		Vertex result = RoundTrip(v, XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), XMFLOAT2(0, 0), XMFLOAT2(1, 1));
+		CHECK(AngleDegrees(axis, result.Normal) < 1e-3f);
+		CHECK(AngleDegrees(axis, result.Tangent) < 1e-3f);
+		CHECK_NEAR(result.Normal.z, axis.z, 1e-6);
+	}
+
+	// Right next to -Z every octant folds onto a different corner of the square
+	for (int octant = 0; octant < 4; octant++)
+	{
+		float x = (octant & 1) ? 1e-4f : -1e-4f;
+		float y = (octant & 2) ? 1e-4f : -1e-4f;
+		float z = -sqrtf(1.0f - x * x - y * y);
+		Vertex v = {};
+		v.Normal = XMFLOAT3(x, y, z);
+		v.Tangent = XMFLOAT3(x, y, -z);
+		Vertex result = RoundTrip(v, XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), XMFLOAT2(0, 0), XMFLOAT2(1, 1));
+		CHECK(AngleDegrees(v.Normal, result.Normal) < OCTAHEDRAL_MAX_DEGREES);
+		CHECK(AngleDegrees(v.Tangent, result.Tangent) < OCTAHEDRAL_MAX_DEGREES);
+	}
+
+	// Zero length vectors become +Z rather than NaN
+	XMFLOAT3 zero = OctahedralDecode(OctahedralEncode(XMFLOAT3(0, 0, 0)));
+	CHECK(zero.x == 0.0f && zero.y == 0.0f && zero.z == 1.0f);
+
+	// Random directions stay under the bound
+	std::mt19937 random(1);
+	float worst = 0.0f;
+	for (int i = 0; i < 100000; i++)
+	{
+		Vertex v = {};
+		v.Normal = RandomUnitVector(random);
+		v.Tangent = RandomUnitVector(random);
+		Vertex result = RoundTrip(v, XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), XMFLOAT2(0, 0), XMFLOAT2(1, 1));
+		worst = std::max(worst, std::max(AngleDegrees(v.Normal, result.Normal), AngleDegrees(v.Tangent, result.Tangent)));
+	}
+	CHECK(worst < OCTAHEDRAL_MAX_DEGREES);
+}
+
+static void TestPositionsAndUVs()
+{
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// Random bounds, some far from the origin and some tiny
+	for (int trial = 0; trial < 200; trial++)
+	{
+		float scale = powf(10.0f, unit(random) * 6.0f - 3.0f);
+		XMFLOAT3 boundsMin((unit(random) - 0.5f) * 1000.0f, (unit(random) - 0.5f) * 1000.0f, (unit(random) - 0.5f) * 1000.0f);
+		XMFLOAT3 boundsMax(boundsMin.x + scale * unit(random), boundsMin.y + scale * unit(random), boundsMin.z + scale * unit(random));
+		XMFLOAT2 uvMin((unit(random) - 0.5f) * 100.0f, (unit(random) - 0.5f) * 100.0f);
+		XMFLOAT2 uvMax(uvMin.x + 1.0f + unit(random) * 10.0f, uvMin.y + unit(random));
+
+		for (int i = 0; i < 100; i++)
+		{
+			Vertex v = {};
+			v.Position = XMFLOAT3(
+				boundsMin.x + (boundsMax.x - boundsMin.x) * unit(random),
+				boundsMin.y + (boundsMax.y - boundsMin.y) * unit(random),
+				boundsMin.z + (boundsMax.z - boundsMin.z) * unit(random));
+			v.UV = XMFLOAT2(uvMin.x + (uvMax.x - uvMin.x) * unit(random), uvMin.y + (uvMax.y - uvMin.y) * unit(random));
+			v.Normal = XMFLOAT3(0, 1, 0);
+			Vertex result = RoundTrip(v, boundsMin, boundsMax, uvMin, uvMax);
+
+			// Half a step, plus float rounding of the bounds themselves
+			auto Bound = [](float minimum, float maximum)
+			{
+				return (maximum - minimum) * UNORM16_ERROR * 1.01f + (fabsf(minimum) + fabsf(maximum)) * 2e-7f;
+			};
+			CHECK_NEAR(result.Position.x, v.Position.x, Bound(boundsMin.x, boundsMax.x));
+			CHECK_NEAR(result.Position.y, v.Position.y, Bound(boundsMin.y, boundsMax.y));
+			CHECK_NEAR(result.Position.z, v.Position.z, Bound(boundsMin.z, boundsMax.z));
+			CHECK_NEAR(result.UV.x, v.UV.x, Bound(uvMin.x, uvMax.x));
+			CHECK_NEAR(result.UV.y, v.UV.y, Bound(uvMin.y, uvMax.y));
+		}
+	}
+
+	// Axes with no extent (a flat quad, or UVs that never change)
+	// decode to exactly the minimum instead of dividing by zero
+	Vertex flat = {};
+	flat.Position = XMFLOAT3(0.25f, 3.0f, -2.0f);
+	flat.UV = XMFLOAT2(0.5f, 7.0f);
+	flat.Normal = XMFLOAT3(0, 0, -1);
+	Vertex result = RoundTrip(flat, XMFLOAT3(-1, 3, -2), XMFLOAT3(1, 3, -2), XMFLOAT2(0, 7), XMFLOAT2(1, 7));
+	CHECK(result.Position.y == 3.0f && result.Position.z == -2.0f);
+	CHECK(result.UV.y == 7.0f);
+	CHECK_NEAR(result.Position.x, 0.25f, 2.0f * UNORM16_ERROR);
+
+	// A single point, with every bound collapsed
+	result = RoundTrip(flat, flat.Position, flat.Position, flat.UV, flat.UV);
+	CHECK(result.Position.x == flat.Position.x && result.Position.y == flat.Position.y && result.Position.z == flat.Position.z);
+	CHECK(result.UV.x == flat.UV.x && result.UV.y == flat.UV.y);
+	CHECK(result.Normal.z == -1.0f);
+}
+
+static void TestIndices()
+{
+	CHECK(GetIndexStride(4) == 2);
+	CHECK(GetIndexStride(MAX_SHORT_INDEX_VERTICES - 1) == 2);
+	CHECK(GetIndexStride(MAX_SHORT_INDEX_VERTICES) == 4);
+
+	for (int numVerts : { 3, MAX_SHORT_INDEX_VERTICES - 1, MAX_SHORT_INDEX_VERTICES, 100000 })
+	{
+		std::vector<Vertex> verts(numVerts, Vertex{});
+		std::vector<unsigned int> indices = { 0, 1, 2, (unsigned int)numVerts - 1, 0, (unsigned int)numVerts / 2 };
+
+		std::vector<PackedVertex> packedVerts;
+		std::vector<unsigned char> packedIndices;
+		PackMesh(verts.data(), numVerts, indices.data(), (int)indices.size(),
+			XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), XMFLOAT2(0, 0), XMFLOAT2(1, 1),
+			packedVerts, packedIndices);
+
+		unsigned int stride = GetIndexStride(numVerts);
+		CHECK(packedVerts.size() == (size_t)numVerts);
+		CHECK(packedIndices.size() == indices.size() * stride);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			unsigned int index = 0;
+			memcpy(&index, &packedIndices[i * stride], stride);
+			CHECK(index == indices[i]);
+		}
+	}
+}
+
+static void TestSampleModels()
+{
+	for (const char* model : testModels)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		CHECK(LoadTestModel(model, verts, indices));
+
+		// Any unit tangent will do
+		for (Vertex& v : verts)
+			v.Tangent = XMFLOAT3(v.Normal.y, v.Normal.z, -v.Normal.x);
+
+		PackingError error = MeasureRoundTrip(verts);
+		CHECK(error.Position <= UNORM16_ERROR * 1.01f);
+		CHECK(error.UV <= UNORM16_ERROR * 1.01f);
+		CHECK(error.Normal < OCTAHEDRAL_MAX_DEGREES);
+		CHECK(error.Tangent < OCTAHEDRAL_MAX_DEGREES);
+	}
+}
+
+static void BenchPacking()
+{
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	MakeGridMesh(1000, verts, indices);
+
+	std::mt19937 random(3);
+	for (Vertex& v : verts)
+	{
+		v.Normal = RandomUnitVector(random);
+		v.Tangent = RandomUnitVector(random);
+	}
+
+	XMFLOAT3 boundsMin(0, -0.1f, 0), boundsMax(1000, 0.1f, 1000);
+	std::vector<PackedVertex> packed(verts.size());
+	std::vector<Vertex> unpacked(verts.size());
+	double packMs = TimeBest(5, [&]()
+	{
+		PackVertices(verts.data(), (int)verts.size(), boundsMin, boundsMax, XMFLOAT2(0, 0), XMFLOAT2(1, 1), packed.data());
+	});
+	double unpackMs = TimeBest(5, [&]()
+	{
+		UnpackVertices(packed.data(), (int)verts.size(), boundsMin, boundsMax, XMFLOAT2(0, 0), XMFLOAT2(1, 1), unpacked.data());
+	});
+
+	PackingError error = MeasureRoundTrip(verts);
+	printf("%zu vertices: pack %.1f ms, unpack %.1f ms, %zu -> %zu bytes each\n",
+		verts.size(), packMs, unpackMs, sizeof(Vertex), sizeof(PackedVertex));
+	printf("worst error: position %.2e, uv %.2e of extent, normal %.4f, tangent %.4f degrees\n",
+		error.Position, error.UV, error.Normal, error.Tangent);
+}
+
+int main(int argc, char** argv)
+{
+	StartTests(argc, argv);
+
+	TestOctahedral();
+	TestPositionsAndUVs();
+	TestIndices();
+	TestSampleModels();
+
+	if (BENCH)
+		BenchPacking();
+
+	return FinishTests("VertexPackingTests");
+}
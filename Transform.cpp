@@ -1,133 +1,189 @@
 #include "Transform.h"
+#include "TransformSystem.h"
 
 using namespace DirectX;
 
 Transform::Transform()
 {
-	position = XMFLOAT3(0, 0, 0);
-	scale = XMFLOAT3(1, 1, 1);
-	rotation = XMFLOAT3(0, 0, 0);
-	XMStoreFloat4x4(&world, DirectX::XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTranspose, DirectX::XMMatrixIdentity());
-	up = XMFLOAT3(0, 1, 0);
-	right = XMFLOAT3(1, 0, 0);
-	forward = XMFLOAT3(0, 0, 1);
-	matricesDirty = false;
-	vectorsDirty = false;
+	index = TransformSystem::GetInstance().Create();
+}
+
+Transform::Transform(const Transform& other)
+{
+	index = TransformSystem::GetInstance().Create();
+	*this = other;
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+	// Copies the values, but each handle keeps its own transform
+	TransformSystem& system = TransformSystem::GetInstance();
+	system.SetPosition(index, system.GetPosition(other.index));
+	system.SetRotation(index, system.GetRotation(other.index));
+	system.SetScale(index, system.GetScale(other.index));
+	system.SetParent(index, system.GetParent(other.index));
+	return *this;
+}
+
+Transform::Transform(Transform&& other) noexcept
+{
+	index = other.index;
+	other.index = TRANSFORM_NONE;
+}
+
+Transform& Transform::operator=(Transform&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (index != TRANSFORM_NONE)
+			TransformSystem::GetInstance().Destroy(index);
+		index = other.index;
+		other.index = TRANSFORM_NONE;
+	}
+	return *this;
+}
+
+Transform::~Transform()
+{
+	if (index != TRANSFORM_NONE)
+		TransformSystem::GetInstance().Destroy(index);
 }
 
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
-	matricesDirty = true;
+	TransformSystem::GetInstance().SetPosition(index, XMFLOAT3(x, y, z));
 }
 
 void Transform::SetPosition(DirectX::XMFLOAT3 _position)
 {
-	position = _position;
-	matricesDirty = true;
+	TransformSystem::GetInstance().SetPosition(index, _position);
 }
 
 void Transform::SetRotation(float pitch, float yaw, float roll)
 {
-	rotation.x = pitch;
-	rotation.y = yaw;
-	rotation.z = roll;
-	matricesDirty = true;
-	vectorsDirty = true;
+	TransformSystem::GetInstance().SetPitchYawRoll(index, XMFLOAT3(pitch, yaw, roll));
 }
 
 void Transform::SetRotation(DirectX::XMFLOAT3 _rotation)
 {
-	rotation = _rotation;
-	matricesDirty = true;
-	vectorsDirty = true;
+	TransformSystem::GetInstance().SetPitchYawRoll(index, _rotation);
+}
+
+void Transform::SetRotation(DirectX::XMFLOAT4 _quaternion)
+{
+	TransformSystem::GetInstance().SetRotation(index, _quaternion);
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-	matricesDirty = true;
+	TransformSystem::GetInstance().SetScale(index, XMFLOAT3(x, y, z));
 }
 
 void Transform::SetScale(DirectX::XMFLOAT3 _scale)
 {
-	scale = _scale;
-	matricesDirty = true;
+	TransformSystem::GetInstance().SetScale(index, _scale);
 }
 
 DirectX::XMFLOAT3 Transform::GetPosition()
 {
-	return position;
+	return TransformSystem::GetInstance().GetPosition(index);
+}
+
+DirectX::XMFLOAT4 Transform::GetRotation()
+{
+	return TransformSystem::GetInstance().GetRotation(index);
 }
 
 DirectX::XMFLOAT3 Transform::GetPitchYawRoll()
 {
-	return rotation;
+	return TransformSystem::GetInstance().GetPitchYawRoll(index);
 }
 
 DirectX::XMFLOAT3 Transform::GetScale()
 {
-	return scale;
+	return TransformSystem::GetInstance().GetScale(index);
 }
 
 DirectX::XMFLOAT3 Transform::GetUp()
 {
-	UpdateVectors();
-	return up;
+	return TransformSystem::GetInstance().GetUp(index);
 }
 
 DirectX::XMFLOAT3 Transform::GetRight()
 {
-	UpdateVectors();
-	return right;
+	return TransformSystem::GetInstance().GetRight(index);
 }
 
 DirectX::XMFLOAT3 Transform::GetForward()
 {
-	UpdateVectors();
+	return TransformSystem::GetInstance().GetForward(index);
+}
+
+bool Transform::HasChangedSince(unsigned int frame)
+{
+	return TransformSystem::GetInstance().GetChangedFrame(index) > frame;
+}
+
+void Transform::SetParent(Transform* parent)
+{
+	TransformSystem::GetInstance().SetParent(index, parent ? (int)parent->index : -1);
+}
+
+bool Transform::HasParent()
+{
+	return TransformSystem::GetInstance().GetParent(index) != -1;
+}
+
+DirectX::XMFLOAT3 Transform::GetWorldPosition()
+{
+	const XMFLOAT4X4& world = TransformSystem::GetInstance().GetWorldMatrix(index);
+	return XMFLOAT3(world._41, world._42, world._43);
+}
+
+DirectX::XMFLOAT3 Transform::GetWorldForward()
+{
+	const XMFLOAT4X4& world = TransformSystem::GetInstance().GetWorldMatrix(index);
+	XMFLOAT3 forward;
+	XMStoreFloat3(&forward, XMVector3Normalize(XMVectorSet(world._31, world._32, world._33, 0)));
 	return forward;
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-	UpdateMatrices();
-	return world;
+	return TransformSystem::GetInstance().GetWorldMatrix(index);
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
-	UpdateMatrices();
-	return worldInverseTranspose;
+	return TransformSystem::GetInstance().GetWorldInverseTransposeMatrix(index);
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
-	matricesDirty = true;
+	MoveAbsolute(XMFLOAT3(x, y, z));
 }
 
 void Transform::MoveAbsolute(DirectX::XMFLOAT3 _offset)
 {
+	XMFLOAT3 position = GetPosition();
 	XMStoreFloat3(&position, XMVectorAdd(XMLoadFloat3(&position), XMLoadFloat3(&_offset)));
-	matricesDirty = true;
+	SetPosition(position);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
-	XMVECTOR movement = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&rotation));
-
-	XMVECTOR relativeDir = XMVector3Rotate(movement, rotQuat);
+	// Along the cached axes, rather than rotating the offset
+	XMFLOAT3 right = GetRight();
+	XMFLOAT3 up = GetUp();
+	XMFLOAT3 forward = GetForward();
+	XMVECTOR relativeDir =
+		XMLoadFloat3(&right) * x +
+		XMLoadFloat3(&up) * y +
+		XMLoadFloat3(&forward) * z;
 
+	XMFLOAT3 position = GetPosition();
 	XMStoreFloat3(&position, XMLoadFloat3(&position) + relativeDir);
-	matricesDirty = true;
+	SetPosition(position);
 }
 
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
@@ -137,63 +193,38 @@ void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
 
 void Transform::Rotate(float pitch, float yaw, float roll)
 {
-	rotation.x += pitch;
-	rotation.y += yaw;
-	rotation.z += roll;
-	matricesDirty = true;
-	vectorsDirty = true;
+	Rotate(XMFLOAT3(pitch, yaw, roll));
 }
 
+// --------------------------------------------------------
+// Pitches and rolls around the transform's own axes, and
+// yaws around the world's up axis - with no roll, that's
+// the same as adding to the Euler angles
+// --------------------------------------------------------
 void Transform::Rotate(DirectX::XMFLOAT3 _rotation)
 {
-	XMStoreFloat3(&rotation, XMVectorAdd(XMLoadFloat3(&rotation), XMLoadFloat3(&_rotation)));
-	matricesDirty = true;
-	vectorsDirty = true;
+	XMFLOAT4 rotation = GetRotation();
+	XMVECTOR turned = XMLoadFloat4(&rotation);
+	if (_rotation.x != 0 || _rotation.z != 0)
+		turned = XMQuaternionMultiply(XMQuaternionRotationRollPitchYaw(_rotation.x, 0, _rotation.z), turned);
+	if (_rotation.y != 0)
+	{
+		float sinHalf, cosHalf;
+		XMScalarSinCos(&sinHalf, &cosHalf, _rotation.y * 0.5f);
+		turned = XMQuaternionMultiply(turned, XMVectorSet(0, sinHalf, 0, cosHalf));
+	}
+	XMStoreFloat4(&rotation, turned);
+	SetRotation(rotation);
 }
 
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x *= x;
-	scale.y *= y;
-	scale.z *= z;
-	matricesDirty = true;
+	Scale(XMFLOAT3(x, y, z));
 }
 
 void Transform::Scale(DirectX::XMFLOAT3 _scale)
 {
+	XMFLOAT3 scale = GetScale();
 	XMStoreFloat3(&scale, XMVectorMultiply(XMLoadFloat3(&scale), XMLoadFloat3(&_scale)));
-	matricesDirty = true;
-}
-
-void Transform::UpdateVectors()
-{
-	if (!vectorsDirty) {
-		return;
-	}
-
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&rotation));
-	XMStoreFloat3(&up, XMVector3Rotate(XMVectorSet(0, 1, 0, 0), rotQuat));
-	XMStoreFloat3(&right, XMVector3Rotate(XMVectorSet(1, 0, 0, 0), rotQuat));
-	XMStoreFloat3(&forward, XMVector3Rotate(XMVectorSet(0, 0, 1, 0), rotQuat));
-
-	vectorsDirty = false;
-}
-
-void Transform::UpdateMatrices()
-{
-	if (!matricesDirty) {
-		return;
-	}
-
-	XMMATRIX t = XMMatrixTranslationFromVector(XMLoadFloat3(&position));
-	XMMATRIX s = XMMatrixScalingFromVector(XMLoadFloat3(&scale));
-	XMMATRIX r = XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&rotation));
-
-	XMMATRIX worldMatrix = s * r * t;
-
-	XMStoreFloat4x4(&world, worldMatrix);
-	XMStoreFloat4x4(&worldInverseTranspose,
-		XMMatrixInverse(0, XMMatrixTranspose(worldMatrix)));
-
-	matricesDirty = false;
+	SetScale(scale);
 }
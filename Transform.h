@@ -1,27 +1,50 @@
 #pragma once
-#include "DXCore.h"
 #include <DirectXMath.h>
 
+#define TRANSFORM_NONE	0xFFFFFFFF
+
+// --------------------------------------------------------
+// A handle to one transform in the TransformSystem, which
+// holds the actual data - see TransformSystem.h
+// --------------------------------------------------------
 class Transform
 {
 public:
 	Transform();
+	Transform(const Transform& other);
+	Transform& operator=(const Transform& other);
+	Transform(Transform&& other) noexcept;				// Takes over the other's
+	Transform& operator=(Transform&& other) noexcept;	// transform, so indices stay put
+	~Transform();
 
 	void SetPosition(float x, float y, float z);
 	void SetPosition(DirectX::XMFLOAT3 _position);
 	void SetRotation(float pitch, float yaw, float roll);
 	void SetRotation(DirectX::XMFLOAT3 _rotation);
+	void SetRotation(DirectX::XMFLOAT4 _quaternion);
 	void SetScale(float x, float y, float z);
 	void SetScale(DirectX::XMFLOAT3 _scale);
 
 	DirectX::XMFLOAT3 GetPosition();
-	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation();		// Quaternion
+	DirectX::XMFLOAT3 GetPitchYawRoll();	// Worked out from that, for editing
 	DirectX::XMFLOAT3 GetScale();
 
+	// Cached whenever the rotation's set
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetRight();
 	DirectX::XMFLOAT3 GetForward();
 
+	// Whether the world matrix changed in an UpdateMatrices()
+	// after the given frame - see TransformSystem.h
+	bool HasChangedSince(unsigned int frame);
+
+	// Position, rotation and scale are relative to the parent,
+	// or to the world again after SetParent(nullptr)
+	void SetParent(Transform* parent);
+	bool HasParent();
+	DirectX::XMFLOAT3 GetWorldPosition();
+	DirectX::XMFLOAT3 GetWorldForward();
 
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
@@ -36,20 +59,5 @@ public:
 	void Scale(DirectX::XMFLOAT3 _scale);
 
 private:
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 scale;
-	DirectX::XMFLOAT4X4 world;
-	DirectX::XMFLOAT4X4 worldInverseTranspose;
-	DirectX::XMFLOAT3 rotation;
-
-	DirectX::XMFLOAT3 up;
-	DirectX::XMFLOAT3 right;
-	DirectX::XMFLOAT3 forward;
-
-	float matricesDirty;
-	float vectorsDirty;
-
-	void UpdateVectors();
-	void UpdateMatrices();
+	unsigned int index;	// Into the TransformSystem, or TRANSFORM_NONE once moved from
 };
-
@@ -0,0 +1,563 @@
+#include "TransformSystem.h"
+#include "TransformSystemSimd.h"
+#include "CpuFeatures.h"
+#include "ParallelFor.h"
+#include <cmath>
+
+using namespace DirectX;
+
+TransformSystem* TransformSystem::instance;
+
+TransformSystem::TransformSystem() :
+	frame(0),
+	count(0),
+	dirtyCount(0)
+{
+	levels.resize(1);
+}
+
+unsigned int TransformSystem::Create()
+{
+	unsigned int index;
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		// Grow by whole dirty words, which are whole SIMD blocks too
+		index = (unsigned int)(count + freeIndices.size());
+		if (index >= positionX.size())
+		{
+			size_t size = positionX.size() * 2 > 64 ? positionX.size() * 2 : 64;
+			for (std::vector<float>* component : { &positionX, &positionY, &positionZ,
+				&rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+				component->resize(size, 0.0f);
+			for (std::vector<XMFLOAT3>* axis : { &right, &up, &forward })
+				axis->resize(size);
+			for (std::vector<XMFLOAT4X4>* matrices : { &local, &world, &worldInverseTranspose })
+				matrices->resize(size);
+			for (std::vector<int>* links : { &parent, &firstChild, &nextSibling, &previousSibling })
+				links->resize(size, -1);
+			depth.resize(size, 0);
+			levelSlot.resize(size, 0);
+			changedFrame.resize(size, 0);
+			inverseTransposeDirty.resize(size, 0);
+			dirty.resize(size / 64, 0);
+		}
+	}
+
+	positionX[index] = positionY[index] = positionZ[index] = 0.0f;
+	rotationX[index] = rotationY[index] = rotationZ[index] = 0.0f;
+	rotationW[index] = 1.0f;
+	right[index] = XMFLOAT3(1, 0, 0);
+	up[index] = XMFLOAT3(0, 1, 0);
+	forward[index] = XMFLOAT3(0, 0, 1);
+	scaleX[index] = scaleY[index] = scaleZ[index] = 1.0f;
+	XMStoreFloat4x4(&local[index], XMMatrixIdentity());
+	XMStoreFloat4x4(&world[index], XMMatrixIdentity());
+	XMStoreFloat4x4(&worldInverseTranspose[index], XMMatrixIdentity());
+
+	// A new root
+	parent[index] = firstChild[index] = nextSibling[index] = previousSibling[index] = -1;
+	depth[index] = 0;
+	changedFrame[index] = 0;
+	inverseTransposeDirty[index] = 0;
+	AddToLevel(index);
+
+	count++;
+	return index;
+}
+
+void TransformSystem::Destroy(unsigned int index)
+{
+	// Its children become roots, staying where they are
+	// relative to it
+	while (firstChild[index] != -1)
+		SetParent(firstChild[index], -1);
+	Unlink(index);
+	RemoveFromLevel(index);
+
+	if (IsDirty(index))
+	{
+		dirty[index / 64] &= ~(1ull << (index % 64));
+		dirtyCount--;
+	}
+	freeIndices.push_back(index);
+	count--;
+}
+
+bool TransformSystem::IsDirty(unsigned int index)
+{
+	return (dirty[index / 64] >> (index % 64)) & 1;
+}
+
+void TransformSystem::SetDirty(unsigned int index)
+{
+	if (IsDirty(index))
+		return;
+	dirty[index / 64] |= 1ull << (index % 64);
+	dirtyCount++;
+}
+
+// --------------------------------------------------------
+// Rebuilds the local matrices of the transforms in one SIMD
+// block (starting at first) whose bits are set in dirtyLanes,
+// and the world ones too for the roots among them
+// - See TransformSystemSimd.h for the details
+// --------------------------------------------------------
+void TransformSystem::UpdateBlock(unsigned int first, uint64_t dirtyLanes)
+{
+	uint64_t rootLanes = 0;
+	for (unsigned int lane = 0; lane < TRANSFORM_BLOCK; lane++)
+	{
+		if (parent[first + lane] == -1)
+			rootLanes |= 1ull << lane;
+	}
+
+	TransformBlock block =
+	{
+		{ &positionX[first], &positionY[first], &positionZ[first] },
+		{ &rotationX[first], &rotationY[first], &rotationZ[first], &rotationW[first] },
+		{ &scaleX[first], &scaleY[first], &scaleZ[first] },
+		&local[first], &world[first], &worldInverseTranspose[first],
+		dirtyLanes & ~rootLanes,
+		dirtyLanes & rootLanes
+	};
+	if (HasAvx2())
+		BuildTransformBlockAvx2(block);
+	else
+		BuildTransformBlockSse(block);
+}
+
+void BuildTransformBlockSse(const TransformBlock& block)
+{
+	BuildTransformBlock<SseLanes>(block);
+}
+
+// --------------------------------------------------------
+// 3-component cross and dot products of SSE registers, the
+// dot product in every element
+// --------------------------------------------------------
+static inline __m128 Cross3(__m128 a, __m128 b)
+{
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline __m128 Dot3(__m128 a, __m128 b)
+{
+	__m128 m = _mm_mul_ps(a, b);
+	__m128 sum = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+	return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+// --------------------------------------------------------
+// Combines a transform's local matrix with its parent's
+// world matrix, which must already be up to date (roots'
+// are done by UpdateBlock)
+//
+// The inverse transpose is only worked out when it's asked
+// for, since most transforms deep in a hierarchy (the joints
+// of a rig, say) never draw anything
+// --------------------------------------------------------
+void TransformSystem::UpdateWorld(unsigned int index)
+{
+	int p = parent[index];
+	if (p == -1)
+		return;
+
+	const XMFLOAT4X4& l = local[index];
+	const XMFLOAT4X4& pw = world[p];
+	__m128 parentRows[4] = { _mm_loadu_ps(pw.m[0]), _mm_loadu_ps(pw.m[1]), _mm_loadu_ps(pw.m[2]), _mm_loadu_ps(pw.m[3]) };
+	for (int r = 0; r < 4; r++)
+	{
+		_mm_storeu_ps(world[index].m[r], _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.m[r][0]), parentRows[0]), _mm_mul_ps(_mm_set1_ps(l.m[r][1]), parentRows[1])),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.m[r][2]), parentRows[2]), _mm_mul_ps(_mm_set1_ps(l.m[r][3]), parentRows[3]))));
+	}
+	inverseTransposeDirty[index] = 1;
+}
+
+// --------------------------------------------------------
+// Works out the inverse transpose straight from the world
+// matrix - its upper 3x3 is the cofactors over the
+// determinant, and its last column is -(position . row)
+// --------------------------------------------------------
+void TransformSystem::UpdateInverseTranspose(unsigned int index)
+{
+	const XMFLOAT4X4& w = world[index];
+	__m128 rows[4] = { _mm_loadu_ps(w.m[0]), _mm_loadu_ps(w.m[1]), _mm_loadu_ps(w.m[2]), _mm_loadu_ps(w.m[3]) };
+
+	__m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), Dot3(rows[0], Cross3(rows[1], rows[2])));
+	__m128 x = _mm_mul_ps(Cross3(rows[1], rows[2]), inverseDet);
+	__m128 y = _mm_mul_ps(Cross3(rows[2], rows[0]), inverseDet);
+	__m128 z = _mm_mul_ps(Cross3(rows[0], rows[1]), inverseDet);
+	__m128 last = _mm_setzero_ps();
+
+	// Columns, to get every row's dot product with the position at once
+	_MM_TRANSPOSE4_PS(x, y, z, last);
+	__m128 position = rows[3];
+	last = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(_mm_shuffle_ps(position, position, _MM_SHUFFLE(0, 0, 0, 0)), x),
+		_mm_mul_ps(_mm_shuffle_ps(position, position, _MM_SHUFFLE(1, 1, 1, 1)), y)),
+		_mm_mul_ps(_mm_shuffle_ps(position, position, _MM_SHUFFLE(2, 2, 2, 2)), z)));
+	_MM_TRANSPOSE4_PS(x, y, z, last);
+
+	XMFLOAT4X4& inverseTranspose = worldInverseTranspose[index];
+	_mm_storeu_ps(inverseTranspose.m[0], x);
+	_mm_storeu_ps(inverseTranspose.m[1], y);
+	_mm_storeu_ps(inverseTranspose.m[2], z);
+	_mm_storeu_ps(inverseTranspose.m[3], _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+	inverseTransposeDirty[index] = 0;
+}
+
+// --------------------------------------------------------
+// Rebuilds the world matrices from top down to index, top
+// being one of its ancestors (or itself)
+// --------------------------------------------------------
+void TransformSystem::UpdatePath(unsigned int index, unsigned int top)
+{
+	if (index != top)
+		UpdatePath(parent[index], top);
+
+	if (IsDirty(index))
+		UpdateBlock(index / TRANSFORM_BLOCK * TRANSFORM_BLOCK, 1ull << (index % TRANSFORM_BLOCK));
+	UpdateWorld(index);
+}
+
+// --------------------------------------------------------
+// Rebuilds the world matrices of the transforms from first
+// to last in one depth level that changed, or whose parent
+// changed, this update
+//
+// Returns whether any of them did
+// --------------------------------------------------------
+bool TransformSystem::UpdateLevel(unsigned int level, unsigned int first, unsigned int last)
+{
+	const std::vector<unsigned int>& nodes = levels[level];
+	bool changed = false;
+	for (unsigned int i = first; i < last; i++)
+	{
+		unsigned int index = nodes[i];
+		if (IsDirty(index) || changedFrame[parent[index]] == frame)
+		{
+			UpdateWorld(index);
+			changedFrame[index] = frame;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void TransformSystem::UpdateMatrices()
+{
+	if (dirtyCount == 0)
+		return;
+	frame++;
+
+	// Every dirty local matrix first, which finishes the roots
+	std::vector<char> levelDirty(levels.size(), 0);
+	bool changed = false;
+	for (size_t word = 0; word < dirty.size(); word++)
+	{
+		uint64_t bits = dirty[word];
+		if (bits == 0)
+			continue;
+
+		// Only the blocks with something dirty in them
+		for (unsigned int lane = 0; lane < 64; lane += TRANSFORM_BLOCK)
+		{
+			uint64_t blockBits = (bits >> lane) & TRANSFORM_BLOCK_MASK;
+			if (blockBits != 0)
+				UpdateBlock((unsigned int)word * 64 + lane, blockBits);
+		}
+
+		for (unsigned int lane = 0; lane < 64; lane++)
+		{
+			if (((bits >> lane) & 1) == 0)
+				continue;
+
+			unsigned int index = (unsigned int)word * 64 + lane;
+			if (depth[index] == 0)
+			{
+				changedFrame[index] = frame;
+				changed = true;
+			}
+			else
+			{
+				levelDirty[depth[index]] = 1;
+			}
+		}
+	}
+
+	// Then each level below, skipping any with nothing dirty
+	// in it and nothing changed above it
+	for (unsigned int level = 1; level < levels.size(); level++)
+	{
+		if (!changed && !levelDirty[level])
+			continue;
+
+		int nodeCount = (int)levels[level].size();
+		int rangeCount = GetRangeCount(nodeCount, TRANSFORM_MIN_THREAD_NODES);
+		std::vector<char> rangeChanged(rangeCount, 0);
+		ParallelFor(nodeCount, rangeCount, [&](int r, int first, int last)
+		{
+			rangeChanged[r] = UpdateLevel(level, first, last);
+		});
+
+		changed = false;
+		for (char c : rangeChanged)
+			changed = changed || c;
+	}
+
+	// Not until now, since levels check their own dirty bits
+	for (uint64_t& bits : dirty)
+		bits = 0;
+	dirtyCount = 0;
+}
+
+DirectX::XMFLOAT3 TransformSystem::GetPosition(unsigned int index)
+{
+	return XMFLOAT3(positionX[index], positionY[index], positionZ[index]);
+}
+
+DirectX::XMFLOAT4 TransformSystem::GetRotation(unsigned int index)
+{
+	return XMFLOAT4(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+}
+
+// --------------------------------------------------------
+// Pulls the angles back out of the rotation matrix's
+// elements, which are roll around Z, then pitch around X,
+// then yaw around Y - straight up or down, roll is zero
+// --------------------------------------------------------
+DirectX::XMFLOAT3 TransformSystem::GetPitchYawRoll(unsigned int index)
+{
+	float x = rotationX[index], y = rotationY[index], z = rotationZ[index], w = rotationW[index];
+	float m01 = 2 * (x * y + w * z), m11 = 1 - 2 * (x * x + z * z);
+	float m20 = 2 * (x * z + w * y), m21 = 2 * (y * z - w * x), m22 = 1 - 2 * (x * x + y * y);
+
+	float cosPitch = sqrtf(m20 * m20 + m22 * m22);
+	if (cosPitch < 1e-4f)
+	{
+		float m00 = 1 - 2 * (y * y + z * z), m02 = 2 * (x * z - w * y);
+		return XMFLOAT3(atan2f(-m21, cosPitch), atan2f(-m02, m00), 0.0f);
+	}
+	return XMFLOAT3(atan2f(-m21, cosPitch), atan2f(m20, m22), atan2f(m01, m11));
+}
+
+DirectX::XMFLOAT3 TransformSystem::GetRight(unsigned int index)
+{
+	return right[index];
+}
+
+DirectX::XMFLOAT3 TransformSystem::GetUp(unsigned int index)
+{
+	return up[index];
+}
+
+DirectX::XMFLOAT3 TransformSystem::GetForward(unsigned int index)
+{
+	return forward[index];
+}
+
+DirectX::XMFLOAT3 TransformSystem::GetScale(unsigned int index)
+{
+	return XMFLOAT3(scaleX[index], scaleY[index], scaleZ[index]);
+}
+
+void TransformSystem::SetPosition(unsigned int index, DirectX::XMFLOAT3 position)
+{
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	SetDirty(index);
+}
+
+void TransformSystem::SetRotation(unsigned int index, DirectX::XMFLOAT4 rotation)
+{
+	XMFLOAT4 normalized;
+	XMStoreFloat4(&normalized, XMQuaternionNormalize(XMLoadFloat4(&rotation)));
+	rotationX[index] = normalized.x;
+	rotationY[index] = normalized.y;
+	rotationZ[index] = normalized.z;
+	rotationW[index] = normalized.w;
+
+	// The basis is the rotation matrix's rows
+	XMMATRIX rotationMat = XMMatrixRotationQuaternion(XMLoadFloat4(&normalized));
+	XMStoreFloat3(&right[index], rotationMat.r[0]);
+	XMStoreFloat3(&up[index], rotationMat.r[1]);
+	XMStoreFloat3(&forward[index], rotationMat.r[2]);
+	SetDirty(index);
+}
+
+void TransformSystem::SetPitchYawRoll(unsigned int index, DirectX::XMFLOAT3 rotation)
+{
+	XMFLOAT4 quaternion;
+	XMStoreFloat4(&quaternion, XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&rotation)));
+	SetRotation(index, quaternion);
+}
+
+void TransformSystem::SetScale(unsigned int index, DirectX::XMFLOAT3 scale)
+{
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+	SetDirty(index);
+}
+
+int TransformSystem::GetParent(unsigned int index)
+{
+	return parent[index];
+}
+
+void TransformSystem::SetParent(unsigned int index, int newParent)
+{
+	if (newParent == parent[index])
+		return;
+	for (int i = newParent; i != -1; i = parent[i])
+	{
+		if (i == (int)index)
+			return;
+	}
+
+	// Onto the front of the new parent's children
+	Unlink(index);
+	parent[index] = newParent;
+	if (newParent != -1)
+	{
+		nextSibling[index] = firstChild[newParent];
+		if (firstChild[newParent] != -1)
+			previousSibling[firstChild[newParent]] = index;
+		firstChild[newParent] = index;
+	}
+
+	SetDepth(index, newParent == -1 ? 0 : depth[newParent] + 1);
+	SetDirty(index);
+}
+
+unsigned int TransformSystem::GetDepth(unsigned int index)
+{
+	return depth[index];
+}
+
+unsigned int TransformSystem::GetDepthCount()
+{
+	return (unsigned int)levels.size();
+}
+
+void TransformSystem::Unlink(unsigned int index)
+{
+	int p = parent[index];
+	if (p == -1)
+		return;
+
+	if (previousSibling[index] != -1)
+		nextSibling[previousSibling[index]] = nextSibling[index];
+	else
+		firstChild[p] = nextSibling[index];
+	if (nextSibling[index] != -1)
+		previousSibling[nextSibling[index]] = previousSibling[index];
+
+	parent[index] = nextSibling[index] = previousSibling[index] = -1;
+}
+
+void TransformSystem::AddToLevel(unsigned int index)
+{
+	if (depth[index] >= levels.size())
+		levels.resize(depth[index] + 1);
+
+	levelSlot[index] = (unsigned int)levels[depth[index]].size();
+	levels[depth[index]].push_back(index);
+}
+
+void TransformSystem::RemoveFromLevel(unsigned int index)
+{
+	// Swap the last one in the level into its place
+	std::vector<unsigned int>& level = levels[depth[index]];
+	unsigned int last = level.back();
+	level[levelSlot[index]] = last;
+	levelSlot[last] = levelSlot[index];
+	level.pop_back();
+
+	while (levels.size() > 1 && levels.back().empty())
+		levels.pop_back();
+}
+
+// --------------------------------------------------------
+// Moves a transform and everything under it to the levels
+// for its new depth (without recursion, since hierarchies
+// can be as deep as they like)
+// --------------------------------------------------------
+void TransformSystem::SetDepth(unsigned int index, unsigned int newDepth)
+{
+	if (depth[index] == newDepth)
+		return;
+
+	std::vector<unsigned int> pending = { index };
+	while (!pending.empty())
+	{
+		unsigned int node = pending.back();
+		pending.pop_back();
+
+		int p = parent[node];
+		RemoveFromLevel(node);
+		depth[node] = p == -1 ? 0 : depth[p] + 1;
+		AddToLevel(node);
+
+		for (int child = firstChild[node]; child != -1; child = nextSibling[child])
+			pending.push_back(child);
+	}
+}
+
+const DirectX::XMFLOAT4X4& TransformSystem::GetWorldMatrix(unsigned int index)
+{
+	// Out of date if it, or anything above it, has changed
+	// since the last UpdateMatrices()
+	int top = -1;
+	for (int i = index; i != -1; i = parent[i])
+	{
+		if (IsDirty(i))
+			top = i;
+	}
+
+	// Just the path down to this one, through the same maths as
+	// the rest - the dirty bits stay set, so everything else
+	// under those still gets rebuilt by UpdateMatrices()
+	if (top != -1)
+		UpdatePath(index, top);
+	return world[index];
+}
+
+const DirectX::XMFLOAT4X4& TransformSystem::GetWorldInverseTransposeMatrix(unsigned int index)
+{
+	GetWorldMatrix(index);
+	if (inverseTransposeDirty[index])
+		UpdateInverseTranspose(index);
+	return worldInverseTranspose[index];
+}
+
+unsigned int TransformSystem::GetCount()
+{
+	return count;
+}
+
+unsigned int TransformSystem::GetDirtyCount()
+{
+	return dirtyCount;
+}
+
+unsigned int TransformSystem::GetFrame()
+{
+	return frame;
+}
+
+unsigned int TransformSystem::GetChangedFrame(unsigned int index)
+{
+	return changedFrame[index];
+}
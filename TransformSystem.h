@@ -0,0 +1,146 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+// Fewest transforms in one depth level worth giving a thread
+#define TRANSFORM_MIN_THREAD_NODES	(16 * 1024)
+
+// --------------------------------------------------------
+// Owns the data behind every Transform, one array per
+// component (structure of arrays), so all the matrices
+// that changed can be rebuilt together with SIMD
+//
+// Rotations are stored as quaternions - Euler angles are
+// only a view of them, for editing
+//
+// - Each Transform is just an index into here
+// - UpdateMatrices() rebuilds every dirty transform's local
+//   and inverse transpose matrices in one pass, 8 at a time
+//   with AVX2 (x64 builds) or 4 at a time with SSE
+// - Matrices read before that are rebuilt on their own,
+//   with the same maths, so the results are identical
+//   whichever way they get built
+//
+// Transforms can have a parent, which their position,
+// rotation and scale are relative to
+// - Each depth of the hierarchy has its own list, and the
+//   lists are worked through from the roots down, so every
+//   parent's world matrix is ready before its children's
+// - Only transforms that changed, or that have an ancestor
+//   that changed, have their world matrices rebuilt
+// - The transforms in one depth level don't depend on each
+//   other, so big levels are split across threads
+// - Below the roots, inverse transposes are only worked out
+//   when asked for
+// --------------------------------------------------------
+class TransformSystem
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static TransformSystem& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new TransformSystem();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	TransformSystem(TransformSystem const&) = delete;
+	void operator=(TransformSystem const&) = delete;
+
+private:
+	static TransformSystem* instance;
+	TransformSystem();
+#pragma endregion
+
+public:
+	// Adds an identity transform, returning its index
+	unsigned int Create();
+	void Destroy(unsigned int index);
+
+	// Rebuilds every dirty transform's matrices
+	void UpdateMatrices();
+
+	DirectX::XMFLOAT3 GetPosition(unsigned int index);
+	DirectX::XMFLOAT4 GetRotation(unsigned int index);		// Quaternion
+	DirectX::XMFLOAT3 GetScale(unsigned int index);
+	void SetPosition(unsigned int index, DirectX::XMFLOAT3 position);
+	void SetRotation(unsigned int index, DirectX::XMFLOAT4 rotation);
+	void SetScale(unsigned int index, DirectX::XMFLOAT3 scale);
+
+	// Euler angles, worked out from (or into) the quaternion
+	DirectX::XMFLOAT3 GetPitchYawRoll(unsigned int index);
+	void SetPitchYawRoll(unsigned int index, DirectX::XMFLOAT3 rotation);
+
+	// Local axes, kept up to date whenever the rotation's set
+	DirectX::XMFLOAT3 GetRight(unsigned int index);
+	DirectX::XMFLOAT3 GetUp(unsigned int index);
+	DirectX::XMFLOAT3 GetForward(unsigned int index);
+
+	// -1 for none - the local values are kept as they are, so
+	// the transform moves with its new parent from here on
+	// (parenting a transform to one of its own descendants
+	// is ignored)
+	int GetParent(unsigned int index);
+	void SetParent(unsigned int index, int parent);
+	unsigned int GetDepth(unsigned int index);
+	unsigned int GetDepthCount();
+
+	// Rebuilt first if it, or anything above it, is dirty
+	const DirectX::XMFLOAT4X4& GetWorldMatrix(unsigned int index);
+	const DirectX::XMFLOAT4X4& GetWorldInverseTransposeMatrix(unsigned int index);
+
+	unsigned int GetCount();		// Live transforms
+	unsigned int GetDirtyCount();
+
+	// Counts the UpdateMatrices() calls that rebuilt anything - a
+	// transform's changed frame is the last of those its world
+	// matrix changed in, so it's moved since frame f if that's
+	// greater than f
+	unsigned int GetFrame();
+	unsigned int GetChangedFrame(unsigned int index);
+
+private:
+	bool IsDirty(unsigned int index);
+	void SetDirty(unsigned int index);
+	void UpdateBlock(unsigned int first, uint64_t dirtyLanes);
+	void UpdateWorld(unsigned int index);
+	void UpdateInverseTranspose(unsigned int index);
+	void UpdatePath(unsigned int index, unsigned int top);
+	bool UpdateLevel(unsigned int level, unsigned int first, unsigned int last);
+	void Unlink(unsigned int index);
+	void AddToLevel(unsigned int index);
+	void RemoveFromLevel(unsigned int index);
+	void SetDepth(unsigned int index, unsigned int newDepth);
+
+	// Components, padded to a whole number of SIMD blocks
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<DirectX::XMFLOAT3> right, up, forward;
+
+	// Relative to the parent (below the roots), then combined
+	// with the parent's
+	std::vector<DirectX::XMFLOAT4X4> local;
+	std::vector<DirectX::XMFLOAT4X4> world;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTranspose;
+	std::vector<char> inverseTransposeDirty;			// Not worked out since its world changed
+
+	// Hierarchy - children are a linked list through the siblings
+	std::vector<int> parent, firstChild, nextSibling, previousSibling;
+	std::vector<unsigned int> depth;
+	std::vector<unsigned int> levelSlot;				// Where each is in its level
+	std::vector<std::vector<unsigned int>> levels;		// Transforms at each depth
+	std::vector<unsigned int> changedFrame;				// Last update its world changed in
+	unsigned int frame;
+
+	std::vector<uint64_t> dirty;	// One bit per transform
+	std::vector<unsigned int> freeIndices;
+	unsigned int count;
+	unsigned int dirtyCount;
+};
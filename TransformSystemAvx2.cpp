@@ -0,0 +1,8 @@
+#include "TransformSystemSimd.h"
+
+// Only this file is built with AVX2 - see SimdLanes.h
+
+void BuildTransformBlockAvx2(const TransformBlock& block)
+{
+	BuildTransformBlock<Avx2Lanes>(block);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include "SimdLanes.h"
+
+// Transforms rebuilt together - one AVX2 register, or two SSE ones
+#define TRANSFORM_BLOCK 8
+
+// Mask of the first TRANSFORM_BLOCK bits
+#define TRANSFORM_BLOCK_MASK ((1ull << TRANSFORM_BLOCK) - 1)
+
+// --------------------------------------------------------
+// One block of the TransformSystem's arrays, each pointer
+// at the block's first transform
+// --------------------------------------------------------
+struct TransformBlock
+{
+	const float* Position[3];
+	const float* Rotation[4];
+	const float* Scale[3];
+	DirectX::XMFLOAT4X4* Local;
+	DirectX::XMFLOAT4X4* World;
+	DirectX::XMFLOAT4X4* WorldInverseTranspose;
+	uint64_t LocalLanes;	// Which transforms get a local matrix
+	uint64_t WorldLanes;	// And which (the roots) get world ones
+};
+
+// --------------------------------------------------------
+// BuildTransformBlock() for each instruction set - the AVX2
+// one is in TransformSystemAvx2.cpp, and must only be
+// called if HasAvx2()
+// --------------------------------------------------------
+void BuildTransformBlockSse(const TransformBlock& block);
+void BuildTransformBlockAvx2(const TransformBlock& block);
+
+// --------------------------------------------------------
+// Stores one row (given as a column per element) of each
+// dirty lane's matrix
+// --------------------------------------------------------
+static inline void StoreRowLanes(__m128 x, __m128 y, __m128 z, __m128 w,
+	DirectX::XMFLOAT4X4* matrices, int row, uint64_t dirtyLanes)
+{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	__m128 rows[4] = { x, y, z, w };
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if ((dirtyLanes >> lane) & 1)
+			_mm_storeu_ps(&matrices[lane].m[row][0], rows[lane]);
+	}
+}
+
+#if defined(__AVX2__)
+static inline void StoreRowLanes(__m256 x, __m256 y, __m256 z, __m256 w,
+	DirectX::XMFLOAT4X4* matrices, int row, uint64_t dirtyLanes)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		__m128 r0 = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+		__m128 r1 = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+		__m128 r2 = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+		__m128 r3 = half ? _mm256_extractf128_ps(w, 1) : _mm256_castps256_ps128(w);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		__m128 rows[4] = { r0, r1, r2, r3 };
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((dirtyLanes >> (half * 4 + lane)) & 1)
+				_mm_storeu_ps(&matrices[half * 4 + lane].m[row][0], rows[lane]);
+		}
+	}
+}
+#endif
+
+// --------------------------------------------------------
+// Builds a block's local matrices, L::Count transforms at a
+// time
+//
+// local = scale * rotation * translation - for roots that's
+// the world matrix already, so theirs go straight there,
+// along with an inverse transpose worked out from those
+// parts rather than inverted
+// --------------------------------------------------------
+template<typename L>
+void BuildTransformBlock(const TransformBlock& block)
+{
+	typedef typename L::Type Lanes;
+	for (int first = 0; first < TRANSFORM_BLOCK; first += L::Count)
+	{
+		uint64_t localLanes = block.LocalLanes >> first;
+		uint64_t worldLanes = block.WorldLanes >> first;
+		if (((localLanes | worldLanes) & ((1ull << L::Count) - 1)) == 0)
+			continue;
+
+		// Rotation rows, as XMMatrixRotationQuaternion's
+		Lanes x = L::Load(block.Rotation[0] + first);
+		Lanes y = L::Load(block.Rotation[1] + first);
+		Lanes z = L::Load(block.Rotation[2] + first);
+		Lanes w = L::Load(block.Rotation[3] + first);
+		Lanes x2 = L::Add(x, x), y2 = L::Add(y, y), z2 = L::Add(z, z);
+		Lanes xx = L::Mul(x, x2), yy = L::Mul(y, y2), zz = L::Mul(z, z2);
+		Lanes xy = L::Mul(x, y2), xz = L::Mul(x, z2), yz = L::Mul(y, z2);
+		Lanes wx = L::Mul(w, x2), wy = L::Mul(w, y2), wz = L::Mul(w, z2);
+		Lanes one = L::Set(1.0f);
+		Lanes rotation[3][3] =
+		{
+			{ L::Sub(one, L::Add(yy, zz)), L::Add(xy, wz), L::Sub(xz, wy) },
+			{ L::Sub(xy, wz), L::Sub(one, L::Add(xx, zz)), L::Add(yz, wx) },
+			{ L::Add(xz, wy), L::Sub(yz, wx), L::Sub(one, L::Add(xx, yy)) }
+		};
+
+		Lanes scale[3] = { L::Load(block.Scale[0] + first), L::Load(block.Scale[1] + first), L::Load(block.Scale[2] + first) };
+		Lanes position[3] = { L::Load(block.Position[0] + first), L::Load(block.Position[1] + first), L::Load(block.Position[2] + first) };
+		DirectX::XMFLOAT4X4* local = block.Local + first;
+		DirectX::XMFLOAT4X4* world = block.World + first;
+		DirectX::XMFLOAT4X4* worldInverseTranspose = block.WorldInverseTranspose + first;
+
+		// Each row of both matrices, transposed out to just the dirty lanes
+		Lanes zero = L::Set(0.0f);
+		for (int r = 0; r < 3; r++)
+		{
+			// The world's rows are the rotation's, scaled, and the inverse
+			// transpose's are the same rows divided by the scale instead,
+			// with -(position . row) / scale in the last column
+			Lanes inverseScale = L::Div(one, scale[r]);
+			Lanes moved = L::Add(L::Add(
+				L::Mul(position[0], rotation[r][0]),
+				L::Mul(position[1], rotation[r][1])),
+				L::Mul(position[2], rotation[r][2]));
+
+			Lanes scaled[3] =
+			{
+				L::Mul(rotation[r][0], scale[r]),
+				L::Mul(rotation[r][1], scale[r]),
+				L::Mul(rotation[r][2], scale[r])
+			};
+			StoreRowLanes(scaled[0], scaled[1], scaled[2], zero, local, r, localLanes);
+			StoreRowLanes(scaled[0], scaled[1], scaled[2], zero, world, r, worldLanes);
+			StoreRowLanes(
+				L::Mul(rotation[r][0], inverseScale),
+				L::Mul(rotation[r][1], inverseScale),
+				L::Mul(rotation[r][2], inverseScale),
+				L::Sub(zero, L::Mul(moved, inverseScale)),
+				worldInverseTranspose, r, worldLanes);
+		}
+
+		StoreRowLanes(position[0], position[1], position[2], one, local, 3, localLanes);
+		StoreRowLanes(position[0], position[1], position[2], one, world, 3, worldLanes);
+		StoreRowLanes(zero, zero, zero, one, worldInverseTranspose, 3, worldLanes);
+	}
+}
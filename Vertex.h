@@ -1,6 +1,7 @@
 #pragma once
 
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
 
 // --------------------------------------------------------
 // A custom vertex definition
@@ -13,4 +14,19 @@ struct Vertex
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 UV;
 	DirectX::XMFLOAT3 Tangent;
-};
\ No newline at end of file
+};
+
+// --------------------------------------------------------
+// The compressed vertex actually stored on the GPU
+// (20 bytes instead of 44 - see VertexPacking.h)
+//
+// - Position and UV are relative to the mesh bounds, so
+//   the shader needs the mesh's scales and offsets
+// - Normal and tangent are octahedral encoded
+// --------------------------------------------------------
+struct PackedVertex
+{
+	DirectX::PackedVector::XMUSHORTN4 Position;		// R16G16B16A16_UNORM, w unused
+	DirectX::PackedVector::XMSHORTN4 NormalTangent;	// R16G16B16A16_SNORM, normal in xy, tangent in zw
+	DirectX::PackedVector::XMUSHORTN2 UV;			// R16G16_UNORM
+};
@@ -0,0 +1,133 @@
+#include "VertexPacking.h"
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+XMFLOAT2 OctahedralEncode(XMFLOAT3 n)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1
+	// - Zero length (or NaN) vectors just become +Z
+	float length = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (!(length > 0.0f))
+		return XMFLOAT2(0, 0);
+
+	float x = n.x / length;
+	float y = n.y / length;
+
+	// Fold the lower hemisphere over the diagonals
+	if (n.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return XMFLOAT2(x, y);
+}
+
+XMFLOAT3 OctahedralDecode(XMFLOAT2 e)
+{
+	XMFLOAT3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+
+	// Unfold the lower hemisphere
+	float t = n.z < 0.0f ? -n.z : 0.0f;
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+
+	XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&n)));
+	return n;
+}
+
+// Reciprocal of each component of max - min, or zero for flat
+// axes, which have no extent to divide by (so everything on
+// them just lands on the minimum)
+static XMVECTOR InverseExtent(FXMVECTOR minimum, FXMVECTOR maximum)
+{
+	XMVECTOR extent = maximum - minimum;
+	return XMVectorSelect(
+		XMVectorReciprocal(extent),
+		XMVectorZero(),
+		XMVectorLessOrEqual(extent, XMVectorZero()));
+}
+
+unsigned int GetIndexStride(int numVerts)
+{
+	return numVerts < MAX_SHORT_INDEX_VERTICES ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+void PackVertices(const Vertex* verts, int numVerts,
+	XMFLOAT3 boundsMin, XMFLOAT3 boundsMax,
+	XMFLOAT2 uvMin, XMFLOAT2 uvMax,
+	PackedVertex* packedVerts)
+{
+	XMVECTOR offset = XMLoadFloat3(&boundsMin);
+	XMVECTOR invExtent = InverseExtent(offset, XMLoadFloat3(&boundsMax));
+	XMVECTOR uvOffset = XMLoadFloat2(&uvMin);
+	XMVECTOR uvInvExtent = InverseExtent(uvOffset, XMLoadFloat2(&uvMax));
+
+	for (int i = 0; i < numVerts; i++)
+	{
+		XMVECTOR pos = (XMLoadFloat3(&verts[i].Position) - offset) * invExtent;
+		XMStoreUShortN4(&packedVerts[i].Position, XMVectorSetW(pos, 0.0f));
+
+		XMFLOAT2 normal = OctahedralEncode(verts[i].Normal);
+		XMFLOAT2 tangent = OctahedralEncode(verts[i].Tangent);
+		XMStoreShortN4(&packedVerts[i].NormalTangent,
+			XMVectorSet(normal.x, normal.y, tangent.x, tangent.y));
+
+		XMVECTOR uv = (XMLoadFloat2(&verts[i].UV) - uvOffset) * uvInvExtent;
+		XMStoreUShortN2(&packedVerts[i].UV, uv);
+	}
+}
+
+void UnpackVertices(const PackedVertex* packedVerts, int numVerts,
+	XMFLOAT3 boundsMin, XMFLOAT3 boundsMax,
+	XMFLOAT2 uvMin, XMFLOAT2 uvMax,
+	Vertex* verts)
+{
+	XMVECTOR offset = XMLoadFloat3(&boundsMin);
+	XMVECTOR extent = XMLoadFloat3(&boundsMax) - offset;
+	XMVECTOR uvOffset = XMLoadFloat2(&uvMin);
+	XMVECTOR uvExtent = XMLoadFloat2(&uvMax) - uvOffset;
+
+	for (int i = 0; i < numVerts; i++)
+	{
+		XMVECTOR pos = XMLoadUShortN4(&packedVerts[i].Position);
+		XMStoreFloat3(&verts[i].Position, XMVectorMultiplyAdd(pos, extent, offset));
+
+		XMFLOAT4 normalTangent;
+		XMStoreFloat4(&normalTangent, XMLoadShortN4(&packedVerts[i].NormalTangent));
+		verts[i].Normal = OctahedralDecode(XMFLOAT2(normalTangent.x, normalTangent.y));
+		verts[i].Tangent = OctahedralDecode(XMFLOAT2(normalTangent.z, normalTangent.w));
+
+		XMVECTOR uv = XMLoadUShortN2(&packedVerts[i].UV);
+		XMStoreFloat2(&verts[i].UV, XMVectorMultiplyAdd(uv, uvExtent, uvOffset));
+	}
+}
+
+void PackMesh(const Vertex* verts, int numVerts,
+	const unsigned int* indices, int numIndices,
+	XMFLOAT3 boundsMin, XMFLOAT3 boundsMax,
+	XMFLOAT2 uvMin, XMFLOAT2 uvMax,
+	std::vector<PackedVertex>& packedVerts,
+	std::vector<unsigned char>& packedIndices)
+{
+	packedVerts.resize(numVerts);
+	PackVertices(verts, numVerts, boundsMin, boundsMax, uvMin, uvMax, packedVerts.data());
+
+	unsigned int indexStride = GetIndexStride(numVerts);
+	packedIndices.resize((size_t)numIndices * indexStride);
+	if (indexStride == sizeof(unsigned short))
+	{
+		unsigned short* shortIndices = (unsigned short*)packedIndices.data();
+		for (int i = 0; i < numIndices; i++)
+			shortIndices[i] = (unsigned short)indices[i];
+	}
+	else if (numIndices > 0)
+	{
+		memcpy(packedIndices.data(), indices, (size_t)numIndices * indexStride);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+// Meshes with fewer vertices than this get 16-bit indices
+#define MAX_SHORT_INDEX_VERTICES 65536
+
+// --------------------------------------------------------
+// Octahedral encoding of a unit vector into [-1, 1]^2
+// (Cigolle et al. 2014), and the matching decode
+//
+// Must match OctahedralDecode() in ShaderIncludes.hlsli
+// --------------------------------------------------------
+DirectX::XMFLOAT2 OctahedralEncode(DirectX::XMFLOAT3 n);
+DirectX::XMFLOAT3 OctahedralDecode(DirectX::XMFLOAT2 e);
+
+// Returns the size in bytes of each index for a mesh (2 or 4)
+unsigned int GetIndexStride(int numVerts);
+
+// --------------------------------------------------------
+// Compresses vertices for the GPU, with positions and UVs
+// stored relative to the given bounds
+//
+// UVs get bounds too (rather than being half floats) since
+// tiled UVs can be far enough from 0 for halfs to be off
+// by several texels
+// --------------------------------------------------------
+void PackVertices(const Vertex* verts, int numVerts,
+	DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax,
+	DirectX::XMFLOAT2 uvMin, DirectX::XMFLOAT2 uvMax,
+	PackedVertex* packedVerts);
+
+// --------------------------------------------------------
+// Expands packed vertices back out, the same way the
+// vertex shader does
+// --------------------------------------------------------
+void UnpackVertices(const PackedVertex* packedVerts, int numVerts,
+	DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax,
+	DirectX::XMFLOAT2 uvMin, DirectX::XMFLOAT2 uvMax,
+	Vertex* verts);
+
+// --------------------------------------------------------
+// Packs a whole mesh: vertices as above, and indices
+// at GetIndexStride(numVerts) bytes each
+// --------------------------------------------------------
+void PackMesh(const Vertex* verts, int numVerts,
+	const unsigned int* indices, int numIndices,
+	DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax,
+	DirectX::XMFLOAT2 uvMin, DirectX::XMFLOAT2 uvMax,
+	std::vector<PackedVertex>& packedVerts,
+	std::vector<unsigned char>& packedIndices);
@@ -7,8 +7,10 @@ cbuffer ExternalData : register(b0)
     matrix view;
     matrix projection;  
     
-    matrix lightView;
-    matrix lightProjection;
+    float3 positionOffset;
+    float3 positionScale;
+    float2 uvOffset;
+    float2 uvScale;
 }
 
 // --------------------------------------------------------
@@ -24,17 +26,19 @@ VertexToPixel main( VertexShaderInput input )
 	VertexToPixel output;
 
 	
+    // Unpack the compressed vertex
+    float3 localPosition = DecodePosition(input.localPosition, positionOffset, positionScale);
+    float3 normal = OctahedralDecode(input.normalTangent.xy);
+    float3 tangent = OctahedralDecode(input.normalTangent.zw);
+    
     // Multiply the three matrices together first
     matrix wvp = mul(projection, mul(view, world));
-    output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+    output.screenPosition = mul(wvp, float4(localPosition, 1.0f));
 
-    output.uv = input.uv;
-    output.normal = normalize(mul((float3x3) worldInverseTranspose, input.normal));
-    output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
-    output.tangent = normalize(mul((float3x3) world, input.tangent));
-    
-    matrix shadowWVP = mul(lightProjection, mul(lightView, world));
-    output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
+    output.uv = uvOffset + input.uv * uvScale;
+    output.normal = normalize(mul((float3x3) worldInverseTranspose, normal));
+    output.worldPosition = mul(world, float4(localPosition, 1)).xyz;
+    output.tangent = normalize(mul((float3x3) world, tangent));
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)
@@ -0,0 +1,41 @@
+#include "ShaderIncludes.hlsli"
+
+cbuffer ExternalData : register(b0)
+{
+    matrix view;
+    matrix projection;  
+    
+    float3 positionOffset;
+    float3 positionScale;
+    float2 uvOffset;
+    float2 uvScale;
+}
+
+// --------------------------------------------------------
+// VertexShader.hlsl, but with each entity's matrices coming
+// from the instance buffer (see InstanceBatch.h) instead of
+// the constant buffer, so one draw covers many entities
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input, InstanceInput instance)
+{
+	// Set up output struct
+	VertexToPixel output;
+    matrix world = InstanceMatrix(instance.world);
+    matrix worldInverseTranspose = InstanceMatrix(instance.worldInverseTranspose);
+
+    // Unpack the compressed vertex
+    float3 localPosition = DecodePosition(input.localPosition, positionOffset, positionScale);
+    float3 normal = OctahedralDecode(input.normalTangent.xy);
+    float3 tangent = OctahedralDecode(input.normalTangent.zw);
+    
+    // Multiply the three matrices together first
+    matrix wvp = mul(projection, mul(view, world));
+    output.screenPosition = mul(wvp, float4(localPosition, 1.0f));
+
+    output.uv = uvOffset + input.uv * uvScale;
+    output.normal = normalize(mul((float3x3) worldInverseTranspose, normal));
+    output.worldPosition = mul(world, float4(localPosition, 1)).xyz;
+    output.tangent = normalize(mul((float3x3) world, tangent));
+
+	return output;
+}